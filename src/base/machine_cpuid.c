@@ -37,6 +37,41 @@ int m_cpuid_static(void) {
 #endif
 }
 
+/*******************************************************************************
+ * \brief This routine determines the CPUID of the host at runtime. Unlike
+ *        m_cpuid_static, it reports the instruction set extensions which are
+ *        supported by both the CPU and the operating system. On non-x86
+ *        systems and with compilers lacking the builtins it falls back to
+ *        the compile-time CPUID.
+ ******************************************************************************/
+int m_cpuid_runtime(void); /* avoid pedantic warning about missing prototype */
+int m_cpuid_runtime(void) {
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+  __builtin_cpu_init();
+  const int sse4 = __builtin_cpu_supports("sse4.2") &&
+                   __builtin_cpu_supports("sse4.1") &&
+                   __builtin_cpu_supports("sse3");
+  const int avx = sse4 && __builtin_cpu_supports("avx");
+  const int avx2 = avx && __builtin_cpu_supports("avx2") &&
+                   __builtin_cpu_supports("fma");
+  const int avx512 = avx2 && __builtin_cpu_supports("avx512f") &&
+                     __builtin_cpu_supports("avx512cd");
+  if (avx512) {
+    return CP_MACHINE_X86_AVX512;
+  } else if (avx2) {
+    return CP_MACHINE_X86_AVX2;
+  } else if (avx) {
+    return CP_MACHINE_X86_AVX;
+  } else if (sse4) {
+    return CP_MACHINE_X86_SSE4;
+  } else {
+    return CP_MACHINE_CPU_GENERIC;
+  }
+#else
+  return m_cpuid_static();
+#endif
+}
+
 #if defined(__cplusplus)
 }
 #endif
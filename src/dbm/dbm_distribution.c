@@ -14,7 +14,7 @@
 #include <string.h>
 
 #include "dbm_distribution.h"
-#include "dbm_hyperparams.h"
+#include "dbm_library.h"
 
 /*******************************************************************************
  * \brief Private routine for creating a new one dimensional distribution.
@@ -63,9 +63,39 @@ static void dbm_dist_1d_new(dbm_dist_1d_t *dist, const int length,
 static void dbm_dist_1d_free(dbm_dist_1d_t *dist) {
   free(dist->index2coord);
   free(dist->local_indicies);
+  if (dist->node_ranks != NULL) {
+    free(dist->node_ranks);
+    dbm_mpi_comm_free(&dist->node_comm);
+  }
   dbm_mpi_comm_free(&dist->comm);
 }
 
+/*******************************************************************************
+ * \brief Internal routine for finding the node-local ranks of a distribution.
+ *        The node communicator is split collectively on the first call and
+ *        then kept for the lifetime of the distribution.
+ ******************************************************************************/
+void dbm_dist_1d_split_shared(dbm_dist_1d_t *dist) {
+  if (dist->node_split || dist->nranks == 1) {
+    return;
+  }
+  dist->node_split = true;
+  dist->node_comm = dbm_mpi_comm_split_shared(dist->comm);
+  if (dbm_mpi_comm_size(dist->node_comm) == 1) {
+    dbm_mpi_comm_free(&dist->node_comm);
+    return; // No node-local peers.
+  }
+
+  int *ranks = malloc(dist->nranks * sizeof(int));
+  for (int irank = 0; irank < dist->nranks; irank++) {
+    ranks[irank] = irank;
+  }
+  dist->node_ranks = malloc(dist->nranks * sizeof(int));
+  dbm_mpi_comm_translate_ranks(dist->comm, dist->nranks, ranks,
+                               dist->node_comm, dist->node_ranks);
+  free(ranks);
+}
+
 /*******************************************************************************
  * \brief Returns the larger of two given integer (missing from the C standard)
  * \author Ole Schuett
@@ -104,11 +134,23 @@ void dbm_distribution_new(dbm_distribution_t **dist_out, const int fortran_comm,
                           const int nrows, const int ncols,
                           const int row_dist[nrows],
                           const int col_dist[ncols]) {
+  dbm_distribution_new_cart(dist_out, dbm_mpi_comm_f2c(fortran_comm), nrows,
+                            ncols, row_dist, col_dist);
+}
+
+/*******************************************************************************
+ * \brief Creates a new two dimensional distribution from a C communicator.
+ *        The communicator remains owned by the caller.
+ ******************************************************************************/
+void dbm_distribution_new_cart(dbm_distribution_t **dist_out,
+                               const dbm_mpi_comm_t comm, const int nrows,
+                               const int ncols, const int row_dist[nrows],
+                               const int col_dist[ncols]) {
   assert(omp_get_num_threads() == 1);
   dbm_distribution_t *dist = calloc(1, sizeof(dbm_distribution_t));
   dist->ref_count = 1;
 
-  dist->comm = dbm_mpi_comm_f2c(fortran_comm);
+  dist->comm = comm;
   dist->my_rank = dbm_mpi_comm_rank(dist->comm);
   dist->nranks = dbm_mpi_comm_size(dist->comm);
 
@@ -118,7 +160,8 @@ void dbm_distribution_new(dbm_distribution_t **dist_out, const int fortran_comm,
   const int col_dim_remains[2] = {0, 1};
   const dbm_mpi_comm_t col_comm = dbm_mpi_cart_sub(dist->comm, col_dim_remains);
 
-  const int nshards = SHARDS_PER_THREAD * omp_get_max_threads();
+  const double shards_per_thread = dbm_library_get_config()->shards_per_thread;
+  const int nshards = imax(1, shards_per_thread * omp_get_max_threads());
   const int nrow_shards = find_best_nrow_shards(nshards, nrows, ncols);
   const int ncol_shards = nshards / nrow_shards;
 
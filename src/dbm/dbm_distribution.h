@@ -23,6 +23,9 @@ typedef struct {
   int nranks;
   int my_rank;
   int nshards; // Number of shards for distributing blocks across threads.
+  bool node_split;          // Whether node_comm was created yet.
+  dbm_mpi_comm_t node_comm; // Ranks on the same node, if there are several.
+  int *node_ranks; // Ranks within node_comm or -1, NULL without local peers.
 } dbm_dist_1d_t;
 
 /*******************************************************************************
@@ -46,6 +49,15 @@ void dbm_distribution_new(dbm_distribution_t **dist_out, const int fortran_comm,
                           const int nrows, const int ncols,
                           const int row_dist[nrows], const int col_dist[ncols]);
 
+/*******************************************************************************
+ * \brief Creates a new two dimensional distribution from a C communicator.
+ *        The communicator remains owned by the caller.
+ ******************************************************************************/
+void dbm_distribution_new_cart(dbm_distribution_t **dist_out,
+                               const dbm_mpi_comm_t comm, const int nrows,
+                               const int ncols, const int row_dist[nrows],
+                               const int col_dist[ncols]);
+
 /*******************************************************************************
  * \brief Increases the reference counter of the given distribution.
  * \author Ole Schuett
@@ -72,6 +84,13 @@ void dbm_distribution_row_dist(const dbm_distribution_t *dist, int *nrows,
 void dbm_distribution_col_dist(const dbm_distribution_t *dist, int *ncols,
                                const int **col_dist);
 
+/*******************************************************************************
+ * \brief Internal routine for finding the node-local ranks of a distribution.
+ *        The node communicator is split collectively on the first call and
+ *        then kept for the lifetime of the distribution.
+ ******************************************************************************/
+void dbm_dist_1d_split_shared(dbm_dist_1d_t *dist);
+
 /*******************************************************************************
  * \brief Returns the MPI rank on which the given block should be stored.
  * \author Ole Schuett
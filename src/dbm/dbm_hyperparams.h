@@ -8,13 +8,32 @@
 #ifndef DBM_HYPERPARAMS_H
 #define DBM_HYPERPARAMS_H
 
-// TODO: Tune parameters, check if dynamic OpenMP scheduling is really faster?
+#include <stdbool.h>
 
-static const float HASHTABLE_FACTOR = 3.0;
+// Upper limits, which determine the size of static arrays.
+static const int MAX_BATCH_SIZE = 10000;
+static const int MAX_BATCH_NUM_BUCKETS = 1000;
+
+// Defaults of the runtime configuration, see dbm_library_config_t.
+static const float HASHTABLE_FACTOR = 1.5; // tags make full groups cheap
 static const float ALLOCATION_FACTOR = 1.5;
 static const float SHARDS_PER_THREAD = 1.0;
-static const int MAX_BATCH_SIZE = 10000;
+static const int BATCH_SIZE = 10000;
 static const int BATCH_NUM_BUCKETS = 1000;
+static const int SMALL_GEMM_MAX_SIZE = 32;
+static const int MULTIPLY_TILE_SIZE = 512 * 1024; // bytes, zero disables tiling
+static const int REPLICATION_LAYERS = 1;          // 0 = auto, 1 = off
+static const double MIXED_PRECISION_MIN_EPS = 1e-7; // relative to max|A|*max|B|
+static const bool PACK_COMPRESSION = false;
+static const double PACK_COMPRESSION_TOLERANCE = 0.01; // relative to filter_eps
+static const bool PLAN_CACHE = true;
+static const bool LOAD_BALANCE = false;
+static const bool SHARED_MEMORY = false;
+
+// Fixed parameters.
+static const int MULTIPLY_TILE_MAX_BLOCKS = 65536;
+static const int MULTIPLY_TILE_MAX_BLOCK_SIZE = 1024; // larger are not tiled
+static const int MULTIPLY_MAX_TILES = 64;
 static const int INITIAL_NBLOCKS_ALLOCATED = 100;
 static const int INITIAL_DATA_ALLOCATED = 1024;
 
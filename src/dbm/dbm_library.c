@@ -7,21 +7,90 @@
 
 #include <assert.h>
 #include <inttypes.h>
+#include <math.h>
 #include <omp.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "dbm_hyperparams.h"
 #include "dbm_library.h"
 #include "dbm_mempool.h"
 #include "dbm_mpi.h"
+#include "dbm_multiply_comm.h"
 
 #define DBM_NUM_COUNTERS 64
+#define DBM_MAX_PHASE_DEPTH 4
 
-static int64_t **per_thread_counters = NULL;
+/*******************************************************************************
+ * \brief Private struct for storing a timed phase of the timeline.
+ ******************************************************************************/
+typedef struct {
+  double start;
+  double end;
+  dbm_phase_t phase;
+} trace_event_t;
+
+/*******************************************************************************
+ * \brief Private struct for storing the statistics gathered by a thread.
+ *        The (m,n,k) classes are indexed like the counters.
+ ******************************************************************************/
+typedef struct {
+  int64_t counters[DBM_NUM_COUNTERS];     // block multiplications per class
+  int64_t flops[DBM_NUM_COUNTERS];        // per class
+  int64_t traffic[DBM_NUM_COUNTERS];      // bytes of A, B, and C per class
+  int64_t batch_flops[DBM_NUM_COUNTERS];  // per class of the pending batch
+  double kernel_time[DBM_NUM_COUNTERS];   // per class
+  double phase_time[DBM_NUM_PHASES];      // excluding nested phases
+  double phase_time_call[DBM_NUM_PHASES]; // at the begin of the current call
+  int depth;                              // number of nested phases
+  dbm_phase_t stack[DBM_MAX_PHASE_DEPTH];
+  double stack_start[DBM_MAX_PHASE_DEPTH];
+  double resumed; // when the innermost phase was started or last resumed
+  double busy_time;
+  double idle_time; // waiting for the busiest thread of a multiplication
+  int nevents;
+  int nevents_allocated;
+  trace_event_t *events;
+} thread_stats_t;
+
+/*******************************************************************************
+ * \brief Private struct for storing the record of a single multiplication.
+ ******************************************************************************/
+typedef struct {
+  double duration;
+  double phase_time[DBM_NUM_PHASES]; // maximum over threads
+  int64_t flop;
+  int64_t bytes_sent;
+} call_record_t;
+
+static thread_stats_t **per_thread_stats = NULL;
 static bool library_initialized = false;
 static int max_threads = 0;
+static double comm_time = 0.0;
+static double busy_time_max = 0.0; // summed over multiplies, busiest thread
+static double busy_time_avg = 0.0; // summed over multiplies, average thread
+static int64_t bytes_sent = 0;
+static double time_origin = 0.0; // of the timeline
+static double call_start = 0.0;
+static int64_t call_bytes_sent = 0;
+static int ncalls = 0;
+static int ncalls_allocated = 0;
+static call_record_t *calls = NULL;
+static dbm_library_config_t config;
+
+static const char *phase_names[DBM_NUM_PHASES] = {"pack", "alltoall", "wait",
+                                                  "kernel", "filter"};
+
+// Settings tried by the autotuner, i.e. pairs of batch size and tile size.
+#define DBM_AUTOTUNE_NTRIALS 6
+static const int autotune_settings[DBM_AUTOTUNE_NTRIALS][2] = {
+    {10000, 512 * 1024}, {10000, 128 * 1024}, {10000, 2048 * 1024},
+    {10000, 0},          {3000, 512 * 1024},  {1000, 512 * 1024}};
+static double autotune_rates[DBM_AUTOTUNE_NTRIALS];
+static int autotune_trial = 0;
+static int64_t autotune_flop = 0; // identifies the multiplication being timed
 
 #if !defined(_OPENMP)
 #error "OpenMP is required. Please add -fopenmp to your C compiler flags."
@@ -40,18 +109,42 @@ void dbm_library_init(void) {
   }
 
   max_threads = omp_get_max_threads();
-  per_thread_counters = malloc(max_threads * sizeof(int64_t *));
+  per_thread_stats = malloc(max_threads * sizeof(thread_stats_t *));
 
   // Using parallel regions to ensure memory is allocated near a thread's core.
-#pragma omp parallel default(none) shared(per_thread_counters)                 \
+#pragma omp parallel default(none) shared(per_thread_stats)                    \
     num_threads(max_threads)
   {
     const int ithread = omp_get_thread_num();
-    const size_t counters_size = DBM_NUM_COUNTERS * sizeof(int64_t);
-    per_thread_counters[ithread] = malloc(counters_size);
-    memset(per_thread_counters[ithread], 0, counters_size);
+    per_thread_stats[ithread] = malloc(sizeof(thread_stats_t));
+    memset(per_thread_stats[ithread], 0, sizeof(thread_stats_t));
   }
 
+  comm_time = 0.0;
+  busy_time_max = 0.0;
+  busy_time_avg = 0.0;
+  bytes_sent = 0;
+  time_origin = omp_get_wtime();
+  ncalls = 0;
+  config = (dbm_library_config_t){
+      .hashtable_factor = HASHTABLE_FACTOR,
+      .allocation_factor = ALLOCATION_FACTOR,
+      .shards_per_thread = SHARDS_PER_THREAD,
+      .batch_size = BATCH_SIZE,
+      .batch_num_buckets = BATCH_NUM_BUCKETS,
+      .small_gemm_max_size = SMALL_GEMM_MAX_SIZE,
+      .multiply_tile_size = MULTIPLY_TILE_SIZE,
+      .replication_layers = REPLICATION_LAYERS,
+      .pack_compression = PACK_COMPRESSION,
+      .pack_compression_tolerance = PACK_COMPRESSION_TOLERANCE,
+      .mixed_precision_min_eps = MIXED_PRECISION_MIN_EPS,
+      .plan_cache = PLAN_CACHE,
+      .load_balance = LOAD_BALANCE,
+      .shared_memory = SHARED_MEMORY,
+      .autotune = false,
+      .profile = false};
+  autotune_trial = 0;
+  autotune_flop = 0;
   library_initialized = true;
 }
 
@@ -68,15 +161,93 @@ void dbm_library_finalize(void) {
   }
 
   for (int i = 0; i < max_threads; i++) {
-    free(per_thread_counters[i]);
+    free(per_thread_stats[i]->events);
+    free(per_thread_stats[i]);
   }
-  free(per_thread_counters);
-  per_thread_counters = NULL;
+  free(per_thread_stats);
+  per_thread_stats = NULL;
+  free(calls);
+  calls = NULL;
+  ncalls = ncalls_allocated = 0;
 
+  dbm_comm_plan_cache_clear();
   dbm_mempool_clear();
   library_initialized = false;
 }
 
+/*******************************************************************************
+ * \brief Configures the DBM library. The config is reset by dbm_library_init.
+ ******************************************************************************/
+void dbm_library_set_config(const dbm_library_config_t *new_config) {
+  assert(omp_get_num_threads() == 1);
+  assert(library_initialized);
+  assert(new_config->hashtable_factor > 1.0);
+  assert(new_config->allocation_factor >= 1.0);
+  assert(new_config->shards_per_thread > 0.0);
+  assert(0 < new_config->batch_size);
+  assert(new_config->batch_size <= MAX_BATCH_SIZE);
+  assert(0 < new_config->batch_num_buckets);
+  assert(new_config->batch_num_buckets <= MAX_BATCH_NUM_BUCKETS);
+  assert(0 <= new_config->small_gemm_max_size);
+  assert(0 <= new_config->multiply_tile_size);
+  assert(0 <= new_config->replication_layers);
+  assert(0.0 <= new_config->pack_compression_tolerance);
+  assert(0.0 <= new_config->mixed_precision_min_eps);
+  config = *new_config;
+  autotune_trial = 0;
+  autotune_flop = 0;
+}
+
+/*******************************************************************************
+ * \brief Returns the current config of the DBM library.
+ ******************************************************************************/
+const dbm_library_config_t *dbm_library_get_config(void) { return &config; }
+
+/*******************************************************************************
+ * \brief Internal routine called at the beginning of each multiplication.
+ ******************************************************************************/
+void dbm_library_autotune_begin(void) {
+  assert(omp_get_num_threads() == 1);
+  if (config.autotune && autotune_trial < DBM_AUTOTUNE_NTRIALS) {
+    config.batch_size = autotune_settings[autotune_trial][0];
+    config.multiply_tile_size = autotune_settings[autotune_trial][1];
+  }
+}
+
+/*******************************************************************************
+ * \brief Internal routine called at the end of each multiplication.
+ *        Only recurrences of the first timed multiplication are compared,
+ *        which are recognized by their flop count. This suits SCF iterations,
+ *        which repeat the same multiplications. Each rank tunes on its own,
+ *        because the settings only affect local work.
+ ******************************************************************************/
+void dbm_library_autotune_end(const int64_t flop, const double duration) {
+  assert(omp_get_num_threads() == 1);
+  if (!config.autotune || autotune_trial >= DBM_AUTOTUNE_NTRIALS) {
+    return; // not tuning
+  }
+  if (flop == 0 || duration <= 0.0) {
+    return; // nothing to learn
+  }
+  if (autotune_flop == 0) {
+    autotune_flop = flop;
+  }
+  if (llabs(flop - autotune_flop) > autotune_flop / 20) {
+    return; // a different multiplication, keep the trial's settings
+  }
+  autotune_rates[autotune_trial++] = flop / duration;
+  if (autotune_trial == DBM_AUTOTUNE_NTRIALS) {
+    int best = 0;
+    for (int i = 1; i < DBM_AUTOTUNE_NTRIALS; i++) {
+      if (autotune_rates[i] > autotune_rates[best]) {
+        best = i;
+      }
+    }
+    config.batch_size = autotune_settings[best][0];
+    config.multiply_tile_size = autotune_settings[best][1];
+  }
+}
+
 /*******************************************************************************
  * \brief Computes min(3, floor(log10(x))).
  * \author Ole Schuett
@@ -94,6 +265,47 @@ static int floorlog10(const int x) {
   return 0;
 }
 
+/*******************************************************************************
+ * \brief Internal routine called at the beginning of each multiplication.
+ ******************************************************************************/
+void dbm_library_call_begin(void) {
+  assert(omp_get_num_threads() == 1);
+  call_start = omp_get_wtime();
+  call_bytes_sent = bytes_sent;
+  for (int i = 0; i < max_threads; i++) {
+    thread_stats_t *stats = per_thread_stats[i];
+    memcpy(stats->phase_time_call, stats->phase_time,
+           DBM_NUM_PHASES * sizeof(double));
+  }
+}
+
+/*******************************************************************************
+ * \brief Internal routine called at the end of each multiplication.
+ ******************************************************************************/
+void dbm_library_call_end(const int64_t flop) {
+  assert(omp_get_num_threads() == 1);
+  if (!config.profile) {
+    return;
+  }
+  if (ncalls == ncalls_allocated) {
+    ncalls_allocated = (ncalls_allocated == 0) ? 64 : 2 * ncalls_allocated;
+    calls = realloc(calls, ncalls_allocated * sizeof(call_record_t));
+  }
+  call_record_t *call = &calls[ncalls++];
+  call->duration = omp_get_wtime() - call_start;
+  call->flop = flop;
+  call->bytes_sent = bytes_sent - call_bytes_sent;
+  for (int iphase = 0; iphase < DBM_NUM_PHASES; iphase++) {
+    call->phase_time[iphase] = 0.0;
+    for (int i = 0; i < max_threads; i++) {
+      const thread_stats_t *stats = per_thread_stats[i];
+      const double *now = stats->phase_time, *then = stats->phase_time_call;
+      const double t = now[iphase] - then[iphase];
+      call->phase_time[iphase] = fmax(call->phase_time[iphase], t);
+    }
+  }
+}
+
 /*******************************************************************************
  * \brief Add given block multiplication to stats. This routine is thread-safe.
  * \author Ole Schuett
@@ -102,7 +314,160 @@ void dbm_library_counter_increment(const int m, const int n, const int k) {
   const int ithread = omp_get_thread_num();
   assert(ithread < max_threads);
   const int idx = 16 * floorlog10(m) + 4 * floorlog10(n) + floorlog10(k);
-  per_thread_counters[ithread][idx]++;
+  thread_stats_t *stats = per_thread_stats[ithread];
+  const int64_t flop = 2 * (int64_t)m * n * k;
+  stats->counters[idx]++;
+  stats->flops[idx] += flop;
+  stats->traffic[idx] += sizeof(double) * ((int64_t)m * k + (int64_t)k * n +
+                                           2 * (int64_t)m * n);
+  stats->batch_flops[idx] += flop;
+}
+
+/*******************************************************************************
+ * \brief Internal routine for starting to time a phase on the calling thread.
+ ******************************************************************************/
+void dbm_library_phase_begin(const dbm_phase_t phase) {
+  const int ithread = omp_get_thread_num();
+  assert(ithread < max_threads);
+  thread_stats_t *stats = per_thread_stats[ithread];
+  assert(stats->depth < DBM_MAX_PHASE_DEPTH);
+  const double now = omp_get_wtime();
+  if (stats->depth > 0) { // pause the enclosing phase
+    stats->phase_time[stats->stack[stats->depth - 1]] += now - stats->resumed;
+  }
+  stats->stack[stats->depth] = phase;
+  stats->stack_start[stats->depth] = now;
+  stats->depth++;
+  stats->resumed = now;
+}
+
+/*******************************************************************************
+ * \brief Internal routine for stopping to time a phase on the calling thread.
+ ******************************************************************************/
+void dbm_library_phase_end(const dbm_phase_t phase) {
+  const int ithread = omp_get_thread_num();
+  assert(ithread < max_threads);
+  thread_stats_t *stats = per_thread_stats[ithread];
+  assert(stats->depth > 0 && stats->stack[stats->depth - 1] == phase);
+  const double now = omp_get_wtime();
+  stats->phase_time[phase] += now - stats->resumed;
+  stats->depth--;
+  stats->resumed = now; // resume the enclosing phase
+  const double start = stats->stack_start[stats->depth];
+
+  // Split the time of a kernel among the classes of its batch by their flops.
+  if (phase == DBM_PHASE_KERNEL) {
+    int64_t batch_flops = 0;
+    for (int i = 0; i < DBM_NUM_COUNTERS; i++) {
+      batch_flops += stats->batch_flops[i];
+    }
+    for (int i = 0; i < DBM_NUM_COUNTERS && batch_flops > 0; i++) {
+      const double share = (double)stats->batch_flops[i] / batch_flops;
+      stats->kernel_time[i] += share * (now - start);
+      stats->batch_flops[i] = 0;
+    }
+  }
+
+  // Record the phase for the timeline.
+  if (config.profile) {
+    if (stats->nevents == stats->nevents_allocated) {
+      const int n = stats->nevents_allocated;
+      stats->nevents_allocated = (n == 0) ? 1024 : 2 * n;
+      stats->events = realloc(stats->events,
+                              stats->nevents_allocated * sizeof(trace_event_t));
+    }
+    stats->events[stats->nevents++] =
+        (trace_event_t){.start = start, .end = now, .phase = phase};
+  }
+}
+
+/*******************************************************************************
+ * \brief Add given number of bytes sent to other MPI ranks to stats.
+ *        This routine is not thread-safe.
+ ******************************************************************************/
+void dbm_library_bytes_sent_add(const int64_t nbytes) {
+  assert(omp_get_num_threads() == 1);
+  bytes_sent += nbytes;
+}
+
+/*******************************************************************************
+ * \brief Add given time spent in MPI communication to stats.
+ *        This routine is not thread-safe.
+ ******************************************************************************/
+void dbm_library_comm_time_add(const double seconds) {
+  assert(omp_get_num_threads() == 1);
+  comm_time += seconds;
+}
+
+/*******************************************************************************
+ * \brief Returns the time this rank spent in MPI communication since init.
+ ******************************************************************************/
+double dbm_library_comm_time(void) { return comm_time; }
+
+/*******************************************************************************
+ * \brief Add the busy times of all threads during a multiplication to stats.
+ *        This routine is not thread-safe.
+ ******************************************************************************/
+void dbm_library_busy_time_add(const int nthreads,
+                               const double busy[nthreads]) {
+  assert(omp_get_num_threads() == 1);
+  double max = 0.0, sum = 0.0;
+  for (int i = 0; i < nthreads; i++) {
+    max = fmax(max, busy[i]);
+    sum += busy[i];
+  }
+  busy_time_max += max;
+  busy_time_avg += sum / nthreads;
+  for (int i = 0; i < nthreads; i++) {
+    per_thread_stats[i]->busy_time += busy[i];
+    per_thread_stats[i]->idle_time += max - busy[i];
+  }
+}
+
+/*******************************************************************************
+ * \brief Private struct for storing the statistics of all threads and ranks.
+ ******************************************************************************/
+typedef struct {
+  int64_t counters[DBM_NUM_COUNTERS]; // summed over threads and ranks
+  int64_t flops[DBM_NUM_COUNTERS];
+  int64_t traffic[DBM_NUM_COUNTERS];
+  double kernel_time[DBM_NUM_COUNTERS];
+  double phase_time[DBM_NUM_PHASES]; // maximum over threads and ranks
+  int64_t bytes_sent;                // summed over ranks
+} summary_t;
+
+/*******************************************************************************
+ * \brief Private routine for summarizing the statistics of all threads and
+ *        ranks. Must be called by all ranks.
+ ******************************************************************************/
+static void summarize(const dbm_mpi_comm_t comm, summary_t *sum) {
+  memset(sum, 0, sizeof(summary_t));
+  for (int j = 0; j < max_threads; j++) {
+    const thread_stats_t *stats = per_thread_stats[j];
+    for (int i = 0; i < DBM_NUM_COUNTERS; i++) {
+      sum->counters[i] += stats->counters[i];
+      sum->flops[i] += stats->flops[i];
+      sum->traffic[i] += stats->traffic[i];
+      sum->kernel_time[i] += stats->kernel_time[i];
+    }
+    for (int i = 0; i < DBM_NUM_PHASES; i++) {
+      sum->phase_time[i] = fmax(sum->phase_time[i], stats->phase_time[i]);
+    }
+  }
+  sum->bytes_sent = bytes_sent;
+  dbm_mpi_sum_int64(sum->counters, DBM_NUM_COUNTERS, comm);
+  dbm_mpi_sum_int64(sum->flops, DBM_NUM_COUNTERS, comm);
+  dbm_mpi_sum_int64(sum->traffic, DBM_NUM_COUNTERS, comm);
+  dbm_mpi_sum_double(sum->kernel_time, DBM_NUM_COUNTERS, comm);
+  dbm_mpi_max_double(sum->phase_time, DBM_NUM_PHASES, comm);
+  dbm_mpi_sum_int64(&sum->bytes_sent, 1, comm);
+}
+
+/*******************************************************************************
+ * \brief Private routine for computing the achieved GFLOP/s of a thread.
+ ******************************************************************************/
+static double gflops(const int64_t flop, const double seconds) {
+  return (seconds > 0.0) ? 1e-9 * flop / seconds : 0.0;
 }
 
 /*******************************************************************************
@@ -129,15 +494,13 @@ void dbm_library_print_stats(const int fortran_comm,
 
   const dbm_mpi_comm_t comm = dbm_mpi_comm_f2c(fortran_comm);
   // Sum all counters across threads and mpi ranks.
+  summary_t sum;
+  summarize(comm, &sum);
   int64_t counters[DBM_NUM_COUNTERS][2];
-  memset(counters, 0, DBM_NUM_COUNTERS * 2 * sizeof(int64_t));
   double total = 0.0;
   for (int i = 0; i < DBM_NUM_COUNTERS; i++) {
+    counters[i][0] = sum.counters[i];
     counters[i][1] = i; // needed as inverse index after qsort
-    for (int j = 0; j < max_threads; j++) {
-      counters[i][0] += per_thread_counters[j][i];
-    }
-    dbm_mpi_sum_int64(&counters[i][0], 1, comm);
     total += counters[i][0];
   }
 
@@ -161,7 +524,7 @@ void dbm_library_print_stats(const int fortran_comm,
   print_func(" ----------------------------------------------------------------"
              "---------------\n",
              output_unit);
-  print_func("    M  x    N  x    K                                          "
+  print_func("    M  x    N  x    K      GFLOP/S  FLOP/BYTE                  "
              "COUNT     PERCENT\n",
              output_unit);
 
@@ -175,16 +538,278 @@ void dbm_library_print_stats(const int fortran_comm,
     const int m = (idx % 64) / 16;
     const int n = (idx % 16) / 4;
     const int k = (idx % 4) / 1;
+    const double rate = gflops(sum.flops[idx], sum.kernel_time[idx]);
+    const double intensity = (double)sum.flops[idx] / sum.traffic[idx];
+    char buffer[100];
+    snprintf(buffer, sizeof(buffer),
+             " %4s  x %4s  x %4s %12.2f %10.2f %22" PRId64 " %10.2f%%\n",
+             labels[m], labels[n], labels[k], rate, intensity, counters[i][0],
+             percent);
+    print_func(buffer, output_unit);
+  }
+
+  print_func(" ----------------------------------------------------------------"
+             "---------------\n",
+             output_unit);
+
+  // Print phases of the multiplications, the maximum across threads and ranks.
+  double phases_total = 0.0;
+  for (int i = 0; i < DBM_NUM_PHASES; i++) {
+    phases_total += sum.phase_time[i];
+  }
+  if (phases_total > 0.0) {
+    print_func("    PHASE                                                "
+               "SECONDS         PERCENT\n",
+               output_unit);
+    for (int i = 0; i < DBM_NUM_PHASES; i++) {
+      char buffer[100];
+      snprintf(buffer, sizeof(buffer), "    %-12s %47.3f %14.2f%%\n",
+               phase_names[i], sum.phase_time[i],
+               100.0 * sum.phase_time[i] / phases_total);
+      print_func(buffer, output_unit);
+    }
+    print_func(" ------------------------------------------------------------"
+               "-------------------\n",
+               output_unit);
+  }
+
+  // Print the amount of data sent to other ranks.
+  if (sum.bytes_sent > 0) {
+    print_func("    MPI                                               "
+               "SENT [MiB]        PER RANK\n",
+               output_unit);
+    const double mib = sum.bytes_sent / (1024.0 * 1024.0);
+    char buffer[100];
+    snprintf(buffer, sizeof(buffer), "    %-12s %47.2f %15.2f\n", "total", mib,
+             mib / dbm_mpi_comm_size(comm));
+    print_func(buffer, output_unit);
+    print_func(" ------------------------------------------------------------"
+               "-------------------\n",
+               output_unit);
+  }
+
+  // Print memory pool statistics, the peak is the maximum across ranks.
+  print_func("    MEMPOOL                        MALLOCS          MISSES     "
+             "PEAK MEMORY [MiB]\n",
+             output_unit);
+  const char *mempool_labels[] = {"host", "device"};
+  for (int on_device = 0; on_device < 2; on_device++) {
+    dbm_mempool_stats_t stats;
+    dbm_mempool_statistics(on_device, &stats);
+    int64_t nmallocs_nmisses[2] = {stats.nmallocs, stats.nmisses};
+    dbm_mpi_sum_int64(nmallocs_nmisses, 2, comm);
+    double peak = stats.peak / (1024.0 * 1024.0);
+    dbm_mpi_max_double(&peak, 1, comm);
+    if (nmallocs_nmisses[0] == 0) {
+      continue; // skip unused pools
+    }
     char buffer[100];
     snprintf(buffer, sizeof(buffer),
-             " %4s  x %4s  x %4s %46" PRId64 " %10.2f%%\n", labels[m],
-             labels[n], labels[k], counters[i][0], percent);
+             "    %-12s %25" PRId64 " %15" PRId64 " %21.2f\n",
+             mempool_labels[on_device], nmallocs_nmisses[0],
+             nmallocs_nmisses[1], peak);
     print_func(buffer, output_unit);
   }
 
   print_func(" ----------------------------------------------------------------"
              "---------------\n",
              output_unit);
+
+  // Print load imbalance, i.e. the maximum over the average busy time. The
+  // busiest thread of each multiplication determines the busy time of a rank.
+  double busy_max[2] = {busy_time_max, (busy_time_avg > 0.0)
+                                           ? busy_time_max / busy_time_avg
+                                           : 1.0};
+  double busy_sum = busy_time_max;
+  dbm_mpi_max_double(busy_max, 2, comm);
+  dbm_mpi_sum_double(&busy_sum, 1, comm);
+  if (busy_sum > 0.0) {
+    const double busy_avg = busy_sum / dbm_mpi_comm_size(comm);
+    print_func("    LOAD IMBALANCE                                         "
+               "RANKS         THREADS\n",
+               output_unit);
+    char buffer[100];
+    snprintf(buffer, sizeof(buffer), "    %-12s %47.2f %15.2f\n",
+             "max/average", busy_max[0] / busy_avg, busy_max[1]);
+    print_func(buffer, output_unit);
+    print_func(" ------------------------------------------------------------"
+               "-------------------\n",
+               output_unit);
+  }
+
+  // Print outcome of the autotuning, which each rank performs on its own.
+  if (config.autotune && autotune_trial == DBM_AUTOTUNE_NTRIALS) {
+    print_func("    AUTOTUNED                                   BATCH SIZE     "
+               "TILE SIZE [KiB]\n",
+               output_unit);
+    char buffer[100];
+    snprintf(buffer, sizeof(buffer), "    %-12s %35i %19i\n", "rank 0",
+             config.batch_size, config.multiply_tile_size / 1024);
+    print_func(buffer, output_unit);
+    print_func(" ------------------------------------------------------------"
+               "-------------------\n",
+               output_unit);
+  }
+}
+
+/*******************************************************************************
+ * \brief Returns the unused memory held by the DBM memory pool to the system.
+ ******************************************************************************/
+void dbm_library_trim_memory(void) {
+  assert(omp_get_num_threads() == 1);
+  assert(library_initialized);
+  dbm_mempool_trim();
+}
+
+/*******************************************************************************
+ * \brief Private routine for opening a file or aborting.
+ ******************************************************************************/
+static FILE *open_file(const char *filename, const char *mode) {
+  FILE *file = fopen(filename, mode);
+  if (file == NULL) {
+    fprintf(stderr, "Error: DBM could not open %s.\n", filename);
+    abort();
+  }
+  return file;
+}
+
+/*******************************************************************************
+ * \brief Writes the statistics gathered by the DBM library as JSON.
+ ******************************************************************************/
+void dbm_library_write_profile(const int fortran_comm, const char *filename) {
+  assert(omp_get_num_threads() == 1);
+  assert(library_initialized);
+
+  const dbm_mpi_comm_t comm = dbm_mpi_comm_f2c(fortran_comm);
+  summary_t sum;
+  summarize(comm, &sum);
+
+  // All ranks need the same number of threads and calls for the reductions.
+  int sizes[4] = {max_threads, -max_threads, ncalls, -ncalls};
+  dbm_mpi_max_int(sizes, 4, comm);
+  assert(sizes[0] == -sizes[1] && sizes[2] == -sizes[3]);
+
+  // Busy and idle time of each thread, the maximum across ranks.
+  double *threads = malloc(2 * max_threads * sizeof(double));
+  for (int i = 0; i < max_threads; i++) {
+    threads[2 * i + 0] = per_thread_stats[i]->busy_time;
+    threads[2 * i + 1] = per_thread_stats[i]->idle_time;
+  }
+  dbm_mpi_max_double(threads, 2 * max_threads, comm);
+
+  // Times of the calls are the maximum, their flops and bytes the sum.
+  const int ntimes = 1 + DBM_NUM_PHASES;
+  double *call_times = malloc(ncalls * ntimes * sizeof(double));
+  int64_t *call_counts = malloc(2 * ncalls * sizeof(int64_t));
+  for (int icall = 0; icall < ncalls; icall++) {
+    call_times[icall * ntimes] = calls[icall].duration;
+    memcpy(&call_times[icall * ntimes + 1], calls[icall].phase_time,
+           DBM_NUM_PHASES * sizeof(double));
+    call_counts[2 * icall + 0] = calls[icall].flop;
+    call_counts[2 * icall + 1] = calls[icall].bytes_sent;
+  }
+  dbm_mpi_max_double(call_times, ncalls * ntimes, comm);
+  dbm_mpi_sum_int64(call_counts, 2 * ncalls, comm);
+
+  if (dbm_mpi_comm_rank(comm) == 0) {
+    FILE *file = open_file(filename, "w");
+    fprintf(file, "{\n  \"ranks\": %i,\n  \"threads\": %i,\n",
+            dbm_mpi_comm_size(comm), max_threads);
+    fprintf(file, "  \"bytes_sent\": %" PRId64 ",\n  \"phases\": {",
+            sum.bytes_sent);
+    for (int i = 0; i < DBM_NUM_PHASES; i++) {
+      fprintf(file, "%s\"%s\": %.6f", (i == 0) ? "" : ", ", phase_names[i],
+              sum.phase_time[i]);
+    }
+    fprintf(file, "},\n  \"classes\": [");
+    const char *labels[] = {"?", "??", "???", ">999"};
+    int nclasses = 0;
+    for (int idx = 0; idx < DBM_NUM_COUNTERS; idx++) {
+      if (sum.counters[idx] == 0) {
+        continue; // skip empty classes
+      }
+      fprintf(file, "%s\n    {\"m\": \"%s\", \"n\": \"%s\", \"k\": \"%s\", ",
+              (nclasses++ == 0) ? "" : ",", labels[(idx % 64) / 16],
+              labels[(idx % 16) / 4], labels[idx % 4]);
+      fprintf(file, "\"count\": %" PRId64 ", \"flop\": %" PRId64,
+              sum.counters[idx], sum.flops[idx]);
+      fprintf(file, ", \"bytes\": %" PRId64 ", \"seconds\": %.6f",
+              sum.traffic[idx], sum.kernel_time[idx]);
+      fprintf(file, ", \"gflops\": %.3f, \"flop_per_byte\": %.3f}",
+              gflops(sum.flops[idx], sum.kernel_time[idx]),
+              (double)sum.flops[idx] / sum.traffic[idx]);
+    }
+    fprintf(file, "\n  ],\n  \"thread_times\": [");
+    for (int i = 0; i < max_threads; i++) {
+      fprintf(file, "%s\n    {\"busy\": %.6f, \"idle\": %.6f}",
+              (i == 0) ? "" : ",", threads[2 * i], threads[2 * i + 1]);
+    }
+    fprintf(file, "\n  ],\n  \"calls\": [");
+    for (int icall = 0; icall < ncalls; icall++) {
+      const double *times = &call_times[icall * ntimes];
+      fprintf(file, "%s\n    {\"seconds\": %.6f, \"flop\": %" PRId64,
+              (icall == 0) ? "" : ",", times[0], call_counts[2 * icall]);
+      fprintf(file, ", \"bytes_sent\": %" PRId64, call_counts[2 * icall + 1]);
+      for (int i = 0; i < DBM_NUM_PHASES; i++) {
+        fprintf(file, ", \"%s\": %.6f", phase_names[i], times[1 + i]);
+      }
+      fprintf(file, "}");
+    }
+    fprintf(file, "\n  ]\n}\n");
+    fclose(file);
+  }
+
+  free(threads);
+  free(call_times);
+  free(call_counts);
+}
+
+/*******************************************************************************
+ * \brief Writes the timeline of phases in the Chrome trace format.
+ ******************************************************************************/
+void dbm_library_write_trace(const int fortran_comm, const char *filename) {
+  assert(omp_get_num_threads() == 1);
+  assert(library_initialized);
+
+  const dbm_mpi_comm_t comm = dbm_mpi_comm_f2c(fortran_comm);
+  const int my_rank = dbm_mpi_comm_rank(comm);
+  const int nranks = dbm_mpi_comm_size(comm);
+
+  // Agree on the earliest origin, such that the timelines of the ranks line up.
+  // As the clocks of ranks can differ, they are related via an instant that all
+  // ranks share, namely right after a reduction that serves as barrier.
+  int token = 0;
+  dbm_mpi_sum_int(&token, 1, comm);
+  const double time_sync = omp_get_wtime();
+  double max_elapsed = time_sync - time_origin;
+  dbm_mpi_max_double(&max_elapsed, 1, comm);
+  const double common_origin = time_sync - max_elapsed;
+
+  for (int irank = 0; irank < nranks; irank++) {
+    if (irank == my_rank) {
+      FILE *file = open_file(filename, (my_rank == 0) ? "w" : "a");
+      fprintf(file, "%s  {\"name\": \"process_name\", \"ph\": \"M\", ",
+              (my_rank == 0) ? "{\"traceEvents\": [\n" : ",\n");
+      fprintf(file, "\"pid\": %i, \"args\": {\"name\": \"rank %i\"}}", my_rank,
+              my_rank);
+      for (int ithread = 0; ithread < max_threads; ithread++) {
+        const thread_stats_t *stats = per_thread_stats[ithread];
+        for (int i = 0; i < stats->nevents; i++) {
+          const trace_event_t *event = &stats->events[i];
+          // Timestamps are given in microseconds.
+          fprintf(file,
+                  ",\n  {\"name\": \"%s\", \"cat\": \"dbm\", \"ph\": \"X\", "
+                  "\"pid\": %i, \"tid\": %i, \"ts\": %.3f, \"dur\": %.3f}",
+                  phase_names[event->phase], my_rank, ithread,
+                  1e6 * (event->start - common_origin),
+                  1e6 * (event->end - event->start));
+        }
+      }
+      fprintf(file, "%s", (my_rank == nranks - 1) ? "\n]}\n" : "");
+      fclose(file);
+    }
+    dbm_mpi_sum_int(&token, 1, comm); // the reduction serves as barrier
+  }
 }
 
 // EOF
@@ -7,8 +7,46 @@
 #ifndef DBM_LIBRARY_H
 #define DBM_LIBRARY_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include "dbm_multiply.h"
 
+/*******************************************************************************
+ * \brief Runtime configuration of the DBM library. Mirrored in dbm_api.F.
+ *        The defaults are given in dbm_hyperparams.h.
+ ******************************************************************************/
+typedef struct {
+  double hashtable_factor;  // number of hashtable slots per block
+  double allocation_factor; // over-allocation when growing a shard
+  double shards_per_thread; // applies to distributions created afterwards
+  int batch_size;           // tasks per batch, at most MAX_BATCH_SIZE
+  int batch_num_buckets;    // at most MAX_BATCH_NUM_BUCKETS
+  int small_gemm_max_size;  // larger tasks are passed to BLAS
+  int multiply_tile_size;   // bytes, zero disables tiling
+  int replication_layers;   // 2.5D layers of multiplies, 0 = auto, 1 = off
+  bool pack_compression;
+  double pack_compression_tolerance; // relative to filter_eps
+  double mixed_precision_min_eps;    // relative to max|A|*max|B|
+  bool plan_cache;    // reuse communication plans of recurring multiplies
+  bool load_balance;  // balance ticks and threads according to a cost model
+  bool shared_memory; // read packs of node-local peers in place
+  bool autotune;      // tune batch and tile size on the next multiplies
+  bool profile;       // record every multiply and a timeline of its phases
+} dbm_library_config_t;
+
+/*******************************************************************************
+ * \brief Phases of a multiplication, which are timed on each thread.
+ ******************************************************************************/
+typedef enum {
+  DBM_PHASE_PACK,     // assembling packs, excluding their redistribution
+  DBM_PHASE_ALLTOALL, // redistributing packs or layers via alltoall(v)
+  DBM_PHASE_WAIT,     // waiting for the pack exchange of a tick
+  DBM_PHASE_KERNEL,   // processing batches of block multiplications
+  DBM_PHASE_FILTER,   // scaling and filtering the result
+  DBM_NUM_PHASES
+} dbm_phase_t;
+
 /*******************************************************************************
  * \brief Initializes the DBM library.
  * \author Ole Schuett
@@ -21,12 +59,86 @@ void dbm_library_init(void);
  ******************************************************************************/
 void dbm_library_finalize(void);
 
+/*******************************************************************************
+ * \brief Configures the DBM library. The config is reset by dbm_library_init.
+ *        When config.autotune is set, recurrences of the next multiplication
+ *        try different batch and tile sizes, then the fastest is locked in.
+ ******************************************************************************/
+void dbm_library_set_config(const dbm_library_config_t *config);
+
+/*******************************************************************************
+ * \brief Returns the current config of the DBM library.
+ ******************************************************************************/
+const dbm_library_config_t *dbm_library_get_config(void);
+
+/*******************************************************************************
+ * \brief Internal routine called at the beginning of each multiplication.
+ *        While autotuning it applies the settings of the next trial.
+ ******************************************************************************/
+void dbm_library_autotune_begin(void);
+
+/*******************************************************************************
+ * \brief Internal routine called at the end of each multiplication with the
+ *        rank's number of flops and the elapsed time.
+ ******************************************************************************/
+void dbm_library_autotune_end(const int64_t flop, const double duration);
+
+/*******************************************************************************
+ * \brief Internal routine called at the beginning of each multiplication.
+ *        When profiling, it starts a new record of per-call timings.
+ ******************************************************************************/
+void dbm_library_call_begin(void);
+
+/*******************************************************************************
+ * \brief Internal routine called at the end of each multiplication with the
+ *        rank's number of flops. When profiling, it completes the record.
+ ******************************************************************************/
+void dbm_library_call_end(const int64_t flop);
+
 /*******************************************************************************
  * \brief Add given block multiplication to stats. This routine is thread-safe.
+ *        Its flops belong to the batch of the calling thread's next kernel.
  * \author Ole Schuett
  ******************************************************************************/
 void dbm_library_counter_increment(const int m, const int n, const int k);
 
+/*******************************************************************************
+ * \brief Internal routine for starting to time a phase on the calling thread.
+ *        Phases can be nested, the enclosing phase is paused meanwhile.
+ *        This routine is thread-safe.
+ ******************************************************************************/
+void dbm_library_phase_begin(const dbm_phase_t phase);
+
+/*******************************************************************************
+ * \brief Internal routine for stopping to time a phase on the calling thread.
+ *        The time of a kernel gets attributed to the (m,n,k) classes of its
+ *        batch according to their flops. This routine is thread-safe.
+ ******************************************************************************/
+void dbm_library_phase_end(const dbm_phase_t phase);
+
+/*******************************************************************************
+ * \brief Add given number of bytes sent to other MPI ranks to stats.
+ *        This routine is not thread-safe.
+ ******************************************************************************/
+void dbm_library_bytes_sent_add(const int64_t nbytes);
+
+/*******************************************************************************
+ * \brief Add given time spent in MPI communication to stats.
+ *        This routine is not thread-safe.
+ ******************************************************************************/
+void dbm_library_comm_time_add(const double seconds);
+
+/*******************************************************************************
+ * \brief Returns the time this rank spent in MPI communication since init.
+ ******************************************************************************/
+double dbm_library_comm_time(void);
+
+/*******************************************************************************
+ * \brief Add the busy times of all threads during a multiplication to stats.
+ *        This routine is not thread-safe.
+ ******************************************************************************/
+void dbm_library_busy_time_add(const int nthreads, const double busy[nthreads]);
+
 /*******************************************************************************
  * \brief Prints statistics gathered by the DBM library.
  * \author Ole Schuett
@@ -35,6 +147,27 @@ void dbm_library_print_stats(const int fortran_comm,
                              void (*print_func)(char *, int),
                              const int output_unit);
 
+/*******************************************************************************
+ * \brief Returns the unused memory held by the DBM memory pool to the system,
+ *        including the thread caches of threads that no longer exist.
+ *        Must be called outside of OpenMP parallel regions.
+ ******************************************************************************/
+void dbm_library_trim_memory(void);
+
+/*******************************************************************************
+ * \brief Writes the statistics gathered by the DBM library as JSON, including
+ *        the per-call records when config.profile was set.
+ *        Must be called by all ranks, only the first rank writes the file.
+ ******************************************************************************/
+void dbm_library_write_profile(const int fortran_comm, const char *filename);
+
+/*******************************************************************************
+ * \brief Writes the timeline of phases recorded while config.profile was set
+ *        in the Chrome trace format, which can be viewed e.g. with Perfetto.
+ *        Must be called by all ranks, which append their events in turn.
+ ******************************************************************************/
+void dbm_library_write_trace(const int fortran_comm, const char *filename);
+
 #endif
 
 // EOF
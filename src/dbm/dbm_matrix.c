@@ -47,8 +47,9 @@ void dbm_create(dbm_matrix_t **matrix_out, dbm_distribution_t *dist,
   matrix->col_sizes = malloc(size);
   memcpy(matrix->col_sizes, col_sizes, size);
 
+  // Each shard gets allocated and first touched by the thread that owns it.
   matrix->shards = malloc(dbm_get_num_shards(matrix) * sizeof(dbm_shard_t));
-#pragma omp parallel for
+#pragma omp parallel for schedule(static, 1)
   for (int ishard = 0; ishard < dbm_get_num_shards(matrix); ishard++) {
     dbm_shard_init(&matrix->shards[ishard]);
   }
@@ -57,6 +58,17 @@ void dbm_create(dbm_matrix_t **matrix_out, dbm_distribution_t *dist,
   *matrix_out = matrix;
 }
 
+/*******************************************************************************
+ * \brief Creates a new symmetric matrix, which stores only the upper block
+ *        triangle. Blocks of the lower triangle are transparently transposed.
+ ******************************************************************************/
+void dbm_create_symmetric(dbm_matrix_t **matrix_out, dbm_distribution_t *dist,
+                          const char name[], const int nrows,
+                          const int row_sizes[nrows]) {
+  dbm_create(matrix_out, dist, name, nrows, nrows, row_sizes, row_sizes);
+  (*matrix_out)->symmetric = true;
+}
+
 /*******************************************************************************
  * \brief Releases a matrix and all its ressources.
  * \author Ole Schuett
@@ -76,7 +88,8 @@ void dbm_release(dbm_matrix_t *matrix) {
 
 /*******************************************************************************
  * \brief Copies content of matrix_b into matrix_a.
- *        Matrices must have the same row/col block sizes and distribution.
+ *        Matrices must have the same row/col block sizes, distribution, and
+ *        symmetry.
  * \author Ole Schuett
  ******************************************************************************/
 void dbm_copy(dbm_matrix_t *matrix_a, const dbm_matrix_t *matrix_b) {
@@ -92,8 +105,9 @@ void dbm_copy(dbm_matrix_t *matrix_a, const dbm_matrix_t *matrix_b) {
   }
 
   assert(matrix_a->dist == matrix_b->dist);
+  assert(matrix_a->symmetric == matrix_b->symmetric);
 
-#pragma omp parallel for schedule(dynamic)
+#pragma omp parallel for schedule(static, 1)
   for (int ishard = 0; ishard < dbm_get_num_shards(matrix_a); ishard++) {
     dbm_shard_copy(&matrix_a->shards[ishard], &matrix_b->shards[ishard]);
   }
@@ -115,6 +129,7 @@ void dbm_redistribute(const dbm_matrix_t *matrix, dbm_matrix_t *redist) {
     assert(matrix->col_sizes[i] == redist->col_sizes[i]);
   }
 
+  assert(matrix->symmetric == redist->symmetric);
   assert(dbm_mpi_comms_are_similar(matrix->dist->comm, redist->dist->comm));
   const dbm_mpi_comm_t comm = redist->dist->comm;
   const int nranks = dbm_mpi_comm_size(comm);
@@ -200,12 +215,14 @@ void dbm_redistribute(const dbm_matrix_t *matrix, dbm_matrix_t *redist) {
 /*******************************************************************************
  * \brief Looks up a block from given matrics. This routine is thread-safe.
  *        If the block is not found then a null pointer is returned.
+ *        Symmetric matrices only provide blocks of the upper triangle.
  * \author Ole Schuett
  ******************************************************************************/
 void dbm_get_block_p(dbm_matrix_t *matrix, const int row, const int col,
                      double **block, int *row_size, int *col_size) {
   assert(0 <= row && row < matrix->nrows);
   assert(0 <= col && col < matrix->ncols);
+  assert(!matrix->symmetric || row <= col);
   assert(dbm_get_stored_coordinates(matrix, row, col) == matrix->dist->my_rank);
   *row_size = matrix->row_sizes[row];
   *col_size = matrix->col_sizes[col];
@@ -219,33 +236,57 @@ void dbm_get_block_p(dbm_matrix_t *matrix, const int row, const int col,
   }
 }
 
+/*******************************************************************************
+ * \brief Private routine for writing the data of a block into its stored block
+ *        of given size. Transposed data is written in place, without a copy.
+ ******************************************************************************/
+static void write_block(const double *src, const bool transposed,
+                        const int row_size, const int col_size,
+                        const bool summation, double *blk_data) {
+  if (transposed) {
+    for (int j = 0; j < col_size; j++) {
+      for (int i = 0; i < row_size; i++) {
+        const double element = src[i * col_size + j];
+        blk_data[j * row_size + i] =
+            (summation) ? blk_data[j * row_size + i] + element : element;
+      }
+    }
+  } else if (summation) {
+    for (int i = 0; i < row_size * col_size; i++) {
+      blk_data[i] += src[i];
+    }
+  } else {
+    memcpy(blk_data, src, row_size * col_size * sizeof(double));
+  }
+}
+
 /*******************************************************************************
  * \brief Adds a block to given matrix. This routine is thread-safe.
  *        If block already exist then it gets overwritten (or summed).
+ *        Symmetric matrices store blocks of the lower triangle transposed.
  * \author Ole Schuett
  ******************************************************************************/
 void dbm_put_block(dbm_matrix_t *matrix, const int row, const int col,
                    const bool summation, const double *block) {
   assert(0 <= row && row < matrix->nrows);
   assert(0 <= col && col < matrix->ncols);
-  assert(dbm_get_stored_coordinates(matrix, row, col) == matrix->dist->my_rank);
-  const int row_size = matrix->row_sizes[row];
-  const int col_size = matrix->col_sizes[col];
+  // Symmetric matrices store blocks of the lower triangle transposed.
+  const bool transposed = matrix->symmetric && row > col;
+  const int stored_row = (transposed) ? col : row;
+  const int stored_col = (transposed) ? row : col;
+  assert(dbm_get_stored_coordinates(matrix, stored_row, stored_col) ==
+         matrix->dist->my_rank);
+  const int row_size = matrix->row_sizes[stored_row];
+  const int col_size = matrix->col_sizes[stored_col];
   const int block_size = row_size * col_size;
 
-  const int ishard = dbm_get_shard_index(matrix, row, col);
+  const int ishard = dbm_get_shard_index(matrix, stored_row, stored_col);
   dbm_shard_t *shard = &matrix->shards[ishard];
   omp_set_lock(&shard->lock);
-  dbm_block_t *blk =
-      dbm_shard_get_or_allocate_block(shard, row, col, block_size);
-  double *blk_data = &shard->data[blk->offset];
-  if (summation) {
-    for (int i = 0; i < block_size; i++) {
-      blk_data[i] += block[i];
-    }
-  } else {
-    memcpy(blk_data, block, block_size * sizeof(double));
-  }
+  dbm_block_t *blk = dbm_shard_get_or_allocate_block(shard, stored_row,
+                                                     stored_col, block_size);
+  write_block(block, transposed, row_size, col_size, summation,
+              &shard->data[blk->offset]);
   omp_unset_lock(&shard->lock);
 }
 
@@ -256,14 +297,14 @@ void dbm_put_block(dbm_matrix_t *matrix, const int row, const int col,
 void dbm_clear(dbm_matrix_t *matrix) {
   assert(omp_get_num_threads() == 1);
 
-#pragma omp parallel for schedule(dynamic)
+#pragma omp parallel for schedule(static, 1)
   for (int ishard = 0; ishard < dbm_get_num_shards(matrix); ishard++) {
     dbm_shard_t *shard = &matrix->shards[ishard];
     shard->nblocks = 0;
     shard->data_size = 0;
     shard->data_promised = 0;
     // Does not deallocate memory, hence data_allocated remains unchanged.
-    memset(shard->hashtable, 0, shard->hashtable_size * sizeof(int));
+    dbm_shard_clear_hashtable(shard);
   }
 }
 
@@ -278,42 +319,157 @@ void dbm_filter(dbm_matrix_t *matrix, const double eps) {
   if (eps == 0.0) {
     return;
   }
-  const double eps2 = eps * eps;
 
-#pragma omp parallel for schedule(dynamic)
+#pragma omp parallel for schedule(static, 1)
   for (int ishard = 0; ishard < dbm_get_num_shards(matrix); ishard++) {
+    dbm_shard_filter(&matrix->shards[ishard], matrix->row_sizes,
+                     matrix->col_sizes, eps);
+  }
+}
+
+/*******************************************************************************
+ * \brief Private struct for a block that is staged by dbm_put_blocks.
+ ******************************************************************************/
+typedef struct {
+  int row;
+  int col;
+  int seq;            // position among all staged blocks, preserves call order
+  int offset;         // of the target block within the shard's data
+  bool transposed;    // lower triangle block of a symmetric matrix
+  const double *data; // points into the caller's array
+} staged_block_t;
+
+/*******************************************************************************
+ * \brief Private comperator passed to qsort to order staged blocks.
+ ******************************************************************************/
+static int compare_staged_blocks(const void *a, const void *b) {
+  const staged_block_t *blk_a = (const staged_block_t *)a;
+  const staged_block_t *blk_b = (const staged_block_t *)b;
+  if (blk_a->row != blk_b->row) {
+    return blk_a->row - blk_b->row;
+  }
+  if (blk_a->col != blk_b->col) {
+    return blk_a->col - blk_b->col;
+  }
+  return blk_a->seq - blk_b->seq;
+}
+
+/*******************************************************************************
+ * \brief Adds lists of blocks efficiently. The data of the blocks is given
+ *        consecutively. Each thread passes its own lists, which are staged
+ *        and then merged shard by shard without locking. Duplicate blocks
+ *        are summed, or the last one wins if summation is false.
+ *        This routine must always be called within an OpenMP parallel region.
+ ******************************************************************************/
+void dbm_put_blocks(dbm_matrix_t *matrix, const int nblocks, const int rows[],
+                    const int cols[], const double blocks[],
+                    const bool summation) {
+  assert(omp_get_num_threads() == omp_get_max_threads() &&
+         "Please call dbm_put_blocks within an OpenMP parallel region.");
+  const int my_rank = matrix->dist->my_rank;
+  const int nshards = dbm_get_num_shards(matrix);
+  const int nthreads = omp_get_num_threads();
+  const int ithread = omp_get_thread_num();
+
+  // The staging area is allocated by one thread and shared with the others.
+  int *staged_displ; // per shard and thread, plus the total
+  staged_block_t *staged_blocks;
+#pragma omp single copyprivate(staged_displ)
+  staged_displ = calloc(nshards * nthreads + 1, sizeof(int));
+
+  // Count blocks per shard and thread.
+  for (int i = 0; i < nblocks; i++) {
+    // Symmetric matrices store blocks of the lower triangle transposed.
+    const bool swap = matrix->symmetric && rows[i] > cols[i];
+    const int row = (swap) ? cols[i] : rows[i];
+    const int col = (swap) ? rows[i] : cols[i];
+    assert(0 <= row && row < matrix->nrows);
+    assert(0 <= col && col < matrix->ncols);
+    assert(dbm_get_stored_coordinates(matrix, row, col) == my_rank);
+    const int ishard = dbm_get_shard_index(matrix, row, col);
+    staged_displ[ishard * nthreads + ithread]++;
+  }
+#pragma omp barrier
+
+  // Compute displacements, which order the staged blocks by shard and thread.
+#pragma omp single copyprivate(staged_blocks)
+  {
+    int total = 0;
+    for (int i = 0; i < nshards * nthreads; i++) {
+      const int count = staged_displ[i];
+      staged_displ[i] = total;
+      total += count;
+    }
+    staged_displ[nshards * nthreads] = total;
+    staged_blocks = malloc(total * sizeof(staged_block_t));
+  }
+
+  // Stage blocks, the data remains in the caller's array.
+  int cursor[nshards];
+  for (int ishard = 0; ishard < nshards; ishard++) {
+    cursor[ishard] = staged_displ[ishard * nthreads + ithread];
+  }
+  int offset = 0;
+  for (int i = 0; i < nblocks; i++) {
+    const bool swap = matrix->symmetric && rows[i] > cols[i];
+    const int row = (swap) ? cols[i] : rows[i];
+    const int col = (swap) ? rows[i] : cols[i];
+    const int ishard = dbm_get_shard_index(matrix, row, col);
+    const int seq = cursor[ishard]++;
+    staged_blocks[seq].row = row;
+    staged_blocks[seq].col = col;
+    staged_blocks[seq].seq = seq;
+    staged_blocks[seq].transposed = swap;
+    staged_blocks[seq].data = &blocks[offset];
+    offset += matrix->row_sizes[rows[i]] * matrix->col_sizes[cols[i]];
+  }
+#pragma omp barrier
+
+  // Merge staged blocks shard by shard with a single allocation each.
+#pragma omp for schedule(static, 1)
+  for (int ishard = 0; ishard < nshards; ishard++) {
     dbm_shard_t *shard = &matrix->shards[ishard];
-    const int old_nblocks = shard->nblocks;
-    shard->nblocks = 0;
-    shard->data_promised = 0;
-    memset(shard->hashtable, 0, shard->hashtable_size * sizeof(int));
+    const int start = staged_displ[ishard * nthreads];
+    const int end = staged_displ[(ishard + 1) * nthreads];
+    staged_block_t *staged = &staged_blocks[start];
+    const int nstaged = end - start;
+    bool sorted = true; // e.g. when filled by a single thread in order
+    for (int i = 1; i < nstaged && sorted; i++) {
+      sorted = (compare_staged_blocks(&staged[i - 1], &staged[i]) < 0);
+    }
+    if (!sorted) {
+      qsort(staged, nstaged, sizeof(staged_block_t), &compare_staged_blocks);
+    }
 
-    for (int iblock = 0; iblock < old_nblocks; iblock++) {
-      const dbm_block_t old_blk = shard->blocks[iblock];
-      const double *old_blk_data = &shard->data[old_blk.offset];
-      const int row_size = matrix->row_sizes[old_blk.row];
-      const int col_size = matrix->col_sizes[old_blk.col];
-      const int block_size = row_size * col_size;
-      double norm = 0.0;
-      for (int i = 0; i < block_size; i++) {
-        norm += old_blk_data[i] * old_blk_data[i];
+    // Promise all new blocks, such that the data gets allocated only once.
+    for (int i = 0; i < nstaged; i++) {
+      const int row = staged[i].row, col = staged[i].col;
+      if (i == 0 || row != staged[i - 1].row || col != staged[i - 1].col) {
+        const int block_size = matrix->row_sizes[row] * matrix->col_sizes[col];
+        staged[i].offset =
+            dbm_shard_get_or_promise_block(shard, row, col, block_size)->offset;
+      } else {
+        staged[i].offset = staged[i - 1].offset;
       }
-      // For historic reasons zero-sized blocks are never filtered.
-      if (block_size > 0 && norm < eps2) {
-        continue; // filter the block
-      }
-      // Re-create block.
-      dbm_block_t *new_blk = dbm_shard_promise_new_block(
-          shard, old_blk.row, old_blk.col, block_size);
-      assert(new_blk->offset <= old_blk.offset);
-      if (new_blk->offset != old_blk.offset) {
-        // Using memmove instead of memcpy because it handles overlap correctly.
-        double *new_blk_data = &shard->data[new_blk->offset];
-        memmove(new_blk_data, old_blk_data, block_size * sizeof(double));
+    }
+    dbm_shard_allocate_promised_blocks(shard);
+
+    for (int i = 0; i < nstaged; i++) {
+      const int row = staged[i].row, col = staged[i].col;
+      const bool last = (i + 1 == nstaged || row != staged[i + 1].row ||
+                         col != staged[i + 1].col);
+      if (summation || last) { // Without summation the last one wins.
+        write_block(staged[i].data, staged[i].transposed,
+                    matrix->row_sizes[row], matrix->col_sizes[col], summation,
+                    &shard->data[staged[i].offset]);
       }
     }
-    shard->data_size = shard->data_promised;
-    // TODO: Could call realloc to release excess memory.
+  }
+
+#pragma omp single
+  {
+    free(staged_displ);
+    free(staged_blocks);
   }
 }
 
@@ -328,21 +484,25 @@ void dbm_reserve_blocks(dbm_matrix_t *matrix, const int nblocks,
          "Please call dbm_reserve_blocks within an OpenMP parallel region.");
   const int my_rank = matrix->dist->my_rank;
   for (int i = 0; i < nblocks; i++) {
-    const int ishard = dbm_get_shard_index(matrix, rows[i], cols[i]);
+    // Symmetric matrices store blocks of the lower triangle transposed.
+    const bool swap = matrix->symmetric && rows[i] > cols[i];
+    const int row = (swap) ? cols[i] : rows[i];
+    const int col = (swap) ? rows[i] : cols[i];
+    const int ishard = dbm_get_shard_index(matrix, row, col);
     dbm_shard_t *shard = &matrix->shards[ishard];
     omp_set_lock(&shard->lock);
-    assert(0 <= rows[i] && rows[i] < matrix->nrows);
-    assert(0 <= cols[i] && cols[i] < matrix->ncols);
-    assert(dbm_get_stored_coordinates(matrix, rows[i], cols[i]) == my_rank);
-    const int row_size = matrix->row_sizes[rows[i]];
-    const int col_size = matrix->col_sizes[cols[i]];
+    assert(0 <= row && row < matrix->nrows);
+    assert(0 <= col && col < matrix->ncols);
+    assert(dbm_get_stored_coordinates(matrix, row, col) == my_rank);
+    const int row_size = matrix->row_sizes[row];
+    const int col_size = matrix->col_sizes[col];
     const int block_size = row_size * col_size;
-    dbm_shard_get_or_promise_block(shard, rows[i], cols[i], block_size);
+    dbm_shard_get_or_promise_block(shard, row, col, block_size);
     omp_unset_lock(&shard->lock);
   }
 #pragma omp barrier
 
-#pragma omp for schedule(dynamic)
+#pragma omp for schedule(static, 1)
   for (int ishard = 0; ishard < dbm_get_num_shards(matrix); ishard++) {
     dbm_shard_t *shard = &matrix->shards[ishard];
     dbm_shard_allocate_promised_blocks(shard);
@@ -358,17 +518,10 @@ void dbm_scale(dbm_matrix_t *matrix, const double alpha) {
   if (alpha == 1.0) {
     return;
   }
-  if (alpha == 0.0) {
-    dbm_zero(matrix);
-    return;
-  }
 
-#pragma omp parallel for schedule(dynamic)
+#pragma omp parallel for schedule(static, 1)
   for (int ishard = 0; ishard < dbm_get_num_shards(matrix); ishard++) {
-    dbm_shard_t *shard = &matrix->shards[ishard];
-    for (int i = 0; i < shard->data_size; i++) {
-      shard->data[i] *= alpha;
-    }
+    dbm_shard_scale(&matrix->shards[ishard], alpha);
   }
 }
 
@@ -379,7 +532,7 @@ void dbm_scale(dbm_matrix_t *matrix, const double alpha) {
 void dbm_zero(dbm_matrix_t *matrix) {
   assert(omp_get_num_threads() == 1);
 
-#pragma omp parallel for schedule(dynamic)
+#pragma omp parallel for schedule(static, 1)
   for (int ishard = 0; ishard < dbm_get_num_shards(matrix); ishard++) {
     dbm_shard_t *shard = &matrix->shards[ishard];
     memset(shard->data, 0, shard->data_size * sizeof(double));
@@ -391,35 +544,62 @@ void dbm_zero(dbm_matrix_t *matrix) {
  * \author Ole Schuett
  ******************************************************************************/
 void dbm_add(dbm_matrix_t *matrix_a, const dbm_matrix_t *matrix_b) {
+  dbm_add_filtered(matrix_a, matrix_b, 0.0);
+}
+
+/*******************************************************************************
+ * \brief Adds matrix_b to matrix_a and removes the blocks of matrix_a whose
+ *        norm is below eps. Each shard gets filtered right after the addition.
+ ******************************************************************************/
+void dbm_add_filtered(dbm_matrix_t *matrix_a, const dbm_matrix_t *matrix_b,
+                      const double eps) {
   assert(omp_get_num_threads() == 1);
   assert(matrix_a->dist == matrix_b->dist);
+  assert(matrix_a->symmetric == matrix_b->symmetric);
 
-#pragma omp parallel for schedule(dynamic)
+#pragma omp parallel for schedule(static, 1)
   for (int ishard = 0; ishard < dbm_get_num_shards(matrix_b); ishard++) {
     dbm_shard_t *shard_a = &matrix_a->shards[ishard];
     const dbm_shard_t *shard_b = &matrix_b->shards[ishard];
+
+    // Promise missing blocks first, such that shard_a grows only once.
+    int *offsets_a = malloc(shard_b->nblocks * sizeof(int));
     for (int iblock = 0; iblock < shard_b->nblocks; iblock++) {
       const dbm_block_t blk_b = shard_b->blocks[iblock];
-
       const int row_size = matrix_b->row_sizes[blk_b.row];
       const int col_size = matrix_b->col_sizes[blk_b.col];
       assert(row_size == matrix_a->row_sizes[blk_b.row]);
       assert(col_size == matrix_a->col_sizes[blk_b.col]);
       const int block_size = row_size * col_size;
-      dbm_block_t *blk_a = dbm_shard_get_or_allocate_block(
+      const dbm_block_t *blk_a = dbm_shard_get_or_promise_block(
           shard_a, blk_b.row, blk_b.col, block_size);
-      double *data_a = &shard_a->data[blk_a->offset];
+      offsets_a[iblock] = blk_a->offset;
+    }
+    dbm_shard_allocate_promised_blocks(shard_a);
+
+    for (int iblock = 0; iblock < shard_b->nblocks; iblock++) {
+      const dbm_block_t blk_b = shard_b->blocks[iblock];
+      const int block_size =
+          matrix_b->row_sizes[blk_b.row] * matrix_b->col_sizes[blk_b.col];
+      double *data_a = &shard_a->data[offsets_a[iblock]];
       const double *data_b = &shard_b->data[blk_b.offset];
       for (int i = 0; i < block_size; i++) {
         data_a[i] += data_b[i];
       }
     }
+    free(offsets_a);
+
+    // Filter while the shard is still in cache.
+    if (eps != 0.0) {
+      dbm_shard_filter(shard_a, matrix_a->row_sizes, matrix_a->col_sizes, eps);
+    }
   }
 }
 
 /*******************************************************************************
  * \brief Creates an iterator for the blocks of the given matrix.
- *        The iteration order is not stable.
+ *        The iteration order is not stable. For symmetric matrices only the
+ *        stored blocks of the upper triangle are visited.
  *        This routine must always be called within an OpenMP parallel region.
  * \author Ole Schuett
  ******************************************************************************/
@@ -498,14 +678,29 @@ void dbm_iterator_stop(dbm_iterator_t *iter) { free(iter); }
 
 /*******************************************************************************
  * \brief Computes a checksum of the given matrix.
+ *        Symmetric matrices count their off-diagonal blocks twice.
  * \author Ole Schuett
  ******************************************************************************/
 double dbm_checksum(const dbm_matrix_t *matrix) {
   double checksum = 0.0;
   for (int ishard = 0; ishard < dbm_get_num_shards(matrix); ishard++) {
     const dbm_shard_t *shard = &matrix->shards[ishard];
-    for (int i = 0; i < shard->data_size; i++) {
-      checksum += shard->data[i] * shard->data[i];
+    if (!matrix->symmetric) {
+      for (int i = 0; i < shard->data_size; i++) {
+        checksum += shard->data[i] * shard->data[i];
+      }
+      continue;
+    }
+    for (int iblock = 0; iblock < shard->nblocks; iblock++) {
+      const dbm_block_t *blk = &shard->blocks[iblock];
+      const double *blk_data = &shard->data[blk->offset];
+      const int block_size =
+          matrix->row_sizes[blk->row] * matrix->col_sizes[blk->col];
+      double block_checksum = 0.0;
+      for (int i = 0; i < block_size; i++) {
+        block_checksum += blk_data[i] * blk_data[i];
+      }
+      checksum += (blk->row == blk->col) ? block_checksum : 2 * block_checksum;
     }
   }
   dbm_mpi_sum_double(&checksum, 1, matrix->dist->comm);
@@ -534,6 +729,11 @@ double dbm_maxabs(const dbm_matrix_t *matrix) {
  ******************************************************************************/
 const char *dbm_get_name(const dbm_matrix_t *matrix) { return matrix->name; }
 
+/*******************************************************************************
+ * \brief Returns true if the given matrix is symmetric.
+ ******************************************************************************/
+bool dbm_is_symmetric(const dbm_matrix_t *matrix) { return matrix->symmetric; }
+
 /*******************************************************************************
  * \brief Returns the number of local Non-Zero Elements of the given matrix.
  * \author Ole Schuett
@@ -600,10 +800,14 @@ void dbm_get_local_cols(const dbm_matrix_t *matrix, int *nlocal_cols,
 
 /*******************************************************************************
  * \brief Returns the MPI rank on which the given block should be stored.
+ *        Lower triangle blocks of symmetric matrices are stored transposed.
  * \author Ole Schuett
  ******************************************************************************/
 int dbm_get_stored_coordinates(const dbm_matrix_t *matrix, const int row,
                                const int col) {
+  if (matrix->symmetric && row > col) {
+    return dbm_distribution_stored_coords(matrix->dist, col, row);
+  }
   return dbm_distribution_stored_coords(matrix->dist, row, col);
 }
 
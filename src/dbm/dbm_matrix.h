@@ -24,6 +24,7 @@ typedef struct {
   int ncols;
   int *row_sizes;
   int *col_sizes;
+  bool symmetric; // only blocks with row <= col are stored
 
   dbm_shard_t *shards;
 } dbm_matrix_t;
@@ -46,6 +47,14 @@ void dbm_create(dbm_matrix_t **matrix_out, dbm_distribution_t *dist,
                 const char name[], const int nrows, const int ncols,
                 const int row_sizes[nrows], const int col_sizes[ncols]);
 
+/*******************************************************************************
+ * \brief Creates a new symmetric matrix, which stores only the upper block
+ *        triangle. Blocks of the lower triangle are transparently transposed.
+ ******************************************************************************/
+void dbm_create_symmetric(dbm_matrix_t **matrix_out, dbm_distribution_t *dist,
+                          const char name[], const int nrows,
+                          const int row_sizes[nrows]);
+
 /*******************************************************************************
  * \brief Releases a matrix and all its ressources.
  * \author Ole Schuett
@@ -54,7 +63,8 @@ void dbm_release(dbm_matrix_t *matrix);
 
 /*******************************************************************************
  * \brief Copies content of matrix_b into matrix_a.
- *        Matrices must have the same row/col block sizes and distribution.
+ *        Matrices must have the same row/col block sizes, distribution, and
+ *        symmetry.
  * \author Ole Schuett
  ******************************************************************************/
 void dbm_copy(dbm_matrix_t *matrix_a, const dbm_matrix_t *matrix_b);
@@ -69,6 +79,7 @@ void dbm_redistribute(const dbm_matrix_t *matrix, dbm_matrix_t *redist);
 /*******************************************************************************
  * \brief Looks up a block from given matrics. This routine is thread-safe.
  *        If the block is not found then a null pointer is returned.
+ *        Symmetric matrices only provide blocks of the upper triangle.
  * \author Ole Schuett
  ******************************************************************************/
 void dbm_get_block_p(dbm_matrix_t *matrix, const int row, const int col,
@@ -77,6 +88,7 @@ void dbm_get_block_p(dbm_matrix_t *matrix, const int row, const int col,
 /*******************************************************************************
  * \brief Adds a block to given matrix. This routine is thread-safe.
  *        If block already exist then it gets overwritten (or summed).
+ *        Symmetric matrices store blocks of the lower triangle transposed.
  * \author Ole Schuett
  ******************************************************************************/
 void dbm_put_block(dbm_matrix_t *matrix, const int row, const int col,
@@ -95,6 +107,17 @@ void dbm_clear(dbm_matrix_t *matrix);
  ******************************************************************************/
 void dbm_filter(dbm_matrix_t *matrix, const double eps);
 
+/*******************************************************************************
+ * \brief Adds lists of blocks efficiently. The data of the blocks is given
+ *        consecutively. Each thread passes its own lists, which are staged
+ *        and then merged shard by shard without locking. Duplicate blocks
+ *        are summed, or the last one wins if summation is false.
+ *        This routine must always be called within an OpenMP parallel region.
+ ******************************************************************************/
+void dbm_put_blocks(dbm_matrix_t *matrix, const int nblocks, const int rows[],
+                    const int cols[], const double blocks[],
+                    const bool summation);
+
 /*******************************************************************************
  * \brief Adds list of blocks efficiently. The blocks will be filled with zeros.
  *        This routine must always be called within an OpenMP parallel region.
@@ -116,14 +139,22 @@ void dbm_scale(dbm_matrix_t *matrix, const double alpha);
 void dbm_zero(dbm_matrix_t *matrix);
 
 /*******************************************************************************
- * \brief Adds matrix_b to matrix_a.
+ * \brief Adds matrix_b to matrix_a. Both must have the same symmetry.
  * \author Ole Schuett
  ******************************************************************************/
 void dbm_add(dbm_matrix_t *matrix_a, const dbm_matrix_t *matrix_b);
 
+/*******************************************************************************
+ * \brief Adds matrix_b to matrix_a and removes the blocks of matrix_a whose
+ *        norm is below eps. Each shard gets filtered right after the addition.
+ ******************************************************************************/
+void dbm_add_filtered(dbm_matrix_t *matrix_a, const dbm_matrix_t *matrix_b,
+                      const double eps);
+
 /*******************************************************************************
  * \brief Creates an iterator for the blocks of the given matrix.
- *        The iteration order is not stable.
+ *        The iteration order is not stable. For symmetric matrices only the
+ *        stored blocks of the upper triangle are visited.
  *        This routine must always be called within an OpenMP parallel region.
  * \author Ole Schuett
  ******************************************************************************/
@@ -156,6 +187,7 @@ void dbm_iterator_stop(dbm_iterator_t *iter);
 
 /*******************************************************************************
  * \brief Computes a checksum of the given matrix.
+ *        Symmetric matrices count their off-diagonal blocks twice.
  * \author Ole Schuett
  ******************************************************************************/
 double dbm_checksum(const dbm_matrix_t *matrix);
@@ -172,6 +204,11 @@ double dbm_maxabs(const dbm_matrix_t *matrix);
  ******************************************************************************/
 const char *dbm_get_name(const dbm_matrix_t *matrix);
 
+/*******************************************************************************
+ * \brief Returns true if the given matrix is symmetric.
+ ******************************************************************************/
+bool dbm_is_symmetric(const dbm_matrix_t *matrix);
+
 /*******************************************************************************
  * \brief Returns the number of local Non-Zero Elements of the given matrix.
  * \author Ole Schuett
@@ -214,6 +251,7 @@ void dbm_get_local_cols(const dbm_matrix_t *matrix, int *nlocal_cols,
 
 /*******************************************************************************
  * \brief Returns the MPI rank on which the given block should be stored.
+ *        Lower triangle blocks of symmetric matrices are stored transposed.
  * \author Ole Schuett
  ******************************************************************************/
 int dbm_get_stored_coordinates(const dbm_matrix_t *matrix, const int row,
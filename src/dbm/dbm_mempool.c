@@ -8,6 +8,7 @@
 #include <assert.h>
 #include <omp.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -62,29 +63,199 @@ static void actual_free(void *memory, const bool on_device) {
   dbm_mpi_free_mem(memory);
 }
 
+/*******************************************************************************
+ * \brief Number of size classes, the largest one holds chunks of 2^48 bytes.
+ ******************************************************************************/
+#define DBM_MEMPOOL_NUM_CLASSES 145
+
+/*******************************************************************************
+ * \brief Size of the smallest size class in bytes as log2.
+ ******************************************************************************/
+#define DBM_MEMPOOL_MIN_CLASS_LOG2 12
+
+/*******************************************************************************
+ * \brief Header in front of host chunks, large enough to keep SIMD alignment.
+ ******************************************************************************/
+#define DBM_MEMPOOL_HEADER_SIZE 64
+
+/*******************************************************************************
+ * \brief Number of buckets of the side table for device chunks.
+ ******************************************************************************/
+#define DBM_MEMPOOL_NUM_BUCKETS 256
+
 /*******************************************************************************
  * \brief Private struct for storing a chunk of memory.
  * \author Ole Schuett
  ******************************************************************************/
 struct dbm_memchunk {
   bool on_device;
-  size_t size;
-  void *mem;
+  int size_class;
+  void *base; // as returned by actual_malloc
+  void *mem;  // as handed out to the caller
   struct dbm_memchunk *next;
 };
 typedef struct dbm_memchunk dbm_memchunk_t;
 
 /*******************************************************************************
- * \brief Private linked list of memory chunks that are available.
+ * \brief Private struct for storing a thread's cache of available chunks.
+ ******************************************************************************/
+struct dbm_thread_cache {
+  dbm_memchunk_t *chunks[2][DBM_MEMPOOL_NUM_CLASSES]; // [on_device][class]
+  struct dbm_thread_cache *next;
+};
+typedef struct dbm_thread_cache dbm_thread_cache_t;
+
+/*******************************************************************************
+ * \brief Private linked lists of available chunks for each size class.
+ ******************************************************************************/
+static dbm_memchunk_t *mempool_available[2][DBM_MEMPOOL_NUM_CLASSES];
+
+/*******************************************************************************
+ * \brief Private side table of device chunks that are in use.
+ *        Host chunks are instead found via the header in front of their memory.
+ ******************************************************************************/
+static dbm_memchunk_t *mempool_device_allocated[DBM_MEMPOOL_NUM_BUCKETS];
+
+/*******************************************************************************
+ * \brief Private list of all thread caches, needed to empty them.
+ ******************************************************************************/
+static dbm_thread_cache_t *mempool_thread_caches = NULL;
+
+/*******************************************************************************
+ * \brief Private generation of the thread caches, incremented when clearing.
+ ******************************************************************************/
+static int mempool_generation = 0;
+
+/*******************************************************************************
+ * \brief Private pointer to the calling thread's cache and its generation.
+ ******************************************************************************/
+static dbm_thread_cache_t *mempool_my_thread_cache = NULL;
+static int mempool_my_generation = -1;
+#pragma omp threadprivate(mempool_my_thread_cache, mempool_my_generation)
+
+/*******************************************************************************
+ * \brief Private statistics for host and device memory.
+ ******************************************************************************/
+static dbm_mempool_stats_t mempool_stats[2];
+
+/*******************************************************************************
+ * \brief Private number of chunks that are in use, needed to detect leaks.
+ ******************************************************************************/
+static int64_t mempool_nallocated = 0;
+
+/*******************************************************************************
+ * \brief Private routine for finding the size class of given number of bytes.
+ *        Each power of two is subdivided into four classes, which bounds the
+ *        over-allocation to 25% while keeping the number of classes small.
+ ******************************************************************************/
+static int size_class(const size_t size) {
+  const size_t min_size = (size_t)1 << DBM_MEMPOOL_MIN_CLASS_LOG2;
+  if (size <= min_size) {
+    return 0;
+  }
+  int log2 = DBM_MEMPOOL_MIN_CLASS_LOG2; // find log2 with 2^log2 < size
+  while (((size - 1) >> (log2 + 1)) > 0) {
+    log2++;
+  }
+  const size_t step = (size_t)1 << (log2 - 2);
+  const size_t remainder = size - ((size_t)1 << log2);
+  const int quarter = (remainder + step - 1) / step; // in range 1...4
+  const int iclass = 4 * (log2 - DBM_MEMPOOL_MIN_CLASS_LOG2) + quarter;
+  assert(iclass < DBM_MEMPOOL_NUM_CLASSES);
+  return iclass;
+}
+
+/*******************************************************************************
+ * \brief Private routine for computing the number of bytes of a size class.
+ ******************************************************************************/
+static size_t class_size(const int iclass) {
+  if (iclass == 0) {
+    return (size_t)1 << DBM_MEMPOOL_MIN_CLASS_LOG2;
+  }
+  const int log2 = DBM_MEMPOOL_MIN_CLASS_LOG2 + (iclass - 1) / 4;
+  const int quarter = (iclass - 1) % 4 + 1;
+  return ((size_t)1 << log2) + quarter * ((size_t)1 << (log2 - 2));
+}
+
+/*******************************************************************************
+ * \brief Private routine for hashing a device pointer into a bucket.
+ ******************************************************************************/
+static inline int bucket_of(const void *mem) {
+  return ((uintptr_t)mem >> DBM_MEMPOOL_MIN_CLASS_LOG2) %
+         DBM_MEMPOOL_NUM_BUCKETS;
+}
+
+/*******************************************************************************
+ * \brief Private routine for obtaining the calling thread's cache.
+ ******************************************************************************/
+static dbm_thread_cache_t *get_my_thread_cache(void) {
+  // Caches of an earlier generation were freed by dbm_mempool_clear.
+  if (mempool_my_thread_cache == NULL ||
+      mempool_my_generation != mempool_generation) {
+    dbm_thread_cache_t *cache = calloc(1, sizeof(dbm_thread_cache_t));
+#pragma omp critical(dbm_mempool_modify)
+    {
+      cache->next = mempool_thread_caches;
+      mempool_thread_caches = cache;
+    }
+    mempool_my_thread_cache = cache;
+    mempool_my_generation = mempool_generation;
+  }
+  return mempool_my_thread_cache;
+}
+
+/*******************************************************************************
+ * \brief Private routine for allocating a new chunk from the system.
+ *        Must be called within critical(dbm_mempool_modify).
+ ******************************************************************************/
+static dbm_memchunk_t *new_chunk(const int iclass, const bool on_device) {
+  dbm_memchunk_t *chunk = malloc(sizeof(dbm_memchunk_t));
+  chunk->on_device = on_device;
+  chunk->size_class = iclass;
+  chunk->next = NULL;
+  if (on_device) {
+    chunk->base = actual_malloc(class_size(iclass), true);
+    chunk->mem = chunk->base;
+  } else {
+    chunk->base = actual_malloc(DBM_MEMPOOL_HEADER_SIZE + class_size(iclass),
+                                false);
+    chunk->mem = (char *)chunk->base + DBM_MEMPOOL_HEADER_SIZE;
+    *(dbm_memchunk_t **)chunk->base = chunk; // allows for O(1) lookup
+  }
+  mempool_stats[on_device].nmisses++;
+  mempool_stats[on_device].size += class_size(iclass);
+  return chunk;
+}
+
+/*******************************************************************************
+ * \brief Private routine for returning a chunk to the system.
+ *        Must be called within critical(dbm_mempool_modify) or serially.
  * \author Ole Schuett
  ******************************************************************************/
-static dbm_memchunk_t *mempool_available_head = NULL;
+static void delete_chunk(dbm_memchunk_t *chunk) {
+  mempool_stats[chunk->on_device].size -= class_size(chunk->size_class);
+  actual_free(chunk->base, chunk->on_device);
+  free(chunk);
+}
 
 /*******************************************************************************
- * \brief Private linked list of memory chunks that are in use.
+ * \brief Private routine for updating the in_use and peak statistics.
  * \author Ole Schuett
  ******************************************************************************/
-static dbm_memchunk_t *mempool_allocated_head = NULL;
+static void update_usage(const bool on_device, const int64_t delta) {
+  dbm_mempool_stats_t *stats = &mempool_stats[on_device];
+  int64_t in_use, peak;
+#pragma omp atomic capture
+  in_use = stats->in_use += delta;
+#pragma omp atomic read
+  peak = stats->peak;
+  if (in_use > peak) {
+#pragma omp critical(dbm_mempool_stats)
+    if (in_use > stats->peak) {
+      stats->peak = in_use;
+    }
+  }
+}
 
 /*******************************************************************************
  * \brief Private routine for allocating host or device memory from the pool.
@@ -95,44 +266,71 @@ static void *internal_mempool_malloc(const size_t size, const bool on_device) {
     return NULL;
   }
 
-  dbm_memchunk_t *chunk;
+  const int iclass = size_class(size);
+  assert(size <= class_size(iclass));
+
+  // Fast path: Take chunk from the thread's cache without any locking.
+  dbm_thread_cache_t *cache = get_my_thread_cache();
+  dbm_memchunk_t *chunk = cache->chunks[on_device][iclass];
+  cache->chunks[on_device][iclass] = NULL;
 
+  // Host chunks taken from the cache are done, they carry their own header.
+  if (chunk == NULL || on_device) {
 #pragma omp critical(dbm_mempool_modify)
-  {
-    // Find a suitable chuck in mempool_available.
-    dbm_memchunk_t **indirect = &mempool_available_head;
-    while (*indirect != NULL && (*indirect)->on_device != on_device) {
-      indirect = &(*indirect)->next;
-    }
-    chunk = *indirect;
+    {
+      // Slow path: Take chunk from the shared list or allocate a new one.
+      if (chunk == NULL) {
+        chunk = mempool_available[on_device][iclass];
+        if (chunk != NULL) {
+          mempool_available[on_device][iclass] = chunk->next;
+        } else {
+          chunk = new_chunk(iclass, on_device);
+        }
+      }
 
-    // If a chunck was found, remove it from mempool_available.
-    if (chunk != NULL) {
-      assert(chunk->on_device == on_device);
-      *indirect = chunk->next;
+      // Device chunks can not hold a header, hence they go into a side table.
+      if (on_device) {
+        const int ibucket = bucket_of(chunk->mem);
+        chunk->next = mempool_device_allocated[ibucket];
+        mempool_device_allocated[ibucket] = chunk;
+      }
     }
+  }
 
-    // If no chunk was found, allocate a new one.
-    if (chunk == NULL) {
-      chunk = malloc(sizeof(dbm_memchunk_t));
-      chunk->on_device = on_device;
-      chunk->size = 0;
-      chunk->mem = NULL;
-    }
+  assert(chunk->on_device == on_device && chunk->size_class == iclass);
+#pragma omp atomic
+  mempool_stats[on_device].nmallocs++;
+#pragma omp atomic
+  mempool_nallocated++;
+  update_usage(on_device, class_size(iclass));
 
-    // Resize chunk if needed.
-    if (chunk->size < size) {
-      actual_free(chunk->mem, chunk->on_device);
-      chunk->mem = actual_malloc(size, chunk->on_device);
-      chunk->size = size;
-    }
+  return chunk->mem;
+}
 
-    // Insert chunk into mempool_allocated.
-    chunk->next = mempool_allocated_head;
-    mempool_allocated_head = chunk;
+/*******************************************************************************
+ * \brief Private routine for releasing a chunk back to the pool.
+ ******************************************************************************/
+static void internal_mempool_free(dbm_memchunk_t *chunk) {
+  const bool on_device = chunk->on_device;
+  const int iclass = chunk->size_class;
+  update_usage(on_device, -(int64_t)class_size(iclass));
+#pragma omp atomic
+  mempool_nallocated--;
+
+  // Fast path: Put chunk into the thread's cache if the slot is empty.
+  dbm_thread_cache_t *cache = get_my_thread_cache();
+  if (cache->chunks[on_device][iclass] == NULL) {
+    chunk->next = NULL;
+    cache->chunks[on_device][iclass] = chunk;
+    return;
   }
 
-  return chunk->mem;
+  // Slow path: Put chunk into the shared list.
+#pragma omp critical(dbm_mempool_modify)
+  {
+    chunk->next = mempool_available[on_device][iclass];
+    mempool_available[on_device][iclass] = chunk;
+  }
 }
 
 /*******************************************************************************
@@ -152,30 +350,66 @@ void *dbm_mempool_device_malloc(const size_t size) {
 }
 
 /*******************************************************************************
- * \brief Internal routine for releasing memory back to the pool.
+ * \brief Internal routine for releasing host memory back to the pool.
+ ******************************************************************************/
+void dbm_mempool_host_free(void *mem) {
+  if (mem == NULL) {
+    return;
+  }
+  char *base = (char *)mem - DBM_MEMPOOL_HEADER_SIZE;
+  dbm_memchunk_t *chunk = *(dbm_memchunk_t **)base;
+  assert(chunk->mem == mem && !chunk->on_device);
+  internal_mempool_free(chunk);
+}
+
+/*******************************************************************************
+ * \brief Internal routine for releasing device memory back to the pool.
  * \author Ole Schuett
  ******************************************************************************/
-void dbm_mempool_free(void *mem) {
+void dbm_mempool_device_free(void *mem) {
   if (mem == NULL) {
     return;
   }
+  dbm_memchunk_t *chunk;
 
 #pragma omp critical(dbm_mempool_modify)
   {
-    // Find chuck in mempool_allocated.
-    dbm_memchunk_t **indirect = &mempool_allocated_head;
+    // Find chunk in the side table and remove it.
+    dbm_memchunk_t **indirect = &mempool_device_allocated[bucket_of(mem)];
     while (*indirect != NULL && (*indirect)->mem != mem) {
       indirect = &(*indirect)->next;
     }
-    dbm_memchunk_t *chunk = *indirect;
-    assert(chunk != NULL && chunk->mem == mem);
-
-    // Remove chuck from mempool_allocated.
+    chunk = *indirect;
+    assert(chunk != NULL && chunk->mem == mem && chunk->on_device);
     *indirect = chunk->next;
+  }
 
-    // Add chuck to mempool_available.
-    chunk->next = mempool_available_head;
-    mempool_available_head = chunk;
+  internal_mempool_free(chunk);
+}
+
+/*******************************************************************************
+ * \brief Internal routine for returning all unused memory to the system.
+ ******************************************************************************/
+void dbm_mempool_trim(void) {
+  assert(omp_get_num_threads() == 1);
+
+  for (int on_device = 0; on_device < 2; on_device++) {
+    for (int iclass = 0; iclass < DBM_MEMPOOL_NUM_CLASSES; iclass++) {
+      // Empty thread caches, which are quiet outside of parallel regions.
+      for (dbm_thread_cache_t *cache = mempool_thread_caches; cache != NULL;
+           cache = cache->next) {
+        if (cache->chunks[on_device][iclass] != NULL) {
+          delete_chunk(cache->chunks[on_device][iclass]);
+          cache->chunks[on_device][iclass] = NULL;
+        }
+      }
+      // Empty shared lists.
+      while (mempool_available[on_device][iclass] != NULL) {
+        dbm_memchunk_t *chunk = mempool_available[on_device][iclass];
+        mempool_available[on_device][iclass] = chunk->next;
+        delete_chunk(chunk);
+      }
+    }
   }
 }
 
@@ -185,23 +419,31 @@ void dbm_mempool_free(void *mem) {
  ******************************************************************************/
 void dbm_mempool_clear(void) {
   assert(omp_get_num_threads() == 1);
-  assert(mempool_allocated_head == NULL); // check for memory leak
-
-  // while (mempool_allocated_head != NULL) {
-  //  dbm_memchunk_t *chunk = mempool_allocated_head;
-  //  mempool_allocated_head = chunk->next;
-  //  printf("Found alloacted memory chunk of size: %lu\n", chunk->size);
-  //  actual_free(chunk->mem, chunk->on_device);
-  //  free(chunk);
-  //}
-
-  // Free chunks in mempool_avavailable.
-  while (mempool_available_head != NULL) {
-    dbm_memchunk_t *chunk = mempool_available_head;
-    mempool_available_head = chunk->next;
-    actual_free(chunk->mem, chunk->on_device);
-    free(chunk);
+  assert(mempool_nallocated == 0); // check for memory leak
+  dbm_mempool_trim();
+  for (int on_device = 0; on_device < 2; on_device++) {
+    assert(mempool_stats[on_device].size == 0);
+    mempool_stats[on_device].peak = 0;
   }
+
+  // Free the empty thread caches. Since the threadprivate pointers of other
+  // threads can not be reset from here, the new generation invalidates them.
+  while (mempool_thread_caches != NULL) {
+    dbm_thread_cache_t *cache = mempool_thread_caches;
+    mempool_thread_caches = cache->next;
+    free(cache);
+  }
+  mempool_generation++;
+  mempool_my_thread_cache = NULL;
+}
+
+/*******************************************************************************
+ * \brief Internal routine for querying the statistics of the memory pool.
+ ******************************************************************************/
+void dbm_mempool_statistics(const bool on_device, dbm_mempool_stats_t *stats) {
+#pragma omp critical(dbm_mempool_modify)
+#pragma omp critical(dbm_mempool_stats)
+  *stats = mempool_stats[on_device];
 }
 
 // EOF
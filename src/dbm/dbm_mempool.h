@@ -12,6 +12,19 @@ extern "C" {
 #endif
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*******************************************************************************
+ * \brief Internal struct for storing memory pool statistics.
+ ******************************************************************************/
+typedef struct {
+  int64_t nmallocs; // number of requests served by the pool
+  int64_t nmisses;  // number of requests that required new system memory
+  int64_t size;     // bytes of system memory currently held by the pool
+  int64_t in_use;   // bytes currently handed out to callers
+  int64_t peak;     // high-water mark of in_use
+} dbm_mempool_stats_t;
 
 /*******************************************************************************
  * \brief Internal routine for allocating host memory from the pool.
@@ -26,10 +39,20 @@ void *dbm_mempool_host_malloc(const size_t size);
 void *dbm_mempool_device_malloc(const size_t size);
 
 /*******************************************************************************
- * \brief Internal routine for releasing memory back to the pool.
+ * \brief Internal routine for releasing host memory back to the pool.
+ ******************************************************************************/
+void dbm_mempool_host_free(void *memory);
+
+/*******************************************************************************
+ * \brief Internal routine for releasing device memory back to the pool.
  * \author Ole Schuett
  ******************************************************************************/
-void dbm_mempool_free(void *memory);
+void dbm_mempool_device_free(void *memory);
+
+/*******************************************************************************
+ * \brief Internal routine for returning all unused memory to the system.
+ ******************************************************************************/
+void dbm_mempool_trim(void);
 
 /*******************************************************************************
  * \brief Internal routine for freeing all memory in the pool.
@@ -37,6 +60,11 @@ void dbm_mempool_free(void *memory);
  ******************************************************************************/
 void dbm_mempool_clear(void);
 
+/*******************************************************************************
+ * \brief Internal routine for querying the statistics of the memory pool.
+ ******************************************************************************/
+void dbm_mempool_statistics(const bool on_device, dbm_mempool_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -6,7 +6,9 @@
 /*----------------------------------------------------------------------------*/
 
 #include <assert.h>
+#include <math.h>
 #include <omp.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -17,9 +19,11 @@
 #endif
 
 #include "../offload/offload_library.h"
+#include "dbm_hyperparams.h"
 #include "dbm_library.h"
 #include "dbm_matrix.h"
 #include "dbm_mpi.h"
+#include "dbm_multiply_cpu.h"
 
 /*******************************************************************************
  * \brief Wrapper for printf, passed to dbm_library_print_stats.
@@ -37,12 +41,119 @@ static void print_func(char *message, int output_unit) {
  ******************************************************************************/
 static inline int imin(int x, int y) { return (x < y ? x : y); }
 
+/*******************************************************************************
+ * \brief Returns the larger of two given integer (missing from the C standard).
+ ******************************************************************************/
+static inline int imax(int x, int y) { return (x > y ? x : y); }
+
+/*******************************************************************************
+ * \brief Sparsity patterns of the generated matrices.
+ ******************************************************************************/
+typedef enum {
+  PATTERN_DENSE,  // all blocks are present
+  PATTERN_BANDED, // blocks within a distance of param from the diagonal
+  PATTERN_RANDOM, // diagonal plus further blocks with probability param
+  PATTERN_DECAY,  // values decay like exp(-distance / param) as in insulators
+} pattern_t;
+
+static const char *pattern_names[] = {"dense", "banded", "random", "decay"};
+
+// Decaying blocks are truncated once their values drop below this threshold.
+#define DECAY_CUTOFF 1e-10
+
+// Tolerated relative deviation of the checksum caused by filtering.
+#define SPARSE_CHECKSUM_TOLERANCE 1e-6
+
+/*******************************************************************************
+ * \brief Description of a benchmark on sparse matrices with mixed block sizes.
+ *        All three matrices are square with nblocks block rows and columns.
+ ******************************************************************************/
+typedef struct {
+  const char *name;
+  pattern_t pattern;
+  double param;
+  int nblocks;
+  int nsizes;
+  int sizes[4]; // block sizes, each block row picks one at random
+  double filter_eps;
+  int nrepetitions; // only the last is timed, mimicking the steady state of SCF
+  bool symmetric;   // all three matrices store only their upper triangle
+} sparse_benchmark_t;
+
+/*******************************************************************************
+ * \brief Timings of a multiplication, which are reduced across all ranks.
+ ******************************************************************************/
+typedef struct {
+  double duration;  // wall time of dbm_multiply
+  double comm_time; // maximum time a rank spent in MPI communication
+  double imbalance; // maximum over average of the ranks' computation time
+  int64_t flop;     // total of all ranks
+} multiply_stats_t;
+
+// Output file for machine-readable results, only used by rank 0.
+static FILE *json_file = NULL;
+static int json_nrecords = 0;
+
+// Whether multiplications may communicate in single precision.
+static bool mixed_precision = false;
+
+/*******************************************************************************
+ * \brief Returns a reproducible pseudo-random number in [0,1) for given key.
+ *        Based on the finalizer of SplitMix64.
+ ******************************************************************************/
+static double random_uniform(uint64_t key) {
+  key += 0x9E3779B97F4A7C15ull;
+  key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ull;
+  key = (key ^ (key >> 27)) * 0x94D049BB133111EBull;
+  key = key ^ (key >> 31);
+  return (key >> 11) * 0x1.0p-53;
+}
+
+/*******************************************************************************
+ * \brief Returns the periodic distance of given block from the diagonal.
+ ******************************************************************************/
+static int distance(const int n, const int row, const int col) {
+  const int d = abs(row - col);
+  return imin(d, n - d);
+}
+
+/*******************************************************************************
+ * \brief Returns true if given block is present in an n x n block pattern.
+ ******************************************************************************/
+static bool block_present(const pattern_t pattern, const double param,
+                          const int n, const int row, const int col) {
+  switch (pattern) {
+  case PATTERN_DENSE:
+    return true;
+  case PATTERN_BANDED:
+    return distance(n, row, col) <= param;
+  case PATTERN_RANDOM:
+    return row == col || random_uniform((uint64_t)row * n + col) < param;
+  case PATTERN_DECAY:
+    return exp(-distance(n, row, col) / param) >= DECAY_CUTOFF;
+  }
+  return false;
+}
+
+/*******************************************************************************
+ * \brief Returns the value of all elements of given block.
+ ******************************************************************************/
+static double block_value(const pattern_t pattern, const double param,
+                          const int n, const int row, const int col) {
+  if (pattern == PATTERN_DECAY) {
+    return exp(-distance(n, row, col) / param);
+  }
+  return 1.0;
+}
+
 /*******************************************************************************
  * \brief Private routine for creating a distribution and an empty matrix.
  * \author Ole Schuett
  ******************************************************************************/
 static dbm_matrix_t *create_some_matrix(const int nrows, const int ncols,
-                                        const int row_size, const int col_size,
+                                        const int row_sizes[nrows],
+                                        const int col_sizes[ncols],
+                                        const bool symmetric,
                                         const dbm_mpi_comm_t comm) {
   int cart_dims[2], cart_periods[2], cart_coords[2];
   dbm_mpi_cart_get(comm, 2, cart_dims, cart_periods, cart_coords);
@@ -63,27 +174,23 @@ static dbm_matrix_t *create_some_matrix(const int nrows, const int ncols,
   free(col_dist);
 
   // Create matrix.
-  int *row_sizes = malloc(nrows * sizeof(int));
-  int *col_sizes = malloc(ncols * sizeof(int));
-  for (int i = 0; i < nrows; i++) {
-    row_sizes[i] = row_size;
-  }
-  for (int i = 0; i < ncols; i++) {
-    col_sizes[i] = col_size;
-  }
   dbm_matrix_t *matrix = NULL;
-  dbm_create(&matrix, dist, "some name", nrows, ncols, row_sizes, col_sizes);
+  if (symmetric) {
+    assert(nrows == ncols);
+    dbm_create_symmetric(&matrix, dist, "some name", nrows, row_sizes);
+  } else {
+    dbm_create(&matrix, dist, "some name", nrows, ncols, row_sizes, col_sizes);
+  }
   dbm_distribution_release(dist);
-  free(row_sizes);
-  free(col_sizes);
   return matrix;
 }
 
 /*******************************************************************************
- * \brief Private routine for reserving all blocks of the given matrix.
+ * \brief Private routine for reserving the blocks of given pattern.
  * \author Ole Schuett
  ******************************************************************************/
-static void reserve_all_blocks(dbm_matrix_t *matrix) {
+static void reserve_blocks(dbm_matrix_t *matrix, const pattern_t pattern,
+                           const double param) {
   int nrows, ncols;
   const int *row_sizes, *col_sizes;
   dbm_get_row_sizes(matrix, &nrows, &row_sizes);
@@ -95,8 +202,10 @@ static void reserve_all_blocks(dbm_matrix_t *matrix) {
 #pragma omp for collapse(2)
     for (int row = 0; row < nrows; row++) {
       for (int col = 0; col < ncols; col++) {
-        if (dbm_get_stored_coordinates(matrix, row, col) ==
-            matrix->dist->my_rank) {
+        if ((!dbm_is_symmetric(matrix) || row <= col) &&
+            dbm_get_stored_coordinates(matrix, row, col) ==
+                matrix->dist->my_rank &&
+            block_present(pattern, param, nrows, row, col)) {
           ++nblocks;
         }
       }
@@ -107,8 +216,10 @@ static void reserve_all_blocks(dbm_matrix_t *matrix) {
 #pragma omp for collapse(2)
     for (int row = 0; row < nrows; row++) {
       for (int col = 0; col < ncols; col++) {
-        if (dbm_get_stored_coordinates(matrix, row, col) ==
-            matrix->dist->my_rank) {
+        if ((!dbm_is_symmetric(matrix) || row <= col) &&
+            dbm_get_stored_coordinates(matrix, row, col) ==
+                matrix->dist->my_rank &&
+            block_present(pattern, param, nrows, row, col)) {
           reserve_row[iblock] = row;
           reserve_col[iblock] = col;
           iblock++;
@@ -123,10 +234,15 @@ static void reserve_all_blocks(dbm_matrix_t *matrix) {
 }
 
 /*******************************************************************************
- * \brief Private routine for setting all blocks to 1.0.
+ * \brief Private routine for setting all blocks to the values of given pattern.
  * \author Ole Schuett
  ******************************************************************************/
-static void set_all_blocks(dbm_matrix_t *matrix) {
+static void set_blocks(dbm_matrix_t *matrix, const pattern_t pattern,
+                       const double param) {
+  int nrows;
+  const int *row_sizes;
+  dbm_get_row_sizes(matrix, &nrows, &row_sizes);
+
 #pragma omp parallel
   {
     dbm_iterator_t *iter = NULL;
@@ -135,33 +251,122 @@ static void set_all_blocks(dbm_matrix_t *matrix) {
       int row, col, row_size, col_size;
       double *block;
       dbm_iterator_next_block(iter, &row, &col, &block, &row_size, &col_size);
+      const double value = block_value(pattern, param, nrows, row, col);
       const int block_size = row_size * col_size;
       for (int i = 0; i < block_size; i++) {
-        block[i] = 1.0;
+        block[i] = value;
       }
     }
     dbm_iterator_stop(iter);
   }
 }
+
 /*******************************************************************************
- * \brief Run a benchmark of dbm_multiply with given block sizes.
+ * \brief Private routine for running dbm_multiply and gathering its timings.
  * \author Ole Schuett
  ******************************************************************************/
-void benchmark_multiply(const int M, const int N, const int K, const int m,
-                        const int n, const int k, const dbm_mpi_comm_t comm) {
-  dbm_matrix_t *matrix_a = create_some_matrix(M, K, m, k, comm);
-  dbm_matrix_t *matrix_b = create_some_matrix(K, N, k, n, comm);
-  dbm_matrix_t *matrix_c = create_some_matrix(M, N, m, n, comm);
-  reserve_all_blocks(matrix_a);
-  reserve_all_blocks(matrix_b);
-  set_all_blocks(matrix_a);
-  set_all_blocks(matrix_b);
-
-  int64_t flop = 0;
+static multiply_stats_t run_multiply(const dbm_matrix_t *matrix_a,
+                                     const dbm_matrix_t *matrix_b,
+                                     dbm_matrix_t *matrix_c,
+                                     const double filter_eps,
+                                     const dbm_mpi_comm_t comm) {
+  multiply_stats_t stats;
+  const double comm_time_start = dbm_library_comm_time();
   const double time_start_multiply = omp_get_wtime();
   dbm_multiply(false, false, 1.0, matrix_a, matrix_b, 1.0, matrix_c, false,
-               1e-8, &flop);
+               filter_eps, mixed_precision, &stats.flop);
   const double time_end_multiply = omp_get_wtime();
+  const double comm_time = dbm_library_comm_time() - comm_time_start;
+  dbm_mpi_sum_int64(&stats.flop, 1, comm);
+
+  // Time spent outside of communication reveals the load imbalance, because
+  // waiting for slower ranks is attributed to communication.
+  double times[3] = {time_end_multiply - time_start_multiply, comm_time,
+                     time_end_multiply - time_start_multiply - comm_time};
+  double compute_sum = times[2];
+  dbm_mpi_max_double(times, 3, comm);
+  dbm_mpi_sum_double(&compute_sum, 1, comm);
+  const double compute_avg = compute_sum / dbm_mpi_comm_size(comm);
+  stats.duration = times[0];
+  stats.comm_time = times[1];
+  stats.imbalance = (compute_avg > 0.0) ? times[2] / compute_avg : 1.0;
+  return stats;
+}
+
+/*******************************************************************************
+ * \brief Private routine for printing the timings of a multiplication.
+ ******************************************************************************/
+static void print_stats(const multiply_stats_t *stats) {
+  printf("%6.3f s =>  %6.1f GFLOP/s  comm: %4.1f%%  imbalance: %4.2f\n",
+         stats->duration, 1e-9 * stats->flop / stats->duration,
+         100.0 * stats->comm_time / stats->duration, stats->imbalance);
+  fflush(stdout);
+}
+
+/*******************************************************************************
+ * \brief Private routine for writing the results of a benchmark as JSON.
+ ******************************************************************************/
+static void write_json(const char *name, const char *pattern, const int M,
+                       const int N, const int K, const int nsizes,
+                       const int sizes[nsizes], const double filter_eps,
+                       const double occupation, const double checksum_error,
+                       const multiply_stats_t *stats,
+                       const dbm_mpi_comm_t comm) {
+  if (json_file == NULL) {
+    return;
+  }
+  fprintf(json_file, "%s  {\"name\": \"%s\", \"pattern\": \"%s\", ",
+          (json_nrecords++ == 0) ? "" : ",\n", name, pattern);
+  fprintf(json_file, "\"M\": %i, \"N\": %i, \"K\": %i, \"block_sizes\": [", M,
+          N, K);
+  for (int i = 0; i < nsizes; i++) {
+    fprintf(json_file, "%s%i", (i == 0) ? "" : ", ", sizes[i]);
+  }
+  fprintf(json_file, "], \"filter_eps\": %g, \"occupation\": %g, ",
+          filter_eps, occupation);
+  fprintf(json_file, "\"ranks\": %i, \"threads\": %i, ",
+          dbm_mpi_comm_size(comm), omp_get_max_threads());
+  fprintf(json_file,
+          "\"seconds\": %g, \"gflops\": %g, \"comm_seconds\": %g, "
+          "\"imbalance\": %g, \"checksum_error\": %g}",
+          stats->duration, 1e-9 * stats->flop / stats->duration,
+          stats->comm_time, stats->imbalance, checksum_error);
+  fflush(json_file);
+}
+
+/*******************************************************************************
+ * \brief Run a benchmark of dbm_multiply with given block sizes.
+ ******************************************************************************/
+void benchmark_multiply(const int M, const int N, const int K, const int m,
+                        const int n, const int k, const dbm_mpi_comm_t comm) {
+  int *sizes_m = malloc(M * sizeof(int));
+  int *sizes_n = malloc(N * sizeof(int));
+  int *sizes_k = malloc(K * sizeof(int));
+  for (int i = 0; i < M; i++) {
+    sizes_m[i] = m;
+  }
+  for (int i = 0; i < N; i++) {
+    sizes_n[i] = n;
+  }
+  for (int i = 0; i < K; i++) {
+    sizes_k[i] = k;
+  }
+  dbm_matrix_t *matrix_a =
+      create_some_matrix(M, K, sizes_m, sizes_k, false, comm);
+  dbm_matrix_t *matrix_b =
+      create_some_matrix(K, N, sizes_k, sizes_n, false, comm);
+  dbm_matrix_t *matrix_c =
+      create_some_matrix(M, N, sizes_m, sizes_n, false, comm);
+  free(sizes_m);
+  free(sizes_n);
+  free(sizes_k);
+  reserve_blocks(matrix_a, PATTERN_DENSE, 0.0);
+  reserve_blocks(matrix_b, PATTERN_DENSE, 0.0);
+  set_blocks(matrix_a, PATTERN_DENSE, 0.0);
+  set_blocks(matrix_b, PATTERN_DENSE, 0.0);
+
+  const multiply_stats_t stats =
+      run_multiply(matrix_a, matrix_b, matrix_c, 1e-8, comm);
 
   // Validate checksum.
   // Since all matrix elements were set to 1.0 the checksum is an integer.
@@ -177,11 +382,133 @@ void benchmark_multiply(const int M, const int N, const int K, const int m,
     printf("%5i x %5i x %5i  with  %3i x %3i x %3i blocks: ", M, N, K, m, n, k);
   }
   if (checksum == expected) {
-    dbm_mpi_sum_int64(&flop, 1, comm);
     if (dbm_mpi_comm_rank(comm) == 0) {
-      const double duration = time_end_multiply - time_start_multiply;
-      printf("%6.3f s =>  %6.1f GFLOP/s\n", duration, 1e-9 * flop / duration);
-      fflush(stdout);
+      print_stats(&stats);
+      const int sizes[3] = {m, n, k};
+      write_json("dense", pattern_names[PATTERN_DENSE], M, N, K, 3, sizes,
+                 1e-8, 1.0, 0.0, &stats, comm);
+    }
+  } else {
+    printf("ERROR\n");
+    fprintf(stderr, "Expected checksum %f but got %f.\n", expected, checksum);
+    exit(1);
+  }
+}
+
+/*******************************************************************************
+ * \brief Private routine for computing the checksum of the product C = A * B
+ *        on the level of blocks, ignoring any filtering.
+ ******************************************************************************/
+static double reference_checksum(const pattern_t pattern, const double param,
+                                 const int n, const int sizes[n]) {
+  // Collect the columns of all rows.
+  int *row_start = malloc((n + 1) * sizeof(int));
+  row_start[0] = 0;
+  for (int row = 0; row < n; row++) {
+    row_start[row + 1] = row_start[row];
+    for (int col = 0; col < n; col++) {
+      row_start[row + 1] += block_present(pattern, param, n, row, col);
+    }
+  }
+  int *cols = malloc(row_start[n] * sizeof(int));
+  double *values = malloc(row_start[n] * sizeof(double));
+  for (int row = 0; row < n; row++) {
+    int i = row_start[row];
+    for (int col = 0; col < n; col++) {
+      if (block_present(pattern, param, n, row, col)) {
+        cols[i] = col;
+        values[i] = block_value(pattern, param, n, row, col);
+        i++;
+      }
+    }
+  }
+
+  // All elements of a block of C share the same value.
+  double checksum = 0.0;
+  double *c_row = calloc(n, sizeof(double));
+  for (int row = 0; row < n; row++) {
+    for (int i = row_start[row]; i < row_start[row + 1]; i++) {
+      const int k = cols[i];
+      const double a = values[i] * sizes[k];
+      for (int j = row_start[k]; j < row_start[k + 1]; j++) {
+        c_row[cols[j]] += a * values[j];
+      }
+    }
+    for (int col = 0; col < n; col++) {
+      checksum += sizes[row] * sizes[col] * c_row[col] * c_row[col];
+      c_row[col] = 0.0;
+    }
+  }
+
+  free(c_row);
+  free(row_start);
+  free(cols);
+  free(values);
+  return checksum;
+}
+
+/*******************************************************************************
+ * \brief Private routine for choosing the block sizes of a sparse benchmark.
+ *        Each block row picks a random size, mimicking a mix of atom kinds.
+ ******************************************************************************/
+static int *random_block_sizes(const sparse_benchmark_t *bench) {
+  int *sizes = malloc(bench->nblocks * sizeof(int));
+  for (int i = 0; i < bench->nblocks; i++) {
+    const double r = random_uniform(~(uint64_t)i);
+    sizes[i] = bench->sizes[(int)(r * bench->nsizes)];
+  }
+  return sizes; // Ownership of sizes transfers to caller.
+}
+
+/*******************************************************************************
+ * \brief Run a benchmark of dbm_multiply with given sparsity and block sizes.
+ ******************************************************************************/
+void benchmark_sparse(const sparse_benchmark_t *bench,
+                      const dbm_mpi_comm_t comm) {
+  const int n = bench->nblocks;
+  int *sizes = random_block_sizes(bench);
+
+  const bool symm = bench->symmetric;
+  dbm_matrix_t *matrix_a = create_some_matrix(n, n, sizes, sizes, symm, comm);
+  dbm_matrix_t *matrix_b = create_some_matrix(n, n, sizes, sizes, symm, comm);
+  dbm_matrix_t *matrix_c = create_some_matrix(n, n, sizes, sizes, symm, comm);
+  reserve_blocks(matrix_a, bench->pattern, bench->param);
+  reserve_blocks(matrix_b, bench->pattern, bench->param);
+  set_blocks(matrix_a, bench->pattern, bench->param);
+  set_blocks(matrix_b, bench->pattern, bench->param);
+
+  multiply_stats_t stats;
+  for (int irep = 0; irep < bench->nrepetitions; irep++) {
+    dbm_clear(matrix_c);
+    stats = run_multiply(matrix_a, matrix_b, matrix_c, bench->filter_eps, comm);
+  }
+
+  // Validate checksum, which deviates from the reference due to filtering.
+  const double expected =
+      reference_checksum(bench->pattern, bench->param, n, sizes);
+  const double checksum = dbm_checksum(matrix_c);
+  const double error = fabs(checksum - expected) / expected;
+  int64_t nblocks[2] = {dbm_get_num_blocks(matrix_a),
+                        dbm_get_num_blocks(matrix_c)};
+  dbm_mpi_sum_int64(nblocks, 2, comm);
+  const double occupation_a = (double)nblocks[0] / ((double)n * n);
+  const double occupation_c = (double)nblocks[1] / ((double)n * n);
+
+  dbm_release(matrix_a);
+  dbm_release(matrix_b);
+  dbm_release(matrix_c);
+  free(sizes);
+
+  if (dbm_mpi_comm_rank(comm) == 0) {
+    printf("%-9s %5i blocks  %5.1f%% -> %5.1f%% occupied: ", bench->name, n,
+           100.0 * occupation_a, 100.0 * occupation_c);
+  }
+  if (error <= SPARSE_CHECKSUM_TOLERANCE) {
+    if (dbm_mpi_comm_rank(comm) == 0) {
+      print_stats(&stats);
+      write_json(bench->name, pattern_names[bench->pattern], n, n, n,
+                 bench->nsizes, bench->sizes, bench->filter_eps, occupation_c,
+                 error, &stats, comm);
     }
   } else {
     printf("ERROR\n");
@@ -190,6 +517,256 @@ void benchmark_multiply(const int M, const int N, const int K, const int m,
   }
 }
 
+/*******************************************************************************
+ * \brief Run a benchmark of building a matrix from per-thread lists of blocks,
+ *        as done by loops over neighbor lists. Compares one dbm_put_block call
+ *        per block with a single dbm_put_blocks call per thread.
+ ******************************************************************************/
+void benchmark_put_blocks(const sparse_benchmark_t *bench,
+                          const dbm_mpi_comm_t comm) {
+  const int n = bench->nblocks;
+  int *sizes = random_block_sizes(bench);
+  dbm_matrix_t *matrices[2];
+  double durations[2];
+
+  for (int imode = 0; imode < 2; imode++) {
+    dbm_matrix_t *matrix =
+        create_some_matrix(n, n, sizes, sizes, bench->symmetric, comm);
+    double time_start = 0.0;
+#pragma omp parallel
+    {
+      // Each thread collects the local blocks of every nthreads-th row.
+      // Symmetric matrices are given their lower triangle, which gets stored
+      // transposed.
+      const int ithread = omp_get_thread_num();
+      const int nthreads = omp_get_num_threads();
+      int nblocks = 0, ndata = 0;
+      for (int row = ithread; row < n; row += nthreads) {
+        for (int col = 0; col < n; col++) {
+          if ((!bench->symmetric || row >= col) &&
+              dbm_get_stored_coordinates(matrix, row, col) ==
+                  matrix->dist->my_rank &&
+              block_present(bench->pattern, bench->param, n, row, col)) {
+            nblocks++;
+            ndata += sizes[row] * sizes[col];
+          }
+        }
+      }
+      int *rows = malloc(nblocks * sizeof(int));
+      int *cols = malloc(nblocks * sizeof(int));
+      double *data = malloc(ndata * sizeof(double));
+      int iblock = 0, offset = 0;
+      for (int row = ithread; row < n; row += nthreads) {
+        for (int col = 0; col < n; col++) {
+          if ((!bench->symmetric || row >= col) &&
+              dbm_get_stored_coordinates(matrix, row, col) ==
+                  matrix->dist->my_rank &&
+              block_present(bench->pattern, bench->param, n, row, col)) {
+            rows[iblock] = row;
+            cols[iblock] = col;
+            const int block_size = sizes[row] * sizes[col];
+            const double value = block_value(bench->pattern, bench->param, n,
+                                             row, col);
+            for (int i = 0; i < block_size; i++) {
+              data[offset + i] = value;
+            }
+            iblock++;
+            offset += block_size;
+          }
+        }
+      }
+
+#pragma omp barrier
+#pragma omp master
+      time_start = omp_get_wtime();
+      if (imode == 0) {
+        offset = 0;
+        for (int i = 0; i < nblocks; i++) {
+          dbm_put_block(matrix, rows[i], cols[i], false, &data[offset]);
+          offset += sizes[rows[i]] * sizes[cols[i]];
+        }
+      } else {
+        dbm_put_blocks(matrix, nblocks, rows, cols, data, false);
+      }
+#pragma omp barrier
+#pragma omp master
+      durations[imode] = omp_get_wtime() - time_start;
+
+      free(rows);
+      free(cols);
+      free(data);
+    } // end of omp parallel region
+    matrices[imode] = matrix;
+  }
+  dbm_mpi_max_double(durations, 2, comm);
+
+  // Both matrices should be equal up to the summation order of the checksum.
+  const double checksums[2] = {dbm_checksum(matrices[0]),
+                               dbm_checksum(matrices[1])};
+  dbm_release(matrices[0]);
+  dbm_release(matrices[1]);
+  free(sizes);
+
+  if (fabs(checksums[0] - checksums[1]) <= 1e-12 * fabs(checksums[0])) {
+    if (dbm_mpi_comm_rank(comm) == 0) {
+      printf("%-9s %5i blocks  put_block: %6.3f s  put_blocks: %6.3f s\n",
+             bench->name, n, durations[0], durations[1]);
+      fflush(stdout);
+    }
+  } else {
+    printf("ERROR\n");
+    fprintf(stderr, "Expected checksum %f but got %f.\n", checksums[0],
+            checksums[1]);
+    exit(1);
+  }
+}
+
+/*******************************************************************************
+ * \brief Private routine for multiplying C = A * B into a new matrix C.
+ ******************************************************************************/
+static dbm_matrix_t *multiply_new(const dbm_matrix_t *matrix_a,
+                                  const dbm_matrix_t *matrix_b, const int n,
+                                  const int sizes[n],
+                                  const dbm_mpi_comm_t comm) {
+  dbm_matrix_t *matrix_c = create_some_matrix(n, n, sizes, sizes, false, comm);
+  int64_t flop;
+  dbm_multiply(false, false, 1.0, matrix_a, matrix_b, 1.0, matrix_c, false,
+               0.0, false, &flop);
+  return matrix_c; // Ownership of matrix_c transfers to caller.
+}
+
+/*******************************************************************************
+ * \brief Test that cached communication plans give the same result as fresh
+ *        ones when an operand recurs with different partners. This runs
+ *        A1 * B1, A1 * B2, A1 * B1 and compares the last product against one
+ *        computed without the cache. The balanced tick mapping depends on both
+ *        operands, hence load balancing is enabled as well.
+ ******************************************************************************/
+void test_plan_cache(const dbm_mpi_comm_t comm) {
+  const sparse_benchmark_t bench = {
+      "plans", PATTERN_BANDED, 8.0, 400, 4, {5, 13, 23, 31}, 0.0, 1, false};
+  const int n = bench.nblocks;
+  int *sizes = random_block_sizes(&bench);
+  dbm_matrix_t *matrix_a1 = create_some_matrix(n, n, sizes, sizes, false, comm);
+  dbm_matrix_t *matrix_b1 = create_some_matrix(n, n, sizes, sizes, false, comm);
+  dbm_matrix_t *matrix_b2 = create_some_matrix(n, n, sizes, sizes, false, comm);
+  reserve_blocks(matrix_a1, PATTERN_BANDED, 8.0);
+  reserve_blocks(matrix_b1, PATTERN_DECAY, 2.0);
+  reserve_blocks(matrix_b2, PATTERN_RANDOM, 0.05);
+  set_blocks(matrix_a1, PATTERN_BANDED, 8.0);
+  set_blocks(matrix_b1, PATTERN_DECAY, 2.0);
+  set_blocks(matrix_b2, PATTERN_RANDOM, 0.05);
+
+  const dbm_library_config_t saved_config = *dbm_library_get_config();
+  dbm_library_config_t config = saved_config;
+  config.load_balance = true;
+  config.plan_cache = true;
+  dbm_library_set_config(&config);
+  dbm_release(multiply_new(matrix_a1, matrix_b1, n, sizes, comm));
+  dbm_release(multiply_new(matrix_a1, matrix_b2, n, sizes, comm));
+  dbm_matrix_t *matrix_cached =
+      multiply_new(matrix_a1, matrix_b1, n, sizes, comm);
+
+  config.plan_cache = false;
+  dbm_library_set_config(&config);
+  dbm_matrix_t *matrix_fresh =
+      multiply_new(matrix_a1, matrix_b1, n, sizes, comm);
+  dbm_library_set_config(&saved_config);
+
+  const double checksums[2] = {dbm_checksum(matrix_fresh),
+                               dbm_checksum(matrix_cached)};
+  dbm_release(matrix_a1);
+  dbm_release(matrix_b1);
+  dbm_release(matrix_b2);
+  dbm_release(matrix_cached);
+  dbm_release(matrix_fresh);
+  free(sizes);
+
+  if (fabs(checksums[0] - checksums[1]) <= 1e-12 * fabs(checksums[0])) {
+    if (dbm_mpi_comm_rank(comm) == 0) {
+      printf("%-9s %5i blocks  cached plans match fresh plans\n", bench.name,
+             n);
+      fflush(stdout);
+    }
+  } else {
+    printf("ERROR\n");
+    fprintf(stderr, "Expected checksum %f but got %f.\n", checksums[0],
+            checksums[1]);
+    exit(1);
+  }
+}
+
+/*******************************************************************************
+ * \brief Run a microbenchmark of the CPU backend's execution modes.
+ *        A batch of tasks with given block sizes and random operands is
+ *        executed per-task, bucketed, and stacked on the calling thread.
+ ******************************************************************************/
+void benchmark_cpu_modes(const int m, const int n, const int k) {
+  // Use about 1 MiB per operand, which resembles the working set of a batch.
+  const int max_block_size = imax(m * k, imax(n * k, m * n));
+  const int nblocks = imax(1, (1 << 17) / imax(1, max_block_size));
+
+  // Create packs with some data.
+  dbm_pack_t pack_a = {.nblocks = 0, .data_size = nblocks * m * k};
+  dbm_pack_t pack_b = {.nblocks = 0, .data_size = nblocks * n * k};
+  pack_a.data = malloc(pack_a.data_size * sizeof(double));
+  pack_b.data = malloc(pack_b.data_size * sizeof(double));
+  for (int i = 0; i < pack_a.data_size; i++) {
+    pack_a.data[i] = 1.0 / (1 + i % 7);
+  }
+  for (int i = 0; i < pack_b.data_size; i++) {
+    pack_b.data[i] = 1.0 / (1 + i % 5);
+  }
+
+  // Create shard for result blocks.
+  dbm_shard_t shard_c;
+  dbm_shard_init(&shard_c);
+  for (int i = 0; i < nblocks; i++) {
+    dbm_shard_promise_new_block(&shard_c, i, 0, m * n);
+  }
+  dbm_shard_allocate_promised_blocks(&shard_c);
+
+  // Create batch of tasks with random operands.
+  const int ntasks = MAX_BATCH_SIZE;
+  dbm_task_t *batch = malloc(ntasks * sizeof(dbm_task_t));
+  unsigned int seed = 42;
+  for (int itask = 0; itask < ntasks; itask++) {
+    batch[itask].m = m;
+    batch[itask].n = n;
+    batch[itask].k = k;
+    batch[itask].offset_a = (rand_r(&seed) % nblocks) * m * k;
+    batch[itask].offset_b = (rand_r(&seed) % nblocks) * n * k;
+    const int iblock_c = rand_r(&seed) % nblocks;
+    batch[itask].offset_c = shard_c.blocks[iblock_c].offset;
+  }
+
+  // Run each mode for roughly the same number of flops.
+  const int64_t flop_per_batch = 2 * (int64_t)m * n * k * ntasks;
+  const int nrepetitions = imax(1, (int)(2e8 / flop_per_batch));
+  const dbm_cpu_mode_t modes[3] = {DBM_CPU_PER_TASK, DBM_CPU_BUCKETED,
+                                   DBM_CPU_STACKED};
+  double gflops[3];
+  for (int imode = 0; imode < 3; imode++) {
+    const double time_start = omp_get_wtime();
+    for (int irep = 0; irep < nrepetitions; irep++) {
+      dbm_multiply_cpu_execute_batch(modes[imode], ntasks, batch, 1.0, &pack_a,
+                                     &pack_b, &shard_c);
+    }
+    const double duration = omp_get_wtime() - time_start;
+    gflops[imode] = 1e-9 * flop_per_batch * nrepetitions / duration;
+  }
+
+  printf("%5i x %5i x %5i  CPU per-task: %6.1f  bucketed: %6.1f  "
+         "stacked: %6.1f GFLOP/s\n",
+         m, n, k, gflops[0], gflops[1], gflops[2]);
+  fflush(stdout);
+
+  free(batch);
+  dbm_shard_release(&shard_c);
+  free(pack_a.data);
+  free(pack_b.data);
+}
+
 /*******************************************************************************
  * \brief Stand-alone miniapp for smoke-testing and benchmarking dbm_multiply.
  * \author Ole Schuett
@@ -231,6 +808,63 @@ int main(int argc, char *argv[]) {
     fflush(stdout);
   }
 
+  // Parse options, e.g. --json=results.json, --autotune, or --layers=2
+  const char *profile_filename = NULL, *trace_filename = NULL;
+  while (1 < argc && strncmp(argv[1], "--", 2) == 0) {
+    if (strncmp(argv[1], "--json=", 7) == 0) {
+      if (my_rank == 0) {
+        json_file = fopen(argv[1] + 7, "w");
+        if (json_file == NULL) {
+          fprintf(stderr, "ERROR: could not open %s\n", argv[1] + 7);
+          abort();
+        }
+        fprintf(json_file, "[\n");
+      }
+    } else if (strcmp(argv[1], "--mixed-precision") == 0) {
+      mixed_precision = true;
+    } else if (strcmp(argv[1], "--pack-compression") == 0) {
+      dbm_library_config_t config = *dbm_library_get_config();
+      config.pack_compression = true;
+      dbm_library_set_config(&config);
+    } else if (strcmp(argv[1], "--autotune") == 0) {
+      dbm_library_config_t config = *dbm_library_get_config();
+      config.autotune = true;
+      dbm_library_set_config(&config);
+    } else if (strcmp(argv[1], "--load-balance") == 0) {
+      dbm_library_config_t config = *dbm_library_get_config();
+      config.load_balance = true;
+      dbm_library_set_config(&config);
+    } else if (strcmp(argv[1], "--shared-memory") == 0) {
+      dbm_library_config_t config = *dbm_library_get_config();
+      config.shared_memory = true;
+      dbm_library_set_config(&config);
+    } else if (strcmp(argv[1], "--no-plan-cache") == 0) {
+      dbm_library_config_t config = *dbm_library_get_config();
+      config.plan_cache = false;
+      dbm_library_set_config(&config);
+    } else if (strncmp(argv[1], "--layers=", 9) == 0) {
+      dbm_library_config_t config = *dbm_library_get_config();
+      config.replication_layers = atoi(argv[1] + 9);
+      dbm_library_set_config(&config);
+    } else if (strncmp(argv[1], "--profile=", 10) == 0 ||
+               strncmp(argv[1], "--trace=", 8) == 0) {
+      if (argv[1][2] == 'p') {
+        profile_filename = argv[1] + 10;
+      } else {
+        trace_filename = argv[1] + 8;
+      }
+      dbm_library_config_t config = *dbm_library_get_config();
+      config.profile = true;
+      dbm_library_set_config(&config);
+    } else {
+      fprintf(stderr, "ERROR: unknown option %s\n", argv[1]);
+      abort();
+    }
+    argv[1] = argv[0];
+    argv++;
+    argc--;
+  }
+
   if (1 >= argc) {
     benchmark_multiply(16384, 128, 128, 4, 4, 4, comm);
     benchmark_multiply(128, 16384, 128, 4, 4, 4, comm);
@@ -254,6 +888,36 @@ int main(int argc, char *argv[]) {
     benchmark_multiply(350, 350, 350, 23, 23, 23, comm);
     benchmark_multiply(250, 250, 250, 32, 32, 32, comm);
     benchmark_multiply(60, 60, 60, 128, 128, 128, comm);
+    if (my_rank == 0)
+      printf("\n");
+
+    // Block sizes 5, 13, 23, and 31 correspond to DZVP and TZV2P basis sets.
+    const sparse_benchmark_t sparse_benchmarks[] = {
+        {"banded", PATTERN_BANDED, 8.0, 2000, 4, {5, 13, 23, 31}, 1e-8, 1,
+         false},
+        {"random", PATTERN_RANDOM, 0.01, 2000, 4, {5, 13, 23, 31}, 1e-8, 1,
+         false},
+        {"decay-1e8", PATTERN_DECAY, 2.0, 1000, 4, {5, 13, 23, 31}, 1e-8, 1,
+         false},
+        {"decay-1e6", PATTERN_DECAY, 2.0, 1000, 4, {5, 13, 23, 31}, 1e-6, 1,
+         false},
+        {"recur", PATTERN_BANDED, 8.0, 400, 4, {5, 13, 23, 31}, 1e-8, 10,
+         false},
+        {"symm", PATTERN_BANDED, 8.0, 2000, 4, {5, 13, 23, 31}, 1e-8, 1, true},
+    };
+    for (int i = 0; i < 6; i++) {
+      benchmark_sparse(&sparse_benchmarks[i], comm);
+    }
+    benchmark_put_blocks(&sparse_benchmarks[0], comm);
+    benchmark_put_blocks(&sparse_benchmarks[5], comm);
+    test_plan_cache(comm);
+    if (my_rank == 0) {
+      printf("\n");
+      benchmark_cpu_modes(4, 4, 4);
+      benchmark_cpu_modes(5, 13, 23);
+      benchmark_cpu_modes(23, 23, 23);
+      benchmark_cpu_modes(32, 32, 32);
+    }
   } else { /* read triplet(s) from file or one triplet from command line */
     FILE *const file = fopen(argv[1], "r"); /* try 1st arg as filename */
     char buffer[1024];
@@ -279,8 +943,13 @@ int main(int argc, char *argv[]) {
         } else { /* default */
           nm = nn = nk = 128;
         }
-        benchmark_multiply(nm, nn, nk, mnk[0], 0 < mnk[1] ? mnk[1] : mnk[0],
-                           0 < mnk[2] ? mnk[2] : mnk[0], comm);
+        const int m = mnk[0];
+        const int n = 0 < mnk[1] ? mnk[1] : mnk[0];
+        const int k = 0 < mnk[2] ? mnk[2] : mnk[0];
+        benchmark_multiply(nm, nn, nk, m, n, k, comm);
+        if (my_rank == 0) {
+          benchmark_cpu_modes(m, n, k);
+        }
         mnk[0] = mnk[1] = mnk[2] = 0;
       } else {
         fprintf(stderr, "ERROR: invalid argument(s)\n");
@@ -293,8 +962,19 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  if (json_file != NULL) {
+    fprintf(json_file, "\n]\n");
+    fclose(json_file);
+  }
+
   if (EXIT_SUCCESS == result) {
     dbm_library_print_stats(dbm_mpi_comm_c2f(comm), &print_func, my_rank);
+    if (profile_filename != NULL) {
+      dbm_library_write_profile(dbm_mpi_comm_c2f(comm), profile_filename);
+    }
+    if (trace_filename != NULL) {
+      dbm_library_write_trace(dbm_mpi_comm_c2f(comm), trace_filename);
+    }
   }
   dbm_library_finalize();
   dbm_mpi_comm_free(&comm);
@@ -379,6 +379,201 @@ int dbm_mpi_sendrecv_double(const double *sendbuf, const int sendcount,
 #endif
 }
 
+/*******************************************************************************
+ * \brief Wrapper around MPI_Isend for datatype MPI_BYTE.
+ ******************************************************************************/
+dbm_mpi_request_t dbm_mpi_isend_byte(const void *sendbuf, const int sendcount,
+                                     const int dest, const int sendtag,
+                                     const dbm_mpi_comm_t comm) {
+#if defined(__parallel)
+  dbm_mpi_request_t request;
+  CHECK(MPI_Isend(sendbuf, sendcount, MPI_BYTE, dest, sendtag, comm, &request));
+  return request;
+#else
+  (void)sendbuf; // mark used
+  (void)sendcount;
+  (void)dest;
+  (void)sendtag;
+  (void)comm;
+  fprintf(stderr, "Error: dbm_mpi_isend_byte not available without MPI\n");
+  abort();
+#endif
+}
+
+/*******************************************************************************
+ * \brief Wrapper around MPI_Isend for datatype MPI_DOUBLE.
+ ******************************************************************************/
+dbm_mpi_request_t dbm_mpi_isend_double(const double *sendbuf,
+                                       const int sendcount, const int dest,
+                                       const int sendtag,
+                                       const dbm_mpi_comm_t comm) {
+#if defined(__parallel)
+  dbm_mpi_request_t request;
+  CHECK(
+      MPI_Isend(sendbuf, sendcount, MPI_DOUBLE, dest, sendtag, comm, &request));
+  return request;
+#else
+  (void)sendbuf; // mark used
+  (void)sendcount;
+  (void)dest;
+  (void)sendtag;
+  (void)comm;
+  fprintf(stderr, "Error: dbm_mpi_isend_double not available without MPI\n");
+  abort();
+#endif
+}
+
+/*******************************************************************************
+ * \brief Wrapper around MPI_Isend for datatype MPI_FLOAT.
+ ******************************************************************************/
+dbm_mpi_request_t dbm_mpi_isend_float(const float *sendbuf, const int sendcount,
+                                      const int dest, const int sendtag,
+                                      const dbm_mpi_comm_t comm) {
+#if defined(__parallel)
+  dbm_mpi_request_t request;
+  CHECK(
+      MPI_Isend(sendbuf, sendcount, MPI_FLOAT, dest, sendtag, comm, &request));
+  return request;
+#else
+  (void)sendbuf; // mark used
+  (void)sendcount;
+  (void)dest;
+  (void)sendtag;
+  (void)comm;
+  fprintf(stderr, "Error: dbm_mpi_isend_float not available without MPI\n");
+  abort();
+#endif
+}
+
+/*******************************************************************************
+ * \brief Wrapper around MPI_Irecv for datatype MPI_BYTE.
+ ******************************************************************************/
+dbm_mpi_request_t dbm_mpi_irecv_byte(void *recvbuf, const int recvcount,
+                                     const int source, const int recvtag,
+                                     const dbm_mpi_comm_t comm) {
+#if defined(__parallel)
+  dbm_mpi_request_t request;
+  CHECK(
+      MPI_Irecv(recvbuf, recvcount, MPI_BYTE, source, recvtag, comm, &request));
+  return request;
+#else
+  (void)recvbuf; // mark used
+  (void)recvcount;
+  (void)source;
+  (void)recvtag;
+  (void)comm;
+  fprintf(stderr, "Error: dbm_mpi_irecv_byte not available without MPI\n");
+  abort();
+#endif
+}
+
+/*******************************************************************************
+ * \brief Wrapper around MPI_Irecv for datatype MPI_DOUBLE.
+ ******************************************************************************/
+dbm_mpi_request_t dbm_mpi_irecv_double(double *recvbuf, const int recvcount,
+                                       const int source, const int recvtag,
+                                       const dbm_mpi_comm_t comm) {
+#if defined(__parallel)
+  dbm_mpi_request_t request;
+  CHECK(MPI_Irecv(recvbuf, recvcount, MPI_DOUBLE, source, recvtag, comm,
+                  &request));
+  return request;
+#else
+  (void)recvbuf; // mark used
+  (void)recvcount;
+  (void)source;
+  (void)recvtag;
+  (void)comm;
+  fprintf(stderr, "Error: dbm_mpi_irecv_double not available without MPI\n");
+  abort();
+#endif
+}
+
+/*******************************************************************************
+ * \brief Wrapper around MPI_Irecv for datatype MPI_FLOAT.
+ ******************************************************************************/
+dbm_mpi_request_t dbm_mpi_irecv_float(float *recvbuf, const int recvcount,
+                                      const int source, const int recvtag,
+                                      const dbm_mpi_comm_t comm) {
+#if defined(__parallel)
+  dbm_mpi_request_t request;
+  CHECK(MPI_Irecv(recvbuf, recvcount, MPI_FLOAT, source, recvtag, comm,
+                  &request));
+  return request;
+#else
+  (void)recvbuf; // mark used
+  (void)recvcount;
+  (void)source;
+  (void)recvtag;
+  (void)comm;
+  fprintf(stderr, "Error: dbm_mpi_irecv_float not available without MPI\n");
+  abort();
+#endif
+}
+
+/*******************************************************************************
+ * \brief Wrapper around MPI_Wait, returns number of received MPI_BYTEs.
+ ******************************************************************************/
+int dbm_mpi_wait_byte(dbm_mpi_request_t *request) {
+#if defined(__parallel)
+  MPI_Status status;
+  CHECK(MPI_Wait(request, &status));
+  int count_received;
+  CHECK(MPI_Get_count(&status, MPI_BYTE, &count_received));
+  return count_received;
+#else
+  (void)request; // mark used
+  fprintf(stderr, "Error: dbm_mpi_wait_byte not available without MPI\n");
+  abort();
+#endif
+}
+
+/*******************************************************************************
+ * \brief Wrapper around MPI_Wait, returns number of received MPI_DOUBLEs.
+ ******************************************************************************/
+int dbm_mpi_wait_double(dbm_mpi_request_t *request) {
+#if defined(__parallel)
+  MPI_Status status;
+  CHECK(MPI_Wait(request, &status));
+  int count_received;
+  CHECK(MPI_Get_count(&status, MPI_DOUBLE, &count_received));
+  return count_received;
+#else
+  (void)request; // mark used
+  fprintf(stderr, "Error: dbm_mpi_wait_double not available without MPI\n");
+  abort();
+#endif
+}
+
+/*******************************************************************************
+ * \brief Wrapper around MPI_Wait, returns number of received MPI_FLOATs.
+ ******************************************************************************/
+int dbm_mpi_wait_float(dbm_mpi_request_t *request) {
+#if defined(__parallel)
+  MPI_Status status;
+  CHECK(MPI_Wait(request, &status));
+  int count_received;
+  CHECK(MPI_Get_count(&status, MPI_FLOAT, &count_received));
+  return count_received;
+#else
+  (void)request; // mark used
+  fprintf(stderr, "Error: dbm_mpi_wait_float not available without MPI\n");
+  abort();
+#endif
+}
+
+/*******************************************************************************
+ * \brief Wrapper around MPI_Waitall.
+ ******************************************************************************/
+void dbm_mpi_waitall(const int count, dbm_mpi_request_t requests[count]) {
+#if defined(__parallel)
+  CHECK(MPI_Waitall(count, requests, MPI_STATUSES_IGNORE));
+#else
+  (void)requests; // mark used
+  assert(count == 0);
+#endif
+}
+
 /*******************************************************************************
  * \brief Wrapper around MPI_Alltoall for datatype MPI_INT.
  * \author Ole Schuett
@@ -433,6 +628,133 @@ void dbm_mpi_alltoallv_double(const double *sendbuf, const int *sendcounts,
 #endif
 }
 
+/*******************************************************************************
+ * \brief Wrapper around MPI_Alltoallv for datatype MPI_FLOAT.
+ ******************************************************************************/
+void dbm_mpi_alltoallv_float(const float *sendbuf, const int *sendcounts,
+                             const int *sdispls, float *recvbuf,
+                             const int *recvcounts, const int *rdispls,
+                             const dbm_mpi_comm_t comm) {
+#if defined(__parallel)
+  CHECK(MPI_Alltoallv(sendbuf, sendcounts, sdispls, MPI_FLOAT, recvbuf,
+                      recvcounts, rdispls, MPI_FLOAT, comm));
+#else
+  (void)comm; // mark used
+  assert(sendcounts[0] == recvcounts[0]);
+  assert(sdispls[0] == 0 && rdispls[0] == 0);
+  memcpy(recvbuf, sendbuf, sendcounts[0] * sizeof(float));
+#endif
+}
+
+/*******************************************************************************
+ * \brief Wrapper around MPI_Comm_split_type for MPI_COMM_TYPE_SHARED.
+ *        Returns a communicator of the ranks that can share memory.
+ ******************************************************************************/
+dbm_mpi_comm_t dbm_mpi_comm_split_shared(const dbm_mpi_comm_t comm) {
+#if defined(__parallel)
+  dbm_mpi_comm_t newcomm;
+  CHECK(MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL,
+                            &newcomm));
+  return newcomm;
+#else
+  (void)comm; // mark used
+  return -1;
+#endif
+}
+
+/*******************************************************************************
+ * \brief Wrapper around MPI_Group_translate_ranks for the groups of two comms.
+ *        Ranks that are not part of comm2 are translated to -1.
+ ******************************************************************************/
+void dbm_mpi_comm_translate_ranks(const dbm_mpi_comm_t comm1, const int n,
+                                  const int ranks1[n],
+                                  const dbm_mpi_comm_t comm2, int ranks2[n]) {
+#if defined(__parallel)
+  MPI_Group group1, group2;
+  CHECK(MPI_Comm_group(comm1, &group1));
+  CHECK(MPI_Comm_group(comm2, &group2));
+  CHECK(MPI_Group_translate_ranks(group1, n, ranks1, group2, ranks2));
+  CHECK(MPI_Group_free(&group1));
+  CHECK(MPI_Group_free(&group2));
+  for (int i = 0; i < n; i++) {
+    if (ranks2[i] == MPI_UNDEFINED) {
+      ranks2[i] = -1;
+    }
+  }
+#else
+  (void)comm1; // mark used
+  (void)comm2;
+  memcpy(ranks2, ranks1, n * sizeof(int));
+#endif
+}
+
+/*******************************************************************************
+ * \brief Wrapper around MPI_Win_allocate_shared.
+ ******************************************************************************/
+dbm_mpi_win_t dbm_mpi_win_allocate_shared(const size_t size,
+                                          const dbm_mpi_comm_t comm,
+                                          void **baseptr) {
+#if defined(__parallel)
+  dbm_mpi_win_t win;
+  CHECK(MPI_Win_allocate_shared((MPI_Aint)size, 1, MPI_INFO_NULL, comm,
+                                baseptr, &win));
+  return win;
+#else
+  (void)size; // mark used
+  (void)comm;
+  (void)baseptr;
+  fprintf(stderr, "Error: dbm_mpi_win_allocate_shared not available without "
+                  "MPI\n");
+  abort();
+#endif
+}
+
+/*******************************************************************************
+ * \brief Wrapper around MPI_Win_shared_query.
+ *        Returns the base pointer of the given rank's segment.
+ ******************************************************************************/
+void *dbm_mpi_win_shared_query(const dbm_mpi_win_t win, const int rank) {
+#if defined(__parallel)
+  MPI_Aint size;
+  int disp_unit;
+  void *baseptr;
+  CHECK(MPI_Win_shared_query(win, rank, &size, &disp_unit, &baseptr));
+  return baseptr;
+#else
+  (void)win; // mark used
+  (void)rank;
+  fprintf(stderr, "Error: dbm_mpi_win_shared_query not available without "
+                  "MPI\n");
+  abort();
+#endif
+}
+
+/*******************************************************************************
+ * \brief Wrapper around MPI_Win_fence.
+ ******************************************************************************/
+void dbm_mpi_win_fence(const dbm_mpi_win_t win) {
+#if defined(__parallel)
+  CHECK(MPI_Win_fence(0, win));
+#else
+  (void)win; // mark used
+  fprintf(stderr, "Error: dbm_mpi_win_fence not available without MPI\n");
+  abort();
+#endif
+}
+
+/*******************************************************************************
+ * \brief Wrapper around MPI_Win_free.
+ ******************************************************************************/
+void dbm_mpi_win_free(dbm_mpi_win_t *win) {
+#if defined(__parallel)
+  CHECK(MPI_Win_free(win));
+#else
+  (void)win; // mark used
+  fprintf(stderr, "Error: dbm_mpi_win_free not available without MPI\n");
+  abort();
+#endif
+}
+
 /*******************************************************************************
  * \brief Wrapper around MPI_Alloc_mem.
  * \author Hans Pabst
@@ -15,8 +15,12 @@
 #if defined(__parallel)
 #include <mpi.h>
 typedef MPI_Comm dbm_mpi_comm_t;
+typedef MPI_Request dbm_mpi_request_t;
+typedef MPI_Win dbm_mpi_win_t;
 #else
 typedef int dbm_mpi_comm_t;
+typedef int dbm_mpi_request_t;
+typedef int dbm_mpi_win_t;
 #endif
 
 /*******************************************************************************
@@ -159,6 +163,69 @@ int dbm_mpi_sendrecv_double(const double *sendbuf, const int sendcount,
                             const int recvcount, const int source,
                             const int recvtag, const dbm_mpi_comm_t comm);
 
+/*******************************************************************************
+ * \brief Wrapper around MPI_Isend for datatype MPI_BYTE.
+ ******************************************************************************/
+dbm_mpi_request_t dbm_mpi_isend_byte(const void *sendbuf, const int sendcount,
+                                     const int dest, const int sendtag,
+                                     const dbm_mpi_comm_t comm);
+
+/*******************************************************************************
+ * \brief Wrapper around MPI_Isend for datatype MPI_DOUBLE.
+ ******************************************************************************/
+dbm_mpi_request_t dbm_mpi_isend_double(const double *sendbuf,
+                                       const int sendcount, const int dest,
+                                       const int sendtag,
+                                       const dbm_mpi_comm_t comm);
+
+/*******************************************************************************
+ * \brief Wrapper around MPI_Isend for datatype MPI_FLOAT.
+ ******************************************************************************/
+dbm_mpi_request_t dbm_mpi_isend_float(const float *sendbuf, const int sendcount,
+                                      const int dest, const int sendtag,
+                                      const dbm_mpi_comm_t comm);
+
+/*******************************************************************************
+ * \brief Wrapper around MPI_Irecv for datatype MPI_BYTE.
+ ******************************************************************************/
+dbm_mpi_request_t dbm_mpi_irecv_byte(void *recvbuf, const int recvcount,
+                                     const int source, const int recvtag,
+                                     const dbm_mpi_comm_t comm);
+
+/*******************************************************************************
+ * \brief Wrapper around MPI_Irecv for datatype MPI_DOUBLE.
+ ******************************************************************************/
+dbm_mpi_request_t dbm_mpi_irecv_double(double *recvbuf, const int recvcount,
+                                       const int source, const int recvtag,
+                                       const dbm_mpi_comm_t comm);
+
+/*******************************************************************************
+ * \brief Wrapper around MPI_Irecv for datatype MPI_FLOAT.
+ ******************************************************************************/
+dbm_mpi_request_t dbm_mpi_irecv_float(float *recvbuf, const int recvcount,
+                                      const int source, const int recvtag,
+                                      const dbm_mpi_comm_t comm);
+
+/*******************************************************************************
+ * \brief Wrapper around MPI_Wait, returns number of received MPI_BYTEs.
+ ******************************************************************************/
+int dbm_mpi_wait_byte(dbm_mpi_request_t *request);
+
+/*******************************************************************************
+ * \brief Wrapper around MPI_Wait, returns number of received MPI_DOUBLEs.
+ ******************************************************************************/
+int dbm_mpi_wait_double(dbm_mpi_request_t *request);
+
+/*******************************************************************************
+ * \brief Wrapper around MPI_Wait, returns number of received MPI_FLOATs.
+ ******************************************************************************/
+int dbm_mpi_wait_float(dbm_mpi_request_t *request);
+
+/*******************************************************************************
+ * \brief Wrapper around MPI_Waitall.
+ ******************************************************************************/
+void dbm_mpi_waitall(const int count, dbm_mpi_request_t requests[count]);
+
 /*******************************************************************************
  * \brief Wrapper around MPI_Alltoall for datatype MPI_INT.
  * \author Ole Schuett
@@ -184,6 +251,51 @@ void dbm_mpi_alltoallv_double(const double *sendbuf, const int *sendcounts,
                               const int *recvcounts, const int *rdispls,
                               const dbm_mpi_comm_t comm);
 
+/*******************************************************************************
+ * \brief Wrapper around MPI_Alltoallv for datatype MPI_FLOAT.
+ ******************************************************************************/
+void dbm_mpi_alltoallv_float(const float *sendbuf, const int *sendcounts,
+                             const int *sdispls, float *recvbuf,
+                             const int *recvcounts, const int *rdispls,
+                             const dbm_mpi_comm_t comm);
+
+/*******************************************************************************
+ * \brief Wrapper around MPI_Comm_split_type for MPI_COMM_TYPE_SHARED.
+ *        Returns a communicator of the ranks that can share memory.
+ ******************************************************************************/
+dbm_mpi_comm_t dbm_mpi_comm_split_shared(const dbm_mpi_comm_t comm);
+
+/*******************************************************************************
+ * \brief Wrapper around MPI_Group_translate_ranks for the groups of two comms.
+ *        Ranks that are not part of comm2 are translated to -1.
+ ******************************************************************************/
+void dbm_mpi_comm_translate_ranks(const dbm_mpi_comm_t comm1, const int n,
+                                  const int ranks1[n],
+                                  const dbm_mpi_comm_t comm2, int ranks2[n]);
+
+/*******************************************************************************
+ * \brief Wrapper around MPI_Win_allocate_shared.
+ ******************************************************************************/
+dbm_mpi_win_t dbm_mpi_win_allocate_shared(const size_t size,
+                                          const dbm_mpi_comm_t comm,
+                                          void **baseptr);
+
+/*******************************************************************************
+ * \brief Wrapper around MPI_Win_shared_query.
+ *        Returns the base pointer of the given rank's segment.
+ ******************************************************************************/
+void *dbm_mpi_win_shared_query(const dbm_mpi_win_t win, const int rank);
+
+/*******************************************************************************
+ * \brief Wrapper around MPI_Win_fence.
+ ******************************************************************************/
+void dbm_mpi_win_fence(const dbm_mpi_win_t win);
+
+/*******************************************************************************
+ * \brief Wrapper around MPI_Win_free.
+ ******************************************************************************/
+void dbm_mpi_win_free(dbm_mpi_win_t *win);
+
 /*******************************************************************************
  * \brief Wrapper around MPI_Alloc_mem.
  * \author Hans Pabst
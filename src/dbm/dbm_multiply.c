@@ -7,6 +7,8 @@
 
 #include <assert.h>
 #include <limits.h>
+#include <math.h>
+#include <omp.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -18,6 +20,7 @@
 #include "dbm_multiply_cpu.h"
 #include "dbm_multiply_gpu.h"
 #include "dbm_multiply_internal.h"
+#include "dbm_multiply_layers.h"
 
 /*******************************************************************************
  * \brief Returns the larger of two given integer (missing from the C standard).
@@ -25,6 +28,11 @@
  ******************************************************************************/
 static inline int imax(int x, int y) { return (x > y ? x : y); }
 
+/*******************************************************************************
+ * \brief Returns the smaller of two given integer (missing from the C standard)
+ ******************************************************************************/
+static inline int imin(int x, int y) { return (x < y ? x : y); }
+
 /*******************************************************************************
  * \brief Updates the min/max of a range of values (initially {INT_MAX, 0}).
  * \author Hans Pabst
@@ -58,6 +66,11 @@ static float *compute_rows_max_eps(const bool trans, const dbm_matrix_t *matrix,
         const int row = (trans) ? blk->col : blk->row;
 #pragma omp atomic
         nblocks_per_row[row]++;
+        if (matrix->symmetric && blk->row != blk->col) {
+          const int mirror_row = (trans) ? blk->row : blk->col;
+#pragma omp atomic
+          nblocks_per_row[mirror_row]++;
+        }
       }
     }
 #pragma omp single
@@ -75,6 +88,161 @@ static float *compute_rows_max_eps(const bool trans, const dbm_matrix_t *matrix,
   return row_max_eps; // Ownership of row_max_eps transfers to caller.
 }
 
+/*******************************************************************************
+ * \brief Private struct for locating row/col indices within their shard.
+ ******************************************************************************/
+typedef struct {
+  int *positions; // position among the local indices of the same shard
+  int *counts;    // number of local indices per shard
+} shard_positions_t;
+
+/*******************************************************************************
+ * \brief Private routine for computing the shard positions of local indices.
+ *        Non-local indices get position -1.
+ ******************************************************************************/
+static shard_positions_t compute_shard_positions(const dbm_dist_1d_t *dist) {
+  shard_positions_t result;
+  result.positions = malloc(dist->length * sizeof(int));
+  result.counts = calloc(dist->nshards, sizeof(int));
+  for (int i = 0; i < dist->length; i++) {
+    result.positions[i] = -1;
+  }
+  for (int i = 0; i < dist->nlocals; i++) {
+    const int index = dist->local_indicies[i];
+    result.positions[index] = result.counts[index % dist->nshards]++;
+  }
+  return result;
+}
+
+/*******************************************************************************
+ * \brief Private routine for releasing shard positions.
+ ******************************************************************************/
+static void free_shard_positions(shard_positions_t *shard_positions) {
+  free(shard_positions->positions);
+  free(shard_positions->counts);
+}
+
+/*******************************************************************************
+ * \brief Private routine for measuring the blocks of a shard within a pack.
+ *        Returns the number of blocks and their total data size.
+ ******************************************************************************/
+static int measure_pack_shard(const dbm_pack_t *pack, const int iblock_start,
+                              const int nshards, const int ishard,
+                              const int *free_index_sizes,
+                              const int *sum_index_sizes, int64_t *data_size) {
+  int nblocks = 0;
+  *data_size = 0;
+  for (int iblock = iblock_start; iblock < pack->nblocks; iblock++) {
+    const dbm_pack_block_t *blk = &pack->blocks[iblock];
+    if (blk->free_index % nshards != ishard) {
+      break;
+    }
+    *data_size += (int64_t)free_index_sizes[blk->free_index] *
+                  sum_index_sizes[blk->sum_index];
+    nblocks++;
+  }
+  return nblocks;
+}
+
+/*******************************************************************************
+ * \brief Private routine for grouping the blocks of a shard into tiles.
+ *        Uses a stable counting sort, hence blocks remain ordered by sum_index.
+ ******************************************************************************/
+static void tile_pack_shard(const dbm_pack_t *pack, const int iblock_start,
+                            const int nblocks, const int *positions,
+                            const int tile_size, const int ntiles,
+                            int tile_start[ntiles + 1], int order[nblocks]) {
+  memset(tile_start, 0, (ntiles + 1) * sizeof(int));
+  for (int i = 0; i < nblocks; i++) {
+    const int free_index = pack->blocks[iblock_start + i].free_index;
+    assert(0 <= positions[free_index]);
+    tile_start[positions[free_index] / tile_size + 1]++;
+  }
+  for (int itile = 0; itile < ntiles; itile++) {
+    tile_start[itile + 1] += tile_start[itile];
+  }
+  int tile_fill[ntiles];
+  memcpy(tile_fill, tile_start, ntiles * sizeof(int));
+  for (int i = 0; i < nblocks; i++) {
+    const int free_index = pack->blocks[iblock_start + i].free_index;
+    order[tile_fill[positions[free_index] / tile_size]++] = iblock_start + i;
+  }
+}
+
+/*******************************************************************************
+ * \brief Private routine for choosing the number of tiles per shard dimension.
+ *        Tiles are chosen such that the touched parts of A, B, and C fit into
+ *        tile_size bytes.
+ ******************************************************************************/
+static int choose_tiling(const int64_t data_size_a, const int64_t data_size_b,
+                         const int64_t data_size_c, const int nrows,
+                         const int ncols, const int tile_size) {
+  const int tmax = imin(MULTIPLY_MAX_TILES, imax(1, imax(nrows, ncols)));
+  for (int t = 1; t < tmax; t++) {
+    const int64_t bytes = sizeof(double) * ((data_size_a + data_size_b) / t +
+                                            data_size_c / ((int64_t)t * t));
+    if (bytes <= tile_size) {
+      return t;
+    }
+  }
+  return tmax;
+}
+
+/*******************************************************************************
+ * \brief Private routine for estimating the cost of a pair of shards, i.e. the
+ *        flops of all pairs of blocks with matching sum_index before filtering.
+ *        Utilizes that blocks within a shard are ordered by sum_index.
+ ******************************************************************************/
+static double estimate_shard_pair_cost(
+    const dbm_pack_t *pack_a, const int iblock_start, const int nblocks_a,
+    const int *free_index_sizes_a, const dbm_pack_t *pack_b,
+    const int jblock_start, const int nblocks_b, const int *free_index_sizes_b,
+    const int *sum_index_sizes) {
+  const dbm_pack_block_t *blocks_a = &pack_a->blocks[iblock_start];
+  const dbm_pack_block_t *blocks_b = &pack_b->blocks[jblock_start];
+  double cost = 0.0;
+  int i = 0, j = 0;
+  while (i < nblocks_a && j < nblocks_b) {
+    const int sum_index = blocks_a[i].sum_index;
+    if (sum_index < blocks_b[j].sum_index) {
+      i++;
+    } else if (sum_index > blocks_b[j].sum_index) {
+      j++;
+    } else {
+      double m = 0.0, n = 0.0;
+      for (; i < nblocks_a && blocks_a[i].sum_index == sum_index; i++) {
+        m += free_index_sizes_a[blocks_a[i].free_index];
+      }
+      for (; j < nblocks_b && blocks_b[j].sum_index == sum_index; j++) {
+        n += free_index_sizes_b[blocks_b[j].free_index];
+      }
+      cost += 2.0 * m * n * sum_index_sizes[sum_index];
+    }
+  }
+  return cost;
+}
+
+/*******************************************************************************
+ * \brief Private struct for scheduling pairs of shards by their cost.
+ ******************************************************************************/
+typedef struct {
+  double cost;
+  int ipair;
+} shard_pair_t;
+
+/*******************************************************************************
+ * \brief Private comperator passed to qsort to sort shard pairs by decreasing
+ *        cost. Ties are broken by index to obtain a deterministic order.
+ ******************************************************************************/
+static int compare_shard_pairs_by_cost(const void *a, const void *b) {
+  const shard_pair_t *pair_a = (const shard_pair_t *)a;
+  const shard_pair_t *pair_b = (const shard_pair_t *)b;
+  if (pair_a->cost != pair_b->cost) {
+    return (pair_a->cost < pair_b->cost) ? 1 : -1;
+  }
+  return pair_a->ipair - pair_b->ipair;
+}
+
 /*******************************************************************************
  * \brief Private struct for storing the context of the multiplication backend.
  * \author Ole Schuett
@@ -129,6 +297,10 @@ static void backend_process_batch(const int ntasks, dbm_task_t batch[ntasks],
                                   const dbm_pack_t *pack_b, const int kshard,
                                   dbm_shard_t *shard_c,
                                   backend_context_t *ctx) {
+  if (ntasks == 0) {
+    return; // nothing to do
+  }
+  dbm_library_phase_begin(DBM_PHASE_KERNEL);
 #if defined(__OFFLOAD) && !defined(__NO_OFFLOAD_DBM)
   (void)pack_a; // mark as used
   (void)pack_b;
@@ -141,6 +313,7 @@ static void backend_process_batch(const int ntasks, dbm_task_t batch[ntasks],
   (void)ctx;
   dbm_multiply_cpu_process_batch(ntasks, batch, alpha, pack_a, pack_b, shard_c);
 #endif
+  dbm_library_phase_end(DBM_PHASE_KERNEL);
 }
 
 /*******************************************************************************
@@ -168,24 +341,35 @@ static void backend_stop(backend_context_t *ctx) {
 
 /*******************************************************************************
  * \brief Private routine for multipling two packs.
+ *        Each shard of matrix_c is first scaled by beta and finally filtered
+ *        by filter_eps, while it is still warm in the cache of its thread.
  * \author Ole Schuett
  ******************************************************************************/
 static void multiply_packs(const bool transa, const bool transb,
-                           const double alpha, const dbm_pack_t *pack_a,
-                           const dbm_pack_t *pack_b,
+                           const double alpha, const double beta,
+                           const dbm_pack_t *pack_a, const dbm_pack_t *pack_b,
                            const dbm_matrix_t *matrix_a,
                            const dbm_matrix_t *matrix_b, dbm_matrix_t *matrix_c,
-                           const bool retain_sparsity,
-                           const float *rows_max_eps, int64_t *flop,
-                           backend_context_t *ctx) {
+                           const bool retain_sparsity, const double filter_eps,
+                           const float *rows_max_eps,
+                           const shard_positions_t *rows,
+                           const shard_positions_t *cols, int64_t *flop,
+                           double *busy, backend_context_t *ctx) {
   const float alpha2 = alpha * alpha;
   int64_t flop_sum = 0;
+  const int batch_size = dbm_library_get_config()->batch_size;
+  const int tile_size = dbm_library_get_config()->multiply_tile_size;
+  const bool load_balance = dbm_library_get_config()->load_balance;
 
   const int nshard_rows = matrix_c->dist->rows.nshards;
   const int nshard_cols = matrix_c->dist->cols.nshards;
   int shard_row_start[nshard_rows], shard_col_start[nshard_cols];
   memset(shard_row_start, 0, nshard_rows * sizeof(int));
   memset(shard_col_start, 0, nshard_cols * sizeof(int));
+  int shard_row_nblocks[nshard_rows], shard_col_nblocks[nshard_cols];
+  shard_pair_t pairs[nshard_rows * nshard_cols];
+  int claims[nshard_rows * nshard_cols];
+  memset(claims, 0, nshard_rows * nshard_cols * sizeof(int));
 
   const int *sum_index_sizes_a =
       (transa) ? matrix_a->row_sizes : matrix_a->col_sizes;
@@ -219,103 +403,315 @@ static void multiply_packs(const bool transa, const bool transb,
       }
     }
 
-#pragma omp for collapse(2) schedule(dynamic)
-    for (int shard_row = 0; shard_row < nshard_rows; shard_row++) {
+    // Optionally, sort the pairs of shards by their estimated cost. The sweeps
+    // below then visit expensive pairs before cheap ones, such that the cheap
+    // ones are left over for balancing the threads' loads.
+    if (load_balance) {
+#pragma omp for
+      for (int shard_row = 0; shard_row < nshard_rows; shard_row++) {
+        int64_t data_size;
+        shard_row_nblocks[shard_row] = measure_pack_shard(
+            pack_a, shard_row_start[shard_row], nshard_rows, shard_row,
+            free_index_sizes_a, sum_index_sizes_a, &data_size);
+      }
+#pragma omp for
       for (int shard_col = 0; shard_col < nshard_cols; shard_col++) {
-        const int ishard = shard_row * nshard_cols + shard_col;
+        int64_t data_size;
+        shard_col_nblocks[shard_col] = measure_pack_shard(
+            pack_b, shard_col_start[shard_col], nshard_cols, shard_col,
+            free_index_sizes_b, sum_index_sizes_b, &data_size);
+      }
+#pragma omp for collapse(2) schedule(dynamic)
+      for (int shard_row = 0; shard_row < nshard_rows; shard_row++) {
+        for (int shard_col = 0; shard_col < nshard_cols; shard_col++) {
+          const int ipair = shard_row * nshard_cols + shard_col;
+          pairs[ipair].ipair = ipair;
+          pairs[ipair].cost = estimate_shard_pair_cost(
+              pack_a, shard_row_start[shard_row], shard_row_nblocks[shard_row],
+              free_index_sizes_a, pack_b, shard_col_start[shard_col],
+              shard_col_nblocks[shard_col], free_index_sizes_b,
+              sum_index_sizes_a);
+        }
+      }
+#pragma omp single
+      qsort(pairs, nshard_rows * nshard_cols, sizeof(shard_pair_t),
+            &compare_shard_pairs_by_cost);
+    }
+
+    // Threads first process the shards they own, whose memory is local to
+    // their NUMA domain. Afterwards, idle threads steal the remaining shards.
+    // The stealing sweep starts right after the thread's own position, such
+    // that idle threads spread out instead of contending for the same shards.
+    const int nthreads = omp_get_num_threads();
+    const int ithread = omp_get_thread_num();
+    const int ntasks_total = nshard_rows * nshard_cols;
+    const double time_start = omp_get_wtime();
+    for (int isweep = 0; isweep < 2; isweep++) {
+      const int ifirst = (isweep == 0) ? 0 : ithread + 1;
+      for (int i = 0; i < ntasks_total; i++) {
+        const int itask = (ifirst + i) % ntasks_total;
+        const int ishard = (load_balance) ? pairs[itask].ipair : itask;
+        if (isweep == 0 && ishard % nthreads != ithread) {
+          continue; // not owned, might get stolen in the second sweep
+        }
+        int prior_claims;
+#pragma omp atomic capture
+        prior_claims = claims[ishard]++;
+        if (prior_claims > 0) {
+          continue; // already processed by another thread
+        }
+        const int shard_row = ishard / nshard_cols;
+        const int shard_col = ishard % nshard_cols;
         dbm_shard_t *shard_c = &matrix_c->shards[ishard];
+        if (beta != 1.0) {
+          dbm_library_phase_begin(DBM_PHASE_FILTER);
+          dbm_shard_scale(shard_c, beta);
+          dbm_library_phase_end(DBM_PHASE_FILTER);
+        }
         dbm_task_t batch[MAX_BATCH_SIZE];
         int mnk_range[][2] = {{INT_MAX, 0}, {INT_MAX, 0}, {INT_MAX, 0}};
         int ntasks = 0;
 
-        // Use a merge-join to find pairs of blocks with matching sum indices.
-        // This utilizes that blocks within a shard are ordered by sum_index.
+        // Group the blocks of A and B into tiles of rows and columns of C.
         const int iblock_start = shard_row_start[shard_row];
-        int jblock_start = shard_col_start[shard_col];
-        for (int iblock = iblock_start; iblock < pack_a->nblocks; iblock++) {
-          const dbm_pack_block_t *blk_a = &pack_a->blocks[iblock];
-          if (blk_a->free_index % nshard_rows != shard_row) {
-            break;
-          }
-          for (int jblock = jblock_start; jblock < pack_b->nblocks; jblock++) {
-            const dbm_pack_block_t *blk_b = &pack_b->blocks[jblock];
-            if (blk_b->free_index % nshard_cols != shard_col) {
-              break;
-            }
-            if (blk_a->sum_index < blk_b->sum_index) {
-              break;
-            }
-            if (blk_a->sum_index > blk_b->sum_index) {
-              jblock_start++;
-              continue;
-            }
-            // Found block pair with blk_a->sum_index == blk_b->sum_index.
-
-            // Check norms.
-            const float result_norm = alpha2 * blk_a->norm * blk_b->norm;
-            if (result_norm < rows_max_eps[blk_a->free_index]) {
-              continue;
-            }
-
-            // Check block sizes.
-            const int m = free_index_sizes_a[blk_a->free_index];
-            const int n = free_index_sizes_b[blk_b->free_index];
-            const int k = sum_index_sizes_a[blk_a->sum_index];
-            assert(m == matrix_c->row_sizes[blk_a->free_index]);
-            assert(n == matrix_c->col_sizes[blk_b->free_index]);
-            assert(k == sum_index_sizes_b[blk_b->sum_index]);
-
-            // Get C block.
-            const int row = blk_a->free_index, col = blk_b->free_index;
-            dbm_block_t *blk_c = dbm_shard_lookup(shard_c, row, col);
-            if (blk_c == NULL && retain_sparsity) {
-              continue;
-            } else if (blk_c == NULL) {
-              assert(dbm_get_shard_index(matrix_c, row, col) == ishard);
-              assert(dbm_get_stored_coordinates(matrix_c, row, col) ==
-                     matrix_c->dist->my_rank);
-              blk_c = dbm_shard_promise_new_block(shard_c, row, col, m * n);
-            }
+        const int jblock_start = shard_col_start[shard_col];
+        int64_t data_size_a, data_size_b;
+        const int nblocks_a = measure_pack_shard(
+            pack_a, iblock_start, nshard_rows, shard_row, free_index_sizes_a,
+            sum_index_sizes_a, &data_size_a);
+        const int nblocks_b = measure_pack_shard(
+            pack_b, jblock_start, nshard_cols, shard_col, free_index_sizes_b,
+            sum_index_sizes_b, &data_size_b);
+        const int nrows = rows->counts[shard_row];
+        const int ncols = cols->counts[shard_col];
+        // Only small blocks are tiled, large ones are dominated by the kernels.
+        const int64_t max_data_size =
+            (int64_t)MULTIPLY_TILE_MAX_BLOCK_SIZE * (nblocks_a + nblocks_b);
+        const bool tiled = (tile_size > 0 && nblocks_a > 0 && nblocks_b > 0 &&
+                            data_size_a + data_size_b <= max_data_size);
+        const int t =
+            (tiled) ? choose_tiling(data_size_a, data_size_b,
+                                    shard_c->data_size, nrows, ncols, tile_size)
+                    : 1;
+        const int tile_rows = (tiled) ? imax(1, (nrows + t - 1) / t) : INT_MAX;
+        const int tile_cols = (tiled) ? imax(1, (ncols + t - 1) / t) : INT_MAX;
+        const int ntiles_a = (tiled) ? (nrows + tile_rows - 1) / tile_rows : 1;
+        const int ntiles_b = (tiled) ? (ncols + tile_cols - 1) / tile_cols : 1;
+        int tile_start_a[ntiles_a + 1], tile_start_b[ntiles_b + 1];
+        int *order_a = NULL, *order_b = NULL;
+        if (tiled) {
+          order_a = malloc(nblocks_a * sizeof(int));
+          order_b = malloc(nblocks_b * sizeof(int));
+          tile_pack_shard(pack_a, iblock_start, nblocks_a, rows->positions,
+                          tile_rows, ntiles_a, tile_start_a, order_a);
+          tile_pack_shard(pack_b, jblock_start, nblocks_b, cols->positions,
+                          tile_cols, ntiles_b, tile_start_b, order_b);
+        } else {
+          tile_start_a[0] = tile_start_b[0] = 0;
+          tile_start_a[1] = nblocks_a;
+          tile_start_b[1] = nblocks_b;
+        }
 
-            // Count flops.
-            dbm_library_counter_increment(m, n, k);
-            const int task_flops = 2 * m * n * k;
-            flop_sum += task_flops;
-            if (task_flops == 0) {
-              continue;
-            }
+        // Remember offsets of C blocks, such that each block of a tile gets
+        // looked up only once. Entries are valid when stamped with the tile.
+        const bool batched_lookups =
+            tiled && (int64_t)tile_rows * tile_cols <= MULTIPLY_TILE_MAX_BLOCKS;
+        int *offsets_c = NULL, *stamps_c = NULL;
+        if (batched_lookups) {
+          offsets_c = malloc(tile_rows * tile_cols * sizeof(int));
+          stamps_c = calloc(tile_rows * tile_cols, sizeof(int));
+        }
 
-            // Add block multiplication to batch.
-            batch[ntasks].m = m;
-            batch[ntasks].n = n;
-            batch[ntasks].k = k;
-            batch[ntasks].offset_a = blk_a->offset;
-            batch[ntasks].offset_b = blk_b->offset;
-            batch[ntasks].offset_c = blk_c->offset;
-            ntasks++;
-
-            // track MxN-shape covering an entire batch
-            min_max(mnk_range[0], m);
-            min_max(mnk_range[1], n);
-            min_max(mnk_range[2], k);
-
-            if (ntasks == MAX_BATCH_SIZE) {
-              backend_process_batch(ntasks, batch, mnk_range, alpha, pack_a,
-                                    pack_b, ishard, shard_c, ctx);
-              mnk_range[0][0] = mnk_range[1][0] = mnk_range[2][0] = INT_MAX;
-              mnk_range[0][1] = mnk_range[1][1] = mnk_range[2][1] = 0;
-              ntasks = 0;
+        for (int tile_a = 0; tile_a < ntiles_a; tile_a++) {
+          for (int tile_b = 0; tile_b < ntiles_b; tile_b++) {
+            const int stamp = tile_a * ntiles_b + tile_b + 1;
+            // Use a merge-join to find pairs of blocks with matching sum
+            // indices. This utilizes that blocks within a tile are ordered by
+            // sum_index.
+            int jstart = tile_start_b[tile_b];
+            for (int i = tile_start_a[tile_a]; i < tile_start_a[tile_a + 1];
+                 i++) {
+              const int iblock = (tiled) ? order_a[i] : iblock_start + i;
+              const dbm_pack_block_t *blk_a = &pack_a->blocks[iblock];
+              for (int j = jstart; j < tile_start_b[tile_b + 1]; j++) {
+                const int jblock = (tiled) ? order_b[j] : jblock_start + j;
+                const dbm_pack_block_t *blk_b = &pack_b->blocks[jblock];
+                if (blk_a->sum_index < blk_b->sum_index) {
+                  break;
+                }
+                if (blk_a->sum_index > blk_b->sum_index) {
+                  jstart++;
+                  continue;
+                }
+                // Found block pair with blk_a->sum_index == blk_b->sum_index.
+
+                // Symmetric results only need their upper triangle.
+                if (matrix_c->symmetric &&
+                    blk_a->free_index > blk_b->free_index) {
+                  continue;
+                }
+
+                // Check norms.
+                const float result_norm = alpha2 * blk_a->norm * blk_b->norm;
+                if (result_norm < rows_max_eps[blk_a->free_index]) {
+                  continue;
+                }
+
+                // Check block sizes.
+                const int m = free_index_sizes_a[blk_a->free_index];
+                const int n = free_index_sizes_b[blk_b->free_index];
+                const int k = sum_index_sizes_a[blk_a->sum_index];
+                assert(m == matrix_c->row_sizes[blk_a->free_index]);
+                assert(n == matrix_c->col_sizes[blk_b->free_index]);
+                assert(k == sum_index_sizes_b[blk_b->sum_index]);
+
+                // Get C block, consulting the tile's offsets first.
+                const int row = blk_a->free_index, col = blk_b->free_index;
+                int offset_c_lookup, *offset_c = &offset_c_lookup;
+                bool known = false;
+                if (batched_lookups) {
+                  const int ic = rows->positions[row] - tile_a * tile_rows;
+                  const int jc = cols->positions[col] - tile_b * tile_cols;
+                  offset_c = &offsets_c[ic * tile_cols + jc];
+                  known = (stamps_c[ic * tile_cols + jc] == stamp);
+                  stamps_c[ic * tile_cols + jc] = stamp;
+                }
+                if (!known) {
+                  dbm_block_t *blk_c = dbm_shard_lookup(shard_c, row, col);
+                  if (blk_c == NULL && !retain_sparsity) {
+                    assert(dbm_get_shard_index(matrix_c, row, col) == ishard);
+                    assert(dbm_get_stored_coordinates(matrix_c, row, col) ==
+                           matrix_c->dist->my_rank);
+                    blk_c =
+                        dbm_shard_promise_new_block(shard_c, row, col, m * n);
+                  }
+                  *offset_c = (blk_c == NULL) ? -1 : blk_c->offset;
+                }
+                if (*offset_c == -1) {
+                  continue; // retain_sparsity
+                }
+
+                // Count flops.
+                dbm_library_counter_increment(m, n, k);
+                const int task_flops = 2 * m * n * k;
+                flop_sum += task_flops;
+                if (task_flops == 0) {
+                  continue;
+                }
+
+                // Add block multiplication to batch.
+                batch[ntasks].m = m;
+                batch[ntasks].n = n;
+                batch[ntasks].k = k;
+                batch[ntasks].offset_a = blk_a->offset;
+                batch[ntasks].offset_b = blk_b->offset;
+                batch[ntasks].offset_c = *offset_c;
+                ntasks++;
+
+                // track MxN-shape covering an entire batch
+                min_max(mnk_range[0], m);
+                min_max(mnk_range[1], n);
+                min_max(mnk_range[2], k);
+
+                if (ntasks == batch_size) {
+                  backend_process_batch(ntasks, batch, mnk_range, alpha, pack_a,
+                                        pack_b, ishard, shard_c, ctx);
+                  mnk_range[0][0] = mnk_range[1][0] = mnk_range[2][0] = INT_MAX;
+                  mnk_range[0][1] = mnk_range[1][1] = mnk_range[2][1] = 0;
+                  ntasks = 0;
+                }
+              }
             }
           }
         }
+        free(order_a);
+        free(order_b);
+        free(offsets_c);
+        free(stamps_c);
         backend_process_batch(ntasks, batch, mnk_range, alpha, pack_a, pack_b,
                               ishard, shard_c, ctx);
+        if (filter_eps > 0.0) {
+          dbm_library_phase_begin(DBM_PHASE_FILTER);
+          dbm_shard_allocate_promised_blocks(shard_c); // e.g. if task_flops==0
+          dbm_shard_filter(shard_c, matrix_c->row_sizes, matrix_c->col_sizes,
+                           filter_eps);
+          dbm_library_phase_end(DBM_PHASE_FILTER);
+        }
       }
     }
+    busy[omp_get_thread_num()] += omp_get_wtime() - time_start;
   }
   *flop += flop_sum;
 }
 
+/*******************************************************************************
+ * \brief Private routine for multiplying matrices that share a communicator.
+ *        Matrix_c gets scaled by beta and filtered by filter_eps.
+ *        The flops of this rank get added to flop.
+ ******************************************************************************/
+static void multiply_distributed(
+    const bool transa, const bool transb, const double alpha,
+    const dbm_matrix_t *matrix_a, const dbm_matrix_t *matrix_b,
+    const double beta, dbm_matrix_t *matrix_c, const bool retain_sparsity,
+    const double filter_eps, const float *rows_max_eps,
+    const dbm_wire_format_t wire_format, const double compression_eps,
+    int64_t *flop) {
+
+  // On the CPU the scaling and filtering are fused into the first and last
+  // tick, respectively. On the GPU they are separate passes over the host data.
+#if defined(__OFFLOAD) && !defined(__NO_OFFLOAD_DBM)
+  const bool fused = false;
+  dbm_library_phase_begin(DBM_PHASE_FILTER);
+  dbm_scale(matrix_c, beta);
+  dbm_library_phase_end(DBM_PHASE_FILTER);
+#else
+  const bool fused = true;
+#endif
+
+  // Start uploading matrix_c to the GPU.
+  backend_context_t *ctx = backend_start(matrix_c);
+
+  // Locate rows and columns of matrix_c within their shards for tiling.
+  shard_positions_t rows = compute_shard_positions(&matrix_c->dist->rows);
+  shard_positions_t cols = compute_shard_positions(&matrix_c->dist->cols);
+
+  // Redistribute matrix_a and matrix_b across MPI ranks.
+  dbm_comm_iterator_t *iter =
+      dbm_comm_iterator_start(transa, transb, matrix_a, matrix_b, matrix_c,
+                              wire_format, compression_eps);
+
+  // Main loop.
+  const int nthreads = omp_get_max_threads();
+  double *busy = calloc(nthreads, sizeof(double));
+  dbm_pack_t *pack_a, *pack_b;
+  while (dbm_comm_iterator_next(iter, &pack_a, &pack_b)) {
+    const bool first_tick = (fused && iter->itick == 1);
+    const bool last_tick = (fused && iter->itick == iter->nticks);
+    backend_upload_packs(pack_a, pack_b, ctx);
+    multiply_packs(transa, transb, alpha, (first_tick) ? beta : 1.0, pack_a,
+                   pack_b, matrix_a, matrix_b, matrix_c, retain_sparsity,
+                   (last_tick) ? filter_eps : 0.0, rows_max_eps, &rows, &cols,
+                   flop, busy, ctx);
+  }
+  dbm_library_busy_time_add(nthreads, busy);
+  free(busy);
+
+  // Start downloading matrix_c from the GPU.
+  backend_download_results(ctx);
+
+  // Wait for all other MPI ranks to complete, then release ressources.
+  dbm_comm_iterator_stop(iter);
+  free_shard_positions(&rows);
+  free_shard_positions(&cols);
+  backend_stop(ctx);
+
+  if (!fused) {
+    dbm_library_phase_begin(DBM_PHASE_FILTER);
+    dbm_filter(matrix_c, filter_eps);
+    dbm_library_phase_end(DBM_PHASE_FILTER);
+  }
+}
+
 /*******************************************************************************
  * \brief Performs a multiplication of two dbm_matrix_t matrices.
  *        See dbm_matrix.h for details.
@@ -325,9 +721,13 @@ void dbm_multiply(const bool transa, const bool transb, const double alpha,
                   const dbm_matrix_t *matrix_a, const dbm_matrix_t *matrix_b,
                   const double beta, dbm_matrix_t *matrix_c,
                   const bool retain_sparsity, const double filter_eps,
-                  int64_t *flop) {
+                  const bool mixed_precision, int64_t *flop) {
 
   assert(omp_get_num_threads() == 1);
+  const double time_start = omp_get_wtime();
+  dbm_library_autotune_begin();
+  dbm_library_call_begin();
+  const dbm_library_config_t *config = dbm_library_get_config();
 
   // Throughout the matrix multiplication code the "sum_index" and "free_index"
   // denote the summation (aka dummy) and free index from the Einstein notation.
@@ -341,42 +741,69 @@ void dbm_multiply(const bool transa, const bool transb, const double alpha,
   assert(num_free_index_a == matrix_c->nrows);
   assert(num_free_index_b == matrix_c->ncols);
 
-  // Prepare matrix_c.
-  dbm_scale(matrix_c, beta);
-
-  // Start uploading matrix_c to the GPU.
-  backend_context_t *ctx = backend_start(matrix_c);
-
   // Compute filter thresholds for each row.
   float *rows_max_eps = compute_rows_max_eps(transa, matrix_a, filter_eps);
 
-  // Redistribute matrix_a and matrix_b across MPI ranks.
-  dbm_comm_iterator_t *iter =
-      dbm_comm_iterator_start(transa, transb, matrix_a, matrix_b, matrix_c);
-
-  // Main loop.
-  *flop = 0;
-  dbm_pack_t *pack_a, *pack_b;
-  while (dbm_comm_iterator_next(iter, &pack_a, &pack_b)) {
-    backend_upload_packs(pack_a, pack_b, ctx);
-    multiply_packs(transa, transb, alpha, pack_a, pack_b, matrix_a, matrix_b,
-                   matrix_c, retain_sparsity, rows_max_eps, flop, ctx);
+  // Choose wire format of packs. Single precision packs are only used when
+  // their rounding errors are below the filter threshold. The rounding errors
+  // are relative, hence they get scaled by the magnitude of the product.
+  // Compressed packs bound the error of each block individually.
+  dbm_wire_format_t wire_format = DBM_WIRE_FP64;
+  const double compression_eps =
+      config->pack_compression_tolerance * filter_eps;
+  if (config->pack_compression && compression_eps > 0.0) {
+    wire_format = DBM_WIRE_COMPRESSED;
+  } else if (mixed_precision) {
+    const double maxabs_product =
+        fabs(alpha) * dbm_maxabs(matrix_a) * dbm_maxabs(matrix_b);
+    if (filter_eps >= config->mixed_precision_min_eps * maxabs_product) {
+      wire_format = DBM_WIRE_FP32;
+    }
   }
 
-  // Start downloading matrix_c from the GPU.
-  backend_download_results(ctx);
+  // Layering requires a result matrix that can grow new blocks. Symmetric
+  // operands are expanded only during packing, hence they are not layered.
+  const bool layerable = !retain_sparsity && !matrix_a->symmetric &&
+                         !matrix_b->symmetric;
+  const int nlayers =
+      (layerable) ? dbm_layers_choose(matrix_a, matrix_b, matrix_c) : 1;
 
-  // Wait for all other MPI ranks to complete, then release ressources.
-  dbm_comm_iterator_stop(iter);
+  *flop = 0;
+  if (nlayers == 1) {
+    multiply_distributed(transa, transb, alpha, matrix_a, matrix_b, beta,
+                         matrix_c, retain_sparsity, filter_eps, rows_max_eps,
+                         wire_format, compression_eps, flop);
+  } else {
+    // 2.5D algorithm: Each layer multiplies the blocks of its share of the sum
+    // indices on a smaller grid, then the partial results get summed up.
+    dbm_layers_t *layers = dbm_layers_create(matrix_c->dist, nlayers);
+    dbm_matrix_t *layer_a = dbm_layers_scatter(layers, transa, matrix_a);
+    dbm_matrix_t *layer_b = dbm_layers_scatter(layers, !transb, matrix_b);
+    dbm_matrix_t *layer_c = dbm_layers_create_matrix(layers, matrix_c);
+    multiply_distributed(transa, transb, alpha, layer_a, layer_b, 1.0, layer_c,
+                         retain_sparsity, 0.0, rows_max_eps, wire_format,
+                         compression_eps, flop);
+    dbm_release(layer_a);
+    dbm_release(layer_b);
+    dbm_library_phase_begin(DBM_PHASE_FILTER);
+    dbm_scale(matrix_c, beta);
+    dbm_library_phase_end(DBM_PHASE_FILTER);
+    dbm_layers_reduce(layers, layer_c, matrix_c);
+    dbm_release(layer_c);
+    dbm_layers_free(layers);
+    dbm_library_phase_begin(DBM_PHASE_FILTER);
+    dbm_filter(matrix_c, filter_eps);
+    dbm_library_phase_end(DBM_PHASE_FILTER);
+  }
   free(rows_max_eps);
-  backend_stop(ctx);
+
+  // Let the autotuner learn from this rank's performance.
+  dbm_library_autotune_end(*flop, omp_get_wtime() - time_start);
+  dbm_library_call_end(*flop);
 
   // Compute average flops per rank.
   dbm_mpi_sum_int64(flop, 1, matrix_c->dist->comm);
   *flop = (*flop + matrix_c->dist->nranks - 1) / matrix_c->dist->nranks;
-
-  // Final filter pass.
-  dbm_filter(matrix_c, filter_eps);
 }
 
 // EOF
@@ -25,13 +25,18 @@
           epsilon divided by the maximum number of possible multiplies in each
           row. In addition a final filtering is done as well with the same
           epsilon value.
+
+          The mixed_precision parameter allows to communicate the blocks of
+          A and B in single precision, while the multiplication still
+          accumulates in double precision. It only takes effect when the
+          filter_eps is large enough to hide the rounding errors.
  * \author Ole Schuett
  ******************************************************************************/
 void dbm_multiply(const bool transa, const bool transb, const double alpha,
                   const dbm_matrix_t *matrix_a, const dbm_matrix_t *matrix_b,
                   const double beta, dbm_matrix_t *matrix_c,
                   const bool retain_sparsity, const double filter_eps,
-                  int64_t *flop);
+                  const bool mixed_precision, int64_t *flop);
 
 #endif
 
@@ -8,10 +8,18 @@
 #include "dbm_multiply_comm.h"
 
 #include <assert.h>
+#include <math.h>
+#include <omp.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 #include "dbm_hyperparams.h"
+#include "dbm_library.h"
 #include "dbm_mempool.h"
 #include "dbm_mpi.h"
 
@@ -21,6 +29,9 @@
  ******************************************************************************/
 static inline int imax(int x, int y) { return (x > y ? x : y); }
 
+// Number of bits sorted per pass of the radix sort.
+#define RADIX_BITS 8
+
 /*******************************************************************************
  * \brief Private routine for computing greatest common divisor of two numbers.
  * \author Ole Schuett
@@ -60,6 +71,213 @@ static inline void icumsum(const int n, const int input[n], int output[n]) {
   }
 }
 
+/*******************************************************************************
+ * \brief Private enum for the precision levels of single blocks on the wire.
+ *        The integer levels store mantissas aligned to a per-block exponent.
+ ******************************************************************************/
+typedef enum {
+  WIRE_LEVEL_ZERO,
+  WIRE_LEVEL_INT8,
+  WIRE_LEVEL_INT16,
+  WIRE_LEVEL_FP32,
+  WIRE_LEVEL_FP64,
+} wire_level_t;
+
+static const int wire_level_bytes[] = {0, 1, 2, 4, 8};
+static const int wire_level_bits[] = {0, 8, 16, 0, 0};
+
+/*******************************************************************************
+ * \brief Private struct preceding every block of a compressed pack.
+ ******************************************************************************/
+typedef struct {
+  int32_t level;
+  int32_t exponent;
+} wire_header_t;
+
+/*******************************************************************************
+ * \brief Private routine returning the size of a data unit of the wire format.
+ ******************************************************************************/
+static inline int wire_unit_size(const dbm_wire_format_t wire_format) {
+  switch (wire_format) {
+  case DBM_WIRE_FP64:
+    return sizeof(double);
+  case DBM_WIRE_FP32:
+    return sizeof(float);
+  case DBM_WIRE_COMPRESSED:
+    return 1;
+  }
+  assert(false && "Unknown wire format.");
+  return 0;
+}
+
+/*******************************************************************************
+ * \brief Private routine for choosing the smallest wire level of a compressed
+ *        block whose Frobenius norm error stays below the given epsilon.
+ ******************************************************************************/
+static wire_level_t choose_wire_level(const int n, const double data[n],
+                                      const double eps, int *exponent) {
+  double norm = 0.0, maxabs = 0.0;
+  for (int i = 0; i < n; i++) {
+    norm += data[i] * data[i];
+    maxabs = fmax(maxabs, fabs(data[i]));
+  }
+  *exponent = 0;
+  if (sqrt(norm) <= eps) {
+    return WIRE_LEVEL_ZERO;
+  }
+  frexp(maxabs, exponent); // maxabs < 2^exponent
+  // Rounding of a mantissa with given bits errs by at most 2^(exponent-bits+1).
+  const double sqrt_n = sqrt((double)n);
+  if (sqrt_n * ldexp(1.0, *exponent - 7) <= eps) {
+    return WIRE_LEVEL_INT8;
+  }
+  if (sqrt_n * ldexp(1.0, *exponent - 15) <= eps) {
+    return WIRE_LEVEL_INT16;
+  }
+  if (sqrt_n * ldexp(maxabs, -24) <= eps) {
+    return WIRE_LEVEL_FP32;
+  }
+  return WIRE_LEVEL_FP64;
+}
+
+/*******************************************************************************
+ * \brief Private routine for storing an element at the given wire level.
+ ******************************************************************************/
+static inline void store_element(const wire_level_t level, const double factor,
+                                 void *payload, const int i,
+                                 const double element) {
+  switch (level) {
+  case WIRE_LEVEL_ZERO:
+    break;
+  case WIRE_LEVEL_INT8:
+    ((int8_t *)payload)[i] = (int8_t)fmax(
+        -INT8_MAX, fmin(INT8_MAX, nearbyint(element * factor)));
+    break;
+  case WIRE_LEVEL_INT16:
+    ((int16_t *)payload)[i] = (int16_t)fmax(
+        -INT16_MAX, fmin(INT16_MAX, nearbyint(element * factor)));
+    break;
+  case WIRE_LEVEL_FP32:
+    ((float *)payload)[i] = (float)element;
+    break;
+  case WIRE_LEVEL_FP64:
+    ((double *)payload)[i] = element;
+    break;
+  }
+}
+
+/*******************************************************************************
+ * \brief Private routine for computing the squared Frobenius norm of a block.
+ *        Eight independent partial sums hide the latency of the additions.
+ *        Their fixed order keeps the result independent of the call site.
+ ******************************************************************************/
+static double block_norm(const int n, const double data[n]) {
+  double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+  double s4 = 0.0, s5 = 0.0, s6 = 0.0, s7 = 0.0;
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    s0 += data[i + 0] * data[i + 0];
+    s1 += data[i + 1] * data[i + 1];
+    s2 += data[i + 2] * data[i + 2];
+    s3 += data[i + 3] * data[i + 3];
+    s4 += data[i + 4] * data[i + 4];
+    s5 += data[i + 5] * data[i + 5];
+    s6 += data[i + 6] * data[i + 6];
+    s7 += data[i + 7] * data[i + 7];
+  }
+  for (; i < n; i++) {
+    s0 += data[i] * data[i];
+  }
+  return ((s0 + s4) + (s2 + s6)) + ((s1 + s5) + (s3 + s7));
+}
+
+#if defined(__AVX2__)
+/*******************************************************************************
+ * \brief Private routine for transposing a 4x4 tile within SIMD registers.
+ ******************************************************************************/
+static inline void transpose_tile_4x4(const double *src, const int ld_src,
+                                      double *dst, const int ld_dst) {
+  const __m256d c0 = _mm256_loadu_pd(&src[0 * ld_src]);
+  const __m256d c1 = _mm256_loadu_pd(&src[1 * ld_src]);
+  const __m256d c2 = _mm256_loadu_pd(&src[2 * ld_src]);
+  const __m256d c3 = _mm256_loadu_pd(&src[3 * ld_src]);
+  const __m256d t0 = _mm256_unpacklo_pd(c0, c1); // c0[0] c1[0] c0[2] c1[2]
+  const __m256d t1 = _mm256_unpackhi_pd(c0, c1); // c0[1] c1[1] c0[3] c1[3]
+  const __m256d t2 = _mm256_unpacklo_pd(c2, c3); // c2[0] c3[0] c2[2] c3[2]
+  const __m256d t3 = _mm256_unpackhi_pd(c2, c3); // c2[1] c3[1] c2[3] c3[3]
+  _mm256_storeu_pd(&dst[0 * ld_dst], _mm256_permute2f128_pd(t0, t2, 0x20));
+  _mm256_storeu_pd(&dst[1 * ld_dst], _mm256_permute2f128_pd(t1, t3, 0x20));
+  _mm256_storeu_pd(&dst[2 * ld_dst], _mm256_permute2f128_pd(t0, t2, 0x31));
+  _mm256_storeu_pd(&dst[3 * ld_dst], _mm256_permute2f128_pd(t1, t3, 0x31));
+}
+#endif
+
+/*******************************************************************************
+ * \brief Private routine for transposing a block in double precision.
+ *        The block is processed in strips of four rows, such that the strided
+ *        accesses touch only four cache lines at a time.
+ ******************************************************************************/
+static void transpose_block(const int row_size, const int col_size,
+                            const double src[row_size * col_size],
+                            double dst[row_size * col_size]) {
+  int i0 = 0;
+#if defined(__AVX2__)
+  for (; i0 + 4 <= row_size; i0 += 4) {
+    int j0 = 0;
+    for (; j0 + 4 <= col_size; j0 += 4) {
+      transpose_tile_4x4(&src[j0 * row_size + i0], row_size,
+                         &dst[i0 * col_size + j0], col_size);
+    }
+    for (int j = j0; j < col_size; j++) {
+      for (int i = i0; i < i0 + 4; i++) {
+        dst[i * col_size + j] = src[j * row_size + i];
+      }
+    }
+  }
+#endif
+  for (; i0 < row_size; i0 += 4) {
+    const int i1 = (i0 + 4 < row_size) ? i0 + 4 : row_size;
+    for (int j = 0; j < col_size; j++) {
+      for (int i = i0; i < i1; i++) {
+        dst[i * col_size + j] = src[j * row_size + i];
+      }
+    }
+  }
+}
+
+/*******************************************************************************
+ * \brief Private routine for expanding a compressed block into double.
+ ******************************************************************************/
+static void expand_block(const int n, const void *segment, double data[n]) {
+  const wire_header_t *header = (const wire_header_t *)segment;
+  const void *payload = header + 1;
+  const int bits = wire_level_bits[header->level];
+  const double scale = ldexp(1.0, header->exponent - bits + 1);
+  switch ((wire_level_t)header->level) {
+  case WIRE_LEVEL_ZERO:
+    memset(data, 0, n * sizeof(double));
+    break;
+  case WIRE_LEVEL_INT8:
+    for (int i = 0; i < n; i++) {
+      data[i] = scale * ((const int8_t *)payload)[i];
+    }
+    break;
+  case WIRE_LEVEL_INT16:
+    for (int i = 0; i < n; i++) {
+      data[i] = scale * ((const int16_t *)payload)[i];
+    }
+    break;
+  case WIRE_LEVEL_FP32:
+    for (int i = 0; i < n; i++) {
+      data[i] = ((const float *)payload)[i];
+    }
+    break;
+  case WIRE_LEVEL_FP64:
+    memcpy(data, payload, n * sizeof(double));
+    break;
+  }
+}
+
 /*******************************************************************************
  * \brief Private struct used for planing during pack_matrix.
  * \author Ole Schuett
@@ -69,8 +287,33 @@ typedef struct {
   int rank;               // target mpi rank
   int row_size;
   int col_size;
+  int ndata; // in units of the wire format
+  wire_level_t level;
+  int exponent;
+  bool transposed; // block is sent transposed
 } plan_t;
 
+/*******************************************************************************
+ * \brief Private routine for counting the ways in which a block gets sent.
+ *        Off-diagonal blocks of symmetric matrices are sent also transposed.
+ ******************************************************************************/
+static inline int num_mirrors(const dbm_matrix_t *matrix,
+                              const dbm_block_t *blk) {
+  return (matrix->symmetric && blk->row != blk->col) ? 2 : 1;
+}
+
+/*******************************************************************************
+ * \brief Private routine for choosing the tick in which a sum index is sent.
+ *        Without a balanced mapping the indices are scattered pseudo-randomly.
+ ******************************************************************************/
+static inline int choose_tick(const int sum_index, const int nticks,
+                              const int *tick_of_sum_index) {
+  if (tick_of_sum_index != NULL) {
+    return tick_of_sum_index[sum_index];
+  }
+  return (1021 * sum_index) % nticks; // 1021 = a random prime
+}
+
 /*******************************************************************************
  * \brief Private routine for planing packs.
  * \author Ole Schuett
@@ -80,6 +323,9 @@ static void create_pack_plans(const bool trans_matrix, const bool trans_dist,
                               const dbm_mpi_comm_t comm,
                               const dbm_dist_1d_t *dist_indices,
                               const dbm_dist_1d_t *dist_ticks, const int nticks,
+                              const int *tick_of_sum_index,
+                              const dbm_wire_format_t wire_format,
+                              const double compression_eps,
                               const int npacks, plan_t *plans_per_pack[npacks],
                               int nblks_per_pack[npacks],
                               int ndata_per_pack[npacks]) {
@@ -97,10 +343,13 @@ static void create_pack_plans(const bool trans_matrix, const bool trans_dist,
       dbm_shard_t *shard = &matrix->shards[ishard];
       for (int iblock = 0; iblock < shard->nblocks; iblock++) {
         const dbm_block_t *blk = &shard->blocks[iblock];
-        const int sum_index = (trans_matrix) ? blk->row : blk->col;
-        const int itick = (1021 * sum_index) % nticks; // 1021 = a random prime
-        const int ipack = itick / dist_ticks->nranks;
-        nblks_mythread[ipack]++;
+        for (int mirror = 0; mirror < num_mirrors(matrix, blk); mirror++) {
+          const bool transposed = (trans_matrix != mirror);
+          const int sum_index = (transposed) ? blk->row : blk->col;
+          const int itick = choose_tick(sum_index, nticks, tick_of_sum_index);
+          const int ipack = itick / dist_ticks->nranks;
+          nblks_mythread[ipack]++;
+        }
       }
     }
 
@@ -124,25 +373,45 @@ static void create_pack_plans(const bool trans_matrix, const bool trans_dist,
       dbm_shard_t *shard = &matrix->shards[ishard];
       for (int iblock = 0; iblock < shard->nblocks; iblock++) {
         const dbm_block_t *blk = &shard->blocks[iblock];
-        const int free_index = (trans_matrix) ? blk->col : blk->row;
-        const int sum_index = (trans_matrix) ? blk->row : blk->col;
-        const int itick = (1021 * sum_index) % nticks; // Same mapping as above.
-        const int ipack = itick / dist_ticks->nranks;
-        // Compute rank to which this block should be sent.
-        const int coord_free_idx = dist_indices->index2coord[free_index];
-        const int coord_sum_idx = itick % dist_ticks->nranks;
-        const int coords[2] = {(trans_dist) ? coord_sum_idx : coord_free_idx,
-                               (trans_dist) ? coord_free_idx : coord_sum_idx};
-        const int rank = dbm_mpi_cart_rank(comm, coords);
-        const int row_size = matrix->row_sizes[blk->row];
-        const int col_size = matrix->col_sizes[blk->col];
-        ndata_mythread[ipack] += row_size * col_size;
-        // Create plan.
-        const int iplan = --nblks_mythread[ipack];
-        plans_per_pack[ipack][iplan].blk = blk;
-        plans_per_pack[ipack][iplan].rank = rank;
-        plans_per_pack[ipack][iplan].row_size = row_size;
-        plans_per_pack[ipack][iplan].col_size = col_size;
+        for (int mirror = 0; mirror < num_mirrors(matrix, blk); mirror++) {
+          const bool transposed = (trans_matrix != mirror);
+          const int free_index = (transposed) ? blk->col : blk->row;
+          const int sum_index = (transposed) ? blk->row : blk->col;
+          const int itick = choose_tick(sum_index, nticks, tick_of_sum_index);
+          const int ipack = itick / dist_ticks->nranks;
+          // Compute rank to which this block should be sent.
+          const int coord_free_idx = dist_indices->index2coord[free_index];
+          const int coord_sum_idx = itick % dist_ticks->nranks;
+          const int coords[2] = {(trans_dist) ? coord_sum_idx : coord_free_idx,
+                                 (trans_dist) ? coord_free_idx : coord_sum_idx};
+          const int rank = dbm_mpi_cart_rank(comm, coords);
+          const int row_size = matrix->row_sizes[blk->row];
+          const int col_size = matrix->col_sizes[blk->col];
+          // Choose wire level of block.
+          const int n = row_size * col_size;
+          int ndata = n, exponent = 0;
+          wire_level_t level = WIRE_LEVEL_FP64;
+          if (wire_format == DBM_WIRE_FP32) {
+            level = WIRE_LEVEL_FP32;
+          } else if (wire_format == DBM_WIRE_COMPRESSED) {
+            level = choose_wire_level(n, &shard->data[blk->offset],
+                                      compression_eps, &exponent);
+            // Keep blocks aligned to 8 bytes.
+            const int payload = (n * wire_level_bytes[level] + 7) / 8 * 8;
+            ndata = sizeof(wire_header_t) + payload;
+          }
+          ndata_mythread[ipack] += ndata;
+          // Create plan.
+          const int iplan = --nblks_mythread[ipack];
+          plans_per_pack[ipack][iplan].blk = blk;
+          plans_per_pack[ipack][iplan].rank = rank;
+          plans_per_pack[ipack][iplan].row_size = row_size;
+          plans_per_pack[ipack][iplan].col_size = col_size;
+          plans_per_pack[ipack][iplan].ndata = ndata;
+          plans_per_pack[ipack][iplan].level = level;
+          plans_per_pack[ipack][iplan].exponent = exponent;
+          plans_per_pack[ipack][iplan].transposed = transposed;
+        }
       }
     }
 #pragma omp critical
@@ -152,16 +421,30 @@ static void create_pack_plans(const bool trans_matrix, const bool trans_dist,
   } // end of omp parallel region
 }
 
+/*******************************************************************************
+ * \brief Private struct for remembering which block went into a send slot.
+ ******************************************************************************/
+typedef struct {
+  int ishard;
+  int iblock;
+  int offset; // within data_send
+  bool transposed;
+} send_slot_t;
+
 /*******************************************************************************
  * \brief Private routine for filling send buffers.
+ *        The data_send is counted in units of the wire format.
+ *        If send_slots is not NULL, the origin of each send slot is recorded.
  * \author Ole Schuett
  ******************************************************************************/
 static void fill_send_buffers(
-    const dbm_matrix_t *matrix, const bool trans_matrix, const int nblks_send,
-    const int ndata_send, plan_t plans[nblks_send], const int nranks,
+    const dbm_matrix_t *matrix, const dbm_wire_format_t wire_format,
+    const int nblks_send, const int ndata_send, plan_t plans[nblks_send],
+    const int nranks,
     int blks_send_count[nranks], int data_send_count[nranks],
     int blks_send_displ[nranks], int data_send_displ[nranks],
-    dbm_pack_block_t blks_send[nblks_send], double data_send[ndata_send]) {
+    dbm_pack_block_t blks_send[nblks_send], void *data_send,
+    send_slot_t *send_slots) {
 
   memset(blks_send_count, 0, nranks * sizeof(int));
   memset(data_send_count, 0, nranks * sizeof(int));
@@ -176,7 +459,7 @@ static void fill_send_buffers(
     for (int iblock = 0; iblock < nblks_send; iblock++) {
       const plan_t *plan = &plans[iblock];
       nblks_mythread[plan->rank] += 1;
-      ndata_mythread[plan->rank] += plan->row_size * plan->col_size;
+      ndata_mythread[plan->rank] += plan->ndata;
     }
 
     // Sum nblks and ndata across threads.
@@ -215,47 +498,107 @@ static void fill_send_buffers(
       //   data_send_displ[irank]: Start of data for irank within blk_send_data.
       //   ndata_mythread[irank]: Current threads offset within data for irank.
       nblks_mythread[irank] -= 1;
-      ndata_mythread[irank] -= row_size * col_size;
+      ndata_mythread[irank] -= plan->ndata;
       const int offset = data_send_displ[irank] + ndata_mythread[irank];
       const int jblock = blks_send_displ[irank] + nblks_mythread[irank];
 
+      // Compressed blocks start with a header, followed by their payload.
+      void *payload = (char *)data_send + offset * wire_unit_size(wire_format);
+      if (wire_format == DBM_WIRE_COMPRESSED) {
+        wire_header_t *header = (wire_header_t *)payload;
+        header->level = plan->level;
+        header->exponent = plan->exponent;
+        payload = header + 1;
+      }
+      const double factor =
+          ldexp(1.0, wire_level_bits[plan->level] - 1 - plan->exponent);
+
       double norm = 0.0; // Compute norm as double...
-      if (trans_matrix) {
+      if (plan->level == WIRE_LEVEL_FP64) {
+        // Fast path, the norm is taken afterwards while the block is in cache.
+        double *dst = (double *)payload;
+        if (plan->transposed) {
+          transpose_block(row_size, col_size, blk_data, dst);
+        } else {
+          memcpy(dst, blk_data, row_size * col_size * sizeof(double));
+        }
+        norm = block_norm(row_size * col_size, dst);
+      } else if (plan->transposed) {
         // Transpose block to allow for outer-product style multiplication.
         for (int i = 0; i < row_size; i++) {
           for (int j = 0; j < col_size; j++) {
             const double element = blk_data[j * row_size + i];
             norm += element * element;
-            data_send[offset + i * col_size + j] = element;
+            store_element(plan->level, factor, payload, i * col_size + j,
+                          element);
           }
         }
-        blks_send[jblock].free_index = plan->blk->col;
-        blks_send[jblock].sum_index = plan->blk->row;
       } else {
         for (int i = 0; i < row_size * col_size; i++) {
           const double element = blk_data[i];
           norm += element * element;
-          data_send[offset + i] = element;
+          store_element(plan->level, factor, payload, i, element);
         }
-        blks_send[jblock].free_index = plan->blk->row;
-        blks_send[jblock].sum_index = plan->blk->col;
       }
+      const dbm_block_t *blk_src = plan->blk;
+      blks_send[jblock].free_index =
+          (plan->transposed) ? blk_src->col : blk_src->row;
+      blks_send[jblock].sum_index =
+          (plan->transposed) ? blk_src->row : blk_src->col;
       blks_send[jblock].norm = (float)norm; // ...store norm as float.
+      // Norms are computed before rounding, hence filtering remains unchanged.
 
       // After the block exchange data_recv_displ will be added to the offsets.
       blks_send[jblock].offset = offset - data_send_displ[irank];
+
+      if (send_slots != NULL) {
+        send_slots[jblock].ishard = ishard;
+        send_slots[jblock].iblock = blk - shard->blocks;
+        send_slots[jblock].offset = offset;
+        send_slots[jblock].transposed = plan->transposed;
+      }
     }
   } // end of omp parallel region
 }
 
 /*******************************************************************************
- * \brief Private comperator passed to qsort to compare two blocks by sum_index.
+ * \brief Private routine for sorting blocks by their sum_index via a stable
+ *        LSD radix sort. The tmp array serves as scratch space.
  * \author Ole Schuett
  ******************************************************************************/
-static int compare_pack_blocks_by_sum_index(const void *a, const void *b) {
-  const dbm_pack_block_t *blk_a = (const dbm_pack_block_t *)a;
-  const dbm_pack_block_t *blk_b = (const dbm_pack_block_t *)b;
-  return blk_a->sum_index - blk_b->sum_index;
+static void radix_sort_by_sum_index(const int nblocks,
+                                    dbm_pack_block_t blocks[nblocks],
+                                    dbm_pack_block_t tmp[nblocks]) {
+  int max_sum_index = 0;
+  for (int i = 0; i < nblocks; i++) {
+    max_sum_index = imax(max_sum_index, blocks[i].sum_index);
+  }
+
+  const int nbuckets = 1 << RADIX_BITS;
+  dbm_pack_block_t *src = blocks, *dst = tmp;
+  for (int shift = 0; (max_sum_index >> shift) > 0; shift += RADIX_BITS) {
+    int bucket_start[nbuckets];
+    memset(bucket_start, 0, nbuckets * sizeof(int));
+    for (int i = 0; i < nblocks; i++) {
+      bucket_start[(src[i].sum_index >> shift) & (nbuckets - 1)]++;
+    }
+    int offset = 0;
+    for (int ibucket = 0; ibucket < nbuckets; ibucket++) {
+      const int count = bucket_start[ibucket];
+      bucket_start[ibucket] = offset;
+      offset += count;
+    }
+    for (int i = 0; i < nblocks; i++) {
+      const int ibucket = (src[i].sum_index >> shift) & (nbuckets - 1);
+      dst[bucket_start[ibucket]++] = src[i];
+    }
+    dbm_pack_block_t *swap = src;
+    src = dst;
+    dst = swap;
+  }
+  if (src != blocks) {
+    memcpy(blocks, src, nblocks * sizeof(dbm_pack_block_t));
+  }
 }
 
 /*******************************************************************************
@@ -312,8 +655,9 @@ static void postprocess_received_blocks(
 #pragma omp for
     for (int ishard = 0; ishard < nshards; ishard++) {
       if (nblocks_per_shard[ishard] > 1) {
-        qsort(&blks_recv[shard_start[ishard]], nblocks_per_shard[ishard],
-              sizeof(dbm_pack_block_t), &compare_pack_blocks_by_sum_index);
+        radix_sort_by_sum_index(nblocks_per_shard[ishard],
+                                &blks_recv[shard_start[ishard]],
+                                &blocks_tmp[shard_start[ishard]]);
       }
     }
   } // end of omp parallel region
@@ -322,38 +666,401 @@ static void postprocess_received_blocks(
 }
 
 /*******************************************************************************
- * \brief Private routine for redistributing a matrix along selected dimensions.
+ * \brief Private struct for remembering how a single pack was assembled.
  * \author Ole Schuett
  ******************************************************************************/
-static dbm_packed_matrix_t pack_matrix(const bool trans_matrix,
-                                       const bool trans_dist,
-                                       const dbm_matrix_t *matrix,
-                                       const dbm_distribution_t *dist,
-                                       const int nticks) {
+typedef struct {
+  int nblks_send;
+  int ndata_send;
+  send_slot_t *send_slots;
+  int *data_send_count; // All four arrays of size nranks share one allocation.
+  int *data_send_displ;
+  int *data_recv_count;
+  int *data_recv_displ;
+  int nblocks_recv;
+  int ndata_recv;
+  dbm_pack_block_t *blocks_recv; // Already post-processed, but stale norms.
+} pack_plan_t;
 
-  assert(dbm_mpi_comms_are_similar(matrix->dist->comm, dist->comm));
+/*******************************************************************************
+ * \brief Private struct for caching the pack plans of a packed matrix.
+ *        The global_key identifies the sparsity and distribution on all ranks,
+ *        while the local_key identifies the part owned by this rank.
+ ******************************************************************************/
+typedef struct {
+  bool valid;
+  uint64_t global_key;
+  uint64_t local_key;
+  uint64_t last_used;
+  int nsend_packs;
+  int max_sizes[3]; // nblocks, data_size, wire_size
+  pack_plan_t *packs;
+} matrix_plan_t;
+
+#define DBM_PLAN_CACHE_SIZE 8
+static matrix_plan_t plan_cache[DBM_PLAN_CACHE_SIZE];
+static uint64_t plan_cache_clock = 0;
 
-  // The row/col indicies are distributed along one cart dimension and the
-  // ticks are distributed along the other cart dimension.
-  const dbm_dist_1d_t *dist_indices = (trans_dist) ? &dist->cols : &dist->rows;
-  const dbm_dist_1d_t *dist_ticks = (trans_dist) ? &dist->rows : &dist->cols;
+/*******************************************************************************
+ * \brief Private routine for mixing a value into a hash, based on SplitMix64.
+ ******************************************************************************/
+static inline uint64_t hash_combine(const uint64_t seed, const uint64_t value) {
+  uint64_t z = (seed ^ value) + 0x9E3779B97F4A7C15ULL;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
 
-  // Allocate packed matrix.
-  const int nsend_packs = nticks / dist_ticks->nranks;
-  assert(nsend_packs * dist_ticks->nranks == nticks);
-  dbm_packed_matrix_t packed;
-  packed.dist_indices = dist_indices;
-  packed.dist_ticks = dist_ticks;
-  packed.nsend_packs = nsend_packs;
-  packed.send_packs = malloc(nsend_packs * sizeof(dbm_pack_t));
+/*******************************************************************************
+ * \brief Private routine for hashing everything pack_matrix's plans depend on,
+ *        except for the data of the blocks.
+ ******************************************************************************/
+static uint64_t fingerprint_matrix(const bool trans_matrix,
+                                   const bool trans_dist,
+                                   const dbm_matrix_t *matrix,
+                                   const dbm_distribution_t *dist,
+                                   const int nticks, const bool load_balance) {
+  const int nshards = dbm_get_num_shards(matrix);
+  uint64_t shard_keys[nshards];
+#pragma omp parallel for schedule(dynamic)
+  for (int ishard = 0; ishard < nshards; ishard++) {
+    const dbm_shard_t *shard = &matrix->shards[ishard];
+    uint64_t key = shard->nblocks;
+    for (int iblock = 0; iblock < shard->nblocks; iblock++) {
+      const dbm_block_t *blk = &shard->blocks[iblock];
+      key = hash_combine(key, ((uint64_t)blk->row << 32) | (uint32_t)blk->col);
+    }
+    shard_keys[ishard] = key;
+  }
+
+  uint64_t key =
+      8 * matrix->symmetric + 4 * load_balance + 2 * trans_matrix + trans_dist;
+  key = hash_combine(key, nticks);
+  key = hash_combine(key, nshards);
+  key = hash_combine(key, ((uint64_t)dist->nranks << 32) | dist->my_rank);
+  for (int i = 0; i < matrix->nrows; i++) {
+    key = hash_combine(key, matrix->row_sizes[i]);
+  }
+  for (int i = 0; i < matrix->ncols; i++) {
+    key = hash_combine(key, matrix->col_sizes[i]);
+  }
+  for (int i = 0; i < dist->rows.length; i++) {
+    key = hash_combine(key, dist->rows.index2coord[i]);
+  }
+  for (int i = 0; i < dist->cols.length; i++) {
+    key = hash_combine(key, dist->cols.index2coord[i]);
+  }
+  for (int ishard = 0; ishard < nshards; ishard++) {
+    key = hash_combine(key, shard_keys[ishard]);
+  }
+  return key;
+}
+
+/*******************************************************************************
+ * \brief Private routine for releasing the pack plans of a cached entry.
+ ******************************************************************************/
+static void free_matrix_plan(matrix_plan_t *plan) {
+  if (plan->valid) {
+    for (int ipack = 0; ipack < plan->nsend_packs; ipack++) {
+      free(plan->packs[ipack].send_slots);
+      free(plan->packs[ipack].data_send_count);
+      free(plan->packs[ipack].blocks_recv);
+    }
+    free(plan->packs);
+  }
+  plan->valid = false;
+  plan->nsend_packs = 0;
+  plan->packs = NULL;
+}
+
+/*******************************************************************************
+ * \brief Private routine for looking up the cached plans of both operands.
+ *        A plan is only reused when all ranks found it, otherwise a cache
+ *        entry is (re-)claimed, which pack_matrix then fills.
+ ******************************************************************************/
+static void lookup_plans(const bool transa, const bool transb,
+                         const dbm_matrix_t *matrix_a,
+                         const dbm_matrix_t *matrix_b,
+                         const dbm_distribution_t *dist, const int nticks,
+                         const bool load_balance, matrix_plan_t *plans[2],
+                         bool reuse[2]) {
+  const uint64_t keys[2] = {
+      fingerprint_matrix(transa, false, matrix_a, dist, nticks, load_balance),
+      fingerprint_matrix(!transb, true, matrix_b, dist, nticks, load_balance)};
+
+  // A balanced tick mapping depends on both operands, hence each plan is keyed
+  // by the pair. Otherwise, a plan could be replayed with a mapping that was
+  // balanced for another partner and disagrees with that of the partner's plan.
+  uint64_t local_keys[2] = {keys[0], keys[1]};
+  if (load_balance) {
+    for (int i = 0; i < 2; i++) { // Asymmetric, as hash_combine commutes.
+      local_keys[i] = hash_combine(hash_combine(keys[i], i), keys[1 - i]);
+    }
+  }
+
+  // Sum truncated local keys across ranks. With 40 bits it can not overflow.
+  int64_t sums[2];
+  for (int i = 0; i < 2; i++) {
+    sums[i] = (int64_t)(local_keys[i] >> 24);
+  }
+  dbm_mpi_sum_int64(sums, 2, dist->comm);
+
+  int found[2] = {0, 0};
+  uint64_t global_keys[2];
+  for (int i = 0; i < 2; i++) {
+    global_keys[i] = hash_combine((uint64_t)sums[i], dist->nranks);
+    plans[i] = NULL;
+    for (int j = 0; j < DBM_PLAN_CACHE_SIZE; j++) {
+      const matrix_plan_t *entry = &plan_cache[j];
+      if (entry->valid && entry->global_key == global_keys[i] &&
+          entry->local_key == local_keys[i]) {
+        plans[i] = &plan_cache[j];
+        plans[i]->last_used = ++plan_cache_clock;
+        found[i] = 1;
+        break;
+      }
+    }
+  }
+
+  // Cached recv counts are only valid when all other ranks also reuse theirs.
+  dbm_mpi_sum_int(found, 2, dist->comm);
+
+  for (int i = 0; i < 2; i++) {
+    reuse[i] = (found[i] == dist->nranks);
+  }
+
+  // Both plans have to be rebuilt together, as they share the tick mapping.
+  if (load_balance && !(reuse[0] && reuse[1])) {
+    reuse[0] = reuse[1] = false;
+  }
+
+  for (int i = 0; i < 2; i++) {
+    if (!reuse[i]) {
+      if (plans[i] == NULL) { // Evict least recently used entry.
+        plans[i] = &plan_cache[0];
+        for (int j = 1; j < DBM_PLAN_CACHE_SIZE; j++) {
+          if (plan_cache[j].last_used < plans[i]->last_used) {
+            plans[i] = &plan_cache[j];
+          }
+        }
+      }
+      free_matrix_plan(plans[i]);
+      plans[i]->global_key = global_keys[i];
+      plans[i]->local_key = local_keys[i];
+      plans[i]->last_used = ++plan_cache_clock;
+    }
+  }
+}
+
+/*******************************************************************************
+ * \brief Private routine for filling a send buffer according to a cached plan.
+ *        Only used for packs in DBM_WIRE_FP64.
+ ******************************************************************************/
+static void replay_send_buffer(const dbm_matrix_t *matrix,
+                               const pack_plan_t *pp, double *data_send) {
+#pragma omp parallel for schedule(static)
+  for (int islot = 0; islot < pp->nblks_send; islot++) {
+    const send_slot_t *slot = &pp->send_slots[islot];
+    const dbm_shard_t *shard = &matrix->shards[slot->ishard];
+    const dbm_block_t *blk = &shard->blocks[slot->iblock];
+    const double *blk_data = &shard->data[blk->offset];
+    const int row_size = matrix->row_sizes[blk->row];
+    const int col_size = matrix->col_sizes[blk->col];
+    double *payload = &data_send[slot->offset];
+    if (slot->transposed) {
+      transpose_block(row_size, col_size, blk_data, payload);
+    } else {
+      memcpy(payload, blk_data, row_size * col_size * sizeof(double));
+    }
+  }
+}
+
+/*******************************************************************************
+ * \brief Private routine for computing the norms of received blocks.
+ *        Like fill_send_buffers it uses block_norm, hence results are equal.
+ ******************************************************************************/
+static void compute_pack_norms(const dbm_packed_matrix_t *packed,
+                               dbm_pack_t *pack) {
+#pragma omp parallel for schedule(dynamic, 64)
+  for (int iblock = 0; iblock < pack->nblocks; iblock++) {
+    dbm_pack_block_t *blk = &pack->blocks[iblock];
+    const int n = packed->free_index_sizes[blk->free_index] *
+                  packed->sum_index_sizes[blk->sum_index];
+    blk->norm = (float)block_norm(n, &pack->data[blk->offset]);
+  }
+}
+
+/*******************************************************************************
+ * \brief Private struct for locating a send pack within a node-shared window.
+ ******************************************************************************/
+typedef struct {
+  int nblocks;
+  int data_size;
+  int wire_size;
+  size_t blocks_offset; // in bytes from the start of the rank's segment
+  size_t data_offset;
+} shared_pack_t;
+
+/*******************************************************************************
+ * \brief Private routine for rounding up to a multiple of the cache line size.
+ ******************************************************************************/
+static inline size_t align_to_cache_line(const size_t size) {
+  return (size + 63) & ~(size_t)63;
+}
+
+/*******************************************************************************
+ * \brief Private routine for allocating send packs of the given sizes, which
+ *        are counted in units of the wire format. When node-local peers read
+ *        the packs in place, they get placed directly into a shared window.
+ ******************************************************************************/
+static void allocate_send_packs(dbm_packed_matrix_t *packed,
+                                const int nsend_packs,
+                                const int nblocks[nsend_packs],
+                                const int ndata[nsend_packs]) {
+  assert(nsend_packs == packed->nsend_packs);
+  const bool fp64 = (packed->wire_format == DBM_WIRE_FP64);
+  const size_t unit = wire_unit_size(packed->wire_format);
+
+  // The segment starts with the headers, followed by the packs.
+  char *segment = NULL;
+  size_t offset = align_to_cache_line(nsend_packs * sizeof(shared_pack_t));
+  if (packed->node_ranks != NULL) {
+    size_t segment_size = offset;
+    for (int ipack = 0; ipack < nsend_packs; ipack++) {
+      segment_size +=
+          align_to_cache_line(nblocks[ipack] * sizeof(dbm_pack_block_t)) +
+          align_to_cache_line((size_t)ndata[ipack] * unit);
+    }
+    void *baseptr = NULL;
+    packed->shared_win = dbm_mpi_win_allocate_shared(
+        segment_size, packed->dist_ticks->node_comm, &baseptr);
+    segment = baseptr;
+  }
+
+  for (int ipack = 0; ipack < nsend_packs; ipack++) {
+    dbm_pack_t *pack = &packed->send_packs[ipack];
+    const size_t blocks_bytes = nblocks[ipack] * sizeof(dbm_pack_block_t);
+    const size_t data_bytes = (size_t)ndata[ipack] * unit;
+    void *data = NULL;
+    if (segment == NULL) {
+      pack->blocks = dbm_mpi_alloc_mem(blocks_bytes);
+      data = dbm_mempool_host_malloc(data_bytes);
+    } else {
+      shared_pack_t *header = &((shared_pack_t *)segment)[ipack];
+      header->blocks_offset = offset;
+      pack->blocks = (dbm_pack_block_t *)(segment + offset);
+      offset += align_to_cache_line(blocks_bytes);
+      header->data_offset = offset;
+      data = segment + offset;
+      offset += align_to_cache_line(data_bytes);
+    }
+    pack->data = (fp64) ? data : NULL;
+    pack->data_wire = (fp64) ? NULL : data;
+  }
+}
+
+/*******************************************************************************
+ * \brief Private routine for assembling a pack according to a cached plan.
+ *        Only the data exchange remains, everything else was memorized.
+ ******************************************************************************/
+static void replay_pack(const dbm_matrix_t *matrix, const dbm_mpi_comm_t comm,
+                        const pack_plan_t *pp, double *data_send,
+                        const dbm_packed_matrix_t *packed, dbm_pack_t *pack) {
+  replay_send_buffer(matrix, pp, data_send);
+
+  // The pack was allocated by allocate_send_packs according to the plan.
+  pack->nblocks = pp->nblocks_recv;
+  memcpy(pack->blocks, pp->blocks_recv,
+         pp->nblocks_recv * sizeof(dbm_pack_block_t));
+  pack->data_size = pp->ndata_recv;
+  pack->wire_size = 0;
+
+  dbm_library_phase_begin(DBM_PHASE_ALLTOALL);
+  dbm_mpi_alltoallv_double(data_send, pp->data_send_count, pp->data_send_displ,
+                           pack->data, pp->data_recv_count,
+                           pp->data_recv_displ, comm);
+  const int my_rank = dbm_mpi_comm_rank(comm);
+  for (int irank = 0; irank < dbm_mpi_comm_size(comm); irank++) {
+    if (irank != my_rank) {
+      dbm_library_bytes_sent_add(pp->data_send_count[irank] * sizeof(double));
+    }
+  }
+  dbm_library_phase_end(DBM_PHASE_ALLTOALL);
+
+  // Norms are not cached, because they depend on the data.
+  compute_pack_norms(packed, pack);
+}
+
+/*******************************************************************************
+ * \brief Internal routine for releasing all cached plans.
+ ******************************************************************************/
+void dbm_comm_plan_cache_clear(void) {
+  for (int i = 0; i < DBM_PLAN_CACHE_SIZE; i++) {
+    free_matrix_plan(&plan_cache[i]);
+    plan_cache[i].last_used = 0;
+  }
+  plan_cache_clock = 0;
+}
+
+/*******************************************************************************
+ * \brief Private routine for planing, filling, and exchanging all send packs.
+ *        If plan is not NULL, everything needed for a replay is recorded.
+ ******************************************************************************/
+static void create_packs(const bool trans_matrix, const bool trans_dist,
+                         const dbm_matrix_t *matrix,
+                         const dbm_distribution_t *dist, const int nticks,
+                         const int *tick_of_sum_index,
+                         const dbm_wire_format_t wire_format,
+                         const double compression_eps, matrix_plan_t *plan,
+                         dbm_packed_matrix_t *packed) {
+  const dbm_dist_1d_t *dist_indices = packed->dist_indices;
+  const dbm_dist_1d_t *dist_ticks = packed->dist_ticks;
+  const int nsend_packs = packed->nsend_packs;
+  const int unit = wire_unit_size(wire_format);
+  if (plan != NULL) {
+    assert(wire_format == DBM_WIRE_FP64 && !plan->valid);
+    plan->nsend_packs = nsend_packs;
+    plan->packs = malloc(nsend_packs * sizeof(pack_plan_t));
+  }
 
   // Plan all packs.
   plan_t *plans_per_pack[nsend_packs];
   int nblks_send_per_pack[nsend_packs], ndata_send_per_pack[nsend_packs];
   create_pack_plans(trans_matrix, trans_dist, matrix, dist->comm, dist_indices,
-                    dist_ticks, nticks, nsend_packs, plans_per_pack,
+                    dist_ticks, nticks, tick_of_sum_index, wire_format,
+                    compression_eps, nsend_packs, plans_per_pack,
                     nblks_send_per_pack, ndata_send_per_pack);
 
+  // Exchange the counts of all packs at once. This way the sizes of the packs
+  // are known before any of them is received, such that they can be allocated
+  // in one go, possibly within a window that is shared among the node.
+  const int nranks = dist->nranks;
+  const int ncounts = 2 * nsend_packs; // nblocks and ndata per pack
+  int *counts_send = calloc(nranks * ncounts, sizeof(int));
+  int *counts_recv = malloc(nranks * ncounts * sizeof(int));
+  for (int ipack = 0; ipack < nsend_packs; ipack++) {
+    for (int iblock = 0; iblock < nblks_send_per_pack[ipack]; iblock++) {
+      const plan_t *p = &plans_per_pack[ipack][iblock];
+      counts_send[p->rank * ncounts + 2 * ipack] += 1;
+      counts_send[p->rank * ncounts + 2 * ipack + 1] += p->ndata;
+    }
+  }
+  dbm_library_phase_begin(DBM_PHASE_ALLTOALL);
+  dbm_mpi_alltoall_int(counts_send, ncounts, counts_recv, ncounts, dist->comm);
+  dbm_library_phase_end(DBM_PHASE_ALLTOALL);
+  int nblocks_recv_per_pack[nsend_packs], ndata_recv_per_pack[nsend_packs];
+  memset(nblocks_recv_per_pack, 0, nsend_packs * sizeof(int));
+  memset(ndata_recv_per_pack, 0, nsend_packs * sizeof(int));
+  for (int ipack = 0; ipack < nsend_packs; ipack++) {
+    for (int irank = 0; irank < nranks; irank++) {
+      nblocks_recv_per_pack[ipack] += counts_recv[irank * ncounts + 2 * ipack];
+      ndata_recv_per_pack[ipack] +=
+          counts_recv[irank * ncounts + 2 * ipack + 1];
+    }
+  }
+  allocate_send_packs(packed, nsend_packs, nblocks_recv_per_pack,
+                      ndata_recv_per_pack);
+
   // Allocate send buffers for maximum number of blocks/data over all packs.
   int nblks_send_max = 0, ndata_send_max = 0;
   for (int ipack = 0; ipack < nsend_packs; ++ipack) {
@@ -362,29 +1069,45 @@ static dbm_packed_matrix_t pack_matrix(const bool trans_matrix,
   }
   dbm_pack_block_t *blks_send =
       dbm_mpi_alloc_mem(nblks_send_max * sizeof(dbm_pack_block_t));
-  double *data_send = dbm_mempool_host_malloc(ndata_send_max * sizeof(double));
+  void *data_send = dbm_mempool_host_malloc((size_t)ndata_send_max * unit);
 
   // Cannot parallelize over packs (there might be too few of them).
   for (int ipack = 0; ipack < nsend_packs; ipack++) {
     // Fill send buffers according to plans.
-    const int nranks = dist->nranks;
+    pack_plan_t *pp = (plan != NULL) ? &plan->packs[ipack] : NULL;
+    send_slot_t *send_slots = NULL;
+    if (pp != NULL) {
+      send_slots = malloc(nblks_send_per_pack[ipack] * sizeof(send_slot_t));
+    }
     int blks_send_count[nranks], data_send_count[nranks];
     int blks_send_displ[nranks], data_send_displ[nranks];
-    fill_send_buffers(matrix, trans_matrix, nblks_send_per_pack[ipack],
-                      ndata_send_per_pack[ipack], plans_per_pack[ipack], nranks,
-                      blks_send_count, data_send_count, blks_send_displ,
-                      data_send_displ, blks_send, data_send);
+    fill_send_buffers(matrix, wire_format, nblks_send_per_pack[ipack],
+                      ndata_send_per_pack[ipack], plans_per_pack[ipack],
+                      nranks, blks_send_count, data_send_count,
+                      blks_send_displ, data_send_displ, blks_send, data_send,
+                      send_slots);
     free(plans_per_pack[ipack]);
 
-    // 1st communication: Exchange block counts.
+    // Look up the counts, which were exchanged upfront.
+    dbm_library_phase_begin(DBM_PHASE_ALLTOALL);
     int blks_recv_count[nranks], blks_recv_displ[nranks];
-    dbm_mpi_alltoall_int(blks_send_count, 1, blks_recv_count, 1, dist->comm);
+    int data_recv_count[nranks], data_recv_displ[nranks];
+    for (int irank = 0; irank < nranks; irank++) {
+      assert(blks_send_count[irank] ==
+             counts_send[irank * ncounts + 2 * ipack]);
+      assert(data_send_count[irank] ==
+             counts_send[irank * ncounts + 2 * ipack + 1]);
+      blks_recv_count[irank] = counts_recv[irank * ncounts + 2 * ipack];
+      data_recv_count[irank] = counts_recv[irank * ncounts + 2 * ipack + 1];
+    }
     icumsum(nranks, blks_recv_count, blks_recv_displ);
-    const int nblocks_recv = isum(nranks, blks_recv_count);
+    icumsum(nranks, data_recv_count, data_recv_displ);
+    dbm_pack_t *pack = &packed->send_packs[ipack];
+    const int nblocks_recv = nblocks_recv_per_pack[ipack];
+    const int ndata_recv = ndata_recv_per_pack[ipack];
 
-    // 2nd communication: Exchange blocks.
-    dbm_pack_block_t *blks_recv =
-        dbm_mpi_alloc_mem(nblocks_recv * sizeof(dbm_pack_block_t));
+    // 1st communication: Exchange blocks.
+    dbm_pack_block_t *blks_recv = pack->blocks;
     int blks_send_count_byte[nranks], blks_send_displ_byte[nranks];
     int blks_recv_count_byte[nranks], blks_recv_displ_byte[nranks];
     for (int i = 0; i < nranks; i++) { // TODO: this is ugly!
@@ -397,59 +1120,358 @@ static dbm_packed_matrix_t pack_matrix(const bool trans_matrix,
         blks_send, blks_send_count_byte, blks_send_displ_byte, blks_recv,
         blks_recv_count_byte, blks_recv_displ_byte, dist->comm);
 
-    // 3rd communication: Exchange data counts.
-    // TODO: could be computed from blks_recv.
-    int data_recv_count[nranks], data_recv_displ[nranks];
-    dbm_mpi_alltoall_int(data_send_count, 1, data_recv_count, 1, dist->comm);
-    icumsum(nranks, data_recv_count, data_recv_displ);
-    const int ndata_recv = isum(nranks, data_recv_count);
-
-    // 4th communication: Exchange data.
-    double *data_recv = dbm_mempool_host_malloc(ndata_recv * sizeof(double));
-    dbm_mpi_alltoallv_double(data_send, data_send_count, data_send_displ,
-                             data_recv, data_recv_count, data_recv_displ,
+    // 2nd communication: Exchange data.
+    // The counts are in units of the wire format, hence they overflow only
+    // beyond 2^31 elements, as with double precision.
+    void *data_recv = (wire_format == DBM_WIRE_FP64) ? (void *)pack->data
+                                                     : pack->data_wire;
+    if (wire_format == DBM_WIRE_FP64) {
+      dbm_mpi_alltoallv_double(data_send, data_send_count, data_send_displ,
+                               data_recv, data_recv_count, data_recv_displ,
+                               dist->comm);
+    } else if (wire_format == DBM_WIRE_FP32) {
+      dbm_mpi_alltoallv_float(data_send, data_send_count, data_send_displ,
+                              data_recv, data_recv_count, data_recv_displ,
+                              dist->comm);
+    } else {
+      int data_send_count_byte[nranks], data_send_displ_byte[nranks];
+      int data_recv_count_byte[nranks], data_recv_displ_byte[nranks];
+      for (int i = 0; i < nranks; i++) {
+        data_send_count_byte[i] = data_send_count[i] * unit;
+        data_send_displ_byte[i] = data_send_displ[i] * unit;
+        data_recv_count_byte[i] = data_recv_count[i] * unit;
+        data_recv_displ_byte[i] = data_recv_displ[i] * unit;
+      }
+      dbm_mpi_alltoallv_byte(data_send, data_send_count_byte,
+                             data_send_displ_byte, data_recv,
+                             data_recv_count_byte, data_recv_displ_byte,
                              dist->comm);
+    }
+    for (int irank = 0; irank < nranks; irank++) {
+      if (irank != dist->my_rank) {
+        dbm_library_bytes_sent_add(blks_send_count_byte[irank] +
+                                   (int64_t)data_send_count[irank] * unit);
+      }
+    }
+    dbm_library_phase_end(DBM_PHASE_ALLTOALL);
 
     // Post-process received blocks and assemble them into a pack.
     postprocess_received_blocks(nranks, dist_indices->nshards, nblocks_recv,
                                 blks_recv_count, blks_recv_displ,
                                 data_recv_displ, blks_recv);
-    packed.send_packs[ipack].nblocks = nblocks_recv;
-    packed.send_packs[ipack].data_size = ndata_recv;
-    packed.send_packs[ipack].blocks = blks_recv;
-    packed.send_packs[ipack].data = data_recv;
+    pack->nblocks = nblocks_recv;
+    if (wire_format == DBM_WIRE_FP64) {
+      pack->data_size = ndata_recv;
+      pack->wire_size = 0;
+    } else {
+      pack->data_size = 0;
+      for (int iblock = 0; iblock < nblocks_recv; iblock++) {
+        const dbm_pack_block_t *blk = &blks_recv[iblock];
+        pack->data_size += packed->free_index_sizes[blk->free_index] *
+                           packed->sum_index_sizes[blk->sum_index];
+      }
+      pack->wire_size = ndata_recv;
+    }
+
+    // Memorize everything but the data for later replays.
+    if (pp != NULL) {
+      pp->nblks_send = nblks_send_per_pack[ipack];
+      pp->ndata_send = ndata_send_per_pack[ipack];
+      pp->send_slots = send_slots;
+      pp->data_send_count = malloc(4 * nranks * sizeof(int));
+      pp->data_send_displ = &pp->data_send_count[nranks];
+      pp->data_recv_count = &pp->data_send_count[2 * nranks];
+      pp->data_recv_displ = &pp->data_send_count[3 * nranks];
+      memcpy(pp->data_send_count, data_send_count, nranks * sizeof(int));
+      memcpy(pp->data_send_displ, data_send_displ, nranks * sizeof(int));
+      memcpy(pp->data_recv_count, data_recv_count, nranks * sizeof(int));
+      memcpy(pp->data_recv_displ, data_recv_displ, nranks * sizeof(int));
+      pp->nblocks_recv = nblocks_recv;
+      pp->ndata_recv = ndata_recv;
+      pp->blocks_recv = malloc(nblocks_recv * sizeof(dbm_pack_block_t));
+      memcpy(pp->blocks_recv, blks_recv,
+             nblocks_recv * sizeof(dbm_pack_block_t));
+    }
   }
 
   // Deallocate send buffers.
   dbm_mpi_free_mem(blks_send);
-  dbm_mempool_free(data_send);
+  dbm_mempool_host_free(data_send);
+  free(counts_send);
+  free(counts_recv);
+}
+
+/*******************************************************************************
+ * \brief Private routine for summing the free index sizes per sum index.
+ ******************************************************************************/
+static void sum_free_index_sizes(const bool trans_matrix,
+                                 const dbm_matrix_t *matrix,
+                                 int64_t free_index_sizes_sum[]) {
+#pragma omp parallel for schedule(dynamic)
+  for (int ishard = 0; ishard < dbm_get_num_shards(matrix); ishard++) {
+    const dbm_shard_t *shard = &matrix->shards[ishard];
+    for (int iblock = 0; iblock < shard->nblocks; iblock++) {
+      const dbm_block_t *blk = &shard->blocks[iblock];
+      for (int mirror = 0; mirror < num_mirrors(matrix, blk); mirror++) {
+        const bool transposed = (trans_matrix != mirror);
+        const int sum_index = (transposed) ? blk->row : blk->col;
+        const int free_size = (transposed) ? matrix->col_sizes[blk->col]
+                                           : matrix->row_sizes[blk->row];
+#pragma omp atomic
+        free_index_sizes_sum[sum_index] += free_size;
+      }
+    }
+  }
+}
+
+/*******************************************************************************
+ * \brief Private struct for assigning sum indices to ticks by their cost.
+ ******************************************************************************/
+typedef struct {
+  double cost;
+  int sum_index;
+} sum_index_cost_t;
+
+/*******************************************************************************
+ * \brief Private comperator passed to qsort to sort sum indices by decreasing
+ *        cost. Ties are broken by index, hence all ranks obtain the same order.
+ ******************************************************************************/
+static int compare_sum_indices_by_cost(const void *a, const void *b) {
+  const sum_index_cost_t *index_a = (const sum_index_cost_t *)a;
+  const sum_index_cost_t *index_b = (const sum_index_cost_t *)b;
+  if (index_a->cost != index_b->cost) {
+    return (index_a->cost < index_b->cost) ? 1 : -1;
+  }
+  return index_a->sum_index - index_b->sum_index;
+}
+
+/*******************************************************************************
+ * \brief Private routine for balancing the estimated flops across ticks.
+ *        The sum indices are assigned greedily to the least loaded tick in the
+ *        order of decreasing cost, aka longest-processing-time-first.
+ ******************************************************************************/
+static int *balance_ticks(const bool transa, const bool transb,
+                          const dbm_matrix_t *matrix_a,
+                          const dbm_matrix_t *matrix_b,
+                          const dbm_distribution_t *dist, const int nticks) {
+  // Sum free index sizes of the blocks of A and B per sum index across ranks.
+  const int nsum_indices = (transa) ? matrix_a->nrows : matrix_a->ncols;
+  int64_t *sums = calloc(2 * nsum_indices, sizeof(int64_t));
+  sum_free_index_sizes(transa, matrix_a, &sums[0]);
+  sum_free_index_sizes(!transb, matrix_b, &sums[nsum_indices]);
+  dbm_mpi_sum_int64(sums, 2 * nsum_indices, dist->comm);
+
+  // Before filtering a sum index of size k costs 2 * k * sum(m) * sum(n) flops.
+  const int *sum_index_sizes =
+      (transa) ? matrix_a->row_sizes : matrix_a->col_sizes;
+  sum_index_cost_t *costs = malloc(nsum_indices * sizeof(sum_index_cost_t));
+  for (int i = 0; i < nsum_indices; i++) {
+    costs[i].sum_index = i;
+    costs[i].cost = 2.0 * sum_index_sizes[i] * (double)sums[i] *
+                    (double)sums[nsum_indices + i];
+  }
+  free(sums);
+  qsort(costs, nsum_indices, sizeof(sum_index_cost_t),
+        &compare_sum_indices_by_cost);
+
+  int *tick_of_sum_index = malloc(nsum_indices * sizeof(int));
+  double loads[nticks];
+  memset(loads, 0, nticks * sizeof(double));
+  for (int i = 0; i < nsum_indices; i++) {
+    const int sum_index = costs[i].sum_index;
+    if (costs[i].cost == 0.0) {
+      // Indices without work keep their pseudo-random tick to spread the data.
+      tick_of_sum_index[sum_index] = choose_tick(sum_index, nticks, NULL);
+      continue;
+    }
+    int itick_min = 0;
+    for (int itick = 1; itick < nticks; itick++) {
+      if (loads[itick] < loads[itick_min]) {
+        itick_min = itick;
+      }
+    }
+    tick_of_sum_index[sum_index] = itick_min;
+    loads[itick_min] += costs[i].cost;
+  }
+  free(costs);
+
+  return tick_of_sum_index; // Ownership of tick_of_sum_index passes to caller.
+}
+
+/*******************************************************************************
+ * \brief Private routine for making the send packs, which were allocated
+ *        within the shared window, visible to the node-local peers.
+ ******************************************************************************/
+static void publish_send_packs(dbm_packed_matrix_t *packed) {
+  const int my_node_rank = packed->node_ranks[packed->dist_ticks->my_rank];
+  shared_pack_t *headers =
+      dbm_mpi_win_shared_query(packed->shared_win, my_node_rank);
+  for (int ipack = 0; ipack < packed->nsend_packs; ipack++) {
+    const dbm_pack_t *pack = &packed->send_packs[ipack];
+    headers[ipack].nblocks = pack->nblocks;
+    headers[ipack].data_size = pack->data_size;
+    headers[ipack].wire_size = pack->wire_size;
+  }
+  dbm_mpi_win_fence(packed->shared_win);
+}
+
+/*******************************************************************************
+ * \brief Private routine for obtaining a view of a node-local peer's send pack.
+ ******************************************************************************/
+static dbm_pack_t *view_shared_pack(const dbm_packed_matrix_t *packed,
+                                    const int node_rank, const int ipack,
+                                    dbm_pack_t *view) {
+  char *segment = dbm_mpi_win_shared_query(packed->shared_win, node_rank);
+  const shared_pack_t *header = &((const shared_pack_t *)segment)[ipack];
+  view->nblocks = header->nblocks;
+  view->data_size = header->data_size;
+  view->wire_size = header->wire_size;
+  view->blocks = (dbm_pack_block_t *)(segment + header->blocks_offset);
+  if (packed->wire_format == DBM_WIRE_FP64) {
+    view->data = (double *)(segment + header->data_offset);
+    view->data_wire = NULL;
+  } else {
+    view->data = NULL;
+    view->data_wire = segment + header->data_offset;
+  }
+  return view;
+}
+
+/*******************************************************************************
+ * \brief Private routine for redistributing a matrix along selected dimensions.
+ *        With reuse_plan the given cached plan is replayed, otherwise the plan
+ *        gets recorded, unless it is NULL.
+ ******************************************************************************/
+static dbm_packed_matrix_t pack_matrix(const bool trans_matrix,
+                                       const bool trans_dist,
+                                       const dbm_matrix_t *matrix,
+                                       const dbm_distribution_t *dist,
+                                       const int nticks,
+                                       const int *tick_of_sum_index,
+                                       const dbm_wire_format_t wire_format,
+                                       const double compression_eps,
+                                       matrix_plan_t *plan,
+                                       const bool reuse_plan) {
+
+  assert(dbm_mpi_comms_are_similar(matrix->dist->comm, dist->comm));
+
+  // The row/col indicies are distributed along one cart dimension and the
+  // ticks are distributed along the other cart dimension.
+  const dbm_dist_1d_t *dist_indices = (trans_dist) ? &dist->cols : &dist->rows;
+  const dbm_dist_1d_t *dist_ticks = (trans_dist) ? &dist->rows : &dist->cols;
+
+  // Allocate packed matrix.
+  const int nsend_packs = nticks / dist_ticks->nranks;
+  assert(nsend_packs * dist_ticks->nranks == nticks);
+  dbm_packed_matrix_t packed;
+  packed.dist_indices = dist_indices;
+  packed.dist_ticks = dist_ticks;
+  packed.nsend_packs = nsend_packs;
+  packed.wire_format = wire_format;
+  packed.free_index_sizes = (trans_matrix) ? matrix->col_sizes
+                                           : matrix->row_sizes;
+  packed.sum_index_sizes = (trans_matrix) ? matrix->row_sizes
+                                          : matrix->col_sizes;
+  packed.send_packs = malloc(nsend_packs * sizeof(dbm_pack_t));
+
+  // Node-local peers read the send packs in place from a shared window.
+  packed.node_ranks = NULL;
+  if (dbm_library_get_config()->shared_memory) {
+    packed.node_ranks = dist_ticks->node_ranks;
+  }
+
+  int max_sizes[3]; // nblocks, data_size, wire_size
+  if (reuse_plan) {
+    // Replay cached plan, only the data needs to be exchanged.
+    assert(plan->valid && plan->nsend_packs == nsend_packs);
+    int ndata_send_max = 0;
+    int nblocks_recv[nsend_packs], ndata_recv[nsend_packs];
+    memset(nblocks_recv, 0, nsend_packs * sizeof(int));
+    memset(ndata_recv, 0, nsend_packs * sizeof(int));
+    for (int ipack = 0; ipack < nsend_packs; ipack++) {
+      ndata_send_max = imax(ndata_send_max, plan->packs[ipack].ndata_send);
+      nblocks_recv[ipack] = plan->packs[ipack].nblocks_recv;
+      ndata_recv[ipack] = plan->packs[ipack].ndata_recv;
+    }
+    allocate_send_packs(&packed, nsend_packs, nblocks_recv, ndata_recv);
+    double *data_send =
+        dbm_mempool_host_malloc(ndata_send_max * sizeof(double));
+    for (int ipack = 0; ipack < nsend_packs; ipack++) {
+      replay_pack(matrix, dist->comm, &plan->packs[ipack], data_send, &packed,
+                  &packed.send_packs[ipack]);
+    }
+    dbm_mempool_host_free(data_send);
+    memcpy(max_sizes, plan->max_sizes, 3 * sizeof(int));
+  } else {
+    create_packs(trans_matrix, trans_dist, matrix, dist, nticks,
+                 tick_of_sum_index, wire_format, compression_eps, plan,
+                 &packed);
+    memset(max_sizes, 0, 3 * sizeof(int));
+    for (int ipack = 0; ipack < packed.nsend_packs; ipack++) {
+      max_sizes[0] = imax(max_sizes[0], packed.send_packs[ipack].nblocks);
+      max_sizes[1] = imax(max_sizes[1], packed.send_packs[ipack].data_size);
+      max_sizes[2] = imax(max_sizes[2], packed.send_packs[ipack].wire_size);
+    }
+    dbm_mpi_max_int(max_sizes, 3, packed.dist_ticks->comm);
+    if (plan != NULL) {
+      memcpy(plan->max_sizes, max_sizes, 3 * sizeof(int));
+      plan->valid = true;
+    }
+  }
+
+  if (packed.node_ranks != NULL) {
+    publish_send_packs(&packed);
+  }
 
   // Allocate pack_recv.
-  int max_nblocks = 0, max_data_size = 0;
-  for (int ipack = 0; ipack < packed.nsend_packs; ipack++) {
-    max_nblocks = imax(max_nblocks, packed.send_packs[ipack].nblocks);
-    max_data_size = imax(max_data_size, packed.send_packs[ipack].data_size);
-  }
-  dbm_mpi_max_int(&max_nblocks, 1, packed.dist_ticks->comm);
-  dbm_mpi_max_int(&max_data_size, 1, packed.dist_ticks->comm);
-  packed.max_nblocks = max_nblocks;
-  packed.max_data_size = max_data_size;
-  packed.recv_pack.blocks =
-      dbm_mpi_alloc_mem(packed.max_nblocks * sizeof(dbm_pack_block_t));
-  packed.recv_pack.data =
-      dbm_mempool_host_malloc(packed.max_data_size * sizeof(double));
+  packed.max_nblocks = max_sizes[0];
+  packed.max_data_size = max_sizes[1];
+  packed.max_wire_size = max_sizes[2];
+  for (int ibuf = 0; ibuf < 2; ibuf++) {
+    dbm_pack_t *recv_pack = &packed.recv_packs[ibuf];
+    recv_pack->blocks =
+        dbm_mpi_alloc_mem(packed.max_nblocks * sizeof(dbm_pack_block_t));
+    recv_pack->data = NULL;
+    recv_pack->data_wire = NULL;
+    if (wire_format == DBM_WIRE_FP64) {
+      recv_pack->data =
+          dbm_mempool_host_malloc(packed.max_data_size * sizeof(double));
+    } else {
+      recv_pack->data_wire = dbm_mempool_host_malloc(
+          (size_t)packed.max_wire_size * wire_unit_size(wire_format));
+    }
+    packed.ready_packs[ibuf] = NULL;
+    packed.nrequests[ibuf] = 0;
+  }
+
+  // Packs are expanded only when handed out, which happens one at a time.
+  // Hence, a single buffer in double precision suffices for both receive
+  // buffers, while those shrink to the size of the wire format.
+  dbm_pack_t *fp64_pack = &packed.fp64_pack;
+  fp64_pack->blocks = NULL;
+  fp64_pack->data = NULL;
+  if (wire_format != DBM_WIRE_FP64) {
+    fp64_pack->data =
+        dbm_mempool_host_malloc(packed.max_data_size * sizeof(double));
+  }
+  if (wire_format == DBM_WIRE_COMPRESSED) {
+    // Compressed blocks get new offsets when expanded.
+    fp64_pack->blocks = malloc(packed.max_nblocks * sizeof(dbm_pack_block_t));
+  }
 
   return packed; // Ownership of packed transfers to caller.
 }
 
 /*******************************************************************************
- * \brief Private routine for sending and receiving the pack for the given tick.
+ * \brief Private routine for posting the pack exchange for the given tick.
+ *        The exchange is non-blocking and lands in the given receive buffer.
  * \author Ole Schuett
  ******************************************************************************/
-static dbm_pack_t *sendrecv_pack(const int itick, const int nticks,
-                                 dbm_packed_matrix_t *packed) {
+static void post_pack_exchange(const int itick, const int nticks,
+                               const int ibuf, dbm_packed_matrix_t *packed) {
   const int nranks = packed->dist_ticks->nranks;
   const int my_rank = packed->dist_ticks->my_rank;
+  assert(packed->ready_packs[ibuf] == NULL && packed->nrequests[ibuf] == 0);
 
   // Compute send rank and pack.
   const int itick_of_rank0 = (itick + nticks - my_rank) % nticks;
@@ -464,39 +1486,179 @@ static dbm_pack_t *sendrecv_pack(const int itick, const int nticks,
 
   if (send_rank == my_rank) {
     assert(send_rank == recv_rank && send_ipack == recv_ipack);
-    return &packed->send_packs[send_ipack]; // Local pack, no mpi needed.
+    // Local pack, no mpi needed.
+    packed->ready_packs[ibuf] = &packed->send_packs[send_ipack];
   } else {
     const dbm_pack_t *send_pack = &packed->send_packs[send_ipack];
+    dbm_pack_t *recv_pack = &packed->recv_packs[ibuf];
+    dbm_mpi_request_t *requests = packed->requests[ibuf];
+    const dbm_mpi_comm_t comm = packed->dist_ticks->comm;
+
+    const int *node_ranks = packed->node_ranks;
+    int nrequests = 0;
+
+    if (node_ranks != NULL && node_ranks[recv_rank] >= 0) {
+      // Read the pack in place from the window of a node-local peer.
+      dbm_pack_t *view = &packed->shared_packs[ibuf];
+      packed->ready_packs[ibuf] =
+          view_shared_pack(packed, node_ranks[recv_rank], recv_ipack, view);
+    } else {
+      // Receives are waited upon individually to obtain the received counts.
+      requests[nrequests++] = dbm_mpi_irecv_byte(
+          /*recvbuf=*/recv_pack->blocks,
+          /*recvcount=*/packed->max_nblocks * sizeof(dbm_pack_block_t),
+          /*source=*/recv_rank,
+          /*recvtag=*/recv_ipack,
+          /*comm=*/comm);
+      if (packed->wire_format == DBM_WIRE_FP64) {
+        requests[nrequests++] = dbm_mpi_irecv_double(
+            /*recvbuf=*/recv_pack->data,
+            /*recvcount=*/packed->max_data_size,
+            /*source=*/recv_rank,
+            /*recvtag=*/recv_ipack,
+            /*comm=*/comm);
+      } else if (packed->wire_format == DBM_WIRE_FP32) {
+        requests[nrequests++] = dbm_mpi_irecv_float(
+            /*recvbuf=*/recv_pack->data_wire,
+            /*recvcount=*/packed->max_wire_size,
+            /*source=*/recv_rank,
+            /*recvtag=*/recv_ipack,
+            /*comm=*/comm);
+      } else {
+        requests[nrequests++] = dbm_mpi_irecv_byte(
+            /*recvbuf=*/recv_pack->data_wire,
+            /*recvcount=*/packed->max_wire_size,
+            /*source=*/recv_rank,
+            /*recvtag=*/recv_ipack,
+            /*comm=*/comm);
+      }
+      packed->ready_packs[ibuf] = recv_pack;
+    }
 
-    // Exchange blocks.
-    const int nblocks_in_bytes = dbm_mpi_sendrecv_byte(
-        /*sendbuf=*/send_pack->blocks,
-        /*sendcound=*/send_pack->nblocks * sizeof(dbm_pack_block_t),
-        /*dest=*/send_rank,
-        /*sendtag=*/send_ipack,
-        /*recvbuf=*/packed->recv_pack.blocks,
-        /*recvcount=*/packed->max_nblocks * sizeof(dbm_pack_block_t),
-        /*source=*/recv_rank,
-        /*recvtag=*/recv_ipack,
-        /*comm=*/packed->dist_ticks->comm);
+    // The send packs remain untouched until the iterator is stopped.
+    if (node_ranks == NULL || node_ranks[send_rank] < 0) {
+      requests[nrequests++] = dbm_mpi_isend_byte(
+          /*sendbuf=*/send_pack->blocks,
+          /*sendcount=*/send_pack->nblocks * sizeof(dbm_pack_block_t),
+          /*dest=*/send_rank,
+          /*sendtag=*/send_ipack,
+          /*comm=*/comm);
+      if (packed->wire_format == DBM_WIRE_FP64) {
+        requests[nrequests++] = dbm_mpi_isend_double(
+            /*sendbuf=*/send_pack->data,
+            /*sendcount=*/send_pack->data_size,
+            /*dest=*/send_rank,
+            /*sendtag=*/send_ipack,
+            /*comm=*/comm);
+      } else if (packed->wire_format == DBM_WIRE_FP32) {
+        requests[nrequests++] = dbm_mpi_isend_float(
+            /*sendbuf=*/send_pack->data_wire,
+            /*sendcount=*/send_pack->wire_size,
+            /*dest=*/send_rank,
+            /*sendtag=*/send_ipack,
+            /*comm=*/comm);
+      } else {
+        requests[nrequests++] = dbm_mpi_isend_byte(
+            /*sendbuf=*/send_pack->data_wire,
+            /*sendcount=*/send_pack->wire_size,
+            /*dest=*/send_rank,
+            /*sendtag=*/send_ipack,
+            /*comm=*/comm);
+      }
+      int64_t bytes = send_pack->nblocks * sizeof(dbm_pack_block_t);
+      if (packed->wire_format == DBM_WIRE_FP64) {
+        bytes += send_pack->data_size * sizeof(double);
+      } else {
+        bytes += (int64_t)send_pack->wire_size *
+                 wire_unit_size(packed->wire_format);
+      }
+      dbm_library_bytes_sent_add(bytes);
+    }
+    packed->nrequests[ibuf] = nrequests;
+  }
+}
 
-    assert(nblocks_in_bytes % sizeof(dbm_pack_block_t) == 0);
-    packed->recv_pack.nblocks = nblocks_in_bytes / sizeof(dbm_pack_block_t);
+/*******************************************************************************
+ * \brief Private routine for expanding a pack from its wire format into double.
+ ******************************************************************************/
+static void expand_pack(const dbm_packed_matrix_t *packed,
+                        const dbm_pack_t *pack, dbm_pack_t *fp64_pack) {
+  fp64_pack->nblocks = pack->nblocks;
+  fp64_pack->data_wire = pack->data_wire;
+  fp64_pack->wire_size = pack->wire_size;
+
+  if (packed->wire_format == DBM_WIRE_FP32) {
+    fp64_pack->data_size = pack->wire_size;
+    fp64_pack->blocks = pack->blocks; // Offsets remain the same.
+    const float *data_wire = pack->data_wire;
+    double *data = fp64_pack->data;
+#pragma omp parallel for simd schedule(static)
+    for (int i = 0; i < fp64_pack->data_size; i++) {
+      data[i] = data_wire[i];
+    }
+    return;
+  }
 
-    // Exchange data.
-    packed->recv_pack.data_size = dbm_mpi_sendrecv_double(
-        /*sendbuf=*/send_pack->data,
-        /*sendcound=*/send_pack->data_size,
-        /*dest=*/send_rank,
-        /*sendtag=*/send_ipack,
-        /*recvbuf=*/packed->recv_pack.data,
-        /*recvcount=*/packed->max_data_size,
-        /*source=*/recv_rank,
-        /*recvtag=*/recv_ipack,
-        /*comm=*/packed->dist_ticks->comm);
+  // Compressed blocks are expanded consecutively in the order of the pack.
+  assert(packed->wire_format == DBM_WIRE_COMPRESSED);
+  int data_size = 0;
+  for (int iblock = 0; iblock < pack->nblocks; iblock++) {
+    const dbm_pack_block_t *blk = &pack->blocks[iblock];
+    fp64_pack->blocks[iblock] = *blk;
+    fp64_pack->blocks[iblock].offset = data_size;
+    data_size += packed->free_index_sizes[blk->free_index] *
+                 packed->sum_index_sizes[blk->sum_index];
+  }
+  assert(data_size <= packed->max_data_size);
+  fp64_pack->data_size = data_size;
+
+#pragma omp parallel for schedule(dynamic, 64)
+  for (int iblock = 0; iblock < pack->nblocks; iblock++) {
+    const dbm_pack_block_t *blk = &pack->blocks[iblock];
+    const int n = packed->free_index_sizes[blk->free_index] *
+                  packed->sum_index_sizes[blk->sum_index];
+    const char *segment = (const char *)pack->data_wire + blk->offset;
+    const int offset = fp64_pack->blocks[iblock].offset;
+    expand_block(n, segment, &fp64_pack->data[offset]);
+  }
+}
+
+/*******************************************************************************
+ * \brief Private routine for completing the pack exchange of given buffer.
+ ******************************************************************************/
+static dbm_pack_t *wait_pack_exchange(const int ibuf,
+                                      dbm_packed_matrix_t *packed) {
+  dbm_pack_t *pack = packed->ready_packs[ibuf];
+  assert(pack != NULL);
+
+  if (packed->nrequests[ibuf] > 0) {
+    dbm_mpi_request_t *requests = packed->requests[ibuf];
+    int isend = 0; // The receive requests, if any, come first.
+    if (pack == &packed->recv_packs[ibuf]) {
+      const int nblocks_in_bytes = dbm_mpi_wait_byte(&requests[0]);
+      assert(nblocks_in_bytes % sizeof(dbm_pack_block_t) == 0);
+      pack->nblocks = nblocks_in_bytes / sizeof(dbm_pack_block_t);
+      if (packed->wire_format == DBM_WIRE_FP64) {
+        pack->data_size = dbm_mpi_wait_double(&requests[1]);
+      } else if (packed->wire_format == DBM_WIRE_FP32) {
+        pack->wire_size = dbm_mpi_wait_float(&requests[1]);
+      } else {
+        pack->wire_size = dbm_mpi_wait_byte(&requests[1]);
+      }
+      isend = 2;
+    }
+    dbm_mpi_waitall(packed->nrequests[ibuf] - isend, &requests[isend]);
+    packed->nrequests[ibuf] = 0;
+  }
 
-    return &packed->recv_pack;
+  packed->ready_packs[ibuf] = NULL;
+  if (packed->wire_format == DBM_WIRE_FP64) {
+    return pack;
   }
+
+  // Decompression is fused into the receive path.
+  expand_pack(packed, pack, &packed->fp64_pack);
+  return &packed->fp64_pack;
 }
 
 /*******************************************************************************
@@ -504,25 +1666,55 @@ static dbm_pack_t *sendrecv_pack(const int itick, const int nticks,
  * \author Ole Schuett
  ******************************************************************************/
 static void free_packed_matrix(dbm_packed_matrix_t *packed) {
-  dbm_mpi_free_mem(packed->recv_pack.blocks);
-  dbm_mempool_free(packed->recv_pack.data);
-  for (int ipack = 0; ipack < packed->nsend_packs; ipack++) {
-    dbm_mpi_free_mem(packed->send_packs[ipack].blocks);
-    dbm_mempool_free(packed->send_packs[ipack].data);
+  for (int ibuf = 0; ibuf < 2; ibuf++) {
+    assert(packed->nrequests[ibuf] == 0); // All exchanges must be completed.
+    dbm_mpi_free_mem(packed->recv_packs[ibuf].blocks);
+    dbm_mempool_host_free(packed->recv_packs[ibuf].data);
+    dbm_mempool_host_free(packed->recv_packs[ibuf].data_wire);
+  }
+  dbm_mempool_host_free(packed->fp64_pack.data);
+  if (packed->wire_format == DBM_WIRE_COMPRESSED) {
+    free(packed->fp64_pack.blocks);
+  }
+  if (packed->node_ranks != NULL) {
+    // Freeing synchronizes, hence node-local peers are done reading the packs.
+    dbm_mpi_win_free(&packed->shared_win);
+  } else {
+    for (int ipack = 0; ipack < packed->nsend_packs; ipack++) {
+      dbm_mpi_free_mem(packed->send_packs[ipack].blocks);
+      dbm_mempool_host_free(packed->send_packs[ipack].data);
+      dbm_mempool_host_free(packed->send_packs[ipack].data_wire);
+    }
   }
   free(packed->send_packs);
 }
 
+/*******************************************************************************
+ * \brief Private routine for posting the pack exchanges of the iterator's tick.
+ ******************************************************************************/
+static void post_tick_exchange(dbm_comm_iterator_t *iter) {
+  // Start each rank at a different tick to spread the load on the sources.
+  const int shift = iter->dist->rows.my_rank + iter->dist->cols.my_rank;
+  const int shifted_itick = (iter->itick + shift) % iter->nticks;
+  const int ibuf = iter->itick % 2;
+  post_pack_exchange(shifted_itick, iter->nticks, ibuf, &iter->packed_a);
+  post_pack_exchange(shifted_itick, iter->nticks, ibuf, &iter->packed_b);
+}
+
 /*******************************************************************************
  * \brief Internal routine for creating a communication iterator.
  * \author Ole Schuett
  ******************************************************************************/
-dbm_comm_iterator_t *dbm_comm_iterator_start(const bool transa,
-                                             const bool transb,
-                                             const dbm_matrix_t *matrix_a,
-                                             const dbm_matrix_t *matrix_b,
-                                             const dbm_matrix_t *matrix_c) {
-
+dbm_comm_iterator_t *
+dbm_comm_iterator_start(const bool transa, const bool transb,
+                        const dbm_matrix_t *matrix_a,
+                        const dbm_matrix_t *matrix_b,
+                        const dbm_matrix_t *matrix_c,
+                        const dbm_wire_format_t wire_format,
+                        const double compression_eps) {
+
+  const double time_start = omp_get_wtime();
+  dbm_library_phase_begin(DBM_PHASE_PACK);
   dbm_comm_iterator_t *iter = malloc(sizeof(dbm_comm_iterator_t));
   iter->dist = matrix_c->dist;
 
@@ -532,12 +1724,44 @@ dbm_comm_iterator_t *dbm_comm_iterator_start(const bool transa,
   iter->nticks = lcm(iter->dist->rows.nranks, iter->dist->cols.nranks);
   iter->itick = 0;
 
-  // 1.arg=source dimension, 2.arg=target dimension, false=rows, true=columns.
-  iter->packed_a =
-      pack_matrix(transa, false, matrix_a, iter->dist, iter->nticks);
-  iter->packed_b =
-      pack_matrix(!transb, true, matrix_b, iter->dist, iter->nticks);
+  // Node-local peers read each other's packs, which requires node_comm.
+  const dbm_library_config_t *config = dbm_library_get_config();
+  if (config->shared_memory) {
+    dbm_dist_1d_split_shared(&iter->dist->rows);
+    dbm_dist_1d_split_shared(&iter->dist->cols);
+  }
 
+  // Recurring multiplies with unchanged sparsity can replay cached plans.
+  // Other wire formats are not cached as their block sizes depend on the data.
+  matrix_plan_t *plans[2] = {NULL, NULL};
+  bool reuse[2] = {false, false};
+  if (config->plan_cache && wire_format == DBM_WIRE_FP64) {
+    lookup_plans(transa, transb, matrix_a, matrix_b, iter->dist, iter->nticks,
+                 config->load_balance, plans, reuse);
+  }
+
+  // Optionally, balance the estimated flops across ticks. Replayed plans
+  // already incorporate the balanced mapping.
+  int *tick_of_sum_index = NULL;
+  if (config->load_balance && iter->nticks > 1 && !(reuse[0] && reuse[1])) {
+    tick_of_sum_index = balance_ticks(transa, transb, matrix_a, matrix_b,
+                                      iter->dist, iter->nticks);
+  }
+
+  // 1.arg=source dimension, 2.arg=target dimension, false=rows, true=columns.
+  iter->packed_a = pack_matrix(transa, false, matrix_a, iter->dist,
+                               iter->nticks, tick_of_sum_index, wire_format,
+                               compression_eps, plans[0], reuse[0]);
+  iter->packed_b = pack_matrix(!transb, true, matrix_b, iter->dist,
+                               iter->nticks, tick_of_sum_index, wire_format,
+                               compression_eps, plans[1], reuse[1]);
+  free(tick_of_sum_index);
+
+  // Post the exchange of the first tick right away.
+  post_tick_exchange(iter);
+
+  dbm_library_phase_end(DBM_PHASE_PACK);
+  dbm_library_comm_time_add(omp_get_wtime() - time_start);
   return iter;
 }
 
@@ -551,13 +1775,21 @@ bool dbm_comm_iterator_next(dbm_comm_iterator_t *iter, dbm_pack_t **pack_a,
     return false; // end of iterator reached
   }
 
-  // Start each rank at a different tick to spread the load on the sources.
-  const int shift = iter->dist->rows.my_rank + iter->dist->cols.my_rank;
-  const int shifted_itick = (iter->itick + shift) % iter->nticks;
-  *pack_a = sendrecv_pack(shifted_itick, iter->nticks, &iter->packed_a);
-  *pack_b = sendrecv_pack(shifted_itick, iter->nticks, &iter->packed_b);
-
+  // Post the exchange of the next tick into the other buffer, which was handed
+  // out by the previous call and hence is no longer used by the caller. This
+  // way the communication overlaps with the caller's work on the current tick.
+  const double time_start = omp_get_wtime();
+  dbm_library_phase_begin(DBM_PHASE_WAIT);
+  const int ibuf = iter->itick % 2;
   iter->itick++;
+  if (iter->itick < iter->nticks) {
+    post_tick_exchange(iter);
+  }
+
+  *pack_a = wait_pack_exchange(ibuf, &iter->packed_a);
+  *pack_b = wait_pack_exchange(ibuf, &iter->packed_b);
+  dbm_library_phase_end(DBM_PHASE_WAIT);
+  dbm_library_comm_time_add(omp_get_wtime() - time_start);
   return true;
 }
 
@@ -14,6 +14,15 @@
 
 #include <stdbool.h>
 
+/*******************************************************************************
+ * \brief Internal enum for the formats in which pack data is communicated.
+ ******************************************************************************/
+typedef enum {
+  DBM_WIRE_FP64,       // Blocks are sent as double.
+  DBM_WIRE_FP32,       // Blocks are sent as float.
+  DBM_WIRE_COMPRESSED, // Blocks are sent with individually reduced precision.
+} dbm_wire_format_t;
+
 /*******************************************************************************
  * \brief Internal struct for storing a packed matrix.
  * \author Ole Schuett
@@ -23,9 +32,20 @@ typedef struct {
   const dbm_dist_1d_t *dist_ticks;
   int nsend_packs;
   dbm_pack_t *send_packs;
-  dbm_pack_t recv_pack;
+  dbm_pack_t recv_packs[2];         // Double buffered to overlap comm/compute.
+  dbm_pack_t *ready_packs[2];       // Pack that becomes available per buffer.
+  dbm_pack_t fp64_pack;             // Expanded pack of the current tick.
+  dbm_mpi_request_t requests[2][4]; // In-flight exchanges per buffer.
+  int nrequests[2];
   int max_nblocks; // Max across all ranks in dist_ticks.
   int max_data_size;
+  int max_wire_size;
+  dbm_wire_format_t wire_format;
+  const int *free_index_sizes; // Needed to expand compressed packs.
+  const int *sum_index_sizes;
+  const int *node_ranks; // Ranks within shared_win or -1, NULL if not shared.
+  dbm_mpi_win_t shared_win;   // Holds the send packs for node-local peers.
+  dbm_pack_t shared_packs[2]; // Views of packs read from node-local peers.
 } dbm_packed_matrix_t;
 
 /*******************************************************************************
@@ -42,13 +62,18 @@ typedef struct {
 
 /*******************************************************************************
  * \brief Internal routine for creating a communication iterator.
+ *        Unless the wire_format is DBM_WIRE_FP64, the packs are communicated
+ *        in reduced precision and expanded back to double before they are
+ *        handed out. Compressed blocks stay within compression_eps.
  * \author Ole Schuett
  ******************************************************************************/
-dbm_comm_iterator_t *dbm_comm_iterator_start(const bool transa,
-                                             const bool transb,
-                                             const dbm_matrix_t *matrix_a,
-                                             const dbm_matrix_t *matrix_b,
-                                             const dbm_matrix_t *matrix_c);
+dbm_comm_iterator_t *
+dbm_comm_iterator_start(const bool transa, const bool transb,
+                        const dbm_matrix_t *matrix_a,
+                        const dbm_matrix_t *matrix_b,
+                        const dbm_matrix_t *matrix_c,
+                        const dbm_wire_format_t wire_format,
+                        const double compression_eps);
 
 /*******************************************************************************
  * \brief Internal routine for retriving next pair of packs from given iterator.
@@ -63,6 +88,12 @@ bool dbm_comm_iterator_next(dbm_comm_iterator_t *iter, dbm_pack_t **pack_a,
  ******************************************************************************/
 void dbm_comm_iterator_stop(dbm_comm_iterator_t *iter);
 
+/*******************************************************************************
+ * \brief Internal routine for releasing the plans cached by the iterators.
+ *        Plans are cached for recurring multiplies with unchanged sparsity.
+ ******************************************************************************/
+void dbm_comm_plan_cache_clear(void);
+
 #endif
 
 // EOF
@@ -20,7 +20,12 @@
 #endif
 #endif
 
+#if !defined(__LIBXSMM) && (defined(__AVX512F__) || defined(__AVX2__))
+#include <immintrin.h>
+#endif
+
 #include "dbm_hyperparams.h"
+#include "dbm_library.h"
 #include "dbm_multiply_cpu.h"
 
 /*******************************************************************************
@@ -62,10 +67,543 @@ static inline unsigned int hash(const dbm_task_t task) {
 }
 
 /*******************************************************************************
- * \brief Internal routine for executing the tasks in given batch on the CPU.
+ * \brief Private routine for sorting tasks approximately by m,n,k.
+ *        Uses a bucket sort based on the above hash function. When exact is
+ *        set, hash collisions are resolved by sorting within each bucket such
+ *        that tasks of the same shape become contiguous.
+ ******************************************************************************/
+static void sort_batch(const int ntasks, const dbm_task_t batch[ntasks],
+                       const bool exact, int batch_order[ntasks]) {
+  // Skip sorting for the common case of a batch with only a single shape.
+  bool uniform = true;
+  for (int itask = 1; itask < ntasks; ++itask) {
+    uniform &= (batch[itask].m == batch[0].m && batch[itask].n == batch[0].n &&
+                batch[itask].k == batch[0].k);
+  }
+  if (uniform) {
+    for (int itask = 0; itask < ntasks; ++itask) {
+      batch_order[itask] = itask;
+    }
+    return;
+  }
+
+  const int nbuckets = dbm_library_get_config()->batch_num_buckets;
+  assert(nbuckets <= MAX_BATCH_NUM_BUCKETS);
+  int buckets[MAX_BATCH_NUM_BUCKETS];
+  memset(buckets, 0, nbuckets * sizeof(int));
+  for (int itask = 0; itask < ntasks; ++itask) {
+    const int i = hash(batch[itask]) % nbuckets;
+    ++buckets[i];
+  }
+  for (int i = 1; i < nbuckets; ++i) {
+    buckets[i] += buckets[i - 1];
+  }
+  assert(buckets[nbuckets - 1] == ntasks);
+  for (int itask = 0; itask < ntasks; ++itask) {
+    const int i = hash(batch[itask]) % nbuckets;
+    --buckets[i];
+    batch_order[buckets[i]] = itask;
+  }
+  if (!exact) {
+    return;
+  }
+  // Now buckets[i] points to the begin of the i-th bucket.
+  for (int i = 0; i < nbuckets; ++i) {
+    const int begin = buckets[i];
+    const int end = (i + 1 < nbuckets) ? buckets[i + 1] : ntasks;
+    // Insertion sort, which is linear for the common case of a single shape.
+    for (int j = begin + 1; j < end; ++j) {
+      const int itask = batch_order[j];
+      const unsigned int key = hash(batch[itask]);
+      int l = j;
+      while (l > begin && hash(batch[batch_order[l - 1]]) > key) {
+        batch_order[l] = batch_order[l - 1];
+        --l;
+      }
+      batch_order[l] = itask;
+    }
+  }
+}
+
+#if !defined(__LIBXSMM)
+/*******************************************************************************
+ * \brief Returns the smaller of two given integer (missing from the C standard)
+ ******************************************************************************/
+static inline int imin(int x, int y) { return (x < y ? x : y); }
+
+/*******************************************************************************
+ * \brief Returns the larger of two given integer (missing from the C standard).
+ ******************************************************************************/
+static inline int imax(int x, int y) { return (x > y ? x : y); }
+
+#define DBM_CPU_STACK_MAX 4 // max number of interleaved tasks
+
+// Unrolling the loops over registers early allows to keep them in registers.
+#if defined(__GNUC__)
+#define DBM_PRAGMA_UNROLL _Pragma("GCC unroll 16")
+#else
+#define DBM_PRAGMA_UNROLL
+#endif
+
+#if defined(__AVX512F__) || (defined(__AVX2__) && defined(__FMA__))
+#if defined(__AVX512F__)
+#define DBM_CPU_VLEN 8       // number of doubles per SIMD vector
+#define DBM_CPU_TILE_MV 3    // max number of SIMD vectors per tile
+#define DBM_CPU_TILE_NACC 12 // max number of accumulators per tile
+typedef __m512d dbm_vec_t;
+typedef __mmask8 dbm_mask_t;
+
+/*******************************************************************************
+ * \brief Private SIMD wrappers, which allow to write the tile kernel once.
+ ******************************************************************************/
+static inline dbm_mask_t vec_mask(const int nrows) {
+  return (nrows >= 8) ? 0xFF : (nrows <= 0) ? 0 : (1U << nrows) - 1;
+}
+static inline dbm_vec_t vec_zero(void) { return _mm512_setzero_pd(); }
+static inline dbm_vec_t vec_set1(const double x) { return _mm512_set1_pd(x); }
+static inline dbm_vec_t vec_load(const dbm_mask_t mask, const double *x) {
+#if defined(__AVX512VL__)
+  if (mask <= 0xF) { // avoid touching the next cache line
+    return _mm512_zextpd256_pd512(_mm256_maskz_loadu_pd(mask, x));
+  }
+#endif
+  return _mm512_maskz_loadu_pd(mask, x);
+}
+static inline void vec_store(const dbm_mask_t mask, double *x,
+                             const dbm_vec_t v) {
+#if defined(__AVX512VL__)
+  if (mask <= 0xF) { // avoid touching the next cache line
+    _mm256_mask_storeu_pd(x, mask, _mm512_castpd512_pd256(v));
+    return;
+  }
+#endif
+  _mm512_mask_storeu_pd(x, mask, v);
+}
+static inline dbm_vec_t vec_fmadd(const dbm_vec_t a, const dbm_vec_t b,
+                                  const dbm_vec_t c) {
+  return _mm512_fmadd_pd(a, b, c);
+}
+#else
+#define DBM_CPU_VLEN 4      // number of doubles per SIMD vector
+#define DBM_CPU_TILE_MV 2   // max number of SIMD vectors per tile
+#define DBM_CPU_TILE_NACC 8 // max number of accumulators per tile
+typedef __m256d dbm_vec_t;
+typedef __m256i dbm_mask_t;
+
+/*******************************************************************************
+ * \brief Private SIMD wrappers, which allow to write the tile kernel once.
+ ******************************************************************************/
+static inline dbm_mask_t vec_mask(const int nrows) {
+  const __m256i lanes = _mm256_setr_epi64x(0, 1, 2, 3);
+  return _mm256_cmpgt_epi64(_mm256_set1_epi64x(nrows), lanes);
+}
+static inline dbm_vec_t vec_zero(void) { return _mm256_setzero_pd(); }
+static inline dbm_vec_t vec_set1(const double x) { return _mm256_set1_pd(x); }
+static inline dbm_vec_t vec_load(const dbm_mask_t mask, const double *x) {
+  return _mm256_maskload_pd(x, mask);
+}
+static inline void vec_store(const dbm_mask_t mask, double *x,
+                             const dbm_vec_t v) {
+  _mm256_maskstore_pd(x, mask, v);
+}
+static inline dbm_vec_t vec_fmadd(const dbm_vec_t a, const dbm_vec_t b,
+                                  const dbm_vec_t c) {
+  return _mm256_fmadd_pd(a, b, c);
+}
+#endif
+
+/*******************************************************************************
+ * \brief Private micro-kernel for a tile of mv SIMD vectors times nb columns.
+ *        The tile is computed for a stack of s independent tasks at once,
+ *        which interleaves their FMA chains to hide the latency. The tiles
+ *        of C are accumulated in registers across the entire k-loop.
+ *        Partial tiles are handled via masked loads and stores.
+ *        Must be called with compile-time constants for s, mv, and nb.
+ *        The tasks may share the same C block, hence c is not restrict.
+ ******************************************************************************/
+static inline void __attribute__((always_inline))
+small_gemm_tile(const int s, const int mv, const int nb, const int m,
+                const int n, const int k, const int i, const int j,
+                const double alpha, const double *const a[s],
+                const double *const b[s], double *const c[s]) {
+
+  const int nrows = m - i;
+  dbm_mask_t masks[DBM_CPU_TILE_MV];
+  dbm_vec_t acc[DBM_CPU_TILE_NACC]; // requires s * mv * nb <= TILE_NACC
+  DBM_PRAGMA_UNROLL
+  for (int v = 0; v < mv; v++) {
+    masks[v] = vec_mask(nrows - v * DBM_CPU_VLEN);
+  }
+  DBM_PRAGMA_UNROLL
+  for (int iacc = 0; iacc < s * mv * nb; iacc++) {
+    acc[iacc] = vec_zero();
+  }
+  for (int l = 0; l < k; l++) {
+    DBM_PRAGMA_UNROLL
+    for (int t = 0; t < s; t++) {
+      dbm_vec_t a_vec[DBM_CPU_TILE_MV];
+      DBM_PRAGMA_UNROLL
+      for (int v = 0; v < mv; v++) {
+        a_vec[v] = vec_load(masks[v], &a[t][l * m + i + v * DBM_CPU_VLEN]);
+      }
+      DBM_PRAGMA_UNROLL
+      for (int jj = 0; jj < nb; jj++) {
+        const dbm_vec_t b_vec = vec_set1(b[t][l * n + j + jj]);
+        DBM_PRAGMA_UNROLL
+        for (int v = 0; v < mv; v++) {
+          const int iacc = (t * mv + v) * nb + jj;
+          acc[iacc] = vec_fmadd(a_vec[v], b_vec, acc[iacc]);
+        }
+      }
+    }
+  }
+  // Load the entire tile of C before storing to it because masked stores
+  // block the forwarding to subsequent loads of the same cache line.
+  const dbm_vec_t alpha_vec = vec_set1(alpha);
+  DBM_PRAGMA_UNROLL
+  for (int t = 0; t < s; t++) {
+    DBM_PRAGMA_UNROLL
+    for (int jj = 0; jj < nb; jj++) {
+      DBM_PRAGMA_UNROLL
+      for (int v = 0; v < mv; v++) {
+        const int iacc = (t * mv + v) * nb + jj;
+        const double *c_vec = &c[t][(j + jj) * m + i + v * DBM_CPU_VLEN];
+        acc[iacc] = vec_fmadd(acc[iacc], alpha_vec, vec_load(masks[v], c_vec));
+      }
+    }
+    DBM_PRAGMA_UNROLL
+    for (int jj = 0; jj < nb; jj++) {
+      DBM_PRAGMA_UNROLL
+      for (int v = 0; v < mv; v++) {
+        const int iacc = (t * mv + v) * nb + jj;
+        vec_store(masks[v], &c[t][(j + jj) * m + i + v * DBM_CPU_VLEN],
+                  acc[iacc]);
+      }
+    }
+  }
+}
+
+/*******************************************************************************
+ * \brief Private routine for computing the tiling of a row panel.
+ *        Columns are split into tiles of equal width such that each tile uses
+ *        at most DBM_CPU_TILE_NACC accumulator registers.
+ ******************************************************************************/
+static inline void __attribute__((always_inline))
+tile_shape(const int m, const int n, const int i, int *mv, int *tile_n) {
+  const int nrows = imin(DBM_CPU_TILE_MV * DBM_CPU_VLEN, m - i);
+  *mv = (nrows + DBM_CPU_VLEN - 1) / DBM_CPU_VLEN;
+  const int max_nb = imin(8, DBM_CPU_TILE_NACC / *mv);
+  const int ntiles = (n + max_nb - 1) / max_nb;
+  *tile_n = (ntiles > 0) ? (n + ntiles - 1) / ntiles : 0;
+}
+#endif
+
+/*******************************************************************************
+ * \brief Private routine for choosing how many tasks of given shape should be
+ *        interleaved. Small tiles do not have enough independent FMA chains to
+ *        hide the latency, hence several tasks are processed together.
+ ******************************************************************************/
+static inline int __attribute__((always_inline))
+stack_depth(const int m, const int n) {
+#if defined(__AVX512F__) || (defined(__AVX2__) && defined(__FMA__))
+  int mv, tile_n;
+  tile_shape(m, n, 0, &mv, &tile_n);
+  const int nacc = imax(1, mv * tile_n);
+  return imax(1, imin(DBM_CPU_STACK_MAX, DBM_CPU_TILE_NACC / nacc));
+#else
+  (void)m; // mark used
+  (void)n;
+  return 1;
+#endif
+}
+
+/*******************************************************************************
+ * \brief Private small GEMM for a stack of s tasks of the same shape, which
+ *        gets inlined into every kernel below. Rows are processed in panels
+ *        of up to DBM_CPU_TILE_MV SIMD vectors. When s, m, n, and k are
+ *        compile-time constants the compiler resolves all tile dispatching.
+ ******************************************************************************/
+static inline void __attribute__((always_inline))
+small_gemm(const int s, const int m, const int n, const int k,
+           const double alpha, const double *const a[s],
+           const double *const b[s], double *const c[s]) {
+
+#if defined(__AVX512F__) || (defined(__AVX2__) && defined(__FMA__))
+  for (int i = 0; i < m; i += DBM_CPU_TILE_MV * DBM_CPU_VLEN) {
+    int mv, tile_n;
+    tile_shape(m, n, i, &mv, &tile_n);
+    for (int j = 0; j < n; j += tile_n) {
+      const int nb = imin(tile_n, n - j);
+      // Dispatch to a micro-kernel with compile-time constant mv and nb.
+#define DBM_CPU_TILE_CASE(MV, NB)                                              \
+  case (MV * 16 + NB):                                                         \
+    if (s * MV * NB <= DBM_CPU_TILE_NACC) {                                    \
+      small_gemm_tile(s, MV, NB, m, n, k, i, j, alpha, a, b, c);               \
+    } else {                                                                   \
+      assert(false && "Too many accumulators.");                               \
+    }                                                                          \
+    break;
+      switch (mv * 16 + nb) {
+        DBM_CPU_TILE_CASE(1, 1)
+        DBM_CPU_TILE_CASE(1, 2)
+        DBM_CPU_TILE_CASE(1, 3)
+        DBM_CPU_TILE_CASE(1, 4)
+        DBM_CPU_TILE_CASE(1, 5)
+        DBM_CPU_TILE_CASE(1, 6)
+        DBM_CPU_TILE_CASE(1, 7)
+        DBM_CPU_TILE_CASE(1, 8)
+        DBM_CPU_TILE_CASE(2, 1)
+        DBM_CPU_TILE_CASE(2, 2)
+        DBM_CPU_TILE_CASE(2, 3)
+        DBM_CPU_TILE_CASE(2, 4)
+#if DBM_CPU_TILE_NACC >= 12
+        DBM_CPU_TILE_CASE(2, 5)
+        DBM_CPU_TILE_CASE(2, 6)
+        DBM_CPU_TILE_CASE(3, 1)
+        DBM_CPU_TILE_CASE(3, 2)
+        DBM_CPU_TILE_CASE(3, 3)
+        DBM_CPU_TILE_CASE(3, 4)
+#endif
+      default:
+        assert(false && "Unsupported tile shape.");
+      }
+#undef DBM_CPU_TILE_CASE
+    }
+  }
+#else
+  for (int t = 0; t < s; t++) {
+    for (int j = 0; j < n; j++) {
+      for (int l = 0; l < k; l++) {
+        const double alpha_b = alpha * b[t][l * n + j];
+#pragma omp simd
+        for (int i = 0; i < m; i++) {
+          c[t][j * m + i] += a[t][l * m + i] * alpha_b;
+        }
+      }
+    }
+  }
+#endif
+}
+
+/*******************************************************************************
+ * \brief Private routine for processing a stack of tasks with the same shape.
+ *        The stack is given as list of indices into the batch.
+ *        Tasks are processed in groups of s, followed by the remainder.
+ ******************************************************************************/
+static inline void __attribute__((always_inline))
+small_gemm_stack(const int s, const int m, const int n, const int k,
+                 const int nstack, const int stack[nstack],
+                 const dbm_task_t batch[], const double alpha,
+                 const double *data_a, const double *data_b, double *data_c) {
+
+  const double *a[DBM_CPU_STACK_MAX];
+  const double *b[DBM_CPU_STACK_MAX];
+  double *c[DBM_CPU_STACK_MAX];
+  int istack = 0;
+  for (; istack + s <= nstack; istack += s) {
+    for (int t = 0; t < s; t++) {
+      const dbm_task_t task = batch[stack[istack + t]];
+      a[t] = &data_a[task.offset_a];
+      b[t] = &data_b[task.offset_b];
+      c[t] = &data_c[task.offset_c];
+    }
+    small_gemm(s, m, n, k, alpha, a, b, c);
+  }
+  for (; istack < nstack; istack++) {
+    const dbm_task_t task = batch[stack[istack]];
+    a[0] = &data_a[task.offset_a];
+    b[0] = &data_b[task.offset_b];
+    c[0] = &data_c[task.offset_c];
+    small_gemm(1, m, n, k, alpha, a, b, c);
+  }
+}
+
+/*******************************************************************************
+ * \brief Private signature shared by all kernels of the CPU backend.
+ *        Processes a stack of tasks, which all have the given shape m,n,k.
+ *        Each task computes C(m,n) += alpha * A(m,k) * B(n,k)^T.
+ ******************************************************************************/
+typedef void (*dbm_cpu_kernel_t)(const int m, const int n, const int k,
+                                 const int nstack, const int stack[nstack],
+                                 const dbm_task_t batch[], const double alpha,
+                                 const double *data_a, const double *data_b,
+                                 double *data_c);
+
+/*******************************************************************************
+ * \brief Private generic small GEMM kernel for arbitrary shapes.
+ ******************************************************************************/
+static void kernel_generic(const int m, const int n, const int k,
+                           const int nstack, const int stack[nstack],
+                           const dbm_task_t batch[], const double alpha,
+                           const double *data_a, const double *data_b,
+                           double *data_c) {
+  small_gemm_stack(1, m, n, k, nstack, stack, batch, alpha, data_a, data_b,
+                   data_c);
+}
+
+/*******************************************************************************
+ * \brief Private kernel for shapes that are too large for the small GEMM.
+ ******************************************************************************/
+static void kernel_blas(const int m, const int n, const int k,
+                        const int nstack, const int stack[nstack],
+                        const dbm_task_t batch[], const double alpha,
+                        const double *data_a, const double *data_b,
+                        double *data_c) {
+  for (int istack = 0; istack < nstack; istack++) {
+    const dbm_task_t task = batch[stack[istack]];
+    dbm_dgemm('N', 'T', m, n, k, alpha, &data_a[task.offset_a], m,
+              &data_b[task.offset_b], n, 1.0, &data_c[task.offset_c], m);
+  }
+}
+
+/*******************************************************************************
+ * \brief Block sizes for which specialized kernels are generated at compile
+ *        time. These are the most common sizes of CP2K's basis sets.
+ *        All combinations of (m,n,k) are instantiated via X-macros.
+ ******************************************************************************/
+#define DBM_CPU_KERNEL_NSIZES 4
+static const int kernel_sizes[DBM_CPU_KERNEL_NSIZES] = {4, 5, 13, 23};
+#define DBM_CPU_FOREACH_K(X, M, N) X(M, N, 4) X(M, N, 5) X(M, N, 13) X(M, N, 23)
+#define DBM_CPU_FOREACH_N(X, M)                                                \
+  DBM_CPU_FOREACH_K(X, M, 4)                                                   \
+  DBM_CPU_FOREACH_K(X, M, 5)                                                   \
+  DBM_CPU_FOREACH_K(X, M, 13)                                                  \
+  DBM_CPU_FOREACH_K(X, M, 23)
+#define DBM_CPU_FOREACH_SHAPE(X)                                               \
+  DBM_CPU_FOREACH_N(X, 4)                                                      \
+  DBM_CPU_FOREACH_N(X, 5)                                                      \
+  DBM_CPU_FOREACH_N(X, 13)                                                     \
+  DBM_CPU_FOREACH_N(X, 23)
+
+#define DBM_CPU_KERNEL_DEFINE(M, N, K)                                         \
+  static void kernel_##M##x##N##x##K(                                          \
+      const int m, const int n, const int k, const int nstack,                 \
+      const int stack[nstack], const dbm_task_t batch[], const double alpha,   \
+      const double *data_a, const double *data_b, double *data_c) {            \
+    (void)m; /* mark used */                                                   \
+    (void)n;                                                                   \
+    (void)k;                                                                   \
+    small_gemm_stack(stack_depth(M, N), M, N, K, nstack, stack, batch, alpha,  \
+                     data_a, data_b, data_c);                                  \
+  }
+DBM_CPU_FOREACH_SHAPE(DBM_CPU_KERNEL_DEFINE)
+
+#define DBM_CPU_KERNEL_ENTRY(M, N, K) kernel_##M##x##N##x##K,
+static const dbm_cpu_kernel_t
+    specialized_kernels[DBM_CPU_KERNEL_NSIZES * DBM_CPU_KERNEL_NSIZES *
+                        DBM_CPU_KERNEL_NSIZES] = {
+        DBM_CPU_FOREACH_SHAPE(DBM_CPU_KERNEL_ENTRY)};
+
+/*******************************************************************************
+ * \brief Private routine for finding a block size among the kernel_sizes.
+ *        Returns -1 if no specialized kernels exist for given size.
+ ******************************************************************************/
+static inline int kernel_size_index(const int size) {
+  for (int i = 0; i < DBM_CPU_KERNEL_NSIZES; i++) {
+    if (kernel_sizes[i] == size) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/*******************************************************************************
+ * \brief Private routine for selecting the best kernel for given task shape.
+ ******************************************************************************/
+static dbm_cpu_kernel_t select_kernel(const int m, const int n, const int k) {
+  const int im = kernel_size_index(m);
+  const int in = kernel_size_index(n);
+  const int ik = kernel_size_index(k);
+  if (im >= 0 && in >= 0 && ik >= 0) {
+    const int nsizes = DBM_CPU_KERNEL_NSIZES;
+    return specialized_kernels[(im * nsizes + in) * nsizes + ik];
+  }
+  if (imax(m, imax(n, k)) <= dbm_library_get_config()->small_gemm_max_size) {
+    return kernel_generic;
+  }
+  return kernel_blas;
+}
+
+/*******************************************************************************
+ * \brief Private per-batch cache of kernels, direct-mapped via hash(task).
+ ******************************************************************************/
+#define DBM_CPU_KERNEL_CACHE_SIZE 64
+typedef struct {
+  int m;
+  int n;
+  int k;
+  dbm_cpu_kernel_t kernel;
+} dbm_cpu_kernel_cache_t;
+
+/*******************************************************************************
+ * \brief Private routine for looking up a kernel in the cache.
+ ******************************************************************************/
+static inline dbm_cpu_kernel_t
+lookup_kernel(dbm_cpu_kernel_cache_t cache[DBM_CPU_KERNEL_CACHE_SIZE],
+              const dbm_task_t task) {
+  dbm_cpu_kernel_cache_t *entry =
+      &cache[hash(task) % DBM_CPU_KERNEL_CACHE_SIZE];
+  if (entry->kernel == NULL || entry->m != task.m || entry->n != task.n ||
+      entry->k != task.k) {
+    entry->m = task.m;
+    entry->n = task.n;
+    entry->k = task.k;
+    entry->kernel = select_kernel(task.m, task.n, task.k);
+  }
+  return entry->kernel;
+}
+
+/*******************************************************************************
+ * \brief Private routine for executing a batch with the built-in kernels.
+ ******************************************************************************/
+static void process_batch_builtin(const dbm_cpu_mode_t mode, const int ntasks,
+                                  const dbm_task_t batch[ntasks],
+                                  const double alpha, const double *data_a,
+                                  const double *data_b, double *data_c) {
+
+  int batch_order[ntasks];
+  if (mode == DBM_CPU_PER_TASK) {
+    for (int itask = 0; itask < ntasks; ++itask) {
+      batch_order[itask] = itask;
+    }
+  } else {
+    // Sort tasks by m,n,k - exactly when building stacks.
+    sort_batch(ntasks, batch, mode == DBM_CPU_STACKED, batch_order);
+  }
+
+  dbm_cpu_kernel_cache_t cache[DBM_CPU_KERNEL_CACHE_SIZE];
+  memset(cache, 0, DBM_CPU_KERNEL_CACHE_SIZE * sizeof(dbm_cpu_kernel_cache_t));
+  int itask = 0;
+  while (itask < ntasks) {
+    const dbm_task_t task = batch[batch_order[itask]];
+    const dbm_cpu_kernel_t kernel = (mode == DBM_CPU_PER_TASK)
+                                        ? select_kernel(task.m, task.n, task.k)
+                                        : lookup_kernel(cache, task);
+    // Find the end of the stack, ie. the run of tasks with the same shape.
+    int nstack = 1;
+    if (mode == DBM_CPU_STACKED) {
+      while (itask + nstack < ntasks) {
+        const dbm_task_t next = batch[batch_order[itask + nstack]];
+        if (next.m != task.m || next.n != task.n || next.k != task.k) {
+          break;
+        }
+        nstack++;
+      }
+    }
+    kernel(task.m, task.n, task.k, nstack, &batch_order[itask], batch, alpha,
+           data_a, data_b, data_c);
+    itask += nstack;
+  }
+}
+#endif
+
+/*******************************************************************************
+ * \brief Internal routine for executing the tasks in given batch on the CPU
+ *        using the given mode. Assumes all promised blocks are allocated.
  * \author Ole Schuett
  ******************************************************************************/
-void dbm_multiply_cpu_process_batch(const int ntasks, dbm_task_t batch[ntasks],
+void dbm_multiply_cpu_execute_batch(const dbm_cpu_mode_t mode, const int ntasks,
+                                    dbm_task_t batch[ntasks],
                                     const double alpha,
                                     const dbm_pack_t *pack_a,
                                     const dbm_pack_t *pack_b,
@@ -74,26 +612,17 @@ void dbm_multiply_cpu_process_batch(const int ntasks, dbm_task_t batch[ntasks],
   if (0 >= ntasks) { // nothing to do
     return;
   }
-  dbm_shard_allocate_promised_blocks(shard_c);
 
 #if defined(__LIBXSMM)
 
   // Sort tasks approximately by m,n,k via bucket sort.
-  int buckets[BATCH_NUM_BUCKETS];
-  memset(buckets, 0, BATCH_NUM_BUCKETS * sizeof(int));
-  for (int itask = 0; itask < ntasks; ++itask) {
-    const int i = hash(batch[itask]) % BATCH_NUM_BUCKETS;
-    ++buckets[i];
-  }
-  for (int i = 1; i < BATCH_NUM_BUCKETS; ++i) {
-    buckets[i] += buckets[i - 1];
-  }
-  assert(buckets[BATCH_NUM_BUCKETS - 1] == ntasks);
   int batch_order[ntasks];
-  for (int itask = 0; itask < ntasks; ++itask) {
-    const int i = hash(batch[itask]) % BATCH_NUM_BUCKETS;
-    --buckets[i];
-    batch_order[buckets[i]] = itask;
+  if (mode == DBM_CPU_PER_TASK) {
+    for (int itask = 0; itask < ntasks; ++itask) {
+      batch_order[itask] = itask;
+    }
+  } else {
+    sort_batch(ntasks, batch, false, batch_order);
   }
 
   // Prepare arguments for libxsmm's kernel-dispatch.
@@ -168,16 +697,26 @@ void dbm_multiply_cpu_process_batch(const int ntasks, dbm_task_t batch[ntasks],
     }
   }
 #else
-  // Fallback to BLAS when libxsmm is not available.
-  for (int itask = 0; itask < ntasks; ++itask) {
-    const dbm_task_t task = batch[itask];
-    const double *data_a = &pack_a->data[task.offset_a];
-    const double *data_b = &pack_b->data[task.offset_b];
-    double *data_c = &shard_c->data[task.offset_c];
-    dbm_dgemm('N', 'T', task.m, task.n, task.k, alpha, data_a, task.m, data_b,
-              task.n, 1.0, data_c, task.m);
-  }
+  process_batch_builtin(mode, ntasks, batch, alpha, pack_a->data, pack_b->data,
+                        shard_c->data);
 #endif
 }
 
+/*******************************************************************************
+ * \brief Internal routine for executing the tasks in given batch on the CPU.
+ ******************************************************************************/
+void dbm_multiply_cpu_process_batch(const int ntasks, dbm_task_t batch[ntasks],
+                                    const double alpha,
+                                    const dbm_pack_t *pack_a,
+                                    const dbm_pack_t *pack_b,
+                                    dbm_shard_t *shard_c) {
+
+  if (0 >= ntasks) { // nothing to do
+    return;
+  }
+  dbm_shard_allocate_promised_blocks(shard_c);
+  dbm_multiply_cpu_execute_batch(DBM_CPU_STACKED, ntasks, batch, alpha, pack_a,
+                                 pack_b, shard_c);
+}
+
 // EOF
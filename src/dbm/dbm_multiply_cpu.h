@@ -12,6 +12,32 @@
 #include "dbm_multiply_internal.h"
 #include "dbm_shard.h"
 
+/*******************************************************************************
+ * \brief Internal enum for the execution modes of the CPU backend.
+ *        PER_TASK: Executes tasks in their original order.
+ *        BUCKETED: Sorts tasks approximately by shape and executes them.
+ *        STACKED:  Groups tasks of equal shape into stacks, which are each
+ *                  executed by a single kernel call (default).
+ ******************************************************************************/
+typedef enum {
+  DBM_CPU_PER_TASK,
+  DBM_CPU_BUCKETED,
+  DBM_CPU_STACKED,
+} dbm_cpu_mode_t;
+
+/*******************************************************************************
+ * \brief Internal routine for executing the tasks in given batch on the CPU
+ *        using the given mode. Assumes all promised blocks are allocated.
+ *        Only the built-in kernels support stacks, libxsmm builds fall back
+ *        to the bucketed mode. Exposed for benchmarking.
+ ******************************************************************************/
+void dbm_multiply_cpu_execute_batch(const dbm_cpu_mode_t mode, const int ntasks,
+                                    dbm_task_t batch[ntasks],
+                                    const double alpha,
+                                    const dbm_pack_t *pack_a,
+                                    const dbm_pack_t *pack_b,
+                                    dbm_shard_t *shard_c);
+
 /*******************************************************************************
  * \brief Internal routine for executing the tasks in given batch on the CPU.
  * \author Ole Schuett
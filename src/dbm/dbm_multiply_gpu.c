@@ -9,7 +9,7 @@
 #if defined(__OFFLOAD) && !defined(__NO_OFFLOAD_DBM)
 
 #include "../offload/offload_library.h"
-#include "dbm_hyperparams.h"
+#include "dbm_library.h"
 #include "dbm_mempool.h"
 #include "dbm_multiply_gpu.h"
 #include "dbm_multiply_gpu_kernel.h"
@@ -61,7 +61,7 @@ static void upload_pack(const dbm_pack_t *pack_host, dbm_pack_t *pack_dev,
 
   const size_t size = pack_host->data_size * sizeof(double);
   if (pack_dev->data_size < pack_host->data_size) {
-    dbm_mempool_free(pack_dev->data);
+    dbm_mempool_device_free(pack_dev->data);
     pack_dev->data = dbm_mempool_device_malloc(size);
   }
   offloadMemcpyAsyncHtoD(pack_dev->data, pack_host->data, size, stream);
@@ -126,8 +126,8 @@ void dbm_multiply_gpu_process_batch(const int ntasks, const dbm_task_t *batch,
   // Reallocate shard_c_dev->data if necessary.
   if (shard_c_host->data_promised > shard_c_dev->data_allocated) {
     double *old_data_dev = shard_c_dev->data;
-    shard_c_dev->data_allocated =
-        ALLOCATION_FACTOR * shard_c_host->data_promised;
+    const double factor = dbm_library_get_config()->allocation_factor;
+    shard_c_dev->data_allocated = factor * shard_c_host->data_promised;
     shard_c_dev->data =
         dbm_mempool_device_malloc(shard_c_dev->data_allocated * sizeof(double));
     offloadMemcpyAsyncDtoD(shard_c_dev->data, old_data_dev,
@@ -135,7 +135,7 @@ void dbm_multiply_gpu_process_batch(const int ntasks, const dbm_task_t *batch,
                            shard_c_dev->stream);
     // Wait for copy to complete before freeing old buffer.
     offloadStreamSynchronize(shard_c_dev->stream);
-    dbm_mempool_free(old_data_dev);
+    dbm_mempool_device_free(old_data_dev);
   }
 
   // Zero new blocks if necessary.
@@ -165,9 +165,9 @@ void dbm_multiply_gpu_download_results(dbm_multiply_gpu_context_t *ctx) {
   // Select GPU device.
   offload_activate_chosen_device();
 
-#pragma omp parallel for schedule(dynamic)
+#pragma omp parallel for schedule(static, 1)
   for (int i = 0; i < ctx->nshards; i++) {
-    // Grow host buffer if necessary.
+    // Grow host buffer if necessary, which is done by the shard's owner.
     dbm_shard_t *shard_c_host = &ctx->shards_c_host[i];
     dbm_shard_allocate_promised_blocks(shard_c_host);
 
@@ -194,13 +194,13 @@ void dbm_multiply_gpu_stop(dbm_multiply_gpu_context_t *ctx) {
     dbm_shard_gpu_t *shard_c_dev = &ctx->shards_c_dev[i];
     offloadStreamSynchronize(shard_c_dev->stream);
     offloadStreamDestroy(shard_c_dev->stream);
-    dbm_mempool_free(shard_c_dev->data);
+    dbm_mempool_device_free(shard_c_dev->data);
   }
   free(ctx->shards_c_dev);
 
-  dbm_mempool_free(ctx->pack_a_dev.data);
-  dbm_mempool_free(ctx->pack_b_dev.data);
-  dbm_mempool_free(ctx->batches_dev);
+  dbm_mempool_device_free(ctx->pack_a_dev.data);
+  dbm_mempool_device_free(ctx->pack_b_dev.data);
+  dbm_mempool_device_free(ctx->batches_dev);
   offloadStreamDestroy(ctx->main_stream);
 }
 
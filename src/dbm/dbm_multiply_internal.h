@@ -28,6 +28,8 @@ typedef struct {
   int data_size;
   dbm_pack_block_t *blocks;
   double *data;
+  void *data_wire; // Reduced precision wire format, otherwise NULL.
+  int wire_size;   // Size of data_wire in units of the wire format.
 } dbm_pack_t;
 
 /*******************************************************************************
@@ -0,0 +1,339 @@
+/*----------------------------------------------------------------------------*/
+/*  CP2K: A general program to perform molecular dynamics simulations         */
+/*  Copyright 2000-2024 CP2K developers group <https://cp2k.org>              */
+/*                                                                            */
+/*  SPDX-License-Identifier: BSD-3-Clause                                     */
+/*----------------------------------------------------------------------------*/
+
+#include "dbm_multiply_layers.h"
+
+#include <assert.h>
+#include <math.h>
+#include <omp.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dbm_library.h"
+
+/*******************************************************************************
+ * \brief Private routine for estimating the memory available to this rank.
+ *        The free memory of the node is shared among all its ranks.
+ ******************************************************************************/
+static double available_memory(const dbm_mpi_comm_t comm) {
+#if defined(_SC_AVPHYS_PAGES)
+  dbm_mpi_comm_t node_comm = dbm_mpi_comm_split_shared(comm);
+  const int node_nranks = dbm_mpi_comm_size(node_comm);
+  dbm_mpi_comm_free(&node_comm);
+  return (double)sysconf(_SC_AVPHYS_PAGES) * (double)sysconf(_SC_PAGESIZE) /
+         node_nranks;
+#else
+  (void)comm; // mark used
+  return HUGE_VAL;
+#endif
+}
+
+/*******************************************************************************
+ * \brief Private routine for counting the local matrix elements.
+ ******************************************************************************/
+static double count_nze(const dbm_matrix_t *matrix) {
+  double nze = 0.0;
+  for (int ishard = 0; ishard < dbm_get_num_shards(matrix); ishard++) {
+    nze += matrix->shards[ishard].data_size;
+  }
+  return nze;
+}
+
+/*******************************************************************************
+ * \brief Internal routine for choosing the number of layers of a multiply.
+ *        Returns one when the multiplication should not be layered.
+ ******************************************************************************/
+int dbm_layers_choose(const dbm_matrix_t *matrix_a,
+                      const dbm_matrix_t *matrix_b,
+                      const dbm_matrix_t *matrix_c) {
+  const int nranks = matrix_c->dist->nranks;
+  int nlayers = dbm_library_get_config()->replication_layers;
+
+  if (nlayers == 0) {
+    // The communication volume of 2.5D algorithms is minimal for nranks^(1/3)
+    // layers. However, each layer holds a partial result of matrix_c, which
+    // should fit comfortably into the available memory of every rank.
+    nlayers = (int)(cbrt((double)nranks) + 1e-9);
+    double memory[2] = {
+        sizeof(double) * (count_nze(matrix_a) + count_nze(matrix_b) +
+                          count_nze(matrix_c)),
+        -available_memory(matrix_c->dist->comm)};
+    dbm_mpi_max_double(memory, 2, matrix_c->dist->comm);
+    while (nlayers > 1 && nlayers * memory[0] > -0.5 * memory[1]) {
+      nlayers--;
+    }
+  }
+
+  // The layers have to partition the ranks evenly.
+  nlayers = (nlayers < nranks) ? nlayers : nranks;
+  while (nranks % nlayers != 0) {
+    nlayers--;
+  }
+  return nlayers;
+}
+
+/*******************************************************************************
+ * \brief Internal routine for arranging the ranks of dist into layers.
+ ******************************************************************************/
+dbm_layers_t *dbm_layers_create(const dbm_distribution_t *dist,
+                                const int nlayers) {
+  assert(omp_get_num_threads() == 1);
+  assert(dist->nranks % nlayers == 0);
+  dbm_layers_t *layers = calloc(1, sizeof(dbm_layers_t));
+  layers->nlayers = nlayers;
+
+  int dims[3] = {0, 0, nlayers};
+  dbm_mpi_dims_create(dist->nranks, 3, dims);
+  assert(dims[2] == nlayers);
+  const int periods[3] = {1, 1, 1};
+  layers->cart = dbm_mpi_cart_create(dist->comm, 3, dims, periods, 0);
+  assert(dbm_mpi_comm_rank(layers->cart) == dist->my_rank);
+
+  int cart_periods[3], coords[3];
+  dbm_mpi_cart_get(layers->cart, 3, dims, cart_periods, coords);
+  layers->my_layer = coords[2];
+  layers->layer_dims[0] = dims[0];
+  layers->layer_dims[1] = dims[1];
+
+  const int layer_dim_remains[3] = {1, 1, 0};
+  layers->layer_comm = dbm_mpi_cart_sub(layers->cart, layer_dim_remains);
+  return layers;
+}
+
+/*******************************************************************************
+ * \brief Internal routine for releasing layers.
+ ******************************************************************************/
+void dbm_layers_free(dbm_layers_t *layers) {
+  dbm_mpi_comm_free(&layers->layer_comm);
+  dbm_mpi_comm_free(&layers->cart);
+  free(layers);
+}
+
+/*******************************************************************************
+ * \brief Internal routine for creating an empty matrix within my_layer that
+ *        has the same shape as the given matrix.
+ ******************************************************************************/
+dbm_matrix_t *dbm_layers_create_matrix(const dbm_layers_t *layers,
+                                       const dbm_matrix_t *matrix) {
+  // Fold the distribution of the given matrix onto the smaller layer grid.
+  const dbm_distribution_t *dist = matrix->dist;
+  int *row_dist = malloc(matrix->nrows * sizeof(int));
+  int *col_dist = malloc(matrix->ncols * sizeof(int));
+  for (int i = 0; i < matrix->nrows; i++) {
+    row_dist[i] = dist->rows.index2coord[i] % layers->layer_dims[0];
+  }
+  for (int i = 0; i < matrix->ncols; i++) {
+    col_dist[i] = dist->cols.index2coord[i] % layers->layer_dims[1];
+  }
+
+  dbm_distribution_t *layer_dist = NULL;
+  dbm_distribution_new_cart(&layer_dist, layers->layer_comm, matrix->nrows,
+                            matrix->ncols, row_dist, col_dist);
+  free(row_dist);
+  free(col_dist);
+
+  dbm_matrix_t *layer_matrix = NULL;
+  dbm_create(&layer_matrix, layer_dist, matrix->name, matrix->nrows,
+             matrix->ncols, matrix->row_sizes, matrix->col_sizes);
+  layer_matrix->symmetric = matrix->symmetric;
+  dbm_distribution_release(layer_dist);
+  return layer_matrix;
+}
+
+/*******************************************************************************
+ * \brief Private routine for sending every block of a matrix to the rank given
+ *        by block_ranks in order of the shards, and storing the received blocks
+ *        in redist. Unlike dbm_redistribute this works across communicators.
+ ******************************************************************************/
+static void exchange_blocks(const dbm_matrix_t *matrix, const int *block_ranks,
+                            const dbm_mpi_comm_t comm, const bool summation,
+                            dbm_matrix_t *redist) {
+  const double time_start = omp_get_wtime();
+  dbm_library_phase_begin(DBM_PHASE_ALLTOALL);
+  const int nranks = dbm_mpi_comm_size(comm);
+  const int my_rank = dbm_mpi_comm_rank(comm);
+
+  // 1st pass: Compute send_count.
+  int send_count[nranks];
+  memset(send_count, 0, nranks * sizeof(int));
+  int iblock_total = 0;
+  for (int ishard = 0; ishard < dbm_get_num_shards(matrix); ishard++) {
+    dbm_shard_t *shard = &matrix->shards[ishard];
+    for (int iblock = 0; iblock < shard->nblocks; iblock++) {
+      const dbm_block_t *blk = &shard->blocks[iblock];
+      const int block_size =
+          matrix->row_sizes[blk->row] * matrix->col_sizes[blk->col];
+      const int rank = block_ranks[iblock_total++];
+      assert(0 <= rank && rank < nranks);
+      send_count[rank] += 2 + block_size;
+    }
+  }
+
+  // 1st communication: Exchange counts.
+  int recv_count[nranks];
+  dbm_mpi_alltoall_int(send_count, 1, recv_count, 1, comm);
+
+  // Compute displacements and allocate data buffers.
+  int send_displ[nranks + 1], recv_displ[nranks + 1];
+  send_displ[0] = recv_displ[0] = 0;
+  for (int irank = 1; irank <= nranks; irank++) {
+    send_displ[irank] = send_displ[irank - 1] + send_count[irank - 1];
+    recv_displ[irank] = recv_displ[irank - 1] + recv_count[irank - 1];
+  }
+  const int total_send_count = send_displ[nranks];
+  const int total_recv_count = recv_displ[nranks];
+  double *data_send = dbm_mpi_alloc_mem(total_send_count * sizeof(double));
+  double *data_recv = dbm_mpi_alloc_mem(total_recv_count * sizeof(double));
+
+  // 2nd pass: Fill send_data.
+  int send_data_positions[nranks];
+  memcpy(send_data_positions, send_displ, nranks * sizeof(int));
+  iblock_total = 0;
+  for (int ishard = 0; ishard < dbm_get_num_shards(matrix); ishard++) {
+    dbm_shard_t *shard = &matrix->shards[ishard];
+    for (int iblock = 0; iblock < shard->nblocks; iblock++) {
+      const dbm_block_t *blk = &shard->blocks[iblock];
+      const int block_size =
+          matrix->row_sizes[blk->row] * matrix->col_sizes[blk->col];
+      const int rank = block_ranks[iblock_total++];
+      const int pos = send_data_positions[rank];
+      data_send[pos + 0] = blk->row; // send integers as doubles
+      data_send[pos + 1] = blk->col;
+      memcpy(&data_send[pos + 2], &shard->data[blk->offset],
+             block_size * sizeof(double));
+      send_data_positions[rank] += 2 + block_size;
+    }
+  }
+  for (int irank = 0; irank < nranks; irank++) {
+    assert(send_data_positions[irank] == send_displ[irank + 1]);
+  }
+
+  // 2nd communication: Exchange data.
+  dbm_mpi_alltoallv_double(data_send, send_count, send_displ, data_recv,
+                           recv_count, recv_displ, comm);
+  dbm_mpi_free_mem(data_send);
+  for (int irank = 0; irank < nranks; irank++) {
+    if (irank != my_rank) {
+      dbm_library_bytes_sent_add(send_count[irank] * sizeof(double));
+    }
+  }
+  dbm_library_phase_end(DBM_PHASE_ALLTOALL);
+  dbm_library_comm_time_add(omp_get_wtime() - time_start);
+
+  // 3rd pass: Locate received blocks.
+  int nblocks_recv = 0;
+  for (int pos = 0; pos < total_recv_count; nblocks_recv++) {
+    const int row = (int)data_recv[pos + 0];
+    const int col = (int)data_recv[pos + 1];
+    pos += 2 + matrix->row_sizes[row] * matrix->col_sizes[col];
+  }
+  int *recv_block_pos = malloc(nblocks_recv * sizeof(int));
+  int recv_data_pos = 0;
+  for (int iblock = 0; iblock < nblocks_recv; iblock++) {
+    recv_block_pos[iblock] = recv_data_pos;
+    const int row = (int)data_recv[recv_data_pos + 0];
+    const int col = (int)data_recv[recv_data_pos + 1];
+    recv_data_pos += 2 + matrix->row_sizes[row] * matrix->col_sizes[col];
+  }
+  assert(recv_data_pos == total_recv_count);
+
+  // 4th pass: Unpack data. Each thread gathers a range of blocks into
+  // consecutive lists, which are then inserted concurrently.
+#pragma omp parallel
+  {
+    const int nthreads = omp_get_num_threads();
+    const int ithread = omp_get_thread_num();
+    const int first = (int64_t)nblocks_recv * ithread / nthreads;
+    const int last = (int64_t)nblocks_recv * (ithread + 1) / nthreads;
+    const int nblocks = last - first;
+    int *rows = malloc(nblocks * sizeof(int));
+    int *cols = malloc(nblocks * sizeof(int));
+    int ndata = 0;
+    for (int i = 0; i < nblocks; i++) {
+      const int pos = recv_block_pos[first + i];
+      rows[i] = (int)data_recv[pos + 0];
+      cols[i] = (int)data_recv[pos + 1];
+      ndata += matrix->row_sizes[rows[i]] * matrix->col_sizes[cols[i]];
+    }
+    double *data = malloc(ndata * sizeof(double));
+    int offset = 0;
+    for (int i = 0; i < nblocks; i++) {
+      const int block_size =
+          matrix->row_sizes[rows[i]] * matrix->col_sizes[cols[i]];
+      memcpy(&data[offset], &data_recv[recv_block_pos[first + i] + 2],
+             block_size * sizeof(double));
+      offset += block_size;
+    }
+    dbm_put_blocks(redist, nblocks, rows, cols, data, summation);
+    free(rows);
+    free(cols);
+    free(data);
+  }
+  free(recv_block_pos);
+  dbm_mpi_free_mem(data_recv);
+}
+
+/*******************************************************************************
+ * \brief Internal routine for sending every block of the given matrix to the
+ *        layer of its sum index, which is the row if sum_is_row is set.
+ *        Returns the blocks received by my_layer as a new matrix.
+ ******************************************************************************/
+dbm_matrix_t *dbm_layers_scatter(const dbm_layers_t *layers,
+                                 const bool sum_is_row,
+                                 const dbm_matrix_t *matrix) {
+  assert(omp_get_num_threads() == 1);
+  dbm_matrix_t *layer_matrix = dbm_layers_create_matrix(layers, matrix);
+  const dbm_distribution_t *layer_dist = layer_matrix->dist;
+
+  int *block_ranks = malloc(dbm_get_num_blocks(matrix) * sizeof(int));
+  int iblock_total = 0;
+  for (int ishard = 0; ishard < dbm_get_num_shards(matrix); ishard++) {
+    dbm_shard_t *shard = &matrix->shards[ishard];
+    for (int iblock = 0; iblock < shard->nblocks; iblock++) {
+      const dbm_block_t *blk = &shard->blocks[iblock];
+      const int sum_index = (sum_is_row) ? blk->row : blk->col;
+      const int coords[3] = {layer_dist->rows.index2coord[blk->row],
+                             layer_dist->cols.index2coord[blk->col],
+                             sum_index % layers->nlayers};
+      block_ranks[iblock_total++] = dbm_mpi_cart_rank(layers->cart, coords);
+    }
+  }
+
+  exchange_blocks(matrix, block_ranks, layers->cart, false, layer_matrix);
+  free(block_ranks);
+  return layer_matrix;
+}
+
+/*******************************************************************************
+ * \brief Internal routine for summing the partial results of all layers
+ *        into the given matrix.
+ ******************************************************************************/
+void dbm_layers_reduce(const dbm_layers_t *layers,
+                       const dbm_matrix_t *layer_matrix, dbm_matrix_t *matrix) {
+  assert(omp_get_num_threads() == 1);
+  assert(layer_matrix->nrows == matrix->nrows);
+  assert(layer_matrix->ncols == matrix->ncols);
+
+  // The ranks of the cart coincide with those of the matrix's communicator.
+  int *block_ranks = malloc(dbm_get_num_blocks(layer_matrix) * sizeof(int));
+  int iblock_total = 0;
+  for (int ishard = 0; ishard < dbm_get_num_shards(layer_matrix); ishard++) {
+    dbm_shard_t *shard = &layer_matrix->shards[ishard];
+    for (int iblock = 0; iblock < shard->nblocks; iblock++) {
+      const dbm_block_t *blk = &shard->blocks[iblock];
+      block_ranks[iblock_total++] =
+          dbm_get_stored_coordinates(matrix, blk->row, blk->col);
+    }
+  }
+
+  exchange_blocks(layer_matrix, block_ranks, layers->cart, true, matrix);
+  free(block_ranks);
+}
+
+// EOF
@@ -0,0 +1,73 @@
+/*----------------------------------------------------------------------------*/
+/*  CP2K: A general program to perform molecular dynamics simulations         */
+/*  Copyright 2000-2024 CP2K developers group <https://cp2k.org>              */
+/*                                                                            */
+/*  SPDX-License-Identifier: BSD-3-Clause                                     */
+/*----------------------------------------------------------------------------*/
+#ifndef DBM_MULTIPLY_LAYERS_H
+#define DBM_MULTIPLY_LAYERS_H
+
+#include <stdbool.h>
+
+#include "dbm_distribution.h"
+#include "dbm_matrix.h"
+#include "dbm_mpi.h"
+
+/*******************************************************************************
+ * \brief Internal struct for the layers of a 2.5D multiplication.
+ *        The ranks are arranged in a 3D cart of layer_dims x nlayers, where
+ *        each layer multiplies the blocks of every nlayers-th sum index.
+ ******************************************************************************/
+typedef struct {
+  int nlayers;
+  int my_layer;
+  int layer_dims[2];
+  dbm_mpi_comm_t cart;       // spans all ranks, ranks are not reordered
+  dbm_mpi_comm_t layer_comm; // 2D cart of the ranks within my_layer
+} dbm_layers_t;
+
+/*******************************************************************************
+ * \brief Internal routine for choosing the number of layers of a multiply.
+ *        Returns one when the multiplication should not be layered.
+ ******************************************************************************/
+int dbm_layers_choose(const dbm_matrix_t *matrix_a,
+                      const dbm_matrix_t *matrix_b,
+                      const dbm_matrix_t *matrix_c);
+
+/*******************************************************************************
+ * \brief Internal routine for arranging the ranks of dist into layers.
+ ******************************************************************************/
+dbm_layers_t *dbm_layers_create(const dbm_distribution_t *dist,
+                                const int nlayers);
+
+/*******************************************************************************
+ * \brief Internal routine for releasing layers.
+ ******************************************************************************/
+void dbm_layers_free(dbm_layers_t *layers);
+
+/*******************************************************************************
+ * \brief Internal routine for creating an empty matrix within my_layer that
+ *        has the same shape as the given matrix.
+ ******************************************************************************/
+dbm_matrix_t *dbm_layers_create_matrix(const dbm_layers_t *layers,
+                                       const dbm_matrix_t *matrix);
+
+/*******************************************************************************
+ * \brief Internal routine for sending every block of the given matrix to the
+ *        layer of its sum index, which is the row if sum_is_row is set.
+ *        Returns the blocks received by my_layer as a new matrix.
+ ******************************************************************************/
+dbm_matrix_t *dbm_layers_scatter(const dbm_layers_t *layers,
+                                 const bool sum_is_row,
+                                 const dbm_matrix_t *matrix);
+
+/*******************************************************************************
+ * \brief Internal routine for summing the partial results of all layers
+ *        into the given matrix.
+ ******************************************************************************/
+void dbm_layers_reduce(const dbm_layers_t *layers,
+                       const dbm_matrix_t *layer_matrix, dbm_matrix_t *matrix);
+
+#endif
+
+// EOF
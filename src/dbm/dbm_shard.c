@@ -11,9 +11,21 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "dbm_hyperparams.h"
+#include "dbm_library.h"
 #include "dbm_shard.h"
 
+// Tag of empty slots, all other tags have their highest bit cleared.
+#define HASHTABLE_EMPTY 0x80
+// Tag of the padding after a group's slots, which never matches.
+#define HASHTABLE_PADDING 0xFF
+// Number of groups migrated from the old hashtable per insertion.
+#define HASHTABLE_MIGRATION_GROUPS 2
+
 /*******************************************************************************
  * \brief Internal routine for finding a power of two greater than given number.
  * \author Ole Schuett
@@ -44,16 +56,44 @@ static int next_prime(const int start) {
 }
 
 /*******************************************************************************
- * \brief Internal routine for initializing a shard's hashtable.
+ * \brief Internal routine for initializing an empty hashtable.
  * \author Ole Schuett
  ******************************************************************************/
-static void hashtable_init(dbm_shard_t *shard) {
-  // Choosing size as power of two allows to replace modulo with bitwise AND.
-  shard->hashtable_size =
-      next_power2(HASHTABLE_FACTOR * shard->nblocks_allocated);
-  shard->hashtable_mask = shard->hashtable_size - 1;
-  shard->hashtable_prime = next_prime(shard->hashtable_size);
-  shard->hashtable = calloc(shard->hashtable_size, sizeof(int));
+static void hashtable_init(dbm_hashtable_t *table, const int min_size) {
+  table->ngroups = next_power2(min_size / DBM_HASHTABLE_GROUP_SIZE + 1);
+  table->prime = next_prime(table->ngroups);
+  table->nsteps = 0;
+  const size_t size = table->ngroups * sizeof(dbm_hashtable_group_t);
+  table->groups = aligned_alloc(sizeof(dbm_hashtable_group_t), size);
+  for (int i = 0; i < table->ngroups; i++) {
+    uint8_t *tags = table->groups[i].tags;
+    memset(tags, HASHTABLE_EMPTY, DBM_HASHTABLE_GROUP_SIZE);
+    memset(&tags[DBM_HASHTABLE_GROUP_SIZE], HASHTABLE_PADDING,
+           16 - DBM_HASHTABLE_GROUP_SIZE);
+  }
+}
+
+/*******************************************************************************
+ * \brief Internal routine for releasing a hashtable.
+ ******************************************************************************/
+static void hashtable_release(dbm_hashtable_t *table) {
+  free(table->groups);
+  table->ngroups = 0;
+  table->groups = NULL;
+}
+
+/*******************************************************************************
+ * \brief Internal routine for copying a hashtable.
+ ******************************************************************************/
+static void hashtable_copy(dbm_hashtable_t *dst, const dbm_hashtable_t *src) {
+  hashtable_release(dst);
+  if (src->ngroups == 0) {
+    return;
+  }
+  *dst = *src;
+  const size_t size = src->ngroups * sizeof(dbm_hashtable_group_t);
+  dst->groups = aligned_alloc(sizeof(dbm_hashtable_group_t), size);
+  memcpy(dst->groups, src->groups, size);
 }
 
 /*******************************************************************************
@@ -64,7 +104,10 @@ void dbm_shard_init(dbm_shard_t *shard) {
   shard->nblocks = 0;
   shard->nblocks_allocated = INITIAL_NBLOCKS_ALLOCATED;
   shard->blocks = malloc(shard->nblocks_allocated * sizeof(dbm_block_t));
-  hashtable_init(shard);
+  const double factor = dbm_library_get_config()->hashtable_factor;
+  hashtable_init(&shard->hashtable, factor * shard->nblocks_allocated);
+  shard->old_hashtable = (dbm_hashtable_t){0};
+  shard->old_hashtable_migrated = 0;
   shard->data_size = 0;
   shard->data_promised = 0;
   shard->data_allocated = INITIAL_DATA_ALLOCATED;
@@ -85,13 +128,9 @@ void dbm_shard_copy(dbm_shard_t *shard_a, const dbm_shard_t *shard_b) {
   memcpy(shard_a->blocks, shard_b->blocks,
          shard_b->nblocks * sizeof(dbm_block_t));
 
-  free(shard_a->hashtable);
-  shard_a->hashtable_size = shard_b->hashtable_size;
-  shard_a->hashtable_mask = shard_b->hashtable_mask;
-  shard_a->hashtable_prime = shard_b->hashtable_prime;
-  shard_a->hashtable = malloc(shard_b->hashtable_size * sizeof(int));
-  memcpy(shard_a->hashtable, shard_b->hashtable,
-         shard_b->hashtable_size * sizeof(int));
+  hashtable_copy(&shard_a->hashtable, &shard_b->hashtable);
+  hashtable_copy(&shard_a->old_hashtable, &shard_b->old_hashtable);
+  shard_a->old_hashtable_migrated = shard_b->old_hashtable_migrated;
 
   free(shard_a->data);
   shard_a->data_allocated = shard_b->data_allocated;
@@ -106,7 +145,8 @@ void dbm_shard_copy(dbm_shard_t *shard_a, const dbm_shard_t *shard_b) {
  ******************************************************************************/
 void dbm_shard_release(dbm_shard_t *shard) {
   free(shard->blocks);
-  free(shard->hashtable);
+  hashtable_release(&shard->hashtable);
+  hashtable_release(&shard->old_hashtable);
   free(shard->data);
   omp_destroy_lock(&shard->lock);
 }
@@ -124,46 +164,185 @@ static inline unsigned int hash(const unsigned int row,
 }
 
 /*******************************************************************************
- * \brief Private routine for inserting a block into a shard's hashtable.
+ * \brief Private routine for obtaining the 7-bit fingerprint of a hash.
+ *        The group is chosen by the hash's low bits, which keeps neighboring
+ *        blocks close. Hence, the fingerprint is taken from the scrambled bits.
+ ******************************************************************************/
+static inline uint8_t hash_tag(const unsigned int h) {
+  return (uint8_t)((h * 0x9E3779B9u) >> 25); // 2^32 divided by golden ratio
+}
+
+/*******************************************************************************
+ * \brief Private routine for matching a tag against a group of slots.
+ *        Returns a bit-mask of the matching slots. As a by-product of the same
+ *        load, a bit-mask of the empty slots is stored in the empty argument.
+ ******************************************************************************/
+static inline unsigned int group_match(const dbm_hashtable_group_t *group,
+                                       const uint8_t tag, unsigned int *empty) {
+#if defined(__SSE2__)
+  const __m128i tags = _mm_load_si128((const __m128i *)group->tags);
+  const __m128i empty_tags = _mm_set1_epi8((char)HASHTABLE_EMPTY);
+  *empty = _mm_movemask_epi8(_mm_cmpeq_epi8(tags, empty_tags));
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(tags, _mm_set1_epi8(tag)));
+#else
+  unsigned int mask = 0;
+  *empty = 0;
+  for (int i = 0; i < DBM_HASHTABLE_GROUP_SIZE; i++) {
+    mask |= (unsigned int)(group->tags[i] == tag) << i;
+    *empty |= (unsigned int)(group->tags[i] == HASHTABLE_EMPTY) << i;
+  }
+  return mask;
+#endif
+}
+
+/*******************************************************************************
+ * \brief Private routine for finding the next slot of a bit-mask.
+ ******************************************************************************/
+static inline int next_slot(const unsigned int mask) {
+#if defined(__GNUC__)
+  return __builtin_ctz(mask);
+#else
+  int i = 0;
+  while (!(mask & (1u << i))) {
+    i++;
+  }
+  return i;
+#endif
+}
+
+/*******************************************************************************
+ * \brief Private routine for inserting a block into the given hashtable.
+ *        Groups are probed quadratically, which visits all of them eventually.
  * \author Ole Schuett
  ******************************************************************************/
-static void hashtable_insert(dbm_shard_t *shard, const int block_idx) {
+static void hashtable_insert(dbm_shard_t *shard, dbm_hashtable_t *table,
+                             const int block_idx) {
   assert(0 <= block_idx && block_idx < shard->nblocks);
   const dbm_block_t *blk = &shard->blocks[block_idx];
-  const int row = blk->row, col = blk->col;
-  int slot = (shard->hashtable_prime * hash(row, col)) & shard->hashtable_mask;
-  while (true) {
-    if (shard->hashtable[slot] == 0) {
-      shard->hashtable[slot] = block_idx + 1; // 1-based because 0 means empty
+  const unsigned int h = hash(blk->row, blk->col);
+  const int group_mask = table->ngroups - 1;
+  int igroup = (table->prime * h) & group_mask;
+  for (int step = 1;; step++) {
+    dbm_hashtable_group_t *group = &table->groups[igroup];
+    unsigned int empty;
+    group_match(group, HASHTABLE_EMPTY, &empty);
+    if (empty) {
+      const int slot = next_slot(empty);
+      group->tags[slot] = hash_tag(h);
+      group->slots[slot] = block_idx;
+      if (table->nsteps < step - 1) {
+        table->nsteps = step - 1;
+      }
       return;
     }
-    // linear probing
-    slot = (slot + 1) & shard->hashtable_mask;
+    igroup = (igroup + step) & group_mask;
   }
 }
 
 /*******************************************************************************
- * \brief Internal routine for looking up a block from a shard.
+ * \brief Private routine for looking up a block from the given hashtable.
  * \author Ole Schuett
  ******************************************************************************/
-dbm_block_t *dbm_shard_lookup(const dbm_shard_t *shard, const int row,
-                              const int col) {
-  int slot = (shard->hashtable_prime * hash(row, col)) & shard->hashtable_mask;
-  while (true) {
-    const int block_idx = shard->hashtable[slot] - 1; // 1-based, 0 means empty.
-    if (block_idx < 0) {
+static inline dbm_block_t *hashtable_lookup(const dbm_shard_t *shard,
+                                            const dbm_hashtable_t *table,
+                                            const unsigned int h, const int row,
+                                            const int col) {
+  const uint8_t tag = hash_tag(h);
+  const int group_mask = table->ngroups - 1;
+  int igroup = (table->prime * h) & group_mask;
+  for (int step = 1;; step++) {
+    const dbm_hashtable_group_t *group = &table->groups[igroup];
+    unsigned int empty;
+    // Only blocks with matching fingerprint need to be dereferenced.
+    for (unsigned int match = group_match(group, tag, &empty); match;
+         match &= match - 1) {
+      const int block_idx = group->slots[next_slot(match)];
+      assert(0 <= block_idx && block_idx < shard->nblocks);
+      dbm_block_t *blk = &shard->blocks[block_idx];
+      if (blk->row == row && blk->col == col) {
+        return blk;
+      }
+    }
+    if (empty) {
       return NULL; // block not found
     }
-    assert(0 <= block_idx && block_idx < shard->nblocks);
-    dbm_block_t *blk = &shard->blocks[block_idx];
-    if (blk->row == row && blk->col == col) {
-      return blk;
+    igroup = (igroup + step) & group_mask;
+  }
+}
+
+/*******************************************************************************
+ * \brief Private routine for migrating groups from the old hashtable.
+ *        Migrated slots are left in place, since lookups try the new hashtable
+ *        first. Once all groups are migrated the old hashtable gets released.
+ ******************************************************************************/
+static void hashtable_migrate(dbm_shard_t *shard, const int ngroups) {
+  dbm_hashtable_t *old_table = &shard->old_hashtable;
+  if (old_table->ngroups == 0) {
+    return;
+  }
+  int igroup = shard->old_hashtable_migrated;
+  const int end = igroup + ngroups;
+  for (; igroup < end && igroup < old_table->ngroups; igroup++) {
+    const dbm_hashtable_group_t *group = &old_table->groups[igroup];
+    for (int i = 0; i < DBM_HASHTABLE_GROUP_SIZE; i++) {
+      if (group->tags[i] != HASHTABLE_EMPTY) {
+        hashtable_insert(shard, &shard->hashtable, group->slots[i]);
+      }
     }
-    // linear probing
-    slot = (slot + 1) & shard->hashtable_mask;
+  }
+  shard->old_hashtable_migrated = igroup;
+  if (igroup == old_table->ngroups) {
+    hashtable_release(old_table);
+    shard->old_hashtable_migrated = 0;
+  }
+}
+
+/*******************************************************************************
+ * \brief Internal routine for removing all blocks from a shard's hashtable.
+ ******************************************************************************/
+void dbm_shard_clear_hashtable(dbm_shard_t *shard) {
+  hashtable_release(&shard->old_hashtable);
+  shard->old_hashtable_migrated = 0;
+  shard->hashtable.nsteps = 0;
+  for (int i = 0; i < shard->hashtable.ngroups; i++) {
+    memset(shard->hashtable.groups[i].tags, HASHTABLE_EMPTY,
+           DBM_HASHTABLE_GROUP_SIZE);
   }
 }
 
+/*******************************************************************************
+ * \brief Private routine for looking up a block from the old hashtable.
+ *        The probe sequence of a block is bounded by the longest one of any
+ *        insertion. Once all groups along it are migrated, the block would have
+ *        been found in the new hashtable already. Kept out of line, because it
+ *        is rarely needed and would otherwise occupy registers of the lookups.
+ ******************************************************************************/
+static dbm_block_t *__attribute__((noinline))
+old_hashtable_lookup(const dbm_shard_t *shard, const int row, const int col) {
+  const dbm_hashtable_t *old_table = &shard->old_hashtable;
+  const unsigned int h = hash(row, col);
+  const int nsteps = old_table->nsteps;
+  const int first = (old_table->prime * h) & (old_table->ngroups - 1);
+  const long last = first + (long)nsteps * (nsteps + 1) / 2;
+  if (last < shard->old_hashtable_migrated) {
+    return NULL; // all groups along the probe sequence are migrated
+  }
+  return hashtable_lookup(shard, old_table, h, row, col);
+}
+
+/*******************************************************************************
+ * \brief Internal routine for looking up a block from a shard.
+ ******************************************************************************/
+dbm_block_t *dbm_shard_lookup(const dbm_shard_t *shard, const int row,
+                              const int col) {
+  const unsigned int h = hash(row, col);
+  dbm_block_t *blk = hashtable_lookup(shard, &shard->hashtable, h, row, col);
+  if (blk == NULL && shard->old_hashtable.ngroups > 0) {
+    return old_hashtable_lookup(shard, row, col);
+  }
+  return blk;
+}
+
 /*******************************************************************************
  * \brief Internal routine for allocating the metadata of a new block.
  * \author Ole Schuett
@@ -172,17 +351,23 @@ dbm_block_t *dbm_shard_promise_new_block(dbm_shard_t *shard, const int row,
                                          const int col, const int block_size) {
   // Grow blocks array if necessary.
   if (shard->nblocks_allocated < shard->nblocks + 1) {
-    shard->nblocks_allocated = ALLOCATION_FACTOR * (shard->nblocks + 1);
+    const double factor = dbm_library_get_config()->allocation_factor;
+    shard->nblocks_allocated = factor * (shard->nblocks + 1);
     shard->blocks = (dbm_block_t *)realloc(
         shard->blocks, shard->nblocks_allocated * sizeof(dbm_block_t));
+  }
 
-    // rebuild hashtable
-    free(shard->hashtable);
-    hashtable_init(shard);
-    for (int i = 0; i < shard->nblocks; i++) {
-      hashtable_insert(shard, i);
-    }
+  // Grow hashtable if necessary. Instead of a full rebuild, the old hashtable
+  // is kept and migrated incrementally during subsequent insertions.
+  const int capacity = shard->hashtable.ngroups * DBM_HASHTABLE_GROUP_SIZE;
+  if (capacity < dbm_library_get_config()->hashtable_factor *
+                     (shard->nblocks + 1)) {
+    hashtable_migrate(shard, shard->old_hashtable.ngroups); // finish pending
+    shard->old_hashtable = shard->hashtable;
+    shard->old_hashtable_migrated = 0;
+    hashtable_init(&shard->hashtable, 2 * capacity);
   }
+  hashtable_migrate(shard, HASHTABLE_MIGRATION_GROUPS);
 
   const int new_block_idx = shard->nblocks;
   shard->nblocks++;
@@ -192,19 +377,20 @@ dbm_block_t *dbm_shard_promise_new_block(dbm_shard_t *shard, const int row,
   new_block->offset = shard->data_promised;
   shard->data_promised += block_size;
   // The data_size will be increase after the memory is allocated and zeroed.
-  hashtable_insert(shard, new_block_idx);
+  hashtable_insert(shard, &shard->hashtable, new_block_idx);
   return new_block;
 }
 
 /*******************************************************************************
- * \brief Internal routine for allocating and zeroing any promised block's data.
+ * \brief Private routine for allocating and zeroing any promised block's data.
  * \author Ole Schuett
  ******************************************************************************/
-void dbm_shard_allocate_promised_blocks(dbm_shard_t *shard) {
+static void allocate_promised_data(dbm_shard_t *shard) {
 
   // Reallocate data array if necessary.
   if (shard->data_promised > shard->data_allocated) {
-    shard->data_allocated = ALLOCATION_FACTOR * shard->data_promised;
+    const double factor = dbm_library_get_config()->allocation_factor;
+    shard->data_allocated = factor * shard->data_promised;
     shard->data =
         (double *)realloc(shard->data, shard->data_allocated * sizeof(double));
   }
@@ -219,6 +405,17 @@ void dbm_shard_allocate_promised_blocks(dbm_shard_t *shard) {
   }
 }
 
+/*******************************************************************************
+ * \brief Internal routine for allocating and zeroing any promised block's data.
+ *        Blocks get promised in bulk, which is typically followed by lookups.
+ *        Hence, a pending migration of the hashtable gets finished here.
+ * \author Ole Schuett
+ ******************************************************************************/
+void dbm_shard_allocate_promised_blocks(dbm_shard_t *shard) {
+  hashtable_migrate(shard, shard->old_hashtable.ngroups);
+  allocate_promised_data(shard);
+}
+
 /*******************************************************************************
  * \brief Internal routine for getting block or promising a new one.
  * \author Ole Schuett
@@ -249,9 +446,91 @@ dbm_block_t *dbm_shard_get_or_allocate_block(dbm_shard_t *shard, const int row,
   // Create a new block.
   dbm_block_t *new_blk =
       dbm_shard_promise_new_block(shard, row, col, block_size);
-  dbm_shard_allocate_promised_blocks(shard);
+  allocate_promised_data(shard); // keeps the migration incremental
 
   return new_blk;
 }
 
+/*******************************************************************************
+ * \brief Internal routine for multiplying all blocks of a shard by alpha.
+ ******************************************************************************/
+void dbm_shard_scale(dbm_shard_t *shard, const double alpha) {
+  if (alpha == 0.0) {
+    memset(shard->data, 0, shard->data_size * sizeof(double));
+  } else if (alpha != 1.0) {
+    for (int i = 0; i < shard->data_size; i++) {
+      shard->data[i] *= alpha;
+    }
+  }
+}
+
+/*******************************************************************************
+ * \brief Private routine for checking if a block should be filtered.
+ *        For historic reasons zero-sized blocks are never filtered.
+ ******************************************************************************/
+static bool block_is_filtered(const int block_size, const double *block,
+                              const double eps2) {
+  if (block_size == 0) {
+    return false;
+  }
+  double norm = 0.0;
+  for (int i = 0; i < block_size; i++) {
+    norm += block[i] * block[i];
+  }
+  return norm < eps2;
+}
+
+/*******************************************************************************
+ * \brief Internal routine for removing all blocks whose norm is below eps.
+ *        The remaining blocks are compacted in place, hence the data does not
+ *        get reallocated. Blocks of size zero are always kept.
+ ******************************************************************************/
+void dbm_shard_filter(dbm_shard_t *shard, const int row_sizes[],
+                      const int col_sizes[], const double eps) {
+  const double eps2 = eps * eps;
+
+  // Blocks in front of the first filtered block remain untouched. When no
+  // block gets filtered, even the hashtable remains valid.
+  int ifirst = 0;
+  while (ifirst < shard->nblocks) {
+    const dbm_block_t *blk = &shard->blocks[ifirst];
+    const int block_size = row_sizes[blk->row] * col_sizes[blk->col];
+    if (block_is_filtered(block_size, &shard->data[blk->offset], eps2)) {
+      break;
+    }
+    ifirst++;
+  }
+  if (ifirst == shard->nblocks) {
+    return;
+  }
+
+  // Compact the remaining blocks, which shifts their numbers. Hence, the
+  // hashtable gets rebuilt while the kept blocks are re-created.
+  const int old_nblocks = shard->nblocks;
+  shard->nblocks = 0;
+  shard->data_promised = 0;
+  dbm_shard_clear_hashtable(shard);
+  for (int iblock = 0; iblock < old_nblocks; iblock++) {
+    const dbm_block_t old_blk = shard->blocks[iblock];
+    const double *old_blk_data = &shard->data[old_blk.offset];
+    const int block_size = row_sizes[old_blk.row] * col_sizes[old_blk.col];
+    const bool filtered =
+        (iblock == ifirst) ||
+        (iblock > ifirst && block_is_filtered(block_size, old_blk_data, eps2));
+    if (filtered) {
+      continue; // filter the block
+    }
+    dbm_block_t *new_blk = dbm_shard_promise_new_block(shard, old_blk.row,
+                                                       old_blk.col, block_size);
+    assert(new_blk->offset <= old_blk.offset);
+    if (new_blk->offset != old_blk.offset) {
+      // Using memmove instead of memcpy because it handles overlap correctly.
+      double *new_blk_data = &shard->data[new_blk->offset];
+      memmove(new_blk_data, old_blk_data, block_size * sizeof(double));
+    }
+  }
+  shard->data_size = shard->data_promised;
+  // TODO: Could call realloc to release excess memory.
+}
+
 // EOF
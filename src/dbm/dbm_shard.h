@@ -8,6 +8,7 @@
 #define DBM_SHARD_H
 
 #include <omp.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -23,8 +24,33 @@ typedef struct {
   int offset;
 } dbm_block_t;
 
+#define DBM_HASHTABLE_GROUP_SIZE 12
+
+/*******************************************************************************
+ * \brief Internal struct for storing a group of hashtable slots.
+ *        A group fills exactly one cache line and its tags one SIMD register.
+ ******************************************************************************/
+typedef struct {
+  uint8_t tags[16]; // 7-bit fingerprints of the row/col, empty, or padding
+  int slots[DBM_HASHTABLE_GROUP_SIZE]; // block numbers
+} dbm_hashtable_group_t;
+
+/*******************************************************************************
+ * \brief Internal struct for storing an open-addressing hashtable.
+ *        Slots are probed in groups, which are filtered via their tags.
+ ******************************************************************************/
+typedef struct {
+  int ngroups; // should be a power of two
+  int prime;   // scatters hashes across groups
+  int nsteps;  // longest probe sequence of any insertion
+  dbm_hashtable_group_t *groups;
+} dbm_hashtable_t;
+
 /*******************************************************************************
  * \brief Internal struct for storing a matrix shard.
+ *        Shard i is owned by thread i % nthreads, which allocates and first
+ *        touches its memory. Hence, loops over shards use schedule(static, 1)
+ *        to keep the memory of each shard on the NUMA domain of its owner.
  * \author Ole Schuett
  ******************************************************************************/
 typedef struct {
@@ -32,10 +58,9 @@ typedef struct {
   int nblocks_allocated;
   dbm_block_t *blocks;
 
-  int hashtable_size;  // should be a power of two
-  int hashtable_mask;  // should be hashtable_size - 1, ie. a bit-mask
-  int hashtable_prime; // should be a coprime of hashtable_size
-  int *hashtable;      // maps row/col to block numbers
+  dbm_hashtable_t hashtable;     // maps row/col to block numbers
+  dbm_hashtable_t old_hashtable; // gets migrated incrementally after growth
+  int old_hashtable_migrated;    // number of already migrated groups
 
   int data_promised;  // referenced by a dbm_block_t.offset, but not yet
                       // allocated
@@ -64,6 +89,11 @@ void dbm_shard_copy(dbm_shard_t *shard_a, const dbm_shard_t *shard_b);
  ******************************************************************************/
 void dbm_shard_release(dbm_shard_t *shard);
 
+/*******************************************************************************
+ * \brief Internal routine for removing all blocks from a shard's hashtable.
+ ******************************************************************************/
+void dbm_shard_clear_hashtable(dbm_shard_t *shard);
+
 /*******************************************************************************
  * \brief Internal routine for looking up a block from a shard.
  * \author Ole Schuett
@@ -100,6 +130,19 @@ dbm_block_t *dbm_shard_get_or_allocate_block(dbm_shard_t *shard, const int row,
                                              const int col,
                                              const int block_size);
 
+/*******************************************************************************
+ * \brief Internal routine for multiplying all blocks of a shard by alpha.
+ ******************************************************************************/
+void dbm_shard_scale(dbm_shard_t *shard, const double alpha);
+
+/*******************************************************************************
+ * \brief Internal routine for removing all blocks whose norm is below eps.
+ *        The remaining blocks are compacted in place, hence the data does not
+ *        get reallocated. Blocks of size zero are always kept.
+ ******************************************************************************/
+void dbm_shard_filter(dbm_shard_t *shard, const int row_sizes[],
+                      const int col_sizes[], const double eps);
+
 #ifdef __cplusplus
 }
 #endif
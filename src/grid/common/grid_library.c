@@ -22,9 +22,13 @@
 #define GRID_NKERNELS 4
 #define GRID_MAX_LP 20
 
+// schedule statistics: calls, average, maximum, and predicted maximum in ns
+#define GRID_NSCHEDULE_STATS 4
+
 typedef struct {
   grid_sphere_cache sphere_cache;
   long counters[GRID_NBACKENDS * GRID_NKERNELS * GRID_MAX_LP];
+  long schedule_stats[2][GRID_NSCHEDULE_STATS];
 } grid_library_globals;
 
 static grid_library_globals **per_thread_globals = NULL;
@@ -33,6 +37,9 @@ static int max_threads = 0;
 static grid_library_config config = {
     .backend = GRID_BACKEND_AUTO, .validate = false, .apply_cutoff = false};
 
+// Prototype for the CPUID probe in base/machine_cpuid.c.
+int m_cpuid_runtime(void);
+
 #if !defined(_OPENMP)
 #error "OpenMP is required. Please add -fopenmp to your C compiler flags."
 #endif
@@ -73,6 +80,9 @@ void grid_library_init(void) {
     memset(per_thread_globals[ithread], 0, sizeof(grid_library_globals));
   }
 
+  // Let backends choose kernels for the instruction set of the host.
+  config.cpuid = m_cpuid_runtime();
+
   library_initialized = true;
 }
 
@@ -140,6 +150,22 @@ void grid_library_counter_add(const int lp, const enum grid_backend backend,
   per_thread_globals[ithread]->counters[idx] += increment;
 }
 
+/*******************************************************************************
+ * \brief Adds the thread loads of a parallel collocation or integration to the
+ *        schedule statistics. The predicted imbalance is weighted by time.
+ ******************************************************************************/
+void grid_library_schedule_add(const bool integrate,
+                               const double predicted_imbalance,
+                               const double max_time, const double avg_time) {
+  const int ithread = omp_get_thread_num();
+  assert(ithread < max_threads);
+  long *stats = per_thread_globals[ithread]->schedule_stats[integrate];
+  stats[0] += 1;
+  stats[1] += (long)(1e9 * avg_time);
+  stats[2] += (long)(1e9 * max_time);
+  stats[3] += (long)(1e9 * avg_time * predicted_imbalance);
+}
+
 /*******************************************************************************
  * \brief Comperator passed to qsort to compare two counters.
  * \author Ole Schuett
@@ -218,6 +244,40 @@ void grid_library_print_stats(void (*mpi_sum_func)(long *, int),
     print_func(buffer, output_unit);
   }
 
+  // Sum schedule statistics across threads and mpi ranks.
+  long schedule_stats[2][GRID_NSCHEDULE_STATS];
+  memset(schedule_stats, 0, sizeof(schedule_stats));
+  for (int i = 0; i < 2; i++) {
+    for (int j = 0; j < GRID_NSCHEDULE_STATS; j++) {
+      for (int k = 0; k < max_threads; k++) {
+        schedule_stats[i][j] += per_thread_globals[k]->schedule_stats[i][j];
+      }
+      mpi_sum_func(&schedule_stats[i][j], mpi_comm);
+    }
+  }
+
+  // Print imbalance of thread loads, i.e. maximum over average.
+  if (schedule_stats[0][0] + schedule_stats[1][0] > 0) {
+    print_func(" --------------------------------------------------------------"
+               "-----------------\n",
+               output_unit);
+    print_func(" SCHEDULE                       CALLS   PREDICTED IMBALANCE "
+               "  MEASURED IMBALANCE\n",
+               output_unit);
+    const char *schedule_names[] = {"collocate", "integrate"};
+    for (int i = 0; i < 2; i++) {
+      if (schedule_stats[i][0] == 0 || schedule_stats[i][1] == 0) {
+        continue; // skip empty statistics
+      }
+      const double avg = schedule_stats[i][1];
+      char buffer[100];
+      snprintf(buffer, sizeof(buffer), " %-18s %17li %21.2f %20.2f\n",
+               schedule_names[i], schedule_stats[i][0],
+               schedule_stats[i][3] / avg, schedule_stats[i][2] / avg);
+      print_func(buffer, output_unit);
+    }
+  }
+
   print_func(" ----------------------------------------------------------------"
              "---------------\n",
              output_unit);
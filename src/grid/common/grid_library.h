@@ -36,6 +36,7 @@ typedef struct {
       backend;       // Selectes the backend to be used by the grid library.
   bool validate;     // When true the reference backend runs in shadow mode.
   bool apply_cutoff; // only important for the dgemm and gpu backends
+  int cpuid;         // probed by grid_library_init, see base/machine_cpuid.h
 } grid_library_config;
 
 /*******************************************************************************
@@ -83,6 +84,18 @@ void grid_library_counter_add(const int lp, const enum grid_backend backend,
                               const enum grid_library_kernel kern,
                               const int increment);
 
+/*******************************************************************************
+ * \brief Adds the thread loads of a parallel collocation or integration to the
+ *        schedule statistics.
+ * \param integrate            Whether the loads stem from an integration.
+ * \param predicted_imbalance  Predicted maximum over average thread load.
+ * \param max_time             Measured maximum of the threads' busy times.
+ * \param avg_time             Measured average of the threads' busy times.
+ ******************************************************************************/
+void grid_library_schedule_add(const bool integrate,
+                               const double predicted_imbalance,
+                               const double max_time, const double avg_time);
+
 #ifdef __cplusplus
 }
 #endif
@@ -30,6 +30,35 @@
 #define GRID_CONST_WHEN_INTEGRATE const
 #endif
 
+// Kinds of scratch buffers, see get_scratch.
+enum grid_cpu_scratch {
+  GRID_CPU_SCRATCH_CAB,
+  GRID_CPU_SCRATCH_CXYZ,
+  GRID_CPU_SCRATCH_CIJK,
+  GRID_CPU_NSCRATCH
+};
+
+static double *scratch_buffers[GRID_CPU_NSCRATCH];
+static size_t scratch_sizes[GRID_CPU_NSCRATCH];
+#pragma omp threadprivate(scratch_buffers, scratch_sizes)
+
+/*******************************************************************************
+ * \brief Returns zeroed memory from the calling thread's scratch buffer of the
+ *        given kind. Since batches can exceed the stack, the buffers live on
+ *        the heap. They only ever grow, hence they get reused across tasks.
+ ******************************************************************************/
+static inline double *get_scratch(const enum grid_cpu_scratch kind,
+                                  const size_t size) {
+  if (scratch_sizes[kind] < size) {
+    free(scratch_buffers[kind]);
+    scratch_buffers[kind] = malloc(size * sizeof(double));
+    assert(scratch_buffers[kind] != NULL);
+    scratch_sizes[kind] = size;
+  }
+  memset(scratch_buffers[kind], 0, size * sizeof(double));
+  return scratch_buffers[kind];
+}
+
 /*******************************************************************************
  * \brief Simple loop body for ortho_cx_to_grid using plain C.
  * \author Ole Schuett
@@ -348,7 +377,8 @@ static inline void ortho_cxyz_to_cxy(const int lp, const int k1, const int k2,
 }
 
 /*******************************************************************************
- * \brief Collocates coefficients C_xyz onto the grid for orthorhombic case.
+ * \brief Collocates a batch of coefficients C_xyz onto their grids for
+ *        orthorhombic case. The tables and bounds are shared by all sets.
  * \author Ole Schuett
  ******************************************************************************/
 static inline void
@@ -356,8 +386,8 @@ ortho_cxyz_to_grid(const int lp, const double zetp, const double dh[3][3],
                    const double dh_inv[3][3], const double rp[3],
                    const int npts_global[3], const int npts_local[3],
                    const int shift_local[3], const double radius,
-                   GRID_CONST_WHEN_COLLOCATE double *cxyz,
-                   GRID_CONST_WHEN_INTEGRATE double *grid) {
+                   const int nbatch, GRID_CONST_WHEN_COLLOCATE double *cxyz,
+                   GRID_CONST_WHEN_INTEGRATE double *grids[nbatch]) {
 
   // *** position of the gaussian product
   //
@@ -386,7 +416,6 @@ ortho_cxyz_to_grid(const int lp, const double zetp, const double dh[3][3],
   int *sphere_bounds;
   double disr_radius;
   grid_sphere_cache_lookup(radius, dh, dh_inv, &sphere_bounds, &disr_radius);
-  int **sphere_bounds_iter = &sphere_bounds;
 
   // Cube bounds.
   int lb_cube[3], ub_cube[3];
@@ -468,28 +497,37 @@ ortho_cxyz_to_grid(const int lp, const double zetp, const double dh[3][3],
   const int(*sections)[2 * cmax + 1] =
       (const int(*)[2 * cmax + 1]) sections_mutable;
 
-  // Loop over k dimension of the cube.
-  const int kstart = *((*sphere_bounds_iter)++);
+  // Loop over the sets of the batch, each walking the sphere bounds anew.
+  const int kstart = sphere_bounds[0];
+  const size_t cxyz_size = (lp + 1) * (lp + 1) * (lp + 1);
   const size_t cxy_size = (lp + 1) * (lp + 1) * 2;
   double cxy[cxy_size];
-  for (int k1 = kstart; k1 <= 0; k1++) {
-    const int k2 = 1 - k1;
-    const int kg1 = map[2][k1 + cmax];
-    const int kg2 = map[2][k2 + cmax];
+  for (int ibatch = 0; ibatch < nbatch; ibatch++) {
+    GRID_CONST_WHEN_COLLOCATE double *cxyz_set = &cxyz[ibatch * cxyz_size];
+    GRID_CONST_WHEN_INTEGRATE double *grid = grids[ibatch];
+    int *bounds = &sphere_bounds[1];
+    int **sphere_bounds_iter = &bounds;
+
+    // Loop over k dimension of the cube.
+    for (int k1 = kstart; k1 <= 0; k1++) {
+      const int k2 = 1 - k1;
+      const int kg1 = map[2][k1 + cmax];
+      const int kg2 = map[2][k2 + cmax];
 
-    memset(cxy, 0, cxy_size * sizeof(double));
+      memset(cxy, 0, cxy_size * sizeof(double));
 
 #if (GRID_DO_COLLOCATE)
-    // collocate
-    ortho_cxyz_to_cxy(lp, k1, k2, cmax, pol, cxyz, cxy);
-    ortho_cxy_to_grid(lp, kg1, kg2, cmax, pol, map, sections, npts_local,
-                      sphere_bounds_iter, cxy, grid);
+      // collocate
+      ortho_cxyz_to_cxy(lp, k1, k2, cmax, pol, cxyz_set, cxy);
+      ortho_cxy_to_grid(lp, kg1, kg2, cmax, pol, map, sections, npts_local,
+                        sphere_bounds_iter, cxy, grid);
 #else
-    // integrate
-    ortho_cxy_to_grid(lp, kg1, kg2, cmax, pol, map, sections, npts_local,
-                      sphere_bounds_iter, cxy, grid);
-    ortho_cxyz_to_cxy(lp, k1, k2, cmax, pol, cxyz, cxy);
+      // integrate
+      ortho_cxy_to_grid(lp, kg1, kg2, cmax, pol, map, sections, npts_local,
+                        sphere_bounds_iter, cxy, grid);
+      ortho_cxyz_to_cxy(lp, k1, k2, cmax, pol, cxyz_set, cxy);
 #endif
+    }
   }
 }
 
@@ -796,7 +834,8 @@ general_fill_exp_table(const int idir, const int jdir, const int index_min[3],
 }
 
 /*******************************************************************************
- * \brief Collocates coefficients C_ijk onto the grid for general case.
+ * \brief Collocates a batch of coefficients C_ijk onto their grids for general
+ *        case. The mappings and exponentials are shared by all sets.
  * \author Ole Schuett
  ******************************************************************************/
 static inline void
@@ -805,8 +844,8 @@ general_cijk_to_grid(const int border_mask, const int lp, const double zetp,
                      const double rp[3], const int npts_global[3],
                      const int npts_local[3], const int shift_local[3],
                      const int border_width[3], const double radius,
-                     GRID_CONST_WHEN_COLLOCATE double *cijk,
-                     GRID_CONST_WHEN_INTEGRATE double *grid) {
+                     const int nbatch, GRID_CONST_WHEN_COLLOCATE double *cijk,
+                     GRID_CONST_WHEN_INTEGRATE double *grids[nbatch]) {
 
   // Default for border_mask == 0.
   int bounds_i[2] = {0, npts_local[0] - 1};
@@ -882,40 +921,45 @@ general_cijk_to_grid(const int border_mask, const int lp, const double zetp,
   general_fill_exp_table(2, 0, index_min, index_max, zetp, dh, gp, exp_ki);
 
   // go over the grid, but cycle if the point is not within the radius
+  const int cijk_size = (lp + 1) * (lp + 1) * (lp + 1);
   const int cij_size = (lp + 1) * (lp + 1);
   double cij[cij_size];
-  for (int k = index_min[2]; k <= index_max[2]; k++) {
-    const int kg = map_k[k - index_min[2]];
-    if (kg < 0) {
-      k += sections_k[k - index_min[2]]; // skip over out-of-bounds indicies
-      continue;
-    }
+  for (int ibatch = 0; ibatch < nbatch; ibatch++) {
+    GRID_CONST_WHEN_COLLOCATE double *cijk_set = &cijk[ibatch * cijk_size];
+    GRID_CONST_WHEN_INTEGRATE double *grid = grids[ibatch];
+    for (int k = index_min[2]; k <= index_max[2]; k++) {
+      const int kg = map_k[k - index_min[2]];
+      if (kg < 0) {
+        k += sections_k[k - index_min[2]]; // skip over out-of-bounds indicies
+        continue;
+      }
 
-    // zero coef_xyt
-    memset(cij, 0, cij_size * sizeof(double));
+      // zero coef_xyt
+      memset(cij, 0, cij_size * sizeof(double));
 
 #if (GRID_DO_COLLOCATE)
-    // collocate
-    general_cijk_to_cij(lp, (double)k - gp[2], cijk, cij);
-    general_cij_to_grid(lp, k, kg, npts_local, index_min, index_max, map_i,
-                        map_j, sections_i, sections_j, dh, gp, radius, exp_ij,
-                        exp_jk, exp_ki, cij, grid);
+      // collocate
+      general_cijk_to_cij(lp, (double)k - gp[2], cijk_set, cij);
+      general_cij_to_grid(lp, k, kg, npts_local, index_min, index_max, map_i,
+                          map_j, sections_i, sections_j, dh, gp, radius,
+                          exp_ij, exp_jk, exp_ki, cij, grid);
 #else
-    // integrate
-    general_cij_to_grid(lp, k, kg, npts_local, index_min, index_max, map_i,
-                        map_j, sections_i, sections_j, dh, gp, radius, exp_ij,
-                        exp_jk, exp_ki, cij, grid);
-    general_cijk_to_cij(lp, (double)k - gp[2], cijk, cij);
+      // integrate
+      general_cij_to_grid(lp, k, kg, npts_local, index_min, index_max, map_i,
+                          map_j, sections_i, sections_j, dh, gp, radius,
+                          exp_ij, exp_jk, exp_ki, cij, grid);
+      general_cijk_to_cij(lp, (double)k - gp[2], cijk_set, cij);
 #endif
+    }
   }
 }
 
 /*******************************************************************************
- * \brief Transforms coefficients C_xyz into C_ijk.
+ * \brief Transforms a batch of coefficients C_xyz into C_ijk.
  * \author Ole Schuett
  ******************************************************************************/
 static inline void
-general_cxyz_to_cijk(const int lp, const double dh[3][3],
+general_cxyz_to_cijk(const int lp, const double dh[3][3], const int nbatch,
                      GRID_CONST_WHEN_COLLOCATE double *cxyz,
                      GRID_CONST_WHEN_INTEGRATE double *cijk) {
 
@@ -934,6 +978,8 @@ general_cxyz_to_cijk(const int lp, const double dh[3][3],
     }
   }
 
+  // Both C_xyz and C_ijk have the same size per set.
+  const int size = (lp + 1) * (lp + 1) * (lp + 1);
   const int lpx = lp;
   for (int klx = 0; klx <= lpx; klx++) {
     for (int jlx = 0; jlx <= lpx - klx; jlx++) {
@@ -965,11 +1011,13 @@ general_cxyz_to_cijk(const int lp, const double dh[3][3],
                         hmatgridp[klz][2][2] * fac(lx) * fac(ly) * fac(lz) /
                         (fac(ilx) * fac(ily) * fac(ilz) * fac(jlx) * fac(jly) *
                          fac(jlz) * fac(klx) * fac(kly) * fac(klz));
+                    for (int ib = 0; ib < nbatch * size; ib += size) {
 #if (GRID_DO_COLLOCATE)
-                    cijk[cijk_index] += cxyz[cxyz_index] * p; // collocate
+                      cijk[ib + cijk_index] += cxyz[ib + cxyz_index] * p;
 #else
-                    cxyz[cxyz_index] += cijk[cijk_index] * p; // integrate
+                      cxyz[ib + cxyz_index] += cijk[ib + cijk_index] * p;
 #endif
+                    }
                   }
                 }
               }
@@ -982,7 +1030,8 @@ general_cxyz_to_cijk(const int lp, const double dh[3][3],
 }
 
 /*******************************************************************************
- * \brief Collocates coefficients C_xyz onto the grid for general case.
+ * \brief Collocates a batch of coefficients C_xyz onto their grids for general
+ *        case.
  * \author Ole Schuett
  ******************************************************************************/
 static inline void
@@ -991,30 +1040,29 @@ general_cxyz_to_grid(const int border_mask, const int lp, const double zetp,
                      const double rp[3], const int npts_global[3],
                      const int npts_local[3], const int shift_local[3],
                      const int border_width[3], const double radius,
-                     GRID_CONST_WHEN_COLLOCATE double *cxyz,
-                     GRID_CONST_WHEN_INTEGRATE double *grid) {
+                     const int nbatch, GRID_CONST_WHEN_COLLOCATE double *cxyz,
+                     GRID_CONST_WHEN_INTEGRATE double *grids[nbatch]) {
 
-  const size_t cijk_size = (lp + 1) * (lp + 1) * (lp + 1);
-  double cijk[cijk_size];
-  memset(cijk, 0, cijk_size * sizeof(double));
+  const size_t cijk_size = nbatch * (lp + 1) * (lp + 1) * (lp + 1);
+  double *cijk = get_scratch(GRID_CPU_SCRATCH_CIJK, cijk_size);
 
 #if (GRID_DO_COLLOCATE)
   // collocate
-  general_cxyz_to_cijk(lp, dh, cxyz, cijk);
+  general_cxyz_to_cijk(lp, dh, nbatch, cxyz, cijk);
   general_cijk_to_grid(border_mask, lp, zetp, dh, dh_inv, rp, npts_global,
-                       npts_local, shift_local, border_width, radius, cijk,
-                       grid);
+                       npts_local, shift_local, border_width, radius, nbatch,
+                       cijk, grids);
 #else
   // integrate
   general_cijk_to_grid(border_mask, lp, zetp, dh, dh_inv, rp, npts_global,
-                       npts_local, shift_local, border_width, radius, cijk,
-                       grid);
-  general_cxyz_to_cijk(lp, dh, cxyz, cijk);
+                       npts_local, shift_local, border_width, radius, nbatch,
+                       cijk, grids);
+  general_cxyz_to_cijk(lp, dh, nbatch, cxyz, cijk);
 #endif
 }
 
 /*******************************************************************************
- * \brief Collocates coefficients C_xyz onto the grid.
+ * \brief Collocates a batch of coefficients C_xyz onto their grids.
  * \author Ole Schuett
  ******************************************************************************/
 static inline void
@@ -1023,31 +1071,35 @@ cxyz_to_grid(const bool orthorhombic, const int border_mask, const int lp,
              const double dh_inv[3][3], const double rp[3],
              const int npts_global[3], const int npts_local[3],
              const int shift_local[3], const int border_width[3],
-             const double radius, GRID_CONST_WHEN_COLLOCATE double *cxyz,
-             GRID_CONST_WHEN_INTEGRATE double *grid) {
+             const double radius, const int nbatch,
+             GRID_CONST_WHEN_COLLOCATE double *cxyz,
+             GRID_CONST_WHEN_INTEGRATE double *grids[nbatch]) {
 
   enum grid_library_kernel k;
   if (orthorhombic && border_mask == 0) {
     k = (GRID_DO_COLLOCATE) ? GRID_COLLOCATE_ORTHO : GRID_INTEGRATE_ORTHO;
     ortho_cxyz_to_grid(lp, zetp, dh, dh_inv, rp, npts_global, npts_local,
-                       shift_local, radius, cxyz, grid);
+                       shift_local, radius, nbatch, cxyz, grids);
   } else {
     k = (GRID_DO_COLLOCATE) ? GRID_COLLOCATE_GENERAL : GRID_INTEGRATE_GENERAL;
     general_cxyz_to_grid(border_mask, lp, zetp, dh, dh_inv, rp, npts_global,
-                         npts_local, shift_local, border_width, radius, cxyz,
-                         grid);
+                         npts_local, shift_local, border_width, radius, nbatch,
+                         cxyz, grids);
   }
-  grid_library_counter_add(lp, GRID_BACKEND_CPU, k, 1);
+  grid_library_counter_add(lp, GRID_BACKEND_CPU, k, nbatch);
 }
 
 /*******************************************************************************
- * \brief Transforms coefficients C_ab into C_xyz.
+ * \brief Transforms a batch of coefficients C_ab into C_xyz. Each element of
+ *        the transformation is computed once and applied to all sets, which
+ *        amounts to a small matrix-matrix product.
  * \author Ole Schuett
  ******************************************************************************/
 static inline void cab_to_cxyz(const int la_max, const int la_min,
                                const int lb_max, const int lb_min,
                                const double prefactor, const double ra[3],
                                const double rb[3], const double rp[3],
+                               const int nbatch,
                                GRID_CONST_WHEN_COLLOCATE double *cab,
                                GRID_CONST_WHEN_INTEGRATE double *cxyz) {
 
@@ -1094,6 +1146,8 @@ static inline void cab_to_cxyz(const int la_max, const int la_min,
   // (current implementation is l**7)
   //
 
+  const int cab_size = ncoset(lb_max) * ncoset(la_max);
+  const int cxyz_size = (lp + 1) * (lp + 1) * (lp + 1);
   for (int lzb = 0; lzb <= lb_max; lzb++) {
     for (int lza = 0; lza <= la_max; lza++) {
       for (int lyb = 0; lyb <= lb_max - lzb; lyb++) {
@@ -1114,11 +1168,15 @@ static inline void cab_to_cxyz(const int la_max, const int la_min,
                     const int lp1 = lp + 1;
                     const int cxyz_index =
                         lzp * lp1 * lp1 + lyp * lp1 + lxp; // [lzp, lyp, lxp]
+                    for (int ibatch = 0; ibatch < nbatch; ibatch++) {
+                      const int i = ibatch * cxyz_size + cxyz_index;
+                      const int j = ibatch * cab_size + cab_index;
 #if (GRID_DO_COLLOCATE)
-                    cxyz[cxyz_index] += cab[cab_index] * p; // collocate
+                      cxyz[i] += cab[j] * p; // collocate
 #else
-                    cab[cab_index] += cxyz[cxyz_index] * p; // integrate
+                      cab[j] += cxyz[i] * p; // integrate
 #endif
+                    }
                   }
                 }
               }
@@ -1131,7 +1189,8 @@ static inline void cab_to_cxyz(const int la_max, const int la_min,
 }
 
 /*******************************************************************************
- * \brief Collocates coefficients C_ab onto the grid.
+ * \brief Collocates a batch of coefficients C_ab onto their grids.
+ *        The sets of the batch are stored consecutively in cab.
  * \author Ole Schuett
  ******************************************************************************/
 static inline void
@@ -1141,9 +1200,9 @@ cab_to_grid(const bool orthorhombic, const int border_mask, const int la_max,
             const double dh[3][3], const double dh_inv[3][3],
             const double ra[3], const double rab[3], const int npts_global[3],
             const int npts_local[3], const int shift_local[3],
-            const int border_width[3], const double radius,
+            const int border_width[3], const double radius, const int nbatch,
             GRID_CONST_WHEN_COLLOCATE double *cab,
-            GRID_CONST_WHEN_INTEGRATE double *grid) {
+            GRID_CONST_WHEN_INTEGRATE double *grids[nbatch]) {
 
   // Check if radius is too small to be mapped onto grid of given resolution.
   double dh_max = 0.0;
@@ -1167,20 +1226,23 @@ cab_to_grid(const bool orthorhombic, const int border_mask, const int la_max,
   }
 
   const int lp = la_max + lb_max;
-  const size_t cxyz_size = (lp + 1) * (lp + 1) * (lp + 1);
-  double cxyz[cxyz_size];
-  memset(cxyz, 0, cxyz_size * sizeof(double));
+  const size_t cxyz_size = nbatch * (lp + 1) * (lp + 1) * (lp + 1);
+  double *cxyz = get_scratch(GRID_CPU_SCRATCH_CXYZ, cxyz_size);
 
 #if (GRID_DO_COLLOCATE)
   // collocate
-  cab_to_cxyz(la_max, la_min, lb_max, lb_min, prefactor, ra, rb, rp, cab, cxyz);
+  cab_to_cxyz(la_max, la_min, lb_max, lb_min, prefactor, ra, rb, rp, nbatch,
+              cab, cxyz);
   cxyz_to_grid(orthorhombic, border_mask, lp, zetp, dh, dh_inv, rp, npts_global,
-               npts_local, shift_local, border_width, radius, cxyz, grid);
+               npts_local, shift_local, border_width, radius, nbatch, cxyz,
+               grids);
 #else
   // integrate
   cxyz_to_grid(orthorhombic, border_mask, lp, zetp, dh, dh_inv, rp, npts_global,
-               npts_local, shift_local, border_width, radius, cxyz, grid);
-  cab_to_cxyz(la_max, la_min, lb_max, lb_min, prefactor, ra, rb, rp, cab, cxyz);
+               npts_local, shift_local, border_width, radius, nbatch, cxyz,
+               grids);
+  cab_to_cxyz(la_max, la_min, lb_max, lb_min, prefactor, ra, rb, rp, nbatch,
+              cab, cxyz);
 #endif
 }
 
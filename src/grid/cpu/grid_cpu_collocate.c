@@ -20,6 +20,9 @@
 #include "grid_cpu_integrate.h"
 #include "grid_cpu_prepare_pab.h"
 
+// Set this to true to write each task to a file.
+static const bool DUMP_TASKS = false;
+
 /*******************************************************************************
  * \brief Writes the given arguments into a .task file.
  *        See grid_replay.h for details.
@@ -141,8 +144,8 @@ static void write_task_file(
 }
 
 /*******************************************************************************
- * \brief Collocates a single product of primitiv Gaussians.
- *        See grid_cpu_collocate.h for details.
+ * \brief Collocates a single product of primitiv Gaussians for a batch of
+ *        density matrices. See grid_cpu_collocate.h for details.
  * \author Ole Schuett
  ******************************************************************************/
 static void collocate_internal(
@@ -152,8 +155,8 @@ static void collocate_internal(
     const double dh[3][3], const double dh_inv[3][3], const double ra[3],
     const double rab[3], const int npts_global[3], const int npts_local[3],
     const int shift_local[3], const int border_width[3], const double radius,
-    const int o1, const int o2, const int n1, const int n2,
-    const double pab[n2][n1], double *grid) {
+    const int o1, const int o2, const int n1, const int n2, const int nbatch,
+    const double pab[nbatch][n2][n1], double *grids[nbatch]) {
 
   int la_min_diff, la_max_diff, lb_min_diff, lb_max_diff;
   grid_cpu_prepare_get_ldiffs(func, &la_min_diff, &la_max_diff, &lb_min_diff,
@@ -167,14 +170,18 @@ static void collocate_internal(
   const int n2_cab = ncoset(lb_max_cab);
 
   const size_t cab_size = n2_cab * n1_cab;
-  double cab[cab_size];
-  memset(cab, 0, cab_size * sizeof(double));
+  double *cab = get_scratch(GRID_CPU_SCRATCH_CAB, nbatch * cab_size);
 
-  grid_cpu_prepare_pab(func, o1, o2, la_max, la_min, lb_max, lb_min, zeta, zetb,
-                       n1, n2, pab, n1_cab, n2_cab, (double(*)[n1_cab])cab);
+  for (int ibatch = 0; ibatch < nbatch; ibatch++) {
+    double *cab_set = &cab[ibatch * cab_size];
+    grid_cpu_prepare_pab(func, o1, o2, la_max, la_min, lb_max, lb_min, zeta,
+                         zetb, n1, n2, pab[ibatch], n1_cab, n2_cab,
+                         (double(*)[n1_cab])cab_set);
+  }
   cab_to_grid(orthorhombic, border_mask, la_max_cab, la_min_cab, lb_max_cab,
               lb_min_cab, zeta, zetb, rscale, dh, dh_inv, ra, rab, npts_global,
-              npts_local, shift_local, border_width, radius, cab, grid);
+              npts_local, shift_local, border_width, radius, nbatch, cab,
+              grids);
 }
 
 /*******************************************************************************
@@ -192,9 +199,6 @@ void grid_cpu_collocate_pgf_product(
     const int o1, const int o2, const int n1, const int n2,
     const double pab[n2][n1], double *grid) {
 
-  // Set this to true to write each task to a file.
-  const bool DUMP_TASKS = false;
-
   double *grid_before = NULL;
   const size_t npts_local_total = npts_local[0] * npts_local[1] * npts_local[2];
 
@@ -208,7 +212,7 @@ void grid_cpu_collocate_pgf_product(
   collocate_internal(orthorhombic, border_mask, func, la_max, la_min, lb_max,
                      lb_min, zeta, zetb, rscale, dh, dh_inv, ra, rab,
                      npts_global, npts_local, shift_local, border_width, radius,
-                     o1, o2, n1, n2, pab, grid);
+                     o1, o2, n1, n2, 1, (const double(*)[n2][n1])pab, &grid);
 
   if (DUMP_TASKS) {
     write_task_file(orthorhombic, border_mask, func, la_max, la_min, lb_max,
@@ -223,4 +227,35 @@ void grid_cpu_collocate_pgf_product(
   }
 }
 
+/*******************************************************************************
+ * \brief Public entry point for a batch of density matrices.
+ *        See grid_cpu_collocate.h for details.
+ ******************************************************************************/
+void grid_cpu_collocate_pgf_product_batched(
+    const bool orthorhombic, const int border_mask, const enum grid_func func,
+    const int la_max, const int la_min, const int lb_max, const int lb_min,
+    const double zeta, const double zetb, const double rscale,
+    const double dh[3][3], const double dh_inv[3][3], const double ra[3],
+    const double rab[3], const int npts_global[3], const int npts_local[3],
+    const int shift_local[3], const int border_width[3], const double radius,
+    const int o1, const int o2, const int n1, const int n2, const int nbatch,
+    const double pab[nbatch][n2][n1], double *grids[nbatch]) {
+
+  if (DUMP_TASKS) {
+    for (int ibatch = 0; ibatch < nbatch; ibatch++) {
+      grid_cpu_collocate_pgf_product(
+          orthorhombic, border_mask, func, la_max, la_min, lb_max, lb_min, zeta,
+          zetb, rscale, dh, dh_inv, ra, rab, npts_global, npts_local,
+          shift_local, border_width, radius, o1, o2, n1, n2, pab[ibatch],
+          grids[ibatch]);
+    }
+    return;
+  }
+
+  collocate_internal(orthorhombic, border_mask, func, la_max, la_min, lb_max,
+                     lb_min, zeta, zetb, rscale, dh, dh_inv, ra, rab,
+                     npts_global, npts_local, shift_local, border_width, radius,
+                     o1, o2, n1, n2, nbatch, pab, grids);
+}
+
 // EOF
@@ -54,6 +54,26 @@ void grid_cpu_collocate_pgf_product(
     const int o1, const int o2, const int n1, const int n2,
     const double pab[n2][n1], double *grid);
 
+/*******************************************************************************
+ * \brief Collocates a single task for a batch of density matrices at once.
+ *        The setup of the Gaussian product is shared by all of them.
+ *        Arguments are identical with grid_cpu_collocate_pgf_product except:
+ *
+ * \param nbatch        Number of density matrices.
+ * \param pab           The atom-pair's density matrix blocks, one per batch.
+ * \param grids         The output grid arrays, one per batch.
+ *
+ ******************************************************************************/
+void grid_cpu_collocate_pgf_product_batched(
+    const bool orthorhombic, const int border_mask, const enum grid_func func,
+    const int la_max, const int la_min, const int lb_max, const int lb_min,
+    const double zeta, const double zetb, const double rscale,
+    const double dh[3][3], const double dh_inv[3][3], const double ra[3],
+    const double rab[3], const int npts_global[3], const int npts_local[3],
+    const int shift_local[3], const int border_width[3], const double radius,
+    const int o1, const int o2, const int n1, const int n2, const int nbatch,
+    const double pab[nbatch][n2][n1], double *grids[nbatch]);
+
 #endif
 
 // EOF
@@ -0,0 +1,19 @@
+/*----------------------------------------------------------------------------*/
+/*  CP2K: A general program to perform molecular dynamics simulations         */
+/*  Copyright 2000-2024 CP2K developers group <https://cp2k.org>              */
+/*                                                                            */
+/*  SPDX-License-Identifier: BSD-3-Clause                                     */
+/*----------------------------------------------------------------------------*/
+
+// Builds grid_cpu_collocate.c for SSE4, see grid_cpu_kernels.h for details.
+#include "grid_cpu_kernels.h"
+
+#if (GRID_CPU_MULTIVERSIONED)
+#pragma GCC target("sse4.2")
+#define grid_cpu_collocate_pgf_product grid_cpu_collocate_pgf_product_sse4
+#define grid_cpu_collocate_pgf_product_batched                                 \
+  grid_cpu_collocate_pgf_product_batched_sse4
+#include "grid_cpu_collocate.c"
+#endif
+
+// EOF
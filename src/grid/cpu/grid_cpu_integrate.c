@@ -38,46 +38,18 @@ static inline double cab_get(const cab_store *cab, const orbital a,
 #include "../common/grid_process_vab.h"
 
 /*******************************************************************************
- * \brief Integrates a single task. See grid_cpu_integrate.h for details.
- * \author Ole Schuett
+ * \brief Extracts hab and optionally its derivatives from the integrated cab.
  ******************************************************************************/
-void grid_cpu_integrate_pgf_product(
-    const bool orthorhombic, const bool compute_tau, const int border_mask,
-    const int la_max, const int la_min, const int lb_max, const int lb_min,
-    const double zeta, const double zetb, const double dh[3][3],
-    const double dh_inv[3][3], const double ra[3], const double rab[3],
-    const int npts_global[3], const int npts_local[3], const int shift_local[3],
-    const int border_width[3], const double radius, const int o1, const int o2,
-    const int n1, const int n2, const double *grid, double hab[n2][n1],
-    const double pab[n2][n1], double forces[2][3], double virials[2][3][3],
-    double hdab[n2][n1][3], double hadb[n2][n1][3],
-    double a_hdab[n2][n1][3][3]) {
-
-  const bool calculate_forces = (forces != NULL || hdab != NULL);
-  const bool calculate_virial = (virials != NULL || a_hdab != NULL);
-  assert(!calculate_virial || calculate_forces);
-  const process_ldiffs ldiffs =
-      process_get_ldiffs(calculate_forces, calculate_virial, compute_tau);
-  int la_max_local = la_max + ldiffs.la_max_diff;
-  int lb_max_local = lb_max + ldiffs.lb_max_diff;
-  int la_min_local = imax(0, la_min + ldiffs.la_min_diff);
-  int lb_min_local = imax(0, lb_min + ldiffs.lb_min_diff);
-
-  const int m1 = ncoset(la_max_local);
-  const int m2 = ncoset(lb_max_local);
-  double cab[m2 * m1];
-  memset(cab, 0, m2 * m1 * sizeof(double));
-
-  const cab_store cab_obj = {.data = cab, .m1 = m1};
+static void cab_to_hab(const bool compute_tau, const int la_max,
+                       const int la_min, const int lb_max, const int lb_min,
+                       const double zeta, const double zetb,
+                       const double rab[3], const int o1, const int o2,
+                       const int n1, const int n2, const cab_store *cab,
+                       double hab[n2][n1], const double pab[n2][n1],
+                       double forces[2][3], double virials[2][3][3],
+                       double hdab[n2][n1][3], double hadb[n2][n1][3],
+                       double a_hdab[n2][n1][3][3]) {
 
-  const double rscale = 1.0; // TODO: remove rscale from cab_to_grid
-  cab_to_grid(orthorhombic, border_mask, la_max_local, la_min_local,
-              lb_max_local, lb_min_local, zeta, zetb, rscale, dh, dh_inv, ra,
-              rab, npts_global, npts_local, shift_local, border_width, radius,
-              cab, grid);
-
-  //  cab contains all the information needed to find the elements of hab
-  //  and optionally of derivatives of these elements
   for (int la = la_min; la <= la_max; la++) {
     for (int ax = 0; ax <= la; ax++) {
       for (int ay = 0; ay <= la - ax; ay++) {
@@ -91,16 +63,16 @@ void grid_cpu_integrate_pgf_product(
 
               // Update hab block.
               hab[o2 + idx(b)][o1 + idx(a)] +=
-                  get_hab(a, b, zeta, zetb, &cab_obj, compute_tau);
+                  get_hab(a, b, zeta, zetb, cab, compute_tau);
 
               // Update forces.
               if (forces != NULL) {
                 const double pabval = pab[o2 + idx(b)][o1 + idx(a)];
                 for (int i = 0; i < 3; i++) {
                   forces[0][i] += pabval * get_force_a(a, b, i, zeta, zetb,
-                                                       &cab_obj, compute_tau);
+                                                       cab, compute_tau);
                   forces[1][i] += pabval * get_force_b(a, b, i, zeta, zetb, rab,
-                                                       &cab_obj, compute_tau);
+                                                       cab, compute_tau);
                 }
               }
 
@@ -110,11 +82,11 @@ void grid_cpu_integrate_pgf_product(
                 for (int i = 0; i < 3; i++) {
                   for (int j = 0; j < 3; j++) {
                     virials[0][i][j] +=
-                        pabval * get_virial_a(a, b, i, j, zeta, zetb, &cab_obj,
+                        pabval * get_virial_a(a, b, i, j, zeta, zetb, cab,
                                               compute_tau);
                     virials[1][i][j] +=
-                        pabval * get_virial_b(a, b, i, j, zeta, zetb, rab,
-                                              &cab_obj, compute_tau);
+                        pabval * get_virial_b(a, b, i, j, zeta, zetb, rab, cab,
+                                              compute_tau);
                   }
                 }
               }
@@ -124,14 +96,14 @@ void grid_cpu_integrate_pgf_product(
                 assert(!compute_tau);
                 for (int i = 0; i < 3; i++) {
                   hdab[o2 + idx(b)][o1 + idx(a)][i] +=
-                      get_force_a(a, b, i, zeta, zetb, &cab_obj, false);
+                      get_force_a(a, b, i, zeta, zetb, cab, false);
                 }
               }
               if (hadb != NULL) {
                 assert(!compute_tau);
                 for (int i = 0; i < 3; i++) {
                   hadb[o2 + idx(b)][o1 + idx(a)][i] +=
-                      get_force_b(a, b, i, zeta, zetb, rab, &cab_obj, false);
+                      get_force_b(a, b, i, zeta, zetb, rab, cab, false);
                 }
               }
               if (a_hdab != NULL) {
@@ -139,7 +111,7 @@ void grid_cpu_integrate_pgf_product(
                 for (int i = 0; i < 3; i++) {
                   for (int j = 0; j < 3; j++) {
                     a_hdab[o2 + idx(b)][o1 + idx(a)][i][j] +=
-                        get_virial_a(a, b, i, j, zeta, zetb, &cab_obj, false);
+                        get_virial_a(a, b, i, j, zeta, zetb, cab, false);
                   }
                 }
               }
@@ -151,4 +123,94 @@ void grid_cpu_integrate_pgf_product(
   }
 }
 
+/*******************************************************************************
+ * \brief Integrates a single task. See grid_cpu_integrate.h for details.
+ * \author Ole Schuett
+ ******************************************************************************/
+void grid_cpu_integrate_pgf_product(
+    const bool orthorhombic, const bool compute_tau, const int border_mask,
+    const int la_max, const int la_min, const int lb_max, const int lb_min,
+    const double zeta, const double zetb, const double dh[3][3],
+    const double dh_inv[3][3], const double ra[3], const double rab[3],
+    const int npts_global[3], const int npts_local[3], const int shift_local[3],
+    const int border_width[3], const double radius, const int o1, const int o2,
+    const int n1, const int n2, const double *grid, double hab[n2][n1],
+    const double pab[n2][n1], double forces[2][3], double virials[2][3][3],
+    double hdab[n2][n1][3], double hadb[n2][n1][3],
+    double a_hdab[n2][n1][3][3]) {
+
+  const bool calculate_forces = (forces != NULL || hdab != NULL);
+  const bool calculate_virial = (virials != NULL || a_hdab != NULL);
+  assert(!calculate_virial || calculate_forces);
+  const process_ldiffs ldiffs =
+      process_get_ldiffs(calculate_forces, calculate_virial, compute_tau);
+  int la_max_local = la_max + ldiffs.la_max_diff;
+  int lb_max_local = lb_max + ldiffs.lb_max_diff;
+  int la_min_local = imax(0, la_min + ldiffs.la_min_diff);
+  int lb_min_local = imax(0, lb_min + ldiffs.lb_min_diff);
+
+  const int m1 = ncoset(la_max_local);
+  const int m2 = ncoset(lb_max_local);
+  double cab[m2 * m1];
+  memset(cab, 0, m2 * m1 * sizeof(double));
+
+  const cab_store cab_obj = {.data = cab, .m1 = m1};
+
+  const double rscale = 1.0; // TODO: remove rscale from cab_to_grid
+  cab_to_grid(orthorhombic, border_mask, la_max_local, la_min_local,
+              lb_max_local, lb_min_local, zeta, zetb, rscale, dh, dh_inv, ra,
+              rab, npts_global, npts_local, shift_local, border_width, radius,
+              1, cab, &grid);
+
+  //  cab contains all the information needed to find the elements of hab
+  //  and optionally of derivatives of these elements
+  cab_to_hab(compute_tau, la_max, la_min, lb_max, lb_min, zeta, zetb, rab, o1,
+             o2, n1, n2, &cab_obj, hab, pab, forces, virials, hdab, hadb,
+             a_hdab);
+}
+
+/*******************************************************************************
+ * \brief Integrates a single task for a batch of potentials at once.
+ *        See grid_cpu_integrate.h for details.
+ ******************************************************************************/
+void grid_cpu_integrate_pgf_product_batched(
+    const bool orthorhombic, const bool compute_tau, const int border_mask,
+    const int la_max, const int la_min, const int lb_max, const int lb_min,
+    const double zeta, const double zetb, const double dh[3][3],
+    const double dh_inv[3][3], const double ra[3], const double rab[3],
+    const int npts_global[3], const int npts_local[3], const int shift_local[3],
+    const int border_width[3], const double radius, const int o1, const int o2,
+    const int n1, const int n2, const int nbatch, const double *grids[nbatch],
+    double hab[nbatch][n2][n1], const double pab[nbatch][n2][n1],
+    double forces[nbatch][2][3], double virials[nbatch][2][3][3]) {
+
+  const bool calculate_forces = (forces != NULL);
+  const bool calculate_virial = (virials != NULL);
+  assert(!calculate_virial || calculate_forces);
+  const process_ldiffs ldiffs =
+      process_get_ldiffs(calculate_forces, calculate_virial, compute_tau);
+  int la_max_local = la_max + ldiffs.la_max_diff;
+  int lb_max_local = lb_max + ldiffs.lb_max_diff;
+  int la_min_local = imax(0, la_min + ldiffs.la_min_diff);
+  int lb_min_local = imax(0, lb_min + ldiffs.lb_min_diff);
+
+  const int m1 = ncoset(la_max_local);
+  const int m2 = ncoset(lb_max_local);
+  double *cab = get_scratch(GRID_CPU_SCRATCH_CAB, nbatch * m2 * m1);
+
+  cab_to_grid(orthorhombic, border_mask, la_max_local, la_min_local,
+              lb_max_local, lb_min_local, zeta, zetb, /*rscale=*/1.0, dh,
+              dh_inv, ra, rab, npts_global, npts_local, shift_local,
+              border_width, radius, nbatch, cab, grids);
+
+  for (int ibatch = 0; ibatch < nbatch; ibatch++) {
+    const cab_store cab_obj = {.data = &cab[ibatch * m2 * m1], .m1 = m1};
+    cab_to_hab(compute_tau, la_max, la_min, lb_max, lb_min, zeta, zetb, rab,
+               o1, o2, n1, n2, &cab_obj, hab[ibatch],
+               (pab != NULL) ? pab[ibatch] : NULL,
+               (forces != NULL) ? forces[ibatch] : NULL,
+               (virials != NULL) ? virials[ibatch] : NULL, NULL, NULL, NULL);
+  }
+}
+
 // EOF
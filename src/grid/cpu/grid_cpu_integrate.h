@@ -39,5 +39,30 @@ void grid_cpu_integrate_pgf_product(
     double hdab[n2][n1][3], double hadb[n2][n1][3],
     double a_hdab[n2][n1][3][3]);
 
+/*******************************************************************************
+ * \brief Integrates a single task for a batch of potentials at once.
+ *        The setup of the Gaussian product is shared by all of them.
+ *        Arguments are identical with grid_cpu_integrate_pgf_product except:
+ *
+ * \param nbatch        Number of potentials.
+ * \param grids         Input grid arrays, one per batch.
+ * \param hab           Output Hamiltonian matrix blocks, one per batch.
+ *
+ * \param pab           Optional input density matrix blocks, one per batch.
+ * \param forces        Optional output forces, one per batch, requires pab.
+ * \param virials       Optional output virials, one per batch, requires pab.
+ *
+ ******************************************************************************/
+void grid_cpu_integrate_pgf_product_batched(
+    const bool orthorhombic, const bool compute_tau, const int border_mask,
+    const int la_max, const int la_min, const int lb_max, const int lb_min,
+    const double zeta, const double zetb, const double dh[3][3],
+    const double dh_inv[3][3], const double ra[3], const double rab[3],
+    const int npts_global[3], const int npts_local[3], const int shift_local[3],
+    const int border_width[3], const double radius, const int o1, const int o2,
+    const int n1, const int n2, const int nbatch, const double *grids[nbatch],
+    double hab[nbatch][n2][n1], const double pab[nbatch][n2][n1],
+    double forces[nbatch][2][3], double virials[nbatch][2][3][3]);
+
 #endif
 // EOF
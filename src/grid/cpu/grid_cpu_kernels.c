@@ -0,0 +1,46 @@
+/*----------------------------------------------------------------------------*/
+/*  CP2K: A general program to perform molecular dynamics simulations         */
+/*  Copyright 2000-2024 CP2K developers group <https://cp2k.org>              */
+/*                                                                            */
+/*  SPDX-License-Identifier: BSD-3-Clause                                     */
+/*----------------------------------------------------------------------------*/
+
+#include "../../base/machine_cpuid.h"
+#include "grid_cpu_collocate.h"
+#include "grid_cpu_integrate.h"
+#include "grid_cpu_kernels.h"
+
+// Kernels ordered from most to least demanding instruction set.
+static const grid_cpu_kernels kernels[] = {
+#if (GRID_CPU_MULTIVERSIONED)
+    {CP_MACHINE_X86_AVX512, "avx512",
+     &grid_cpu_collocate_pgf_product_batched_avx512,
+     &grid_cpu_integrate_pgf_product_batched_avx512},
+    {CP_MACHINE_X86_AVX2, "avx2", &grid_cpu_collocate_pgf_product_batched_avx2,
+     &grid_cpu_integrate_pgf_product_batched_avx2},
+    {CP_MACHINE_X86_SSE4, "sse4", &grid_cpu_collocate_pgf_product_batched_sse4,
+     &grid_cpu_integrate_pgf_product_batched_sse4},
+#endif
+    {CP_MACHINE_CPU_GENERIC, "default", &grid_cpu_collocate_pgf_product_batched,
+     &grid_cpu_integrate_pgf_product_batched},
+};
+
+/*******************************************************************************
+ * \brief Returns the fastest kernels that can run on a CPU with given CPUID.
+ *        The default kernels are compiled for the build's target flags, which
+ *        the CPU has to support anyways.
+ ******************************************************************************/
+const grid_cpu_kernels *grid_cpu_get_kernels(const int cpuid) {
+  const int nkernels = sizeof(kernels) / sizeof(grid_cpu_kernels);
+  // The x86 instruction sets form a range, see base/machine_cpuid.h.
+  const bool x86 =
+      (CP_MACHINE_X86_SSE4 <= cpuid && cpuid <= CP_MACHINE_X86_AVX512);
+  for (int i = 0; i < nkernels - 1; i++) {
+    if (x86 && kernels[i].cpuid <= cpuid) {
+      return &kernels[i];
+    }
+  }
+  return &kernels[nkernels - 1];
+}
+
+// EOF
@@ -0,0 +1,81 @@
+/*----------------------------------------------------------------------------*/
+/*  CP2K: A general program to perform molecular dynamics simulations         */
+/*  Copyright 2000-2024 CP2K developers group <https://cp2k.org>              */
+/*                                                                            */
+/*  SPDX-License-Identifier: BSD-3-Clause                                     */
+/*----------------------------------------------------------------------------*/
+#ifndef GRID_CPU_KERNELS_H
+#define GRID_CPU_KERNELS_H
+
+#include <stdbool.h>
+
+#include "../common/grid_constants.h"
+
+// The kernels get compiled for several instruction sets via GCC's target
+// pragma, which unlike the one of Clang also updates macros like __AVX2__.
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__) &&         \
+    !defined(__INTEL_COMPILER)
+#define GRID_CPU_MULTIVERSIONED 1
+#else
+#define GRID_CPU_MULTIVERSIONED 0
+#endif
+
+/*******************************************************************************
+ * \brief Signature of grid_cpu_collocate_pgf_product_batched.
+ ******************************************************************************/
+typedef void grid_cpu_collocate_func(
+    const bool orthorhombic, const int border_mask, const enum grid_func func,
+    const int la_max, const int la_min, const int lb_max, const int lb_min,
+    const double zeta, const double zetb, const double rscale,
+    const double dh[3][3], const double dh_inv[3][3], const double ra[3],
+    const double rab[3], const int npts_global[3], const int npts_local[3],
+    const int shift_local[3], const int border_width[3], const double radius,
+    const int o1, const int o2, const int n1, const int n2, const int nbatch,
+    const double pab[nbatch][n2][n1], double *grids[nbatch]);
+
+/*******************************************************************************
+ * \brief Signature of grid_cpu_integrate_pgf_product_batched.
+ ******************************************************************************/
+typedef void grid_cpu_integrate_func(
+    const bool orthorhombic, const bool compute_tau, const int border_mask,
+    const int la_max, const int la_min, const int lb_max, const int lb_min,
+    const double zeta, const double zetb, const double dh[3][3],
+    const double dh_inv[3][3], const double ra[3], const double rab[3],
+    const int npts_global[3], const int npts_local[3], const int shift_local[3],
+    const int border_width[3], const double radius, const int o1, const int o2,
+    const int n1, const int n2, const int nbatch, const double *grids[nbatch],
+    double hab[nbatch][n2][n1], const double pab[nbatch][n2][n1],
+    double forces[nbatch][2][3], double virials[nbatch][2][3][3]);
+
+/*******************************************************************************
+ * \brief Variants of the kernels, which are compiled from the same sources as
+ *        grid_cpu_collocate.c and grid_cpu_integrate.c for SSE4, AVX2, and
+ *        AVX-512 respectively. They may only be called on CPUs supporting it.
+ ******************************************************************************/
+#if (GRID_CPU_MULTIVERSIONED)
+grid_cpu_collocate_func grid_cpu_collocate_pgf_product_batched_sse4;
+grid_cpu_collocate_func grid_cpu_collocate_pgf_product_batched_avx2;
+grid_cpu_collocate_func grid_cpu_collocate_pgf_product_batched_avx512;
+grid_cpu_integrate_func grid_cpu_integrate_pgf_product_batched_sse4;
+grid_cpu_integrate_func grid_cpu_integrate_pgf_product_batched_avx2;
+grid_cpu_integrate_func grid_cpu_integrate_pgf_product_batched_avx512;
+#endif
+
+/*******************************************************************************
+ * \brief Table of kernels compiled for a specific instruction set.
+ ******************************************************************************/
+typedef struct {
+  int cpuid;        // required instruction set, see base/machine_cpuid.h
+  const char *name; // for diagnostics
+  grid_cpu_collocate_func *collocate_pgf_product_batched;
+  grid_cpu_integrate_func *integrate_pgf_product_batched;
+} grid_cpu_kernels;
+
+/*******************************************************************************
+ * \brief Returns the fastest kernels that can run on a CPU with given CPUID.
+ ******************************************************************************/
+const grid_cpu_kernels *grid_cpu_get_kernels(const int cpuid);
+
+#endif
+
+// EOF
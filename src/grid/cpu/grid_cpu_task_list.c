@@ -14,10 +14,14 @@
 #include <string.h>
 
 #include "../common/grid_common.h"
+#include "../common/grid_library.h"
 #include "grid_cpu_collocate.h"
 #include "grid_cpu_integrate.h"
 #include "grid_cpu_task_list.h"
 
+// Number of tiles per thread when collocating onto a tiled grid.
+#define GRID_CPU_TILES_PER_THREAD 2
+
 /*******************************************************************************
  * \brief Comperator passed to qsort to compare two tasks.
  * \author Ole Schuett
@@ -34,6 +38,274 @@ static int compare_tasks(const void *a, const void *b) {
     return task_a->jset - task_b->jset;
   }
 }
+
+/*******************************************************************************
+ * \brief Comperator passed to qsort to sort units of work by decreasing cost.
+ ******************************************************************************/
+static int compare_units(const void *a, const void *b) {
+  const grid_cpu_work_unit *unit_a = a, *unit_b = b;
+  if (unit_a->cost != unit_b->cost) {
+    return (unit_a->cost < unit_b->cost) ? 1 : -1;
+  } else if (unit_a->level != unit_b->level) {
+    return unit_a->level - unit_b->level;
+  } else {
+    return unit_a->index - unit_b->index;
+  }
+}
+
+/*******************************************************************************
+ * \brief Estimates the cost of a task. The kernels map the Gaussian product
+ *        onto a cube of grid points in three steps, whose work scales with the
+ *        number of cube points times the number of polynomial coefficients,
+ *        which are summed one Cartesian direction at a time.
+ ******************************************************************************/
+static double estimate_task_cost(const grid_cpu_task_list *task_list,
+                                 const grid_cpu_task *task) {
+  const grid_cpu_layout *layout = &task_list->layouts[task->level - 1];
+  const int ikind = task_list->atom_kinds[task->iatom - 1] - 1;
+  const int jkind = task_list->atom_kinds[task->jatom - 1] - 1;
+  const grid_basis_set *ibasis = task_list->basis_sets[ikind];
+  const grid_basis_set *jbasis = task_list->basis_sets[jkind];
+  const int lp = ibasis->lmax[task->iset - 1] + jbasis->lmax[task->jset - 1];
+
+  // Extent of the cube in grid points along each lattice vector.
+  double npts[3];
+  for (int i = 0; i < 3; i++) {
+    double norm = 0.0;
+    for (int j = 0; j < 3; j++) {
+      norm += layout->dh_inv[j][i] * layout->dh_inv[j][i];
+    }
+    npts[i] = 2.0 * task->radius * sqrt(norm) + 1.0;
+  }
+
+  const double ncoef = lp + 1;
+  return npts[0] * npts[1] * npts[2] * ncoef +
+         npts[1] * npts[2] * ncoef * ncoef + npts[2] * ncoef * ncoef * ncoef;
+}
+
+/*******************************************************************************
+ * \brief Assigns the given units of work, which have to be sorted by decreasing
+ *        cost, to the queues of a schedule. Each unit goes to the queue with
+ *        the least load so far. Afterwards, the units get reordered by queue
+ *        while keeping their order within each queue.
+ ******************************************************************************/
+static void create_schedule(const int nunits, const int nqueues,
+                            grid_cpu_work_unit units[nunits],
+                            grid_cpu_schedule *schedule) {
+
+  double loads[nqueues];
+  int counts[nqueues];
+  for (int iqueue = 0; iqueue < nqueues; iqueue++) {
+    loads[iqueue] = 0.0;
+    counts[iqueue] = 0;
+  }
+  int *assignment = malloc(nunits * sizeof(int));
+  for (int iunit = 0; iunit < nunits; iunit++) {
+    int best = 0;
+    for (int iqueue = 1; iqueue < nqueues; iqueue++) {
+      best = (loads[iqueue] < loads[best]) ? iqueue : best;
+    }
+    assignment[iunit] = best;
+    loads[best] += units[iunit].cost;
+    counts[best]++;
+  }
+
+  schedule->nqueues = nqueues;
+  schedule->first = malloc((nqueues + 1) * sizeof(int));
+  schedule->first[0] = 0;
+  for (int iqueue = 0; iqueue < nqueues; iqueue++) {
+    schedule->first[iqueue + 1] = schedule->first[iqueue] + counts[iqueue];
+  }
+
+  int positions[nqueues];
+  memcpy(positions, schedule->first, nqueues * sizeof(int));
+  grid_cpu_work_unit *sorted = malloc(nunits * sizeof(grid_cpu_work_unit));
+  for (int iunit = 0; iunit < nunits; iunit++) {
+    sorted[positions[assignment[iunit]]++] = units[iunit];
+  }
+  memcpy(units, sorted, nunits * sizeof(grid_cpu_work_unit));
+  free(sorted);
+  free(assignment);
+
+  double max_load = 0.0, sum_loads = 0.0;
+  for (int iqueue = 0; iqueue < nqueues; iqueue++) {
+    max_load = fmax(max_load, loads[iqueue]);
+    sum_loads += loads[iqueue];
+  }
+  schedule->imbalance =
+      (sum_loads > 0.0) ? max_load * nqueues / sum_loads : 1.0;
+}
+
+/*******************************************************************************
+ * \brief Returns the next unit of work for the calling thread from the given
+ *        schedule, or -1 when all units have been handed out. Threads start
+ *        with their own queue and then steal from the queues of other threads.
+ ******************************************************************************/
+static int next_scheduled_unit(const grid_cpu_schedule *schedule, int *next,
+                               const int ithread) {
+  for (int i = 0; i < schedule->nqueues; i++) {
+    const int iqueue = (ithread + i) % schedule->nqueues;
+    int iunit;
+#pragma omp atomic read
+    iunit = next[iqueue];
+    if (iunit >= schedule->first[iqueue + 1]) {
+      continue; // queue is already exhausted
+    }
+#pragma omp atomic capture
+    iunit = next[iqueue]++;
+    if (iunit < schedule->first[iqueue + 1]) {
+      return iunit;
+    }
+  }
+  return -1;
+}
+
+/*******************************************************************************
+ * \brief Tries to tile the given grid level along the given axis, see
+ *        grid_cpu_tiling for details. On success tiling->axis is set.
+ *        Tiling is skipped when thread-local copies of the grid would actually
+ *        require less memory, e.g. for a single thread or very coarse grids.
+ ******************************************************************************/
+static void create_tiling(const grid_cpu_task_list *task_list, const int level,
+                          const int axis, const int nthreads,
+                          grid_cpu_tiling *tiling) {
+
+  const grid_cpu_layout *layout = &task_list->layouts[level];
+  const int npts = layout->npts_global[axis];
+
+  // Tiles wrap around periodically, hence the axis must not be distributed.
+  if (nthreads < 2 || layout->npts_local[axis] != npts) {
+    return;
+  }
+
+  // Conservative extent of a task's cube along the axis, see cxyz_to_grid.
+  const double(*dh)[3] = layout->dh;
+  const double(*dh_inv)[3] = layout->dh_inv;
+  const double drmin = fmin(dh[0][0], fmin(dh[1][1], dh[2][2]));
+  const double dh_inv_sum =
+      fabs(dh_inv[0][axis]) + fabs(dh_inv[1][axis]) + fabs(dh_inv[2][axis]);
+  const int border_bits = (1 << (2 * axis)) | (1 << (2 * axis + 1));
+
+  // Find the center plane and halo of each task.
+  int *task_centers = malloc(task_list->ntasks * sizeof(int));
+  int *task_halos = malloc(task_list->ntasks * sizeof(int));
+  int max_task_halo = 1;
+  bool feasible = true;
+  for (int itask = 0; itask < task_list->ntasks; itask++) {
+    const grid_cpu_task *task = &task_list->tasks[itask];
+    task_centers[itask] = -1;
+    if (task->level - 1 != level) {
+      continue;
+    }
+    if (task->border_mask & border_bits) {
+      feasible = false; // cube must not be cut along the tiled axis
+      break;
+    }
+    const int iatom = task->iatom - 1;
+    const int jatom = task->jatom - 1;
+    const grid_basis_set *ibasis =
+        task_list->basis_sets[task_list->atom_kinds[iatom] - 1];
+    const grid_basis_set *jbasis =
+        task_list->basis_sets[task_list->atom_kinds[jatom] - 1];
+    const int iset = task->iset - 1;
+    const int jset = task->jset - 1;
+    const double zeta = ibasis->zet[iset * ibasis->maxpgf + task->ipgf - 1];
+    const double zetb = jbasis->zet[jset * jbasis->maxpgf + task->jpgf - 1];
+    const double f = zetb / (zeta + zetb);
+    const double *ra = &task_list->atom_positions[3 * iatom];
+    double gp = 0.0;
+    for (int j = 0; j < 3; j++) {
+      gp += dh_inv[j][axis] * (ra[j] + f * task->rab[j]);
+    }
+    task_centers[itask] =
+        modulo((int)floor(gp) - layout->shift_local[axis], npts);
+    task_halos[itask] = (int)ceil((task->radius + drmin) * dh_inv_sum) + 2;
+    max_task_halo = imax(max_task_halo, task_halos[itask]);
+  }
+
+  // Slabs must be at least as thick as the largest halo. Otherwise, the halos
+  // of many threads overlap, which costs memory and slows down merge_tiles.
+  const int ntiles =
+      imin(GRID_CPU_TILES_PER_THREAD * nthreads, npts / max_task_halo);
+  if (!feasible || ntiles < 2) {
+    free(task_centers);
+    free(task_halos);
+    return;
+  }
+
+  // Assign each task to the tile that contains its center.
+  int *task_tiles = malloc(task_list->ntasks * sizeof(int));
+  int *first_plane = malloc((ntiles + 1) * sizeof(int));
+  int *halos = calloc(ntiles, sizeof(int));
+  int *first_task = calloc(ntiles + 1, sizeof(int));
+  for (int itile = 0; itile <= ntiles; itile++) {
+    first_plane[itile] = (itile * npts) / ntiles;
+  }
+  for (int itask = 0; itask < task_list->ntasks; itask++) {
+    const int center = task_centers[itask];
+    task_tiles[itask] = -1;
+    if (center < 0) {
+      continue; // task belongs to another level
+    }
+    const int itile = ((center + 1) * ntiles - 1) / npts;
+    assert(first_plane[itile] <= center && center < first_plane[itile + 1]);
+    halos[itile] = imax(halos[itile], task_halos[itask]);
+    task_tiles[itask] = itile;
+    first_task[itile + 1]++;
+  }
+  free(task_centers);
+  free(task_halos);
+
+  // Check that tiles do not overlap themselves and save memory over copies.
+  size_t plane_size = 1;
+  for (int i = 0; i < 3; i++) {
+    plane_size *= (i != axis) ? layout->npts_local[i] : 1;
+  }
+  size_t *offsets = malloc((ntiles + 1) * sizeof(size_t));
+  offsets[0] = 0;
+  int max_halo = 0;
+  for (int itile = 0; itile < ntiles && feasible; itile++) {
+    const int nplanes =
+        first_plane[itile + 1] - first_plane[itile] + 2 * halos[itile];
+    feasible = (nplanes <= npts);
+    offsets[itile + 1] = offsets[itile] + nplanes * plane_size;
+    max_halo = imax(max_halo, halos[itile]);
+  }
+  feasible = feasible && (offsets[ntiles] < nthreads * npts * plane_size);
+
+  if (!feasible) {
+    free(task_tiles);
+    free(first_plane);
+    free(halos);
+    free(first_task);
+    free(offsets);
+    return;
+  }
+
+  // Sort tasks by tile while retaining their order within each tile.
+  for (int itile = 0; itile < ntiles; itile++) {
+    first_task[itile + 1] += first_task[itile];
+  }
+  int *tasks = malloc(imax(1, first_task[ntiles]) * sizeof(int));
+  int next_task[ntiles];
+  memcpy(next_task, first_task, ntiles * sizeof(int));
+  for (int itask = 0; itask < task_list->ntasks; itask++) {
+    if (task_tiles[itask] >= 0) {
+      tasks[next_task[task_tiles[itask]]++] = itask;
+    }
+  }
+  free(task_tiles);
+
+  tiling->axis = axis;
+  tiling->ntiles = ntiles;
+  tiling->max_halo = max_halo;
+  tiling->first_plane = first_plane;
+  tiling->halos = halos;
+  tiling->offsets = offsets;
+  tiling->first_task = first_task;
+  tiling->tasks = tasks;
+}
+
 /*******************************************************************************
  * \brief Allocates a task list for the cpu backend.
  *        See grid_task_list.h for details.
@@ -61,6 +333,8 @@ void grid_cpu_create_task_list(
 
   grid_cpu_task_list *task_list = malloc(sizeof(grid_cpu_task_list));
 
+  // Choose kernels for the instruction set probed by grid_library_init.
+  task_list->kernels = grid_cpu_get_kernels(grid_library_get_config().cpuid);
   task_list->orthorhombic = orthorhombic;
   task_list->ntasks = ntasks;
   task_list->nlevels = nlevels;
@@ -153,6 +427,111 @@ void grid_cpu_create_task_list(
   task_list->threadlocal_sizes = malloc(size);
   memset(task_list->threadlocal_sizes, 0, size);
 
+  // Tile grid levels for collocation, preferring contiguous planes.
+  task_list->tilings = malloc(nlevels * sizeof(grid_cpu_tiling));
+  size_t tile_buffer_size = 0;
+  for (int level = 0; level < nlevels; level++) {
+    grid_cpu_tiling *tiling = &task_list->tilings[level];
+    tiling->axis = -1;
+    for (int axis = 2; axis >= 0 && tiling->axis < 0; axis--) {
+      create_tiling(task_list, level, axis, omp_get_max_threads(), tiling);
+    }
+    if (tiling->axis >= 0) {
+      // All levels are collocated concurrently, hence their tiles get stacked.
+      for (int itile = 0; itile <= tiling->ntiles; itile++) {
+        tiling->offsets[itile] += tile_buffer_size;
+      }
+      tile_buffer_size = tiling->offsets[tiling->ntiles];
+    }
+  }
+  task_list->tile_buffer = malloc(tile_buffer_size * sizeof(double));
+  task_list->tile_buffer_size = tile_buffer_size;
+
+  // Likewise, thread-local storage holds copies of all untiled grid levels.
+  task_list->threadlocal_offsets = malloc((nlevels + 1) * sizeof(size_t));
+  task_list->threadlocal_offsets[0] = 0;
+  for (int level = 0; level < nlevels; level++) {
+    const int *npts = task_list->layouts[level].npts_local;
+    const size_t npts_local_total = (size_t)npts[0] * npts[1] * npts[2];
+    const bool tiled = (task_list->tilings[level].axis >= 0);
+    task_list->threadlocal_offsets[level + 1] =
+        task_list->threadlocal_offsets[level] + (tiled ? 0 : npts_local_total);
+  }
+
+  // Estimate the cost of each task.
+  double *task_costs = malloc(ntasks * sizeof(double));
+  for (int itask = 0; itask < ntasks; itask++) {
+    task_costs[itask] = estimate_task_cost(task_list, &task_list->tasks[itask]);
+  }
+
+  // Split collocation into units of work across all levels and schedule them.
+  int max_units = 0;
+  for (int level = 0; level < nlevels; level++) {
+    const grid_cpu_tiling *tiling = &task_list->tilings[level];
+    max_units += (tiling->axis >= 0) ? tiling->ntiles : nblocks;
+  }
+  task_list->units = malloc(max_units * sizeof(grid_cpu_work_unit));
+  task_list->nunits = 0;
+  for (int level = 0; level < nlevels; level++) {
+    const grid_cpu_tiling *tiling = &task_list->tilings[level];
+    const int nindices = (tiling->axis >= 0) ? tiling->ntiles : nblocks;
+    for (int index = 0; index < nindices; index++) {
+      double cost = 0.0;
+      if (tiling->axis >= 0) {
+        const int first_task = tiling->first_task[index];
+        const int last_task = tiling->first_task[index + 1] - 1;
+        for (int i = first_task; i <= last_task; i++) {
+          cost += task_costs[tiling->tasks[i]];
+        }
+      } else {
+        const int idx = level * nblocks + index;
+        const int first_task = task_list->first_level_block_task[idx];
+        const int last_task = task_list->last_level_block_task[idx];
+        for (int itask = first_task; itask <= last_task; itask++) {
+          cost += task_costs[itask];
+        }
+      }
+      if (cost > 0.0) {
+        grid_cpu_work_unit *unit = &task_list->units[task_list->nunits++];
+        unit->level = level;
+        unit->index = index;
+        unit->cost = cost;
+      }
+    }
+  }
+  qsort(task_list->units, task_list->nunits, sizeof(grid_cpu_work_unit),
+        &compare_units);
+  create_schedule(task_list->nunits, omp_get_max_threads(), task_list->units,
+                  &task_list->unit_schedule);
+
+  // Integration processes all levels of a block at once, hence blocks are the
+  // units of work. Blocks without tasks are left out.
+  grid_cpu_work_unit *block_units =
+      malloc(nblocks * sizeof(grid_cpu_work_unit));
+  for (int block_num = 0; block_num < nblocks; block_num++) {
+    block_units[block_num].level = -1;
+    block_units[block_num].index = block_num;
+    block_units[block_num].cost = 0.0;
+  }
+  for (int itask = 0; itask < ntasks; itask++) {
+    block_units[task_list->tasks[itask].block_num - 1].cost +=
+        task_costs[itask];
+  }
+  qsort(block_units, nblocks, sizeof(grid_cpu_work_unit), &compare_units);
+  int nblocks_with_tasks = 0;
+  while (nblocks_with_tasks < nblocks &&
+         block_units[nblocks_with_tasks].cost > 0.0) {
+    nblocks_with_tasks++;
+  }
+  create_schedule(nblocks_with_tasks, omp_get_max_threads(), block_units,
+                  &task_list->block_schedule);
+  task_list->block_order = malloc(nblocks * sizeof(int));
+  for (int i = 0; i < nblocks_with_tasks; i++) {
+    task_list->block_order[i] = block_units[i].index;
+  }
+  free(block_units);
+  free(task_costs);
+
   *task_list_out = task_list;
 }
 
@@ -176,6 +555,23 @@ void grid_cpu_free_task_list(grid_cpu_task_list *task_list) {
   }
   free(task_list->threadlocals);
   free(task_list->threadlocal_sizes);
+  free(task_list->threadlocal_offsets);
+  for (int level = 0; level < task_list->nlevels; level++) {
+    const grid_cpu_tiling *tiling = &task_list->tilings[level];
+    if (tiling->axis >= 0) {
+      free(tiling->first_plane);
+      free(tiling->halos);
+      free(tiling->offsets);
+      free(tiling->first_task);
+      free(tiling->tasks);
+    }
+  }
+  free(task_list->tilings);
+  free(task_list->tile_buffer);
+  free(task_list->units);
+  free(task_list->unit_schedule.first);
+  free(task_list->block_order);
+  free(task_list->block_schedule.first);
   free(task_list);
 }
 
@@ -241,151 +637,229 @@ static void load_pab(const grid_basis_set *ibasis, const grid_basis_set *jbasis,
 }
 
 /*******************************************************************************
- * \brief Collocate a range of tasks which are destined for the same grid level.
- * \author Ole Schuett
+ * \brief Collocate a single task for a batch of density matrices, fetching its
+ *        subblocks only when needed.
  ******************************************************************************/
-static void collocate_one_grid_level(
-    const grid_cpu_task_list *task_list, const int *first_block_task,
-    const int *last_block_task, const enum grid_func func,
-    const int npts_global[3], const int npts_local[3], const int shift_local[3],
+static void collocate_one_task(
+    const grid_cpu_task_list *task_list, const int itask,
+    const enum grid_func func, const int npts_global[3],
+    const int npts_local[3], const int shift_local[3],
     const int border_width[3], const double dh[3][3], const double dh_inv[3][3],
-    const double *pab_blocks, offload_buffer *grid) {
+    const int nbatch, const offload_buffer *pab_blocks[nbatch], int *old_offset,
+    int *old_iset, int *old_jset, double *pab, double *grids[nbatch]) {
+
+  // Define some convenient aliases.
+  const grid_cpu_task *task = &task_list->tasks[itask];
+  const int iatom = task->iatom - 1;
+  const int jatom = task->jatom - 1;
+  const int iset = task->iset - 1;
+  const int jset = task->jset - 1;
+  const int ipgf = task->ipgf - 1;
+  const int jpgf = task->jpgf - 1;
+  const int ikind = task_list->atom_kinds[iatom] - 1;
+  const int jkind = task_list->atom_kinds[jatom] - 1;
+  const grid_basis_set *ibasis = task_list->basis_sets[ikind];
+  const grid_basis_set *jbasis = task_list->basis_sets[jkind];
+  const double zeta = ibasis->zet[iset * ibasis->maxpgf + ipgf];
+  const double zetb = jbasis->zet[jset * jbasis->maxpgf + jpgf];
+  const int ncoseta = ncoset(ibasis->lmax[iset]);
+  const int ncosetb = ncoset(jbasis->lmax[jset]);
+  const int ncoa = ibasis->npgf[iset] * ncoseta; // size of carthesian set
+  const int ncob = jbasis->npgf[jset] * ncosetb;
+  const int block_num = task->block_num - 1;
+  const int block_offset = task_list->block_offsets[block_num];
+  const bool transpose = (iatom <= jatom);
+
+  // Load subblocks from buffers and decontract into Cartesian sublocks pab.
+  // The previous pab can be reused when only ipgf or jpgf has changed.
+  if (block_offset != *old_offset || iset != *old_iset || jset != *old_jset) {
+    *old_offset = block_offset;
+    *old_iset = iset;
+    *old_jset = jset;
+    for (int ibatch = 0; ibatch < nbatch; ibatch++) {
+      const double *block = &pab_blocks[ibatch]->host_buffer[block_offset];
+      load_pab(ibasis, jbasis, iset, jset, transpose, block,
+               &pab[ibatch * ncoa * ncob]);
+    }
+  }
 
-// Using default(shared) because with GCC 9 the behavior around const changed:
-// https://www.gnu.org/software/gcc/gcc-9/porting_to.html
-#pragma omp parallel default(shared)
-  {
-    const int ithread = omp_get_thread_num();
-    const int nthreads = omp_get_num_threads();
+  task_list->kernels->collocate_pgf_product_batched(
+      /*orthorhombic=*/task_list->orthorhombic,
+      /*border_mask=*/task->border_mask,
+      /*func=*/func,
+      /*la_max=*/ibasis->lmax[iset],
+      /*la_min=*/ibasis->lmin[iset],
+      /*lb_max=*/jbasis->lmax[jset],
+      /*lb_min=*/jbasis->lmin[jset],
+      /*zeta=*/zeta,
+      /*zetb=*/zetb,
+      /*rscale=*/(iatom == jatom) ? 1 : 2,
+      /*dh=*/dh,
+      /*dh_inv=*/dh_inv,
+      /*ra=*/&task_list->atom_positions[3 * iatom],
+      /*rab=*/task->rab,
+      /*npts_global=*/npts_global,
+      /*npts_local=*/npts_local,
+      /*shift_local=*/shift_local,
+      /*border_width=*/border_width,
+      /*radius=*/task->radius,
+      /*o1=*/ipgf * ncoseta,
+      /*o2=*/jpgf * ncosetb,
+      /*n1=*/ncoa,
+      /*n2=*/ncob,
+      /*nbatch=*/nbatch,
+      /*pab=*/(const double(*)[ncob][ncoa])pab,
+      /*grids=*/grids);
+}
 
-    // Initialize variables to detect when a new subblock has to be fetched.
-    int old_offset = -1, old_iset = -1, old_jset = -1;
+/*******************************************************************************
+ * \brief Adds the predicted and measured imbalance of the threads' busy times
+ *        to the statistics of the grid library.
+ ******************************************************************************/
+static void report_schedule(const bool integrate,
+                            const grid_cpu_schedule *schedule,
+                            const int nthreads,
+                            const double busy_times[nthreads]) {
+  double max_time = 0.0, sum_times = 0.0;
+  for (int ithread = 0; ithread < nthreads; ithread++) {
+    max_time = fmax(max_time, busy_times[ithread]);
+    sum_times += busy_times[ithread];
+  }
+  grid_library_schedule_add(integrate, schedule->imbalance, max_time,
+                            sum_times / nthreads);
+}
 
-    // Matrix pab is re-used across tasks.
-    double pab[task_list->maxco * task_list->maxco];
+/*******************************************************************************
+ * \brief Collocate the tasks of a tile into its buffers, see grid_cpu_tiling.
+ *        Since a buffer is just a smaller window onto the periodic grid, the
+ *        kernels only need to be passed a shifted layout.
+ ******************************************************************************/
+static void collocate_one_tile(const grid_cpu_task_list *task_list,
+                               const int level, const int itile,
+                               const enum grid_func func, const int nbatch,
+                               const offload_buffer *pab_blocks[nbatch],
+                               double *tile_buffers[nbatch], int *old_offset,
+                               int *old_iset, int *old_jset, double *pab) {
+
+  const grid_cpu_layout *layout = &task_list->layouts[level];
+  const grid_cpu_tiling *tiling = &task_list->tilings[level];
+  const int axis = tiling->axis;
+  const int halo = tiling->halos[itile];
+  int npts_tile[3], shift_tile[3];
+  for (int i = 0; i < 3; i++) {
+    npts_tile[i] = layout->npts_local[i];
+    shift_tile[i] = layout->shift_local[i];
+  }
+  npts_tile[axis] =
+      tiling->first_plane[itile + 1] - tiling->first_plane[itile] + 2 * halo;
+  shift_tile[axis] += tiling->first_plane[itile] - halo;
+  const size_t tile_size = tiling->offsets[itile + 1] - tiling->offsets[itile];
+  double *tile_grids[nbatch];
+  for (int ibatch = 0; ibatch < nbatch; ibatch++) {
+    tile_grids[ibatch] = &tile_buffers[ibatch][tiling->offsets[itile]];
+    memset(tile_grids[ibatch], 0, tile_size * sizeof(double));
+  }
 
-    // Ensure that grid can fit into thread-local storage, reallocate if needed.
-    const int npts_local_total = npts_local[0] * npts_local[1] * npts_local[2];
-    const size_t grid_size = npts_local_total * sizeof(double);
-    if (task_list->threadlocal_sizes[ithread] < grid_size) {
-      if (task_list->threadlocals[ithread] != NULL) {
-        free(task_list->threadlocals[ithread]);
-      }
-      task_list->threadlocals[ithread] = malloc(grid_size);
-      task_list->threadlocal_sizes[ithread] = grid_size;
-    }
+  const int first_task = tiling->first_task[itile];
+  const int last_task = tiling->first_task[itile + 1] - 1;
+  for (int i = first_task; i <= last_task; i++) {
+    collocate_one_task(task_list, tiling->tasks[i], func, layout->npts_global,
+                       npts_tile, shift_tile, layout->border_width, layout->dh,
+                       layout->dh_inv, nbatch, pab_blocks, old_offset, old_iset,
+                       old_jset, pab, tile_grids);
+  }
+}
 
-    // Zero thread-local copy of the grid.
-    double *const my_grid = task_list->threadlocals[ithread];
-    memset(my_grid, 0, grid_size);
-
-    // Parallelize over blocks to avoid unnecessary calls to load_pab.
-    const int chunk_size = imax(1, task_list->nblocks / (nthreads * 50));
-#pragma omp for schedule(dynamic, chunk_size)
-    for (int block_num = 0; block_num < task_list->nblocks; block_num++) {
-      const int first_task = first_block_task[block_num];
-      const int last_task = last_block_task[block_num];
-
-      for (int itask = first_task; itask <= last_task; itask++) {
-        // Define some convenient aliases.
-        const grid_cpu_task *task = &task_list->tasks[itask];
-        const int iatom = task->iatom - 1;
-        const int jatom = task->jatom - 1;
-        const int iset = task->iset - 1;
-        const int jset = task->jset - 1;
-        const int ipgf = task->ipgf - 1;
-        const int jpgf = task->jpgf - 1;
-        const int ikind = task_list->atom_kinds[iatom] - 1;
-        const int jkind = task_list->atom_kinds[jatom] - 1;
-        const grid_basis_set *ibasis = task_list->basis_sets[ikind];
-        const grid_basis_set *jbasis = task_list->basis_sets[jkind];
-        const double zeta = ibasis->zet[iset * ibasis->maxpgf + ipgf];
-        const double zetb = jbasis->zet[jset * jbasis->maxpgf + jpgf];
-        const int ncoseta = ncoset(ibasis->lmax[iset]);
-        const int ncosetb = ncoset(jbasis->lmax[jset]);
-        const int ncoa = ibasis->npgf[iset] * ncoseta; // size of carthesian set
-        const int ncob = jbasis->npgf[jset] * ncosetb;
-        const int block_num = task->block_num - 1;
-        const int block_offset = task_list->block_offsets[block_num];
-        const double *block = &pab_blocks[block_offset];
-        const bool transpose = (iatom <= jatom);
-
-        // Load subblock from buffer and decontract into Cartesian sublock pab.
-        // The previous pab can be reused when only ipgf or jpgf has changed.
-        if (block_offset != old_offset || iset != old_iset ||
-            jset != old_jset) {
-          old_offset = block_offset;
-          old_iset = iset;
-          old_jset = jset;
-          load_pab(ibasis, jbasis, iset, jset, transpose, block, pab);
-        }
+/*******************************************************************************
+ * \brief Sum the tile buffers of a tiled grid level into the given range of
+ *        planes, which requires only a single sweep since each plane has one
+ *        owner. Tiles without tasks have never been written and are skipped.
+ ******************************************************************************/
+static void merge_tiles(const grid_cpu_task_list *task_list, const int level,
+                        const double *tile_buffer, const int plane_lb,
+                        const int plane_ub, double *grid) {
+
+  // Grid points are addressed as [outer][plane][inner] w.r.t. the tiled axis.
+  const grid_cpu_tiling *tiling = &task_list->tilings[level];
+  const int *npts_local = task_list->layouts[level].npts_local;
+  const int axis = tiling->axis;
+  const int ntiles = tiling->ntiles;
+  const int npts = npts_local[axis];
+  int inner = 1, outer = 1;
+  for (int i = 0; i < 3; i++) {
+    inner *= (i < axis) ? npts_local[i] : 1;
+    outer *= (i > axis) ? npts_local[i] : 1;
+  }
 
-        grid_cpu_collocate_pgf_product(
-            /*orthorhombic=*/task_list->orthorhombic,
-            /*border_mask=*/task->border_mask,
-            /*func=*/func,
-            /*la_max=*/ibasis->lmax[iset],
-            /*la_min=*/ibasis->lmin[iset],
-            /*lb_max=*/jbasis->lmax[jset],
-            /*lb_min=*/jbasis->lmin[jset],
-            /*zeta=*/zeta,
-            /*zetb=*/zetb,
-            /*rscale=*/(iatom == jatom) ? 1 : 2,
-            /*dh=*/dh,
-            /*dh_inv=*/dh_inv,
-            /*ra=*/&task_list->atom_positions[3 * iatom],
-            /*rab=*/task->rab,
-            /*npts_global=*/npts_global,
-            /*npts_local=*/npts_local,
-            /*shift_local=*/shift_local,
-            /*border_width=*/border_width,
-            /*radius=*/task->radius,
-            /*o1=*/ipgf * ncoseta,
-            /*o2=*/jpgf * ncosetb,
-            /*n1=*/ncoa,
-            /*n2=*/ncob,
-            /*pab=*/(const double(*)[ncoa])pab,
-            /*grid=*/my_grid);
-
-      } // end of task loop
-    } // end of block loop
+  // Tiles whose halo can reach a plane are at most this many tiles away.
+  const int min_tile_planes = npts / ntiles;
+  const int reach = (tiling->max_halo + min_tile_planes - 1) / min_tile_planes;
+  const int ncandidates = imin(2 * reach + 1, ntiles);
 
-// While there should be an implicit barrier at the end of the block loop, this
-// explicit barrier eliminates occasional seg faults with icc compiled binaries.
-#pragma omp barrier
-
-    // Merge thread-local grids via an efficient tree reduction.
-    const int nreduction_cycles = ceil(log(nthreads) / log(2)); // tree depth
-    for (int icycle = 1; icycle <= nreduction_cycles; icycle++) {
-      // Threads are divided into groups, whose size doubles with each cycle.
-      // After a cycle the reduced data is stored at first thread of each group.
-      const int group_size = 1 << icycle; // 2**icycle
-      const int igroup = ithread / group_size;
-      const int dest_thread = igroup * group_size;
-      const int src_thread = dest_thread + group_size / 2;
-      // The last group might actually be a bit smaller.
-      const int actual_group_size = imin(group_size, nthreads - dest_thread);
-      // Parallelize summation by dividing grid points across group members.
-      const int rank = modulo(ithread, group_size); // position within the group
-      const int lb = (npts_local_total * rank) / actual_group_size;
-      const int ub = (npts_local_total * (rank + 1)) / actual_group_size;
-      if (src_thread < nthreads) {
-        for (int i = lb; i < ub; i++) {
-          task_list->threadlocals[dest_thread][i] +=
-              task_list->threadlocals[src_thread][i];
+  for (int plane = plane_lb; plane < plane_ub; plane++) {
+    for (int io = 0; io < outer; io++) {
+      memset(&grid[(io * npts + plane) * inner], 0, inner * sizeof(double));
+    }
+    const int home = ((plane + 1) * ntiles - 1) / npts;
+    for (int icandidate = 0; icandidate < ncandidates; icandidate++) {
+      const int itile = (ncandidates == ntiles)
+                            ? icandidate
+                            : modulo(home - reach + icandidate, ntiles);
+      if (tiling->first_task[itile] == tiling->first_task[itile + 1]) {
+        continue; // tile has no tasks
+      }
+      const int halo = tiling->halos[itile];
+      const int nplanes = tiling->first_plane[itile + 1] -
+                          tiling->first_plane[itile] + 2 * halo;
+      const int iplane =
+          modulo(plane - tiling->first_plane[itile] + halo, npts);
+      if (iplane >= nplanes) {
+        continue; // plane is not covered by this tile
+      }
+      const double *tile_grid = &tile_buffer[tiling->offsets[itile]];
+      for (int io = 0; io < outer; io++) {
+        double *dest = &grid[(io * npts + plane) * inner];
+        const double *src = &tile_grid[(io * nplanes + iplane) * inner];
+        for (int i = 0; i < inner; i++) {
+          dest[i] += src[i];
         }
       }
-#pragma omp barrier
     }
+  }
+}
 
-    // Copy final result from first thread into shared grid.
-    const int lb = (npts_local_total * ithread) / nthreads;
-    const int ub = (npts_local_total * (ithread + 1)) / nthreads;
-    for (int i = lb; i < ub; i++) {
-      grid->host_buffer[i] = task_list->threadlocals[0][i];
+/*******************************************************************************
+ * \brief Sum the thread-local copies of an untiled grid level into the given
+ *        range of grid points. Copies of threads that did not collocate any
+ *        tasks of the level have never been zeroed and are skipped.
+ ******************************************************************************/
+static void merge_threadlocals(const grid_cpu_task_list *task_list,
+                               const int level, const int ibatch,
+                               const int nthreads, const int nlevels,
+                               const bool touched[nthreads][nlevels],
+                               const size_t lb, const size_t ub, double *grid) {
+
+  // The thread-local copies of all sets of a batch are stacked.
+  const size_t offset = ibatch * task_list->threadlocal_offsets[nlevels] +
+                        task_list->threadlocal_offsets[level];
+  bool first = true;
+  for (int ithread = 0; ithread < nthreads; ithread++) {
+    if (!touched[ithread][level]) {
+      continue;
     }
-
-  } // end of omp parallel region
+    const double *src = &task_list->threadlocals[ithread][offset];
+    if (first) {
+      memcpy(&grid[lb], &src[lb], (ub - lb) * sizeof(double));
+      first = false;
+    } else {
+      for (size_t i = lb; i < ub; i++) {
+        grid[i] += src[i];
+      }
+    }
+  }
+  if (first) {
+    memset(&grid[lb], 0, (ub - lb) * sizeof(double));
+  }
 }
 
 /*******************************************************************************
@@ -398,18 +872,210 @@ void grid_cpu_collocate_task_list(const grid_cpu_task_list *task_list,
                                   const offload_buffer *pab_blocks,
                                   offload_buffer *grids[nlevels]) {
 
+  // A single density matrix is just a batch of size one.
+  offload_buffer *grids_batch[1][nlevels];
+  for (int level = 0; level < nlevels; level++) {
+    grids_batch[0][level] = grids[level];
+  }
+  grid_cpu_collocate_task_list_batched(task_list, func, nlevels, 1, &pab_blocks,
+                                       grids_batch);
+}
+
+/*******************************************************************************
+ * \brief Collocate all tasks of in given list for a batch of density matrices.
+ *        The units of work of all levels are processed according to a single
+ *        schedule. Once all units of a level are done, its merges get handed
+ *        out, in the order in which the levels became ready. Hence, threads
+ *        move freely between levels and merges overlap with work on other
+ *        levels.
+ *        See grid_task_list.h for details.
+ ******************************************************************************/
+void grid_cpu_collocate_task_list_batched(
+    const grid_cpu_task_list *task_list, const enum grid_func func,
+    const int nlevels, const int nbatch,
+    const offload_buffer *pab_blocks[nbatch],
+    offload_buffer *grids[nbatch][nlevels]) {
+
   assert(task_list->nlevels == nlevels);
+  assert(nbatch >= 1);
+  const int max_threads = omp_get_max_threads();
+  const grid_cpu_schedule *schedule = &task_list->unit_schedule;
+
+  // Count the remaining units of each level.
+  int remaining[nlevels];
+  memset(remaining, 0, nlevels * sizeof(int));
+  for (int iunit = 0; iunit < task_list->nunits; iunit++) {
+    remaining[task_list->units[iunit].level]++;
+  }
 
-  for (int level = 0; level < task_list->nlevels; level++) {
-    const int idx = level * task_list->nblocks;
-    const int *first_block_task = &task_list->first_level_block_task[idx];
-    const int *last_block_task = &task_list->last_level_block_task[idx];
-    const grid_cpu_layout *layout = &task_list->layouts[level];
-    collocate_one_grid_level(
-        task_list, first_block_task, last_block_task, func, layout->npts_global,
-        layout->npts_local, layout->shift_local, layout->border_width,
-        layout->dh, layout->dh_inv, pab_blocks->host_buffer, grids[level]);
+  // Levels become ready for merging once their last unit is done. Levels
+  // without any units are ready right away.
+  int ready_levels[nlevels];
+  int nready = 0, iready = 0, next_merge = 0;
+  for (int level = 0; level < nlevels; level++) {
+    if (remaining[level] == 0) {
+      ready_levels[nready++] = level;
+    }
+  }
+
+  // Split the merge of each level into chunks of planes or grid points.
+  int nchunks[nlevels];
+  for (int level = 0; level < nlevels; level++) {
+    const int *npts = task_list->layouts[level].npts_local;
+    const grid_cpu_tiling *tiling = &task_list->tilings[level];
+    nchunks[level] = (tiling->axis >= 0) ? imin(max_threads, npts[tiling->axis])
+                                         : max_threads;
+  }
+
+  // The first set of a batch uses the task list's tile buffer.
+  const size_t tile_buffer_size = task_list->tile_buffer_size;
+  double *extra_tile_buffer = NULL;
+  if (nbatch > 1) {
+    const size_t size = (nbatch - 1) * tile_buffer_size * sizeof(double);
+    extra_tile_buffer = malloc(size);
   }
+  double *tile_buffers[nbatch];
+  tile_buffers[0] = task_list->tile_buffer;
+  for (int ibatch = 1; ibatch < nbatch; ibatch++) {
+    tile_buffers[ibatch] = &extra_tile_buffer[(ibatch - 1) * tile_buffer_size];
+  }
+
+  bool touched[max_threads][nlevels];
+  memset(touched, 0, sizeof(touched));
+  int next_unit[schedule->nqueues];
+  memcpy(next_unit, schedule->first, schedule->nqueues * sizeof(int));
+  double busy_times[max_threads];
+  int nthreads = 1;
+
+// Using default(shared) because with GCC 9 the behavior around const changed:
+// https://www.gnu.org/software/gcc/gcc-9/porting_to.html
+#pragma omp parallel default(shared)
+  {
+    const int ithread = omp_get_thread_num();
+    double busy_time = 0.0;
+#pragma omp master
+    nthreads = omp_get_num_threads();
+
+    // Initialize variables to detect when a new subblock has to be fetched.
+    int old_offset = -1, old_iset = -1, old_jset = -1;
+
+    // Matrices pab are re-used across tasks.
+    const size_t pab_size = task_list->maxco * task_list->maxco;
+    double *pab = malloc(nbatch * pab_size * sizeof(double));
+
+    // Ensure that untiled levels of all sets fit into thread-local storage.
+    const size_t set_size = task_list->threadlocal_offsets[nlevels];
+    const size_t grids_size = nbatch * set_size * sizeof(double);
+    if (task_list->threadlocal_sizes[ithread] < grids_size) {
+      if (task_list->threadlocals[ithread] != NULL) {
+        free(task_list->threadlocals[ithread]);
+      }
+      task_list->threadlocals[ithread] = malloc(grids_size);
+      task_list->threadlocal_sizes[ithread] = grids_size;
+    }
+    double *const my_grids = task_list->threadlocals[ithread];
+
+    while (true) {
+      const int iunit = next_scheduled_unit(schedule, next_unit, ithread);
+      if (iunit < 0) {
+        break;
+      }
+      const double start_time = omp_get_wtime();
+      const grid_cpu_work_unit *unit = &task_list->units[iunit];
+      const int level = unit->level;
+      if (task_list->tilings[level].axis >= 0) {
+        collocate_one_tile(task_list, level, unit->index, func, nbatch,
+                           pab_blocks, tile_buffers, &old_offset, &old_iset,
+                           &old_jset, pab);
+      } else {
+        // Zero thread-local copies of the grid level upon first use.
+        const size_t offset = task_list->threadlocal_offsets[level];
+        const size_t size = task_list->threadlocal_offsets[level + 1] - offset;
+        double *my_grid[nbatch];
+        for (int ibatch = 0; ibatch < nbatch; ibatch++) {
+          my_grid[ibatch] = &my_grids[ibatch * set_size + offset];
+          if (!touched[ithread][level]) {
+            memset(my_grid[ibatch], 0, size * sizeof(double));
+          }
+        }
+        touched[ithread][level] = true;
+        const int idx = level * task_list->nblocks + unit->index;
+        const int first_task = task_list->first_level_block_task[idx];
+        const int last_task = task_list->last_level_block_task[idx];
+        const grid_cpu_layout *layout = &task_list->layouts[level];
+        for (int itask = first_task; itask <= last_task; itask++) {
+          collocate_one_task(task_list, itask, func, layout->npts_global,
+                             layout->npts_local, layout->shift_local,
+                             layout->border_width, layout->dh, layout->dh_inv,
+                             nbatch, pab_blocks, &old_offset, &old_iset,
+                             &old_jset, pab, my_grid);
+        }
+      }
+      busy_time += omp_get_wtime() - start_time;
+      // The critical section publishes the results before the merge starts.
+#pragma omp critical(grid_cpu_merge_queue)
+      if (--remaining[level] == 0) {
+        ready_levels[nready++] = level;
+      }
+    }
+    free(pab);
+
+    while (true) {
+      // Take the next merge of the levels that are ready.
+      int level = -1, imerge = 0, nready_seen;
+#pragma omp critical(grid_cpu_merge_queue)
+      {
+        if (iready < nready) {
+          level = ready_levels[iready];
+          imerge = next_merge++;
+          if (next_merge == nbatch * nchunks[level]) {
+            iready++;
+            next_merge = 0;
+          }
+        }
+        nready_seen = nready;
+      }
+      if (level < 0) {
+        if (nready_seen == nlevels) {
+          break; // All merges were handed out.
+        }
+        // Wait for the next level. Its units were all handed out already,
+        // hence this can not deadlock.
+        int nready_now;
+        do {
+#pragma omp atomic read
+          nready_now = nready;
+        } while (nready_now == nready_seen);
+        continue;
+      }
+
+      // Find chunk and set of this merge.
+      const int ibatch = imerge % nbatch;
+      const int ichunk = imerge / nbatch;
+
+      const double start_time = omp_get_wtime();
+      const int *npts = task_list->layouts[level].npts_local;
+      double *grid = grids[ibatch][level]->host_buffer;
+      if (task_list->tilings[level].axis >= 0) {
+        const int axis = task_list->tilings[level].axis;
+        const int lb = (npts[axis] * ichunk) / nchunks[level];
+        const int ub = (npts[axis] * (ichunk + 1)) / nchunks[level];
+        merge_tiles(task_list, level, tile_buffers[ibatch], lb, ub, grid);
+      } else {
+        const size_t npts_local_total = (size_t)npts[0] * npts[1] * npts[2];
+        const size_t lb = (npts_local_total * ichunk) / nchunks[level];
+        const size_t ub = (npts_local_total * (ichunk + 1)) / nchunks[level];
+        merge_threadlocals(task_list, level, ibatch, max_threads, nlevels,
+                           (const bool(*)[nlevels])touched, lb, ub, grid);
+      }
+      busy_time += omp_get_wtime() - start_time;
+    }
+
+    busy_times[ithread] = busy_time;
+  } // end of omp parallel region
+
+  free(extra_tile_buffer);
+  report_schedule(false, schedule, nthreads, busy_times);
 }
 
 /*******************************************************************************
@@ -456,187 +1122,236 @@ static inline void store_hab(const grid_basis_set *ibasis,
 }
 
 /*******************************************************************************
- * \brief Integrate a range of tasks that belong to the same grid level.
+ * \brief Integrate all tasks of in given list from given grids.
+ *        See grid_task_list.h for details.
  * \author Ole Schuett
  ******************************************************************************/
-static void integrate_one_grid_level(
-    const grid_cpu_task_list *task_list, const int *first_block_task,
-    const int *last_block_task, const bool compute_tau, const int natoms,
-    const int npts_global[3], const int npts_local[3], const int shift_local[3],
-    const int border_width[3], const double dh[3][3], const double dh_inv[3][3],
-    const offload_buffer *pab_blocks, const offload_buffer *grid,
-    offload_buffer *hab_blocks, double forces[natoms][3], double virial[3][3]) {
+void grid_cpu_integrate_task_list(
+    const grid_cpu_task_list *task_list, const bool compute_tau,
+    const int natoms, const int nlevels, const offload_buffer *pab_blocks,
+    const offload_buffer *grids[nlevels], offload_buffer *hab_blocks,
+    double forces[natoms][3], double virial[3][3]) {
+
+  // A single potential is just a batch of size one.
+  const offload_buffer *grids_batch[1][nlevels];
+  for (int level = 0; level < nlevels; level++) {
+    grids_batch[0][level] = grids[level];
+  }
+  grid_cpu_integrate_task_list_batched(
+      task_list, compute_tau, natoms, nlevels, 1,
+      (pab_blocks != NULL) ? &pab_blocks : NULL, grids_batch, &hab_blocks,
+      (double(*)[natoms][3])forces, (double(*)[3][3])virial);
+}
+
+/*******************************************************************************
+ * \brief Integrate all tasks of in given list for a batch of potentials.
+ *        Each block is processed across all levels by a single thread to avoid
+ *        concurrent access to hab_blocks. Blocks are handed out according to a
+ *        single schedule, hence threads do not idle on levels with few tasks.
+ *        See grid_task_list.h for details.
+ ******************************************************************************/
+void grid_cpu_integrate_task_list_batched(
+    const grid_cpu_task_list *task_list, const bool compute_tau,
+    const int natoms, const int nlevels, const int nbatch,
+    const offload_buffer *pab_blocks[nbatch],
+    const offload_buffer *grids[nbatch][nlevels],
+    offload_buffer *hab_blocks[nbatch], double forces[nbatch][natoms][3],
+    double virial[nbatch][3][3]) {
+
+  assert(task_list->nlevels == nlevels);
+  assert(task_list->natoms == natoms);
+  assert(nbatch >= 1);
+
+  // Zero result arrays.
+  for (int ibatch = 0; ibatch < nbatch; ibatch++) {
+    memset(hab_blocks[ibatch]->host_buffer, 0, hab_blocks[ibatch]->size);
+  }
+  if (forces != NULL) {
+    memset(forces, 0, nbatch * natoms * 3 * sizeof(double));
+  }
+  if (virial != NULL) {
+    memset(virial, 0, nbatch * 9 * sizeof(double));
+  }
+
+  const grid_cpu_schedule *schedule = &task_list->block_schedule;
+  int next_block[schedule->nqueues];
+  memcpy(next_block, schedule->first, schedule->nqueues * sizeof(int));
+  double busy_times[omp_get_max_threads()];
+  int nthreads = 1;
 
 // Using default(shared) because with GCC 9 the behavior around const changed:
 // https://www.gnu.org/software/gcc/gcc-9/porting_to.html
 #pragma omp parallel default(shared)
   {
+    const int ithread = omp_get_thread_num();
+    double busy_time = 0.0;
+#pragma omp master
+    nthreads = omp_get_num_threads();
+
     // Initialize variables to detect when a new subblock has to be fetched.
-    int old_offset = -1, old_iset = -1, old_jset = -1;
+    int old_offset = -1, old_iset = -1, old_jset = -1, old_size = 0;
     grid_basis_set *old_ibasis = NULL, *old_jbasis = NULL;
     bool old_transpose = false;
 
-    // Matrix pab and hab are re-used across tasks.
-    double pab[task_list->maxco * task_list->maxco];
-    double hab[task_list->maxco * task_list->maxco];
+    // Matrices pab and hab are re-used across tasks.
+    const size_t pab_size = task_list->maxco * task_list->maxco;
+    double *pab = malloc(nbatch * pab_size * sizeof(double));
+    double *hab = malloc(nbatch * pab_size * sizeof(double));
 
     // Parallelize over blocks to avoid concurred access to hab_blocks.
-    const int nthreads = omp_get_num_threads();
-    const int chunk_size = imax(1, task_list->nblocks / (nthreads * 50));
-#pragma omp for schedule(dynamic, chunk_size)
-    for (int block_num = 0; block_num < task_list->nblocks; block_num++) {
-      const int first_task = first_block_task[block_num];
-      const int last_task = last_block_task[block_num];
+    while (true) {
+      const int iblock = next_scheduled_unit(schedule, next_block, ithread);
+      if (iblock < 0) {
+        break;
+      }
+      const double start_time = omp_get_wtime();
+      const int block_num = task_list->block_order[iblock];
 
       // Accumulate forces per block as it corresponds to a pair of atoms.
-      const int iatom = task_list->tasks[first_task].iatom - 1;
-      const int jatom = task_list->tasks[first_task].jatom - 1;
-      double my_forces[2][3] = {0};
-      double my_virials[2][3][3] = {0};
-
-      for (int itask = first_task; itask <= last_task; itask++) {
-        // Define some convenient aliases.
-        const grid_cpu_task *task = &task_list->tasks[itask];
-        assert(task->block_num - 1 == block_num);
-        assert(task->iatom - 1 == iatom && task->jatom - 1 == jatom);
-        const int ikind = task_list->atom_kinds[iatom] - 1;
-        const int jkind = task_list->atom_kinds[jatom] - 1;
-        grid_basis_set *ibasis = task_list->basis_sets[ikind];
-        grid_basis_set *jbasis = task_list->basis_sets[jkind];
-        const int iset = task->iset - 1;
-        const int jset = task->jset - 1;
-        const int ipgf = task->ipgf - 1;
-        const int jpgf = task->jpgf - 1;
-        const double zeta = ibasis->zet[iset * ibasis->maxpgf + ipgf];
-        const double zetb = jbasis->zet[jset * jbasis->maxpgf + jpgf];
-        const int ncoseta = ncoset(ibasis->lmax[iset]);
-        const int ncosetb = ncoset(jbasis->lmax[jset]);
-        const int ncoa = ibasis->npgf[iset] * ncoseta; // size of carthesian set
-        const int ncob = jbasis->npgf[jset] * ncosetb;
-        const int block_offset = task_list->block_offsets[block_num];
-        const bool transpose = (iatom <= jatom);
-        const bool pab_required = (forces != NULL || virial != NULL);
-
-        // Load pab and store hab subblocks when needed.
-        // Previous hab and pab can be reused when only ipgf or jpgf changed.
-        if (block_offset != old_offset || iset != old_iset ||
-            jset != old_jset) {
-          if (pab_required) {
-            load_pab(ibasis, jbasis, iset, jset, transpose,
-                     &pab_blocks->host_buffer[block_offset], pab);
-          }
-          if (old_offset >= 0) { // skip first iteration
-            store_hab(old_ibasis, old_jbasis, old_iset, old_jset, old_transpose,
-                      hab, &hab_blocks->host_buffer[old_offset]);
-          }
-          memset(hab, 0, ncoa * ncob * sizeof(double));
-          old_offset = block_offset;
-          old_iset = iset;
-          old_jset = jset;
-          old_ibasis = ibasis;
-          old_jbasis = jbasis;
-          old_transpose = transpose;
+      int iatom = -1, jatom = -1;
+      double my_forces[nbatch][2][3];
+      double my_virials[nbatch][2][3][3];
+      memset(my_forces, 0, sizeof(my_forces));
+      memset(my_virials, 0, sizeof(my_virials));
+
+      for (int level = 0; level < nlevels; level++) {
+        const int idx = level * task_list->nblocks + block_num;
+        const int first_task = task_list->first_level_block_task[idx];
+        const int last_task = task_list->last_level_block_task[idx];
+        const grid_cpu_layout *layout = &task_list->layouts[level];
+        if (first_task <= last_task && iatom < 0) {
+          iatom = task_list->tasks[first_task].iatom - 1;
+          jatom = task_list->tasks[first_task].jatom - 1;
+        }
+        const double *level_grids[nbatch];
+        for (int ibatch = 0; ibatch < nbatch; ibatch++) {
+          level_grids[ibatch] = grids[ibatch][level]->host_buffer;
         }
 
-        grid_cpu_integrate_pgf_product(
-            /*orthorhombic=*/task_list->orthorhombic,
-            /*compute_tau=*/compute_tau,
-            /*border_mask=*/task->border_mask,
-            /*la_max=*/ibasis->lmax[iset],
-            /*la_min=*/ibasis->lmin[iset],
-            /*lb_max=*/jbasis->lmax[jset],
-            /*lb_min=*/jbasis->lmin[jset],
-            /*zeta=*/zeta,
-            /*zetb=*/zetb,
-            /*dh=*/dh,
-            /*dh_inv=*/dh_inv,
-            /*ra=*/&task_list->atom_positions[3 * iatom],
-            /*rab=*/task->rab,
-            /*npts_global=*/npts_global,
-            /*npts_local=*/npts_local,
-            /*shift_local=*/shift_local,
-            /*border_width=*/border_width,
-            /*radius=*/task->radius,
-            /*o1=*/ipgf * ncoseta,
-            /*o2=*/jpgf * ncosetb,
-            /*n1=*/ncoa,
-            /*n2=*/ncob,
-            /*grid=*/grid->host_buffer,
-            /*hab=*/(double(*)[ncoa])hab,
-            /*pab=*/(pab_required) ? (const double(*)[ncoa])pab : NULL,
-            /*forces=*/(forces != NULL) ? my_forces : NULL,
-            /*virials=*/(virial != NULL) ? my_virials : NULL,
-            /*hdab=*/NULL,
-            /*hadb=*/NULL,
-            /*a_hdab=*/NULL);
-
-      } // end of task loop
+        for (int itask = first_task; itask <= last_task; itask++) {
+          // Define some convenient aliases.
+          const grid_cpu_task *task = &task_list->tasks[itask];
+          assert(task->block_num - 1 == block_num);
+          assert(task->iatom - 1 == iatom && task->jatom - 1 == jatom);
+          const int ikind = task_list->atom_kinds[iatom] - 1;
+          const int jkind = task_list->atom_kinds[jatom] - 1;
+          grid_basis_set *ibasis = task_list->basis_sets[ikind];
+          grid_basis_set *jbasis = task_list->basis_sets[jkind];
+          const int iset = task->iset - 1;
+          const int jset = task->jset - 1;
+          const int ipgf = task->ipgf - 1;
+          const int jpgf = task->jpgf - 1;
+          const double zeta = ibasis->zet[iset * ibasis->maxpgf + ipgf];
+          const double zetb = jbasis->zet[jset * jbasis->maxpgf + jpgf];
+          const int ncoseta = ncoset(ibasis->lmax[iset]);
+          const int ncosetb = ncoset(jbasis->lmax[jset]);
+          const int ncoa = ibasis->npgf[iset] * ncoseta; // size of carth. set
+          const int ncob = jbasis->npgf[jset] * ncosetb;
+          const int block_offset = task_list->block_offsets[block_num];
+          const bool transpose = (iatom <= jatom);
+          const bool pab_required = (forces != NULL || virial != NULL);
+
+          // Load pab and store hab subblocks when needed.
+          // Previous hab and pab can be reused when only ipgf or jpgf changed.
+          if (block_offset != old_offset || iset != old_iset ||
+              jset != old_jset) {
+            for (int ibatch = 0; ibatch < nbatch; ibatch++) {
+              if (pab_required) {
+                load_pab(ibasis, jbasis, iset, jset, transpose,
+                         &pab_blocks[ibatch]->host_buffer[block_offset],
+                         &pab[ibatch * ncoa * ncob]);
+              }
+              if (old_offset >= 0) { // skip first iteration
+                store_hab(old_ibasis, old_jbasis, old_iset, old_jset,
+                          old_transpose, &hab[ibatch * old_size],
+                          &hab_blocks[ibatch]->host_buffer[old_offset]);
+              }
+            }
+            memset(hab, 0, nbatch * ncoa * ncob * sizeof(double));
+            old_offset = block_offset;
+            old_iset = iset;
+            old_jset = jset;
+            old_size = ncoa * ncob;
+            old_ibasis = ibasis;
+            old_jbasis = jbasis;
+            old_transpose = transpose;
+          }
+
+          task_list->kernels->integrate_pgf_product_batched(
+              /*orthorhombic=*/task_list->orthorhombic,
+              /*compute_tau=*/compute_tau,
+              /*border_mask=*/task->border_mask,
+              /*la_max=*/ibasis->lmax[iset],
+              /*la_min=*/ibasis->lmin[iset],
+              /*lb_max=*/jbasis->lmax[jset],
+              /*lb_min=*/jbasis->lmin[jset],
+              /*zeta=*/zeta,
+              /*zetb=*/zetb,
+              /*dh=*/layout->dh,
+              /*dh_inv=*/layout->dh_inv,
+              /*ra=*/&task_list->atom_positions[3 * iatom],
+              /*rab=*/task->rab,
+              /*npts_global=*/layout->npts_global,
+              /*npts_local=*/layout->npts_local,
+              /*shift_local=*/layout->shift_local,
+              /*border_width=*/layout->border_width,
+              /*radius=*/task->radius,
+              /*o1=*/ipgf * ncoseta,
+              /*o2=*/jpgf * ncosetb,
+              /*n1=*/ncoa,
+              /*n2=*/ncob,
+              /*nbatch=*/nbatch,
+              /*grids=*/level_grids,
+              /*hab=*/(double(*)[ncob][ncoa])hab,
+              /*pab=*/(pab_required) ? (const double(*)[ncob][ncoa])pab : NULL,
+              /*forces=*/(forces != NULL) ? my_forces : NULL,
+              /*virials=*/(virial != NULL) ? my_virials : NULL);
+
+        } // end of task loop
+      } // end of level loop
 
       // Merge thread-local forces and virial into shared ones.
       // It does not seem worth the trouble to accumulate them thread-locally.
       const double scalef = (iatom == jatom) ? 1.0 : 2.0;
       if (forces != NULL) {
 #pragma omp critical(forces)
-        for (int i = 0; i < 3; i++) {
-          forces[iatom][i] += scalef * my_forces[0][i];
-          forces[jatom][i] += scalef * my_forces[1][i];
+        for (int ibatch = 0; ibatch < nbatch; ibatch++) {
+          for (int i = 0; i < 3; i++) {
+            forces[ibatch][iatom][i] += scalef * my_forces[ibatch][0][i];
+            forces[ibatch][jatom][i] += scalef * my_forces[ibatch][1][i];
+          }
         }
       }
       if (virial != NULL) {
 #pragma omp critical(virial)
-        for (int i = 0; i < 3; i++) {
-          for (int j = 0; j < 3; j++) {
-            virial[i][j] += scalef * my_virials[0][i][j];
-            virial[i][j] += scalef * my_virials[1][i][j];
+        for (int ibatch = 0; ibatch < nbatch; ibatch++) {
+          for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+              virial[ibatch][i][j] += scalef * my_virials[ibatch][0][i][j];
+              virial[ibatch][i][j] += scalef * my_virials[ibatch][1][i][j];
+            }
           }
         }
       }
 
+      busy_time += omp_get_wtime() - start_time;
     } // end of block loop
 
     // store final hab
     if (old_offset >= 0) {
-      store_hab(old_ibasis, old_jbasis, old_iset, old_jset, old_transpose, hab,
-                &hab_blocks->host_buffer[old_offset]);
+      for (int ibatch = 0; ibatch < nbatch; ibatch++) {
+        store_hab(old_ibasis, old_jbasis, old_iset, old_jset, old_transpose,
+                  &hab[ibatch * old_size],
+                  &hab_blocks[ibatch]->host_buffer[old_offset]);
+      }
     }
+    free(pab);
+    free(hab);
 
+    busy_times[ithread] = busy_time;
   } // end of omp parallel region
-}
 
-/*******************************************************************************
- * \brief Integrate all tasks of in given list from given grids.
- *        See grid_task_list.h for details.
- * \author Ole Schuett
- ******************************************************************************/
-void grid_cpu_integrate_task_list(
-    const grid_cpu_task_list *task_list, const bool compute_tau,
-    const int natoms, const int nlevels, const offload_buffer *pab_blocks,
-    const offload_buffer *grids[nlevels], offload_buffer *hab_blocks,
-    double forces[natoms][3], double virial[3][3]) {
-
-  assert(task_list->nlevels == nlevels);
-  assert(task_list->natoms == natoms);
-
-  // Zero result arrays.
-  memset(hab_blocks->host_buffer, 0, hab_blocks->size);
-  if (forces != NULL) {
-    memset(forces, 0, natoms * 3 * sizeof(double));
-  }
-  if (virial != NULL) {
-    memset(virial, 0, 9 * sizeof(double));
-  }
-
-  for (int level = 0; level < task_list->nlevels; level++) {
-    const int idx = level * task_list->nblocks;
-    const int *first_block_task = &task_list->first_level_block_task[idx];
-    const int *last_block_task = &task_list->last_level_block_task[idx];
-    const grid_cpu_layout *layout = &task_list->layouts[level];
-    integrate_one_grid_level(
-        task_list, first_block_task, last_block_task, compute_tau, natoms,
-        layout->npts_global, layout->npts_local, layout->shift_local,
-        layout->border_width, layout->dh, layout->dh_inv, pab_blocks,
-        grids[level], hab_blocks, forces, virial);
-  }
+  report_schedule(true, schedule, nthreads, busy_times);
 }
 
 // EOF
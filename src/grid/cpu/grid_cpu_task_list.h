@@ -12,6 +12,7 @@
 #include "../../offload/offload_buffer.h"
 #include "../common/grid_basis_set.h"
 #include "../common/grid_constants.h"
+#include "grid_cpu_kernels.h"
 
 /*******************************************************************************
  * \brief Internal representation of a task.
@@ -44,6 +45,46 @@ typedef struct {
   double dh_inv[3][3];
 } grid_cpu_layout;
 
+/*******************************************************************************
+ * \brief Internal representation of the tiling of a grid level for collocation.
+ *        The grid is cut along one axis into slabs, which are owned by tiles.
+ *        Each tile collocates the tasks centered within its slab into a buffer
+ *        that covers the slab plus a halo wide enough for the tasks' cubes.
+ *        Afterwards, the buffers are summed into the grid plane by plane.
+ ******************************************************************************/
+typedef struct {
+  int axis;            // tiled direction, negative if tiling is not used
+  int ntiles;          // number of tiles
+  int max_halo;        // largest halo of any tile
+  int *first_plane;    // first grid plane of each tile, has ntiles+1 entries
+  int *halos;          // number of halo planes on either side of each tile
+  size_t *offsets;     // start of each tile's buffer, has ntiles+1 entries
+  int *first_task;     // start of each tile in tasks, has ntiles+1 entries
+  int *tasks;          // task indices sorted by tile
+} grid_cpu_tiling;
+
+/*******************************************************************************
+ * \brief Internal representation of a unit of work for collocation, namely the
+ *        tasks of either a block or a tile within a single grid level.
+ ******************************************************************************/
+typedef struct {
+  int level;
+  int index; // tile if the level is tiled, block_num otherwise
+  double cost;
+} grid_cpu_work_unit;
+
+/*******************************************************************************
+ * \brief Internal representation of a schedule. Units of work are assigned to
+ *        one queue per thread, longest processing time first, according to
+ *        their estimated cost. Each thread first processes its own queue and
+ *        then steals units from the queues of other threads.
+ ******************************************************************************/
+typedef struct {
+  int nqueues;      // one queue per thread
+  int *first;       // start of each queue, has nqueues+1 entries
+  double imbalance; // predicted maximum over average load of the queues
+} grid_cpu_schedule;
+
 /*******************************************************************************
  * \brief Internal representation of a task list.
  * \author Ole Schuett
@@ -64,8 +105,18 @@ typedef struct {
   int *first_level_block_task;
   int *last_level_block_task;
   int maxco;
+  const grid_cpu_kernels *kernels;
   double **threadlocals;
   size_t *threadlocal_sizes;
+  size_t *threadlocal_offsets;
+  grid_cpu_tiling *tilings;
+  double *tile_buffer;
+  size_t tile_buffer_size;
+  int nunits;
+  grid_cpu_work_unit *units;
+  grid_cpu_schedule unit_schedule;
+  int *block_order;
+  grid_cpu_schedule block_schedule;
 } grid_cpu_task_list;
 
 /*******************************************************************************
@@ -104,6 +155,16 @@ void grid_cpu_collocate_task_list(const grid_cpu_task_list *task_list,
                                   const offload_buffer *pab_blocks,
                                   offload_buffer *grids[nlevels]);
 
+/*******************************************************************************
+ * \brief Collocate all tasks of in given list for a batch of density matrices.
+ *        See grid_task_list.h for details.
+ ******************************************************************************/
+void grid_cpu_collocate_task_list_batched(
+    const grid_cpu_task_list *task_list, const enum grid_func func,
+    const int nlevels, const int nbatch,
+    const offload_buffer *pab_blocks[nbatch],
+    offload_buffer *grids[nbatch][nlevels]);
+
 /*******************************************************************************
  * \brief Integrate all tasks of in given list from given grids.
  *        See grid_task_list.h for details.
@@ -115,6 +176,18 @@ void grid_cpu_integrate_task_list(
     const offload_buffer *grids[nlevels], offload_buffer *hab_blocks,
     double forces[natoms][3], double virial[3][3]);
 
+/*******************************************************************************
+ * \brief Integrate all tasks of in given list for a batch of potentials.
+ *        See grid_task_list.h for details.
+ ******************************************************************************/
+void grid_cpu_integrate_task_list_batched(
+    const grid_cpu_task_list *task_list, const bool compute_tau,
+    const int natoms, const int nlevels, const int nbatch,
+    const offload_buffer *pab_blocks[nbatch],
+    const offload_buffer *grids[nbatch][nlevels],
+    offload_buffer *hab_blocks[nbatch], double forces[nbatch][natoms][3],
+    double virial[nbatch][3][3]);
+
 #endif
 
 // EOF
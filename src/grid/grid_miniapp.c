@@ -69,7 +69,7 @@ int main(int argc, char *argv[]) {
 
   const double tolerance = 1e-12 * cycles;
   const bool success = grid_replay(argv[iarg++], cycles, collocate, batch,
-                                   cycles_per_block, tolerance);
+                                   cycles_per_block, false, tolerance);
 
   grid_library_print_stats(&mpi_sum_func, 0, &print_func, 0);
   grid_library_finalize();
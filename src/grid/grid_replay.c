@@ -214,6 +214,111 @@ static void create_dummy_task_list(
       shift_local, border_width, dh, dh_inv, task_list);
 }
 
+/*******************************************************************************
+ * \brief Returns the relative difference of a test value to its reference.
+ ******************************************************************************/
+static double rel_diff(const double ref_value, const double test_value) {
+  return fabs(test_value - ref_value) / fmax(1.0, fabs(ref_value));
+}
+
+/*******************************************************************************
+ * \brief Collocates/integrates a batch of the given and a second density, and
+ *        returns the max relative difference to two separate calls.
+ ******************************************************************************/
+static double compare_batch_of_two(const grid_task_list *task_list,
+                                   const bool collocate,
+                                   const enum grid_func func,
+                                   const bool compute_tau,
+                                   const int npts_local[1][3],
+                                   const offload_buffer *pab_blocks,
+                                   const offload_buffer *grid) {
+
+  const int nbatch = 2;
+  const int nlevels = 1;
+  const int natoms = 2;
+  const int npab = pab_blocks->size / sizeof(double);
+  const int ngrid = grid->size / sizeof(double);
+
+  // Derive a second density and potential that are not just multiples.
+  offload_buffer *pab_second = NULL, *grid_second = NULL;
+  offload_create_buffer(npab, &pab_second);
+  offload_create_buffer(ngrid, &grid_second);
+  for (int i = 0; i < npab; i++) {
+    const double f = 1.0 - 0.3 * (i % 5);
+    pab_second->host_buffer[i] = f * pab_blocks->host_buffer[i];
+  }
+  for (int i = 0; i < ngrid; i++) {
+    const double f = 0.5 - 0.2 * (i % 7);
+    grid_second->host_buffer[i] = f * grid->host_buffer[i];
+  }
+  const offload_buffer *pabs[2] = {pab_blocks, pab_second};
+
+  double max_rel_diff = 0.0;
+  if (collocate) {
+    offload_buffer *grids_single[2][1] = {{NULL}, {NULL}};
+    offload_buffer *grids_batch[2][1] = {{NULL}, {NULL}};
+    for (int ibatch = 0; ibatch < nbatch; ibatch++) {
+      offload_create_buffer(ngrid, &grids_single[ibatch][0]);
+      offload_create_buffer(ngrid, &grids_batch[ibatch][0]);
+      grid_collocate_task_list(task_list, func, nlevels, npts_local,
+                               pabs[ibatch], grids_single[ibatch]);
+    }
+    grid_collocate_task_list_batched(task_list, func, nlevels, npts_local,
+                                     nbatch, pabs, grids_batch);
+    for (int ibatch = 0; ibatch < nbatch; ibatch++) {
+      const double *ref = grids_single[ibatch][0]->host_buffer;
+      const double *test = grids_batch[ibatch][0]->host_buffer;
+      for (int i = 0; i < ngrid; i++) {
+        max_rel_diff = fmax(max_rel_diff, rel_diff(ref[i], test[i]));
+      }
+      offload_free_buffer(grids_single[ibatch][0]);
+      offload_free_buffer(grids_batch[ibatch][0]);
+    }
+  } else {
+    const offload_buffer *grids[2][1] = {{grid}, {grid_second}};
+    offload_buffer *habs_single[2] = {NULL, NULL};
+    offload_buffer *habs_batch[2] = {NULL, NULL};
+    double forces_single[2][2][3], forces_batch[2][2][3];
+    double virial_single[2][3][3], virial_batch[2][3][3];
+    for (int ibatch = 0; ibatch < nbatch; ibatch++) {
+      offload_create_buffer(npab, &habs_single[ibatch]);
+      offload_create_buffer(npab, &habs_batch[ibatch]);
+      grid_integrate_task_list(task_list, compute_tau, natoms, nlevels,
+                               npts_local, pabs[ibatch], grids[ibatch],
+                               habs_single[ibatch], forces_single[ibatch],
+                               virial_single[ibatch]);
+    }
+    grid_integrate_task_list_batched(task_list, compute_tau, natoms, nlevels,
+                                     npts_local, nbatch, pabs, grids,
+                                     habs_batch, forces_batch, virial_batch);
+    for (int ibatch = 0; ibatch < nbatch; ibatch++) {
+      const double *ref = habs_single[ibatch]->host_buffer;
+      const double *test = habs_batch[ibatch]->host_buffer;
+      for (int i = 0; i < npab; i++) {
+        max_rel_diff = fmax(max_rel_diff, rel_diff(ref[i], test[i]));
+      }
+      for (int i = 0; i < 3; i++) {
+        for (int iatom = 0; iatom < natoms; iatom++) {
+          const double ref_value = forces_single[ibatch][iatom][i];
+          const double test_value = forces_batch[ibatch][iatom][i];
+          max_rel_diff = fmax(max_rel_diff, rel_diff(ref_value, test_value));
+        }
+        for (int j = 0; j < 3; j++) {
+          const double ref_value = virial_single[ibatch][i][j];
+          const double test_value = virial_batch[ibatch][i][j];
+          max_rel_diff = fmax(max_rel_diff, rel_diff(ref_value, test_value));
+        }
+      }
+      offload_free_buffer(habs_single[ibatch]);
+      offload_free_buffer(habs_batch[ibatch]);
+    }
+  }
+
+  offload_free_buffer(pab_second);
+  offload_free_buffer(grid_second);
+  return max_rel_diff;
+}
+
 /*******************************************************************************
  * \brief Reads a .task file, collocates/integrates it, and compares results.
  *        See grid_replay.h for details.
@@ -221,7 +326,7 @@ static void create_dummy_task_list(
  ******************************************************************************/
 bool grid_replay(const char *filename, const int cycles, const bool collocate,
                  const bool batch, const int cycles_per_block,
-                 const double tolerance) {
+                 const bool check_batch, const double tolerance) {
 
   if (cycles < 1) {
     fprintf(stderr, "Error: Cycles have to be greater than zero.\n");
@@ -332,6 +437,7 @@ bool grid_replay(const char *filename, const int cycles, const bool collocate,
   double forces_test[2][3];
   double virial_test[3][3];
   double start_time, end_time;
+  double max_batch_diff = 0.0;
 
   if (batch) {
     grid_basis_set *basisa = NULL, *basisb = NULL;
@@ -374,6 +480,12 @@ bool grid_replay(const char *filename, const int cycles, const bool collocate,
       }
     }
     end_time = omp_get_wtime();
+    if (check_batch) {
+      const offload_buffer *grid = (collocate) ? grid_test : grid_ref;
+      max_batch_diff = compare_batch_of_two(
+          task_list, collocate, func, compute_tau, (const int(*)[3])npts_local,
+          pab_blocks, grid);
+    }
     grid_free_basis_set(basisa);
     grid_free_basis_set(basisb);
     grid_free_task_list(task_list);
@@ -473,6 +585,11 @@ bool grid_replay(const char *filename, const int cycles, const bool collocate,
       }
     }
   }
+  if (max_batch_diff > tolerance) {
+    printf("Batch of two max rel diff: %le\n", max_batch_diff);
+  }
+  max_rel_diff = fmax(max_rel_diff, max_batch_diff);
+
   printf("Task: %-55s   %9s %-7s   Cycles: %e   Max value: %le   "
          "Max rel diff: %le   Time: %le sec\n",
          filename, collocate ? "Collocate" : "Integrate",
@@ -19,6 +19,8 @@
  * \param batch             When false grid_ref_collocate_pgf_product is called.
  *                          When true grid_collocate_task_list is called.
  * \param cycles_per_block  Number of cycles per matrix block decontraction.
+ * \param check_batch       When true and batch is set, also compares a batch of
+ *                          two densities against two separate calls.
  * \param tolerance         Tolerance for comparing floating point results.
  * \returns                 Returns true iff the test passed.
  *
@@ -26,7 +28,7 @@
  ******************************************************************************/
 bool grid_replay(const char *filename, const int cycles, const bool collocate,
                  const bool batch, const int cycles_per_block,
-                 const double tolerance);
+                 const bool check_batch, const double tolerance);
 
 #endif
 
@@ -175,6 +175,151 @@ void grid_free_task_list(grid_task_list *task_list) {
   free(task_list);
 }
 
+/*******************************************************************************
+ * \brief Compares the results of a collocation against the reference backend.
+ ******************************************************************************/
+static void validate_collocate(const grid_task_list *task_list,
+                               const enum grid_func func, const int nlevels,
+                               const int npts_local[nlevels][3],
+                               const offload_buffer *pab_blocks,
+                               offload_buffer *grids[nlevels]) {
+
+  // Allocate space for reference results.
+  offload_buffer *grids_ref[nlevels];
+  for (int level = 0; level < nlevels; level++) {
+    const int npts_local_total =
+        npts_local[level][0] * npts_local[level][1] * npts_local[level][2];
+    grids_ref[level] = NULL;
+    offload_create_buffer(npts_local_total, &grids_ref[level]);
+  }
+
+  // Call reference implementation.
+  grid_ref_collocate_task_list(task_list->ref, func, nlevels, pab_blocks,
+                               grids_ref);
+
+  // Compare results.
+  const double tolerance = 1e-12;
+  double max_rel_diff = 0.0;
+  for (int level = 0; level < nlevels; level++) {
+    for (int i = 0; i < npts_local[level][0]; i++) {
+      for (int j = 0; j < npts_local[level][1]; j++) {
+        for (int k = 0; k < npts_local[level][2]; k++) {
+          const int idx = k * npts_local[level][1] * npts_local[level][0] +
+                          j * npts_local[level][0] + i;
+          const double ref_value = grids_ref[level]->host_buffer[idx];
+          const double test_value = grids[level]->host_buffer[idx];
+          const double diff = fabs(test_value - ref_value);
+          const double rel_diff = diff / fmax(1.0, fabs(ref_value));
+          max_rel_diff = fmax(max_rel_diff, rel_diff);
+          if (rel_diff > tolerance) {
+            fprintf(stderr, "Error: Validation failure in grid collocate\n");
+            fprintf(stderr, "   diff:     %le\n", diff);
+            fprintf(stderr, "   rel_diff: %le\n", rel_diff);
+            fprintf(stderr, "   value:    %le\n", ref_value);
+            fprintf(stderr, "   level:    %i\n", level);
+            fprintf(stderr, "   ijk:      %i  %i  %i\n", i, j, k);
+            abort();
+          }
+        }
+      }
+    }
+    offload_free_buffer(grids_ref[level]);
+    printf("Validated grid collocate, max rel. diff: %le\n", max_rel_diff);
+  }
+}
+
+/*******************************************************************************
+ * \brief Compares the results of an integration against the reference backend.
+ ******************************************************************************/
+static void validate_integrate(
+    const grid_task_list *task_list, const bool compute_tau, const int natoms,
+    const int nlevels, const offload_buffer *pab_blocks,
+    const offload_buffer *grids[nlevels], offload_buffer *hab_blocks,
+    double forces[natoms][3], double virial[3][3]) {
+
+  // Allocate space for reference results.
+  const int hab_length = hab_blocks->size / sizeof(double);
+  offload_buffer *hab_blocks_ref = NULL;
+  offload_create_buffer(hab_length, &hab_blocks_ref);
+  double forces_ref[natoms][3], virial_ref[3][3];
+
+  // Call reference implementation.
+  grid_ref_integrate_task_list(task_list->ref, compute_tau, natoms, nlevels,
+                               pab_blocks, grids, hab_blocks_ref,
+                               (forces != NULL) ? forces_ref : NULL,
+                               (virial != NULL) ? virial_ref : NULL);
+
+  // Compare hab.
+  const double hab_tolerance = 1e-12;
+  double hab_max_rel_diff = 0.0;
+  for (int i = 0; i < hab_length; i++) {
+    const double ref_value = hab_blocks_ref->host_buffer[i];
+    const double test_value = hab_blocks->host_buffer[i];
+    const double diff = fabs(test_value - ref_value);
+    const double rel_diff = diff / fmax(1.0, fabs(ref_value));
+    hab_max_rel_diff = fmax(hab_max_rel_diff, rel_diff);
+    if (rel_diff > hab_tolerance) {
+      fprintf(stderr, "Error: Validation failure in grid integrate\n");
+      fprintf(stderr, "   hab diff:     %le\n", diff);
+      fprintf(stderr, "   hab rel_diff: %le\n", rel_diff);
+      fprintf(stderr, "   hab value:    %le\n", ref_value);
+      fprintf(stderr, "   hab i:        %i\n", i);
+      abort();
+    }
+  }
+
+  // Compare forces.
+  const double forces_tolerance = 1e-8; // account for higher numeric noise
+  double forces_max_rel_diff = 0.0;
+  if (forces != NULL) {
+    for (int iatom = 0; iatom < natoms; iatom++) {
+      for (int idir = 0; idir < 3; idir++) {
+        const double ref_value = forces_ref[iatom][idir];
+        const double test_value = forces[iatom][idir];
+        const double diff = fabs(test_value - ref_value);
+        const double rel_diff = diff / fmax(1.0, fabs(ref_value));
+        forces_max_rel_diff = fmax(forces_max_rel_diff, rel_diff);
+        if (rel_diff > forces_tolerance) {
+          fprintf(stderr, "Error: Validation failure in grid integrate\n");
+          fprintf(stderr, "   forces diff:     %le\n", diff);
+          fprintf(stderr, "   forces rel_diff: %le\n", rel_diff);
+          fprintf(stderr, "   forces value:    %le\n", ref_value);
+          fprintf(stderr, "   forces atom:     %i\n", iatom);
+          fprintf(stderr, "   forces dir:      %i\n", idir);
+          abort();
+        }
+      }
+    }
+  }
+
+  // Compare virial.
+  const double virial_tolerance = 1e-8; // account for higher numeric noise
+  double virial_max_rel_diff = 0.0;
+  if (virial != NULL) {
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        const double ref_value = virial_ref[i][j];
+        const double test_value = virial[i][j];
+        const double diff = fabs(test_value - ref_value);
+        const double rel_diff = diff / fmax(1.0, fabs(ref_value));
+        virial_max_rel_diff = fmax(virial_max_rel_diff, rel_diff);
+        if (rel_diff > virial_tolerance) {
+          fprintf(stderr, "Error: Validation failure in grid integrate\n");
+          fprintf(stderr, "   virial diff:     %le\n", diff);
+          fprintf(stderr, "   virial rel_diff: %le\n", rel_diff);
+          fprintf(stderr, "   virial value:    %le\n", ref_value);
+          fprintf(stderr, "   virial ij:       %i  %i\n", i, j);
+          abort();
+        }
+      }
+    }
+  }
+
+  printf("Validated grid_integrate, max rel. diff: %le %le %le\n",
+         hab_max_rel_diff, forces_max_rel_diff, virial_max_rel_diff);
+  offload_free_buffer(hab_blocks_ref);
+}
+
 /*******************************************************************************
  * \brief Collocate all tasks of in given list onto given grids.
  *        See grid_task_list.h for details.
@@ -227,48 +372,7 @@ void grid_collocate_task_list(const grid_task_list *task_list,
 
   // Perform validation if enabled.
   if (grid_library_get_config().validate) {
-    // Allocate space for reference results.
-    offload_buffer *grids_ref[nlevels];
-    for (int level = 0; level < nlevels; level++) {
-      const int npts_local_total =
-          npts_local[level][0] * npts_local[level][1] * npts_local[level][2];
-      grids_ref[level] = NULL;
-      offload_create_buffer(npts_local_total, &grids_ref[level]);
-    }
-
-    // Call reference implementation.
-    grid_ref_collocate_task_list(task_list->ref, func, nlevels, pab_blocks,
-                                 grids_ref);
-
-    // Compare results.
-    const double tolerance = 1e-12;
-    double max_rel_diff = 0.0;
-    for (int level = 0; level < nlevels; level++) {
-      for (int i = 0; i < npts_local[level][0]; i++) {
-        for (int j = 0; j < npts_local[level][1]; j++) {
-          for (int k = 0; k < npts_local[level][2]; k++) {
-            const int idx = k * npts_local[level][1] * npts_local[level][0] +
-                            j * npts_local[level][0] + i;
-            const double ref_value = grids_ref[level]->host_buffer[idx];
-            const double test_value = grids[level]->host_buffer[idx];
-            const double diff = fabs(test_value - ref_value);
-            const double rel_diff = diff / fmax(1.0, fabs(ref_value));
-            max_rel_diff = fmax(max_rel_diff, rel_diff);
-            if (rel_diff > tolerance) {
-              fprintf(stderr, "Error: Validation failure in grid collocate\n");
-              fprintf(stderr, "   diff:     %le\n", diff);
-              fprintf(stderr, "   rel_diff: %le\n", rel_diff);
-              fprintf(stderr, "   value:    %le\n", ref_value);
-              fprintf(stderr, "   level:    %i\n", level);
-              fprintf(stderr, "   ijk:      %i  %i  %i\n", i, j, k);
-              abort();
-            }
-          }
-        }
-      }
-      offload_free_buffer(grids_ref[level]);
-      printf("Validated grid collocate, max rel. diff: %le\n", max_rel_diff);
-    }
+    validate_collocate(task_list, func, nlevels, npts_local, pab_blocks, grids);
   }
 }
 
@@ -329,87 +433,100 @@ void grid_integrate_task_list(
 
   // Perform validation if enabled.
   if (grid_library_get_config().validate) {
-    // Allocate space for reference results.
-    const int hab_length = hab_blocks->size / sizeof(double);
-    offload_buffer *hab_blocks_ref = NULL;
-    offload_create_buffer(hab_length, &hab_blocks_ref);
-    double forces_ref[natoms][3], virial_ref[3][3];
+    validate_integrate(task_list, compute_tau, natoms, nlevels, pab_blocks,
+                       grids, hab_blocks, forces, virial);
+  }
+}
 
-    // Call reference implementation.
-    grid_ref_integrate_task_list(task_list->ref, compute_tau, natoms, nlevels,
-                                 pab_blocks, grids, hab_blocks_ref,
-                                 (forces != NULL) ? forces_ref : NULL,
-                                 (virial != NULL) ? virial_ref : NULL);
-
-    // Compare hab.
-    const double hab_tolerance = 1e-12;
-    double hab_max_rel_diff = 0.0;
-    for (int i = 0; i < hab_length; i++) {
-      const double ref_value = hab_blocks_ref->host_buffer[i];
-      const double test_value = hab_blocks->host_buffer[i];
-      const double diff = fabs(test_value - ref_value);
-      const double rel_diff = diff / fmax(1.0, fabs(ref_value));
-      hab_max_rel_diff = fmax(hab_max_rel_diff, rel_diff);
-      if (rel_diff > hab_tolerance) {
-        fprintf(stderr, "Error: Validation failure in grid integrate\n");
-        fprintf(stderr, "   hab diff:     %le\n", diff);
-        fprintf(stderr, "   hab rel_diff: %le\n", rel_diff);
-        fprintf(stderr, "   hab value:    %le\n", ref_value);
-        fprintf(stderr, "   hab i:        %i\n", i);
-        abort();
-      }
+/*******************************************************************************
+ * \brief Collocate all tasks of in given list for a batch of density matrices.
+ *        See grid_task_list.h for details.
+ ******************************************************************************/
+void grid_collocate_task_list_batched(const grid_task_list *task_list,
+                                      const enum grid_func func,
+                                      const int nlevels,
+                                      const int npts_local[nlevels][3],
+                                      const int nbatch,
+                                      const offload_buffer *pab_blocks[nbatch],
+                                      offload_buffer *grids[nbatch][nlevels]) {
+
+  // Only the cpu backend shares work across the batch, others loop over it.
+  if (task_list->backend != GRID_BACKEND_CPU) {
+    for (int ibatch = 0; ibatch < nbatch; ibatch++) {
+      grid_collocate_task_list(task_list, func, nlevels, npts_local,
+                               pab_blocks[ibatch], grids[ibatch]);
     }
+    return;
+  }
 
-    // Compare forces.
-    const double forces_tolerance = 1e-8; // account for higher numeric noise
-    double forces_max_rel_diff = 0.0;
-    if (forces != NULL) {
-      for (int iatom = 0; iatom < natoms; iatom++) {
-        for (int idir = 0; idir < 3; idir++) {
-          const double ref_value = forces_ref[iatom][idir];
-          const double test_value = forces[iatom][idir];
-          const double diff = fabs(test_value - ref_value);
-          const double rel_diff = diff / fmax(1.0, fabs(ref_value));
-          forces_max_rel_diff = fmax(forces_max_rel_diff, rel_diff);
-          if (rel_diff > forces_tolerance) {
-            fprintf(stderr, "Error: Validation failure in grid integrate\n");
-            fprintf(stderr, "   forces diff:     %le\n", diff);
-            fprintf(stderr, "   forces rel_diff: %le\n", rel_diff);
-            fprintf(stderr, "   forces value:    %le\n", ref_value);
-            fprintf(stderr, "   forces atom:     %i\n", iatom);
-            fprintf(stderr, "   forces dir:      %i\n", idir);
-            abort();
-          }
-        }
-      }
+  // Bounds check.
+  assert(task_list->nlevels == nlevels);
+  for (int ilevel = 0; ilevel < nlevels; ilevel++) {
+    assert(task_list->npts_local[ilevel][0] == npts_local[ilevel][0]);
+    assert(task_list->npts_local[ilevel][1] == npts_local[ilevel][1]);
+    assert(task_list->npts_local[ilevel][2] == npts_local[ilevel][2]);
+  }
+
+  grid_cpu_collocate_task_list_batched(task_list->cpu, func, nlevels, nbatch,
+                                       pab_blocks, grids);
+
+  // Perform validation if enabled.
+  if (grid_library_get_config().validate) {
+    for (int ibatch = 0; ibatch < nbatch; ibatch++) {
+      validate_collocate(task_list, func, nlevels, npts_local,
+                         pab_blocks[ibatch], grids[ibatch]);
     }
+  }
+}
 
-    // Compare virial.
-    const double virial_tolerance = 1e-8; // account for higher numeric noise
-    double virial_max_rel_diff = 0.0;
-    if (virial != NULL) {
-      for (int i = 0; i < 3; i++) {
-        for (int j = 0; j < 3; j++) {
-          const double ref_value = virial_ref[i][j];
-          const double test_value = virial[i][j];
-          const double diff = fabs(test_value - ref_value);
-          const double rel_diff = diff / fmax(1.0, fabs(ref_value));
-          virial_max_rel_diff = fmax(virial_max_rel_diff, rel_diff);
-          if (rel_diff > virial_tolerance) {
-            fprintf(stderr, "Error: Validation failure in grid integrate\n");
-            fprintf(stderr, "   virial diff:     %le\n", diff);
-            fprintf(stderr, "   virial rel_diff: %le\n", rel_diff);
-            fprintf(stderr, "   virial value:    %le\n", ref_value);
-            fprintf(stderr, "   virial ij:       %i  %i\n", i, j);
-            abort();
-          }
-        }
-      }
+/*******************************************************************************
+ * \brief Integrate all tasks of in given list for a batch of potentials.
+ *        See grid_task_list.h for details.
+ ******************************************************************************/
+void grid_integrate_task_list_batched(
+    const grid_task_list *task_list, const bool compute_tau, const int natoms,
+    const int nlevels, const int npts_local[nlevels][3], const int nbatch,
+    const offload_buffer *pab_blocks[nbatch],
+    const offload_buffer *grids[nbatch][nlevels],
+    offload_buffer *hab_blocks[nbatch], double forces[nbatch][natoms][3],
+    double virial[nbatch][3][3]) {
+
+  // Only the cpu backend shares work across the batch, others loop over it.
+  if (task_list->backend != GRID_BACKEND_CPU) {
+    for (int ibatch = 0; ibatch < nbatch; ibatch++) {
+      grid_integrate_task_list(
+          task_list, compute_tau, natoms, nlevels, npts_local,
+          (pab_blocks != NULL) ? pab_blocks[ibatch] : NULL, grids[ibatch],
+          hab_blocks[ibatch], (forces != NULL) ? forces[ibatch] : NULL,
+          (virial != NULL) ? virial[ibatch] : NULL);
     }
+    return;
+  }
 
-    printf("Validated grid_integrate, max rel. diff: %le %le %le\n",
-           hab_max_rel_diff, forces_max_rel_diff, virial_max_rel_diff);
-    offload_free_buffer(hab_blocks_ref);
+  // Bounds check.
+  assert(task_list->nlevels == nlevels);
+  for (int ilevel = 0; ilevel < nlevels; ilevel++) {
+    assert(task_list->npts_local[ilevel][0] == npts_local[ilevel][0]);
+    assert(task_list->npts_local[ilevel][1] == npts_local[ilevel][1]);
+    assert(task_list->npts_local[ilevel][2] == npts_local[ilevel][2]);
+  }
+
+  assert(forces == NULL || pab_blocks != NULL);
+  assert(virial == NULL || pab_blocks != NULL);
+
+  grid_cpu_integrate_task_list_batched(task_list->cpu, compute_tau, natoms,
+                                       nlevels, nbatch, pab_blocks, grids,
+                                       hab_blocks, forces, virial);
+
+  // Perform validation if enabled.
+  if (grid_library_get_config().validate) {
+    for (int ibatch = 0; ibatch < nbatch; ibatch++) {
+      validate_integrate(task_list, compute_tau, natoms, nlevels,
+                         (pab_blocks != NULL) ? pab_blocks[ibatch] : NULL,
+                         grids[ibatch], hab_blocks[ibatch],
+                         (forces != NULL) ? forces[ibatch] : NULL,
+                         (virial != NULL) ? virial[ibatch] : NULL);
+    }
   }
 }
 
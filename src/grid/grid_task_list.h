@@ -149,6 +149,44 @@ void grid_integrate_task_list(
     const offload_buffer *pab_blocks, const offload_buffer *grids[nlevels],
     offload_buffer *hab_blocks, double forces[natoms][3], double virial[3][3]);
 
+/*******************************************************************************
+ * \brief Collocate all tasks of in given list for a batch of density matrices,
+ *        e.g. of both spins. In contrast to repeated calls of
+ *        grid_collocate_task_list, the setup of each task is done only once.
+ *
+ * \param task_list       Task list to collocate.
+ * \param func            Function to be collocated, see grid_prepare_pab.h
+ * \param nlevels         Number of grid levels.
+ * \param npts_local      Number of local grid points of each grid level.
+ * \param nbatch          Number of density matrices.
+ * \param pab_blocks      Buffers that contain the density matrix blocks.
+ * \param grids           The output grid arrays of each density matrix.
+ *
+ ******************************************************************************/
+void grid_collocate_task_list_batched(const grid_task_list *task_list,
+                                      const enum grid_func func,
+                                      const int nlevels,
+                                      const int npts_local[nlevels][3],
+                                      const int nbatch,
+                                      const offload_buffer *pab_blocks[nbatch],
+                                      offload_buffer *grids[nbatch][nlevels]);
+
+/*******************************************************************************
+ * \brief Integrate all tasks of in given list for a batch of potentials.
+ *        In contrast to repeated calls of grid_integrate_task_list, the setup
+ *        of each task is done only once. The arguments are those of
+ *        grid_integrate_task_list, but with an additional leading dimension
+ *        of size nbatch. Also pab_blocks, forces, and virial are optional.
+ *
+ ******************************************************************************/
+void grid_integrate_task_list_batched(
+    const grid_task_list *task_list, const bool compute_tau, const int natoms,
+    const int nlevels, const int npts_local[nlevels][3], const int nbatch,
+    const offload_buffer *pab_blocks[nbatch],
+    const offload_buffer *grids[nbatch][nlevels],
+    offload_buffer *hab_blocks[nbatch], double forces[nbatch][natoms][3],
+    double virial[nbatch][3][3]);
+
 #endif
 
 // EOF
@@ -5,12 +5,14 @@
 /*  SPDX-License-Identifier: BSD-3-Clause                                     */
 /*----------------------------------------------------------------------------*/
 
+#include <omp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "../offload/offload_library.h"
 #include "common/grid_library.h"
+#include "cpu/grid_cpu_task_list.h"
 #include "grid_replay.h"
 
 // Only used to call MPI_Init and MPI_Finalize to avoid spurious MPI error.
@@ -60,7 +62,8 @@ static int run_test(const char cp2k_root_dir[], const char task_file[]) {
   for (int icol = 0; icol < 2; icol++) {
     for (int ibatch = 0; ibatch < 2; ibatch++) {
       const bool success =
-          grid_replay(filename, 1, icol == 1, ibatch == 1, 1, tolerance);
+          grid_replay(filename, 1, icol == 1, ibatch == 1, 1, ibatch == 1,
+                      tolerance);
       if (!success) {
         printf("Max diff too high, test failed.\n\n");
         errors++;
@@ -70,6 +73,79 @@ static int run_test(const char cp2k_root_dir[], const char task_file[]) {
   return errors;
 }
 
+/*******************************************************************************
+ * \brief Unit test for the tiling of the cpu backend. Checks that a grid level
+ *        gets tiled on many threads, even when its tasks have wide halos.
+ ******************************************************************************/
+static int run_tiling_test(void) {
+  const int nthreads = 16, npts = 60, natoms = npts;
+  const double h = 0.4, radius = 5.0;
+
+  const int lmin = 0, lmax = 0, nsgf = 1, npgf = 1, first_sgf = 1;
+  const double sphi[1][1] = {{1.0}}, zet[1][1] = {{0.1}};
+  grid_basis_set *basis_set = NULL;
+  grid_create_basis_set(1, nsgf, nsgf, npgf, &lmin, &lmax, &npgf, &nsgf,
+                        &first_sgf, sphi, zet, &basis_set);
+  const grid_basis_set *basis_sets[1] = {basis_set};
+
+  // One task per atom, with one atom in every plane along all axes.
+  int block_offsets[natoms], atom_kinds[natoms], level_list[natoms],
+      atom_list[natoms], ones[natoms], border_mask_list[natoms],
+      block_num_list[natoms];
+  double atom_positions[natoms][3], radius_list[natoms], rab_list[natoms][3];
+  for (int i = 0; i < natoms; i++) {
+    block_offsets[i] = 0;
+    atom_kinds[i] = 1;
+    level_list[i] = 1;
+    atom_list[i] = i + 1;
+    ones[i] = 1;
+    border_mask_list[i] = 0;
+    block_num_list[i] = i + 1;
+    radius_list[i] = radius;
+    for (int j = 0; j < 3; j++) {
+      atom_positions[i][j] = (i + 0.5) * npts * h / natoms;
+      rab_list[i][j] = 0.0;
+    }
+  }
+  const int npts_global[1][3] = {{npts, npts, npts}};
+  const int shift_local[1][3] = {{0, 0, 0}};
+  const double dh[1][3][3] = {{{h, 0.0, 0.0}, {0.0, h, 0.0}, {0.0, 0.0, h}}};
+  const double dh_inv[1][3][3] = {
+      {{1.0 / h, 0.0, 0.0}, {0.0, 1.0 / h, 0.0}, {0.0, 0.0, 1.0 / h}}};
+
+  const int old_nthreads = omp_get_max_threads();
+  omp_set_num_threads(nthreads);
+  grid_cpu_task_list *task_list = NULL;
+  grid_cpu_create_task_list(
+      true, natoms, 1, natoms, 1, natoms, block_offsets,
+      (const double(*)[3])atom_positions, atom_kinds, basis_sets, level_list,
+      atom_list, atom_list, ones, ones, ones, ones, border_mask_list,
+      block_num_list, radius_list, (const double(*)[3])rab_list, npts_global,
+      npts_global, shift_local, shift_local, dh, dh_inv, &task_list);
+  omp_set_num_threads(old_nthreads);
+
+  // Slabs must be at least as thick as the largest halo.
+  int errors = 0;
+  const grid_cpu_tiling *tiling = &task_list->tilings[0];
+  if (tiling->axis < 0) {
+    printf("Grid level was not tiled, test failed.\n\n");
+    errors++;
+  } else {
+    for (int itile = 0; itile < tiling->ntiles; itile++) {
+      const int nplanes = tiling->first_plane[itile + 1] -
+                          tiling->first_plane[itile];
+      if (nplanes < tiling->max_halo) {
+        printf("Slab thinner than halo, test failed.\n\n");
+        errors++;
+      }
+    }
+  }
+
+  grid_cpu_free_task_list(task_list);
+  grid_free_basis_set(basis_set);
+  return errors;
+}
+
 int main(int argc, char *argv[]) {
 #if defined(__parallel)
   MPI_Init(&argc, &argv);
@@ -97,6 +173,7 @@ int main(int argc, char *argv[]) {
   errors += run_test(argv[1], "general_subpatch0.task");
   errors += run_test(argv[1], "general_subpatch16.task");
   errors += run_test(argv[1], "general_overflow.task");
+  errors += run_tiling_test();
 
   grid_library_print_stats(&mpi_sum_func, 0, &print_func, 0);
   grid_library_finalize();